@@ -2,6 +2,7 @@
 pragma solidity ^0.8.28;
 
 import "@openzeppelin/contracts/token/ERC721/ERC721.sol";
+import "@openzeppelin/contracts/utils/Strings.sol";
 import "hardhat/console.sol";
 
 
@@ -14,6 +15,9 @@ contract JmtERC721 is ERC721 {
     bytes32 public jmtRoot = 0;
     uint256 public lastTokenId;
     uint256 public numTokens = 0;
+    bytes32 public forestRoot;
+    uint256 public forestTopDepth;
+    bytes32 public hashedRoot;
 
     constructor(string memory name, string memory symbol) ERC721(name, symbol) {
         creator = msg.sender;
@@ -109,6 +113,117 @@ contract JmtERC721 is ERC721 {
 
 
 
+    function setHashedRoot(bytes32 root) external {
+        require(msg.sender == creator, "Only creator");
+        hashedRoot = root;
+    }
+
+    function publicVerifyHashed(
+        Proof calldata P,
+        uint256 tokenId,
+        uint32 version,
+        bytes calldata value
+    ) external returns (bool) {
+        return verifyHashed(P, tokenId, version, value);
+    }
+
+    // Albero con --hashed-keys: il percorso è keccak256(version ‖ tokenId), la foglia impegna comunque il tokenId
+    function verifyHashed(Proof calldata P, uint256 tokenId, uint32 version, bytes calldata value) internal
+     view returns (bool valid) {
+        require(P.depth == P.levels.length, "Depth mismatch");
+        require(P.tokenId == tokenId, "TokenId mismatch");
+
+        bytes memory input = new bytes(16 + value.length);
+        for (uint i = 0; i < 8; i++) {
+            uint8 byteVal = uint8(tokenId >> (8 * (7 - i)));
+            input[2 * i]     = bytes1(byteVal >> 4);
+            input[2 * i + 1] = bytes1(byteVal & 0x0F);
+        }
+        for (uint j = 0; j < value.length; j++) {
+            input[16 + j] = value[j];
+        }
+
+        bytes32 expectedLeaf = keccak256(input);
+
+        bool membershipValid = (
+            (P.isMembership && (P.leafHash == expectedLeaf)) ||
+            (!P.isMembership && (P.leafHash != expectedLeaf))
+        );
+
+        uint256 path = uint256(keccak256(abi.encodePacked(version, uint64(tokenId))));
+        bytes32 currentHash = P.leafHash;
+        for (uint256 levelIdx = 0; levelIdx < P.levels.length; levelIdx++) {
+            uint8 nibble = _getHashedNibble(path, P.depth - levelIdx);
+            currentHash = _computeLevelHash(P.levels[levelIdx], currentHash, nibble);
+        }
+
+        valid = (P.root == hashedRoot) && (currentHash == P.root) && membershipValid;
+    }
+
+    function _getHashedNibble(uint256 path, uint256 depth) internal pure returns (uint8) {
+        // Come _getNibble ma sui 64 nibble del percorso keccak
+        return uint8((path >> (4 * (64 - depth))) & 0x0F);
+    }
+
+    function setForestRoot(bytes32 root, uint256 topDepth) external {
+        require(msg.sender == creator, "Only creator");
+        forestRoot = root;
+        forestTopDepth = topDepth;
+    }
+
+    function publicVerifyForest(
+        Proof calldata P,
+        uint256 tokenId,
+        uint32 version,
+        bytes calldata value,
+        uint256 shard,
+        LevelSibling[] calldata topLevels
+    ) external returns (bool) {
+        return verifyForest(P, tokenId, version, value, shard, topLevels);
+    }
+
+    // P è la prova interna allo shard (P.root = root dello shard), topLevels la estende alla root globale
+    function verifyForest(
+        Proof calldata P,
+        uint256 tokenId,
+        uint32 version,
+        bytes calldata value,
+        uint256 shard,
+        LevelSibling[] calldata topLevels
+    ) internal view returns (bool valid) {
+        require(P.depth == P.levels.length, "Depth mismatch");
+        require(P.tokenId == tokenId, "TokenId mismatch");
+        require(topLevels.length == forestTopDepth, "Top depth mismatch");
+
+        bytes memory input = new bytes(16 + value.length);
+        for (uint i = 0; i < 8; i++) {
+            uint8 byteVal = uint8(tokenId >> (8 * (7 - i)));
+            input[2 * i]     = bytes1(byteVal >> 4);
+            input[2 * i + 1] = bytes1(byteVal & 0x0F);
+        }
+        for (uint j = 0; j < value.length; j++) {
+            input[16 + j] = value[j];
+        }
+
+        bytes32 expectedLeaf = keccak256(input);
+        bool membershipValid = (
+            (P.isMembership && (P.leafHash == expectedLeaf)) ||
+            (!P.isMembership && (P.leafHash != expectedLeaf))
+        );
+
+        uint256 fullKey = (uint256(version) << 64) | tokenId;
+        bytes32 shardRoot = _computeRootFromProof(P, P.leafHash, fullKey);
+
+        bytes32 currentHash = shardRoot;
+        uint256 pos = shard;
+        for (uint256 k = 0; k < topLevels.length; k++) {
+            currentHash = _computeLevelHash(topLevels[k], currentHash, uint8(pos & 0x0F));
+            pos >>= 4;
+        }
+
+        valid = (shardRoot == P.root) && (currentHash == forestRoot) && membershipValid;
+    }
+
     function mint(
         uint256 tokenId,
         uint32 version,
@@ -143,6 +258,110 @@ contract JmtERC721 is ERC721 {
         numTokens += 1;
     }
 
+    /*
+     * Trasferimento con le prove di jmt_export --owner-values, dove il valore della foglia è l'id del proprietario
+     * in decimale e l'id N corrisponde all'indirizzo address(uint160(N)). I valori sono legati agli indirizzi:
+     * oldValue deve essere il mittente e newValue il destinatario, così la foglia resta allineata a ownerOf.
+     * P prova oldValue sotto jmtRoot; gli stessi fratelli con la foglia di newValue danno la nuova root,
+     * calcolate insieme in un solo passaggio sui livelli.
+     */
+    function transfer(
+        uint256 tokenId,
+        uint32 version,
+        bytes calldata oldValue,
+        bytes calldata newValue,
+        Proof calldata P,
+        address to
+    ) external {
+        require(_isOwnerValue(oldValue, msg.sender), "Old value is not the sender");
+        require(_isOwnerValue(newValue, to), "New value is not the recipient");
+
+        (bytes32 oldRoot, bytes32 newRoot) = _transferRoots(P, tokenId, version, oldValue, newValue);
+        require(oldRoot == jmtRoot, "Previous root mismatch");
+
+        require(ownerOf(tokenId) == msg.sender, "Not the owner");
+        _transfer(msg.sender, to, tokenId);
+        jmtRoot = newRoot;
+    }
+
+    function verifyTransfer(
+        Proof calldata P,
+        uint256 tokenId,
+        uint32 version,
+        bytes calldata oldValue,
+        bytes calldata newValue
+    ) external pure returns (bytes32 oldRoot, bytes32 newRoot) {
+        return _transferRoots(P, tokenId, version, oldValue, newValue);
+    }
+
+    // Root prima e dopo il cambio di valore: P deve provare la foglia di oldValue
+    function _transferRoots(
+        Proof calldata P,
+        uint256 tokenId,
+        uint32 version,
+        bytes calldata oldValue,
+        bytes calldata newValue
+    ) internal pure returns (bytes32 oldRoot, bytes32 newRoot) {
+        require(P.depth == P.levels.length, "Depth mismatch");
+        require(P.tokenId == tokenId, "TokenId mismatch");
+        require(P.isMembership, "Not a membership proof");
+
+        bytes32 oldLeaf = _leafHash(tokenId, oldValue);
+        require(P.leafHash == oldLeaf, "Invalid leaf hash");
+
+        uint256 fullKey = (uint256(version) << 64) | tokenId;
+        return _computeUpdateRoots(P, oldLeaf, _leafHash(tokenId, newValue), fullKey);
+    }
+
+    function _isOwnerValue(bytes calldata value, address owner) internal pure returns (bool) {
+        return keccak256(value) == keccak256(bytes(Strings.toString(uint256(uint160(owner)))));
+    }
+
+    function _leafHash(uint256 tokenId, bytes calldata value) internal pure returns (bytes32) {
+        bytes memory input = new bytes(16 + value.length);
+        for (uint i = 0; i < 8; i++) {
+            uint8 byteVal = uint8(tokenId >> (8 * (7 - i)));
+            input[2 * i]     = bytes1(byteVal >> 4);
+            input[2 * i + 1] = bytes1(byteVal & 0x0F);
+        }
+        for (uint j = 0; j < value.length; j++) {
+            input[16 + j] = value[j];
+        }
+        return keccak256(input);
+    }
+
+    // Un buffer per livello: i fratelli si leggono una volta, cambia solo lo slot del percorso
+    function _computeUpdateRoots(Proof calldata P, bytes32 oldLeaf, bytes32 newLeaf, uint256 fullKey)
+        internal
+        pure
+        returns (bytes32 oldHash, bytes32 newHash)
+    {
+        oldHash = oldLeaf;
+        newHash = newLeaf;
+        for (uint256 levelIdx = 0; levelIdx < P.levels.length; levelIdx++) {
+            bytes32[16] memory buffer;
+            LevelSibling calldata level = P.levels[levelIdx];
+            for (uint256 j = 0; j < level.siblings.length; j++) {
+                buffer[level.siblings[j].index] = level.siblings[j].hash;
+            }
+
+            uint8 nibble = _getNibble(fullKey, P.depth - levelIdx);
+            buffer[nibble] = oldHash;
+            oldHash = _hashBuffer(buffer);
+            buffer[nibble] = newHash;
+            newHash = _hashBuffer(buffer);
+        }
+    }
+
+    function _hashBuffer(bytes32[16] memory buffer) internal pure returns (bytes32) {
+        return keccak256(abi.encodePacked(
+            buffer[0], buffer[1], buffer[2], buffer[3],
+            buffer[4], buffer[5], buffer[6], buffer[7],
+            buffer[8], buffer[9], buffer[10], buffer[11],
+            buffer[12], buffer[13], buffer[14], buffer[15]
+        ));
+    }
+
     function _computeRootFromProof(Proof calldata P, bytes32 leafDigest, uint256 fullKey) internal pure returns (bytes32 root) {
         bytes32 currentHash = leafDigest;
         for (uint256 levelIdx = 0; levelIdx < P.levels.length; levelIdx++) {
@@ -0,0 +1,82 @@
+const { expect } = require("chai");
+const hre = require("hardhat");
+const { toUtf8Bytes, zeroPadBytes, getBytes } = require("ethers");
+const fs = require("fs");
+const path = require("path");
+const { openProofArchive } = require("./proofArchive");
+
+// Archivio prodotto con: jmt_export art_blocks.csv --archive proofs.jmta
+const archive = openProofArchive(path.join(__dirname, "../proofs.jmta"));
+
+function toBytes32(hexString) {
+    return zeroPadBytes(getBytes("0x" + hexString), 32);
+}
+
+function convertLevels(levelsRaw) {
+    return levelsRaw.map(level => ({
+        siblings: level.siblings.map(s => ({
+            index: s.index,
+            hash: toBytes32(s.hash)
+        }))
+    }));
+}
+
+describe("JmtERC721 proof archive", function () {
+    it("should rebuild the exported JSON proofs", function () {
+        // Confronto a campione con proofs/, se presente accanto all'archivio
+        for (let i = 0; i < archive.count; i += 997) {
+            const jsonPath = path.join(__dirname, "../proofs/output_" + i.toString().padStart(5, '0') + ".json");
+            if (!fs.existsSync(jsonPath)) continue;
+            expect(archive.get(i)).to.deep.equal(JSON.parse(fs.readFileSync(jsonPath)));
+        }
+    });
+
+    it("should mint and verify NFTs from the archived proofs", async function () {
+        const [owner] = await hre.ethers.getSigners();
+        const Jmt = await hre.ethers.getContractFactory("JmtERC721");
+        const jmt = await Jmt.deploy("JMTNFT", "JMT");
+
+        const N = archive.count;
+        for (let i = 0; i < N; i++) {
+            if (i % 1000 === 0) {
+                console.log(`🗜️ Processing archived proof ${i}/${N}`);
+            }
+
+            const data = archive.get(i);
+            const tokenId = data.tokenId;
+            const version = data.version;
+            const value = toUtf8Bytes(data.value);
+
+            const proof = {
+                isMembership: true,
+                depth: data.proof.depth,
+                tokenId,
+                leafHash: toBytes32(data.proof.leafHash),
+                root: toBytes32(data.root),
+                levels: convertLevels(data.proof.levels)
+            };
+
+            const P = data.ancestry.P;
+            const ancestry = {
+                splitted: data.ancestry.splitted,
+                preForkDepth: data.ancestry.preForkDepth,
+                tokenId: data.ancestry.key.tokenId,
+                version: data.ancestry.key.version,
+                P: {
+                    isMembership: P.isMembership,
+                    depth: P.depth,
+                    tokenId: P.tokenId,
+                    leafHash: toBytes32(P.leafHash),
+                    root: toBytes32(data.root),
+                    levels: convertLevels(P.levels)
+                }
+            };
+
+            const mintTx = await jmt.mint(tokenId, version, value, proof, ancestry);
+            await mintTx.wait();
+            expect(await jmt.ownerOf(tokenId)).to.equal(owner.address);
+
+            expect(await jmt.publicVerify.staticCall(proof, tokenId, version, value)).to.equal(true);
+        }
+    }).timeout(0);
+});
@@ -0,0 +1,66 @@
+const { expect } = require("chai");
+const hre = require("hardhat");
+const { toUtf8Bytes, zeroPadBytes, getBytes } = require("ethers");
+const fs = require("fs");
+const path = require("path");
+
+function loadProof(index) {
+    const jsonPath = path.join(__dirname, "../proofs-forest/output_" + index.toString().padStart(5, '0') + ".json");
+    return JSON.parse(fs.readFileSync(jsonPath));
+}
+
+function toBytes32(hexString) {
+    return zeroPadBytes(getBytes("0x" + hexString), 32);
+}
+
+function convertLevels(levelsRaw) {
+    return levelsRaw.map(level => ({
+        siblings: level.siblings.map(s => ({
+            index: s.index,
+            hash: toBytes32(s.hash)
+        }))
+    }));
+}
+
+describe("JmtERC721 forest", function () {
+    it("should verify sharded proofs against the global forest root", async function () {
+        const Jmt = await hre.ethers.getContractFactory("JmtERC721");
+        const jmt = await Jmt.deploy("JMTNFT", "JMT");
+
+        const first = loadProof(0);
+        await (await jmt.setForestRoot(toBytes32(first.root), first.topDepth)).wait();
+
+        const outputCsvPath = path.join(__dirname, "forest_results.csv");
+        fs.writeFileSync(outputCsvPath, "tokenId,version,shard,verifyGas\n");
+
+        const N = 10000;
+        for (let i = 0; i < N; i++) {
+            if (i % 1000 === 0) {
+                console.log(`🌲 Verifying forest proof ${i}/${N}`);
+            }
+
+            const data = loadProof(i);
+            const tokenId = data.tokenId;
+            const version = data.version;
+            const value = toUtf8Bytes(data.value);
+
+            const proof = {
+                isMembership: data.proof.isMembership,
+                depth: data.proof.depth,
+                tokenId,
+                leafHash: toBytes32(data.proof.leafHash),
+                root: toBytes32(data.shardRoot),
+                levels: convertLevels(data.proof.levels)
+            };
+            const topLevels = convertLevels(data.topLevels);
+
+            expect(await jmt.publicVerifyForest.staticCall(proof, tokenId, version, value, data.shard, topLevels)).to.equal(true);
+
+            const tx = await jmt.publicVerifyForest(proof, tokenId, version, value, data.shard, topLevels);
+            const receipt = await tx.wait();
+            expect(receipt.status).to.equal(1);
+
+            fs.appendFileSync(outputCsvPath, `${tokenId},${version},${data.shard},${receipt.gasUsed}\n`);
+        }
+    }).timeout(0);
+});
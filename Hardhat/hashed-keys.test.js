@@ -0,0 +1,65 @@
+const { expect } = require("chai");
+const hre = require("hardhat");
+const { toUtf8Bytes, zeroPadBytes, getBytes } = require("ethers");
+const fs = require("fs");
+const path = require("path");
+
+function loadProof(index) {
+    const jsonPath = path.join(__dirname, "../hashed-proofs/output_" + index.toString().padStart(5, '0') + ".json");
+    return JSON.parse(fs.readFileSync(jsonPath));
+}
+
+function toBytes32(hexString) {
+    return zeroPadBytes(getBytes("0x" + hexString), 32);
+}
+
+function convertLevels(levelsRaw) {
+    return levelsRaw.map(level => ({
+        siblings: level.siblings.map(s => ({
+            index: s.index,
+            hash: toBytes32(s.hash)
+        }))
+    }));
+}
+
+describe("JmtERC721 hashed keys", function () {
+    it("should verify proofs exported with --hashed-keys", async function () {
+        const Jmt = await hre.ethers.getContractFactory("JmtERC721");
+        const jmt = await Jmt.deploy("JMTNFT", "JMT");
+
+        const outputCsvPath = path.join(__dirname, "hashed_results.csv");
+        fs.writeFileSync(outputCsvPath, "tokenId,version,depth,verifyGas\n");
+
+        const N = 10000;
+        for (let i = 0; i < N; i++) {
+            if (i % 1000 === 0) {
+                console.log(`🔑 Verifying hashed-key proof ${i}/${N}`);
+            }
+
+            const data = loadProof(i);
+            expect(data.keyMode).to.equal("hashed");
+            const tokenId = data.tokenId;
+            const version = data.version;
+            const value = toUtf8Bytes(data.value);
+
+            const proof = {
+                isMembership: data.proof.isMembership,
+                depth: data.proof.depth,
+                tokenId,
+                leafHash: toBytes32(data.proof.leafHash),
+                root: toBytes32(data.root),
+                levels: convertLevels(data.proof.levels)
+            };
+
+            // Ogni prova è generata subito dopo il proprio inserimento, con la root di quel momento
+            await (await jmt.setHashedRoot(proof.root)).wait();
+            expect(await jmt.publicVerifyHashed.staticCall(proof, tokenId, version, value)).to.equal(true);
+
+            const tx = await jmt.publicVerifyHashed(proof, tokenId, version, value);
+            const receipt = await tx.wait();
+            expect(receipt.status).to.equal(1);
+
+            fs.appendFileSync(outputCsvPath, `${tokenId},${version},${data.proof.depth},${receipt.gasUsed}\n`);
+        }
+    }).timeout(0);
+});
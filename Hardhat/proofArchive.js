@@ -0,0 +1,109 @@
+const fs = require("fs");
+
+// Lettore dell'archivio di prove di jmt_export --archive (JMT/include/ProofArchive.h).
+// Il file si legge una volta sola; get(i) ricostruisce lo stesso oggetto di JSON.parse(proofs/output_XXXXX.json).
+
+const MAGIC = "JMTARCH1";
+const FORMAT = 1;
+const HEADER_SIZE = 48;
+const HASHED_KEY_NIBBLES = 88;
+const HASH_NAMES = ["keccak256", "sha256"];     // JMTHashKind
+
+const PRESENT = 0x01;
+const SPLITTED = 0x02;
+const ANCESTRY_PRESENT = 0x04;
+
+function openProofArchive(filePath) {
+    const buf = fs.readFileSync(filePath);
+    if (buf.length < HEADER_SIZE || buf.toString("latin1", 0, 8) !== MAGIC || buf.readUInt32LE(8) !== FORMAT) {
+        throw new Error(`${filePath} is not a proof archive`);
+    }
+    const hashKind = buf.readUInt32LE(12);
+    const count = Number(buf.readBigUInt64LE(16));
+    const hashCount = Number(buf.readBigUInt64LE(24));
+    const hashesOffset = Number(buf.readBigUInt64LE(32));
+    const indexOffset = Number(buf.readBigUInt64LE(40));
+    if (hashKind >= HASH_NAMES.length || indexOffset !== hashesOffset + hashCount * 32 || indexOffset + count * 8 !== buf.length) {
+        throw new Error(`${filePath} is not a valid proof archive`);
+    }
+
+    // Ogni digest è convertito in esadecimale una volta sola, al primo riferimento
+    const hexCache = new Array(hashCount);
+    function hashHex(id) {
+        if (id >= hashCount) throw new Error(`invalid hash reference ${id}`);
+        if (hexCache[id] === undefined) {
+            hexCache[id] = buf.toString("hex", hashesOffset + id * 32, hashesOffset + (id + 1) * 32);
+        }
+        return hexCache[id];
+    }
+
+    function get(index) {
+        if (index < 0 || index >= count) throw new RangeError(`proof ${index} outside the archive (${count} proofs)`);
+        let p = Number(buf.readBigUInt64LE(indexOffset + index * 8));
+
+        const u8 = () => buf[p++];
+        const varint = () => {
+            let v = 0, mul = 1, b;
+            do {
+                b = buf[p++];
+                v += (b & 0x7f) * mul;
+                mul *= 128;
+            } while (b & 0x80);
+            return v;
+        };
+        const ref = () => hashHex(varint());
+        // version e tokenId sono gli ultimi 12 byte della chiave, anche per le chiavi hashed
+        const key = () => {
+            const nibbles = u8();
+            const start = p + (nibbles === HASHED_KEY_NIBBLES ? 32 : 0);
+            p += (nibbles + 1) >> 1;
+            return {
+                hashed: nibbles === HASHED_KEY_NIBBLES,
+                version: buf.readUInt32BE(start),
+                tokenId: Number(buf.readBigUInt64BE(start + 4))
+            };
+        };
+        const proof = (isMembership, tokenId) => {
+            const depth = u8();
+            const leafHash = ref();
+            const levels = [];
+            for (let n = u8(); n > 0; n--) {
+                const mask = buf.readUInt16LE(p);
+                p += 2;
+                const siblings = [];
+                for (let i = 15; i >= 0; i--) {
+                    if (mask & (1 << i)) siblings.push({ index: i, hash: ref() });
+                }
+                levels.push({ siblings });
+            }
+            return { isMembership, depth, tokenId, leafHash, levels };
+        };
+
+        const flags = u8();
+        const k = key();
+        const valueLength = varint();
+        const value = buf.toString("utf8", p, p + valueLength);
+        p += valueLength;
+
+        const data = { tokenId: k.tokenId, version: k.version, value, root: ref() };
+        if (hashKind !== 0) data.hash = HASH_NAMES[hashKind];
+        if (k.hashed) data.keyMode = "hashed";
+        data.proof = proof((flags & PRESENT) !== 0, k.tokenId);
+
+        const preForkDepth = u8();
+        const a = key();
+        const RootN = ref();
+        data.ancestry = {
+            splitted: (flags & SPLITTED) !== 0,
+            preForkDepth,
+            key: { version: a.version, tokenId: a.tokenId },
+            RootN,
+            P: proof((flags & ANCESTRY_PRESENT) !== 0, a.tokenId)
+        };
+        return data;
+    }
+
+    return { count, hash: HASH_NAMES[hashKind], get };
+}
+
+module.exports = { openProofArchive };
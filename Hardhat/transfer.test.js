@@ -0,0 +1,112 @@
+const { expect } = require("chai");
+const hre = require("hardhat");
+const { toUtf8Bytes, zeroPadBytes, getBytes, getAddress, toBeHex } = require("ethers");
+const fs = require("fs");
+const path = require("path");
+
+// Prove di jmt_export --owner-values: mint e trasferimenti nella stessa numerazione, nell'ordine degli eventi
+function loadProof(index) {
+    const jsonPath = path.join(__dirname, "../owner-proofs/output_" + index.toString().padStart(5, '0') + ".json");
+    return JSON.parse(fs.readFileSync(jsonPath));
+}
+
+function toBytes32(hexString) {
+    return zeroPadBytes(getBytes("0x" + hexString), 32);
+}
+
+function convertLevels(levelsRaw) {
+    return levelsRaw.map(level => ({
+        siblings: level.siblings.map(s => ({
+            index: s.index,
+            hash: toBytes32(s.hash)
+        }))
+    }));
+}
+
+function convertProof(p, tokenId, root) {
+    return {
+        isMembership: p.isMembership,
+        depth: p.depth,
+        tokenId: tokenId,
+        leafHash: toBytes32(p.leafHash),
+        root: toBytes32(root),
+        levels: convertLevels(p.levels)
+    };
+}
+
+// L'id di proprietario N del CSV è l'indirizzo address(uint160(N)), come in JmtERC721.transfer
+function ownerAddress(id) {
+    return getAddress(toBeHex(BigInt(id), 20));
+}
+
+const signers = new Map();
+async function ownerSigner(id) {
+    const address = ownerAddress(id);
+    if (!signers.has(address)) {
+        await hre.network.provider.request({ method: "hardhat_impersonateAccount", params: [address] });
+        await hre.network.provider.request({ method: "hardhat_setBalance", params: [address, "0x56BC75E2D63100000"] });
+        signers.set(address, await hre.ethers.getSigner(address));
+    }
+    return signers.get(address);
+}
+
+describe("JmtERC721 transfer", function () {
+    it("should replay mints and transfers, keeping jmtRoot and owners in sync", async function () {
+        const Jmt = await hre.ethers.getContractFactory("JmtERC721");
+        const jmt = await Jmt.deploy("JMTNFT", "JMT");
+
+        const outputCsvPath = path.join(__dirname, "outputs-transfer.csv");
+        fs.writeFileSync(outputCsvPath, "tokenId,version,transferGas\n");
+
+        const N = 1000;
+        let transfers = 0;
+        for (let i = 0; i < N; i++) {
+            const data = loadProof(i);
+            const tokenId = data.tokenId;
+            const version = data.version;
+            const proof = convertProof(data.proof, tokenId, data.root);
+
+            if (!data.update) {
+                const P = data.ancestry.P;
+                const ancestry = {
+                    splitted: data.ancestry.splitted,
+                    preForkDepth: data.ancestry.preForkDepth,
+                    tokenId: data.ancestry.key.tokenId,
+                    version: data.ancestry.key.version,
+                    P: convertProof(P, P.tokenId, data.root)
+                };
+                const minter = await ownerSigner(data.value);
+                await (await jmt.connect(minter).mint(tokenId, version, toUtf8Bytes(data.value), proof, ancestry)).wait();
+                expect(await jmt.jmtRoot()).to.equal(toBytes32(data.root));
+                continue;
+            }
+
+            const oldValue = toUtf8Bytes(data.value);
+            const newValue = toUtf8Bytes(data.update.value);
+            const [oldRoot, newRoot] = await jmt.verifyTransfer(proof, tokenId, version, oldValue, newValue);
+            expect(oldRoot).to.equal(toBytes32(data.root));
+            expect(newRoot).to.equal(toBytes32(data.update.root));
+
+            const from = await ownerSigner(data.value);
+            const to = ownerAddress(data.update.value);
+
+            // Un destinatario diverso da newValue deve essere rifiutato
+            if (data.value !== data.update.value) {
+                let reverted = false;
+                try {
+                    await jmt.connect(from).transfer.staticCall(tokenId, version, oldValue, newValue, proof, from.address);
+                } catch (e) {
+                    reverted = true;
+                }
+                expect(reverted).to.equal(true);
+            }
+
+            const receipt = await (await jmt.connect(from).transfer(tokenId, version, oldValue, newValue, proof, to)).wait();
+            expect(await jmt.ownerOf(tokenId)).to.equal(to);
+            expect(await jmt.jmtRoot()).to.equal(toBytes32(data.update.root));
+            fs.appendFileSync(outputCsvPath, `${tokenId},${version},${receipt.gasUsed}\n`);
+            transfers++;
+        }
+        expect(transfers).to.be.greaterThan(0);
+    }).timeout(0);
+});
@@ -0,0 +1,55 @@
+#ifndef JELLYFISH_CHECKPOINT_H
+#define JELLYFISH_CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "Jellyfish.h"
+
+#define JMTCKPT_MAGIC "JMTCKPT1"
+#define JMTCKPT_FORMAT 1
+
+#define JMTCKPT_HASHED_KEYS 0x01
+#define JMTCKPT_SLOT_VERSIONS 0x02
+#define JMTCKPT_OWNER_VALUES 0x04
+
+/*
+ * Checkpoint di un'esportazione: quanto serve per riprendere dal record successivo all'ultimo applicato
+ * e ottenere gli stessi file di un'esecuzione senza interruzioni.
+ *   JMTCheckpointHeader | tokens x (u64 tokenId | u32 version) | segmento StateSync con l'albero completo
+ *   | u64 slot | slot x u32 ChildNode.version, in visita anticipata per slot crescente (JMTCKPT_SLOT_VERSIONS)
+ * L'import del segmento marca ogni slot con la versione del checkpoint: le marcature originali servono alle
+ * prove storiche della timeline (Timeline.h), che altrimenti ricalcolerebbero l'intero albero.
+ * Gli interi sono little-endian, l'header è scritto così com'è (come JMTSyncHeader).
+ * Il file è scritto accanto (path.tmp) e rinominato: un crash durante il salvataggio lascia il checkpoint precedente.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t format;
+    uint32_t hashKind;
+    uint32_t flags;             // JMTCKPT_*
+    uint32_t fromBlock;
+    uint64_t inputPosition;     // ingestPosition: offset nel CSV o indice nell'event log
+    uint64_t outputs;           // prove già scritte: la prossima è la numero outputs
+    uint32_t nextVersion;       // contatore delle versioni (jmtNextVersion)
+    uint32_t reserved;
+    uint64_t tokens;            // voci dell'indice tokenId -> version
+} JMTCheckpointHeader;
+
+typedef struct {
+    uint64_t inputPosition;
+    uint64_t outputs;
+    uint32_t fromBlock;
+    bool hashedKeys;
+    bool ownerValues;           // foglie con il proprietario (jmt_export --owner-values)
+} JMTCheckpoint;
+
+// L'albero viene committato prima di essere salvato
+bool jmtCheckpointSave(const char* path, JMT* t, const JMTCheckpoint* cp);
+/*
+ * Carica il checkpoint in t, appena creato con la funzione di hash del checkpoint, e ripristina contatore
+ * delle versioni e indice dei tokenId. La root ricostruita è confrontata con quella salvata.
+ */
+bool jmtCheckpointLoad(const char* path, JMT* t, JMTCheckpoint* cp);
+
+#endif // JELLYFISH_CHECKPOINT_H
@@ -0,0 +1,84 @@
+#ifndef JELLYFISH_EVENTLOG_H
+#define JELLYFISH_EVENTLOG_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "Ingest.h"
+
+#define EVENTLOG_MAGIC "JMTLOG01"
+#define EVENTLOG_FORMAT 1
+#define EVENTLOG_GROUP 4096
+
+/*
+ * Layout del file:
+ *   EventLogHeader (64 byte)
+ *   groupCount gruppi a dimensione fissa, ognuno memorizzato per colonne:
+ *     EventLogGroupHeader, tokenId[G] (u64), timestamp[G], contractId[G], fromId[G], toId[G] (u32),
+ *     blockDelta[G] (u16, relativo a baseBlock del gruppo)
+ *   indice per intervalli di blocco: groupCount EventLogIndexEntry
+ * Un gruppo viene chiuso in anticipo se un blocco dista più di 65535 da baseBlock.
+ * Come nel CSV, i record sono in ordine di blocco non decrescente.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t format;
+    uint32_t groupCapacity;
+    uint64_t recordCount;
+    uint64_t groupCount;
+    uint64_t indexOffset;
+    uint64_t sourceBytes;
+    uint8_t reserved[16];
+} EventLogHeader;
+
+typedef struct {
+    uint32_t count;
+    uint32_t baseBlock;
+    uint32_t lastBlock;
+    uint32_t reserved;
+} EventLogGroupHeader;
+
+typedef struct {
+    uint64_t firstRecord;
+    uint32_t baseBlock;
+    uint32_t lastBlock;
+} EventLogIndexEntry;
+
+#define EVENTLOG_GROUP_BYTES (sizeof(EventLogGroupHeader) + EVENTLOG_GROUP * (8 + 4 * 4 + 2))
+
+typedef struct EventLog {
+    int fd;
+    uint8_t* map;
+    size_t size;
+    const EventLogHeader* header;
+    const EventLogIndexEntry* index;
+} EventLog;
+
+typedef struct {
+    uint64_t group;
+    uint32_t slot;
+} EventLogCursor;
+
+typedef struct {
+    FILE* out;
+    uint8_t* group;
+    EventLogGroupHeader* gh;
+    EventLogIndexEntry* index;
+    size_t indexCap;
+    EventLogHeader header;
+} EventLogWriter;
+
+EventLogWriter* eventLogCreate(const char* path);
+void eventLogAppend(EventLogWriter* w, const EventRecord* ev);
+void eventLogFinish(EventLogWriter* w, uint64_t sourceBytes);
+
+bool isEventLog(const char* path);
+EventLog* eventLogOpen(const char* path);
+void eventLogClose(EventLog* log);
+uint64_t eventLogSeekBlock(EventLog* log, uint32_t blockId);
+bool eventLogRead(EventLog* log, uint64_t record, EventRecord* ev);
+EventLogCursor eventLogCursorAt(EventLog* log, uint64_t record);
+bool eventLogNext(EventLog* log, EventLogCursor* c, EventRecord* ev);
+
+#endif // JELLYFISH_EVENTLOG_H
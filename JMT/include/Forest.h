@@ -0,0 +1,78 @@
+#ifndef JELLYFISH_FOREST_H
+#define JELLYFISH_FOREST_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "Jellyfish.h"
+
+#define FOREST_MAX_SHARDS 256
+#define FOREST_QUEUE_SIZE 4096
+
+// Criterio di partizionamento delle chiavi tra gli shard
+typedef enum {
+    FOREST_BY_KEY_NIBBLES,   // gruppo di nibble della chiave a partire da nibbleOffset
+    FOREST_BY_CONTRACT       // contractId modulo numero di shard
+} ForestPartition;
+
+typedef struct {
+    NodeKey key;
+    uint8_t* value;
+    size_t valueLength;
+} ForestOp;
+
+typedef struct {
+    InternalNode* root;
+    HashValue rootDigest;
+    uint64_t inserted;
+
+    // Coda limitata produttore/consumatore verso il worker dello shard
+    ForestOp ops[FOREST_QUEUE_SIZE];
+    size_t head;
+    size_t count;
+    bool syncRequested;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+    pthread_cond_t drained;
+    pthread_t worker;
+} ForestShard;
+
+typedef struct {
+    size_t shardCount;
+    size_t topDepth;          // livelli della commitment superiore (0 se un solo shard)
+    ForestPartition partition;
+    size_t nibbleOffset;
+    bool threaded;
+    ForestShard* shards;
+    HashValue globalRoot;
+
+    // Livelli della commitment superiore calcolati da forestSync, dal basso (root degli shard) alla root globale
+    HashValue** topLayers;
+    bool synced;              // false dopo forestInsert, finché forestSync non ricalcola root e livelli
+} Forest;
+
+// Prova combinata: prova interna allo shard + prefisso verso la root globale
+typedef struct {
+    size_t shard;
+    Proof proof;
+    HashValue shardRoot;
+    size_t topDepth;
+    LevelSibling* topLevels;  // dal livello più basso della commitment alla root globale
+} ForestProof;
+
+Forest* createForest(size_t shardCount, ForestPartition partition, size_t nibbleOffset, bool threaded);
+void destroyForest(Forest* F);
+size_t forestShardOf(Forest* F, NodeKey* key, uint32_t contractId);
+void forestInsert(Forest* F, size_t shard, NodeKey* key, uint8_t* value, size_t len);
+HashValue forestSync(Forest* F);
+// Richiede una forestSync dopo l'ultima forestInsert: legge root degli shard e livelli calcolati lì, senza lock.
+// Se la foresta non è sincronizzata restituisce false.
+bool forestGenerateProof(Forest* F, NodeKey* key, uint32_t contractId, ForestProof* FP);
+HashValue computeForestRoot(NodeKey* key, ForestProof* FP, HashValue leafStart);
+bool verifyForestProof(NodeKey* key, ForestProof* FP, HashValue globalRoot);
+void freeForestProof(ForestProof* FP);
+
+#endif // JELLYFISH_FOREST_H
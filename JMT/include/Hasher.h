@@ -0,0 +1,60 @@
+#ifndef JELLYFISH_HASHER_H
+#define JELLYFISH_HASHER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <openssl/sha.h>
+#include "keccak-tiny.h"
+
+typedef enum { JMT_HASH_KECCAK256, JMT_HASH_SHA256 } JMTHashKind;
+
+typedef union {
+    keccak_256_ctx keccak;
+    SHA256_CTX sha256;
+} JMTHashCtx;
+
+/*
+ * Funzione di hash di un albero: foglie, nodi interni e prove usano tutti la stessa.
+ * Keccak-256 è quella del verificatore Solidity; SHA-256 (OpenSSL, con SHA-NI se la CPU lo supporta)
+ * è pensata per le collezioni verificate solo off-chain.
+ */
+typedef struct {
+    JMTHashKind kind;
+    const char* name;           // nome registrato nei metadati delle prove esportate
+    void (*init)(JMTHashCtx* ctx);
+    void (*absorb)(JMTHashCtx* ctx, const uint8_t* in, size_t len);
+    void (*absorbByte)(JMTHashCtx* ctx, uint8_t b);
+    void (*absorbZeros)(JMTHashCtx* ctx, size_t len);
+    void (*final)(JMTHashCtx* ctx, uint8_t* out);
+    uint8_t emptyInternal[32];  // digest di un InternalNode senza figli (16 slot a zero)
+} JMTHasher;
+
+extern const JMTHasher jmtKeccak256;
+extern const JMTHasher jmtSha256;
+
+/*
+ * Funzione attiva nel thread corrente, keccak256 se mai impostata.
+ * Le funzioni su radici nude (insertJMT, verifyProof, ...) usano questa; l'handle JMT la imposta da sé.
+ */
+extern _Thread_local const JMTHasher* jmtCurrentHasher;
+
+static inline const JMTHasher* jmtActiveHasher(void) {
+    return jmtCurrentHasher;
+}
+
+// Imposta la funzione del thread e restituisce la precedente
+const JMTHasher* jmtUseHasher(const JMTHasher* h);
+// "keccak256" o "sha256"; NULL se sconosciuta
+const JMTHasher* jmtHasherByName(const char* name);
+// Digest in un colpo solo con la funzione attiva
+void jmtHash(uint8_t* out, const uint8_t* in, size_t len);
+
+static inline void jmtRestoreHasher(const JMTHasher** prev) {
+    jmtUseHasher(*prev);
+}
+
+// Usa h fino alla fine del blocco, su ogni percorso di uscita
+#define JMT_WITH_HASHER(h) \
+    const JMTHasher* jmtPrevHasher_ __attribute__((cleanup(jmtRestoreHasher))) = jmtUseHasher(h)
+
+#endif // JELLYFISH_HASHER_H
@@ -0,0 +1,76 @@
+#ifndef JELLYFISH_INGEST_H
+#define JELLYFISH_INGEST_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#ifndef INGEST_CHUNK_SIZE
+#define INGEST_CHUNK_SIZE (4u << 20)
+#endif
+#define INGEST_COLUMNS 6
+#define INGEST_RING_SIZE 8192
+
+// Record a dimensione fissa per una riga blockId,timestamp,contractId,fromId,toId,tokenId
+typedef struct {
+    uint32_t blockId;
+    uint32_t timestamp;
+    uint32_t contractId;
+    uint32_t fromId;
+    uint32_t toId;
+    uint32_t reserved;
+    uint64_t tokenId;
+} EventRecord;
+
+typedef struct {
+    int fd;
+    uint8_t* buf;
+    size_t start;            // prima posizione non consumata in buf
+    size_t end;              // fine dei dati validi in buf
+    uint64_t bufOffset;      // offset nel file di buf[0]
+    uint64_t lineNum;
+    uint64_t malformed;
+    bool eof;
+} CsvReader;
+
+// Coda a singolo produttore / singolo consumatore tra parser e stadio dell'albero
+typedef struct {
+    EventRecord slots[INGEST_RING_SIZE];
+    uint64_t ends[INGEST_RING_SIZE];    // offset nel CSV subito dopo la riga di ogni record
+    _Atomic size_t head;     // prossimo slot da leggere (consumatore)
+    _Atomic size_t tail;     // prossimo slot da scrivere (produttore)
+    _Atomic bool done;       // il produttore ha terminato
+    _Atomic bool cancelled;  // il consumatore ha smesso di leggere
+} EventRing;
+
+struct EventLog;
+
+// Sorgente di eventi: CSV letto da un thread parser, oppure event log binario mappato in memoria
+typedef struct {
+    CsvReader* reader;
+    struct EventLog* log;
+    uint64_t logGroup;
+    uint32_t logSlot;
+    uint32_t fromBlock;
+    uint64_t position;       // dove riprendere dopo l'ultimo record restituito da ingestNext
+    EventRing ring;
+    pthread_t producer;
+} IngestPipeline;
+
+CsvReader* csvOpen(const char* path, uint64_t startOffset);
+int csvNext(CsvReader* r, EventRecord* ev);
+uint64_t csvOffset(CsvReader* r);
+void csvClose(CsvReader* r);
+
+bool ringPush(EventRing* ring, const EventRecord* ev, uint64_t end);
+bool ringPop(EventRing* ring, EventRecord* ev, uint64_t* end);
+
+IngestPipeline* ingestStart(const char* path, uint64_t startOffset, uint32_t fromBlock);
+bool ingestNext(IngestPipeline* p, EventRecord* ev);
+void ingestStop(IngestPipeline* p);
+// startOffset per un nuovo ingestStart che riparte dal record successivo all'ultimo letto
+uint64_t ingestPosition(const IngestPipeline* p);
+
+#endif // JELLYFISH_INGEST_H
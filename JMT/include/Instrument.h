@@ -0,0 +1,124 @@
+#ifndef JELLYFISH_INSTRUMENT_H
+#define JELLYFISH_INSTRUMENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Strumentazione opzionale della libreria (make INSTRUMENT=1 → -DJMT_INSTRUMENT).
+ * Contatori globali atomici e un istogramma di latenza per ogni operazione pubblica.
+ * Senza JMT_INSTRUMENT le macro si espandono a nulla e l'API resta disponibile come stub vuoti.
+ */
+
+typedef enum {
+    INSTR_KECCAK_CALLS,
+    INSTR_KECCAK_BYTES,
+    INSTR_NODE_ALLOCS,
+    INSTR_NODE_FREES,
+    INSTR_PROOF_LEVELS,
+    INSTR_PROOF_SIBLINGS,
+    INSTR_DIGEST_HITS,
+    INSTR_DIGEST_REHASHES,
+    INSTR_PROOF_CACHE_HITS,
+    INSTR_PROOF_CACHE_MISSES,
+    INSTR_COUNTERS
+} InstrCounter;
+
+typedef enum {
+    INSTR_OP_INSERT,
+    INSTR_OP_LOOKUP,
+    INSTR_OP_DELETE,
+    INSTR_OP_GENERATE_PROOF,
+    INSTR_OP_VERIFY_PROOF,
+    INSTR_OP_COMPUTE_HASH,
+    INSTR_OP_COMMIT,
+    INSTR_OP_UPDATE,
+    INSTR_OP_COMPACT,
+    INSTR_OPS
+} InstrOp;
+
+/*
+ * Bucket log-lineari in stile HDR: valori < 16 ns esatti, poi 16 sotto-bucket per ogni potenza di 2
+ * (errore relativo ≤ 1/16).
+ */
+#define INSTR_SUB_BUCKETS 16
+#define INSTR_BUCKETS ((64 - 3) * INSTR_SUB_BUCKETS)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sumNs;
+    uint64_t maxNs;
+    uint64_t buckets[INSTR_BUCKETS];
+} InstrHistogram;
+
+typedef struct {
+    uint64_t counters[INSTR_COUNTERS];
+    InstrHistogram ops[INSTR_OPS];
+} JMTStatsSnapshot;
+
+typedef enum { JMT_STATS_JSON, JMT_STATS_PROMETHEUS } JMTStatsFormat;
+
+// Formato dedotto dall'estensione del file di dump: .prom → testo Prometheus, altrimenti JSON
+static inline JMTStatsFormat jmtStatsFormatOf(const char* path) {
+    size_t n = strlen(path);
+    return (n >= 5 && strcmp(path + n - 5, ".prom") == 0) ? JMT_STATS_PROMETHEUS : JMT_STATS_JSON;
+}
+
+#ifdef JMT_INSTRUMENT
+
+#include <stdatomic.h>
+#include <time.h>
+
+extern const char* instrCounterNames[INSTR_COUNTERS];
+extern const char* instrOpNames[INSTR_OPS];
+extern _Atomic uint64_t instrCounters[INSTR_COUNTERS];
+
+typedef struct {
+    InstrOp op;
+    uint64_t start;
+} InstrTimer;
+
+static inline uint64_t instrNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void instrRecord(InstrOp op, uint64_t ns);
+
+static inline void instrTimerStop(InstrTimer* t) {
+    instrRecord(t->op, instrNow() - t->start);
+}
+
+#define JMT_COUNT(c, n) atomic_fetch_add_explicit(&instrCounters[c], (uint64_t)(n), memory_order_relaxed)
+// La latenza viene registrata all'uscita dallo scope, qualunque sia il return
+#define JMT_TIMED(op) __attribute__((cleanup(instrTimerStop))) InstrTimer instrTimer_ = {(op), instrNow()}
+
+void jmtStatsSnapshot(JMTStatsSnapshot* out);
+void jmtStatsReset(void);
+uint64_t jmtStatsPercentile(const InstrHistogram* h, double q);
+void jmtStatsWrite(FILE* f, JMTStatsFormat format);
+bool jmtStatsStartDump(const char* path, JMTStatsFormat format, unsigned intervalMs);
+void jmtStatsStopDump(void);
+
+#else
+
+#define JMT_COUNT(c, n) ((void)0)
+#define JMT_TIMED(op) ((void)0)
+
+static inline void jmtStatsSnapshot(JMTStatsSnapshot* out) { memset(out, 0, sizeof(*out)); }
+static inline void jmtStatsReset(void) {}
+static inline uint64_t jmtStatsPercentile(const InstrHistogram* h, double q) { (void)h; (void)q; return 0; }
+static inline void jmtStatsWrite(FILE* f, JMTStatsFormat format) { (void)f; (void)format; }
+static inline bool jmtStatsStartDump(const char* path, JMTStatsFormat format, unsigned intervalMs) {
+    (void)path; (void)format; (void)intervalMs;
+    fprintf(stderr, "⚠️ Statistiche non disponibili: compilare con make INSTRUMENT=1\n");
+    return false;
+}
+static inline void jmtStatsStopDump(void) {}
+
+#endif // JMT_INSTRUMENT
+
+#endif // JELLYFISH_INSTRUMENT_H
@@ -0,0 +1,71 @@
+#ifndef JELLYFISH_ITERATOR_H
+#define JELLYFISH_ITERATOR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "Jellyfish.h"
+
+/*
+ * Cursore sulle foglie in ordine di chiave (visita in profondità per nibble crescente).
+ * Lo stack dei nodi è esplicito: nessuna ricorsione sullo stack C.
+ * L'albero non deve essere modificato mentre un cursore è in uso.
+ */
+typedef struct {
+    InternalNode* node;
+    uint8_t next;       // prossimo slot da visitare (16 = nodo esaurito)
+} JMTIterFrame;
+
+typedef struct {
+    InternalNode* root;
+    JMTIterFrame stack[JMT_INSPECT_LEVELS];
+    size_t depth;
+    LeafNode* leaf;     // foglia corrente, NULL prima della prima next e a fine visita
+    NodeKey* hi;        // limite superiore incluso della scansione, NULL se assente
+} JMTIterator;
+
+void jmtIterInit(JMTIterator* it, InternalNode* root);
+// Posiziona il cursore: la prossima jmtIterNext restituisce la prima foglia con chiave >= key
+void jmtIterSeek(JMTIterator* it, NodeKey* key);
+// Scansione delle foglie con chiave in [lo, hi]; le chiavi devono restare valide durante la visita
+void jmtIterRange(JMTIterator* it, InternalNode* root, NodeKey* lo, NodeKey* hi);
+bool jmtIterNext(JMTIterator* it);
+
+int compareKeys(const NodeKey* a, const NodeKey* b);
+
+/*
+ * Prova di intervallo: tutte le foglie con chiave in [lo, hi] con un solo insieme di fratelli.
+ * È la visita in profondità del sottoalbero che interseca l'intervallo:
+ *   OPEN(i)        apre il nodo interno nello slot i del nodo corrente (la root ha i = 0)
+ *   SIBLING(i, h)  digest di un sottoalbero tutto fuori dall'intervallo
+ *   LEAF(i, k, v)  foglia nello slot i; dentro l'intervallo oppure foglia di confine fuori
+ *   CLOSE          chiude il nodo corrente
+ * Il verificatore ricalcola la root con uno stack di nodi e controlla che ogni SIBLING sia fuori dall'intervallo.
+ * L'hash di una foglia non copre la version (né il percorso delle chiavi hashed), che la root vincola solo fino
+ * alla profondità della foglia: una LEAF è accettata solo se quei nibble bastano a dire se è nell'intervallo.
+ */
+typedef enum { RANGE_OPEN, RANGE_SIBLING, RANGE_LEAF, RANGE_CLOSE } RangeEntryType;
+
+typedef struct {
+    uint8_t type;
+    uint8_t index;
+    HashValue hash;     // RANGE_SIBLING
+    NodeKey key;        // RANGE_LEAF
+    uint8_t* value;
+    size_t valueLength;
+} RangeEntry;
+
+typedef struct {
+    RangeEntry* entries;
+    size_t count;
+    size_t capacity;
+    size_t leavesInRange;
+} RangeProof;
+
+// false se una foglia sopra la profondità della version non si può collocare rispetto a [lo, hi]
+bool generateRangeProof(InternalNode* root, NodeKey* lo, NodeKey* hi, RangeProof* out);
+// Se valida, *leavesInRange (se non NULL) riceve il numero di foglie dell'intervallo
+bool verifyRangeProof(const RangeProof* rp, NodeKey* lo, NodeKey* hi, HashValue root, size_t* leavesInRange);
+void freeRangeProof(RangeProof* rp);
+
+#endif // JELLYFISH_ITERATOR_H
@@ -2,8 +2,10 @@
 #define JELLYFISH_STRUCTURE_H
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include "Hasher.h"
 #define HASH_SIZE 32
 
 
@@ -21,27 +23,73 @@ typedef struct {
     NibblePath nibble_path;
 } NodeKey;
 
+#define JMT_INLINE_VALUE 8
+
+// Il valore si legge con leafValue: fino a JMT_INLINE_VALUE byte sta nella foglia, oltre nel value log
 typedef struct {
     NodeKey leafKey;
-    uint8_t* value;
-    size_t valueLength;
+    uint32_t valueLength;
+    bool tombstone;     // cancellata da markDeletedJMT, rimossa dalla prossima compattazione
+    union {
+        uint8_t inlined[JMT_INLINE_VALUE];
+        const uint8_t* logged;      // copia condivisa nel value log, mai liberata dalla foglia
+    } value;
     HashValue leafDigest;
 } LeafNode;
 
+static inline const uint8_t* leafValue(const LeafNode* leaf) {
+    return leaf->valueLength <= JMT_INLINE_VALUE ? leaf->value.inlined : leaf->value.logged;
+}
+
 typedef struct InternalNode InternalNode;
+struct NodeStore;
+
+// Sottoalbero scritto nel node file (NodeStore.h): in memoria resta solo il digest
+typedef struct {
+    HashValue digest;
+    struct NodeStore* store;
+    uint64_t offset;
+    uint32_t length;
+} EvictedNode;
+
+#define JMT_CHILD_EVICTED    0x01   // node.evicted al posto di node.internal
+#define JMT_CHILD_UNIT       0x02   // radice di un sottoalbero sfrattabile
+#define JMT_CHILD_REFERENCED 0x04   // bit di riferimento del CLOCK
 
 typedef struct ChildNode {
     bool isLeaf;
+    uint8_t flags;      // JMT_CHILD_*, sempre 0 negli alberi senza NodeStore
+    uint32_t version;   // versione del JMT (commit) in cui il contenuto dello slot è cambiato l'ultima volta
     union {
         LeafNode* leaf;
         InternalNode* internal;
+        EvictedNode* evicted;
     } node;
 } ChildNode;
 
 struct InternalNode {
     ChildNode* children[16];
+    HashValue digest;   // hash del nodo, aggiornato da insert/delete lungo il percorso modificato
+    bool dirty;         // digest da ricalcolare (insert senza ancestry), sistemato alla prima lettura
+    bool tombstones;    // foglie cancellate nel sottoalbero, da rimuovere con compactJMT
 };
 
+// Ricarica dal node file un sottoalbero sfrattato, o segna l'accesso a uno residente (NodeStore.c)
+InternalNode* nodeStoreTouch(ChildNode* child);
+
+// Nodo interno di un figlio non foglia: le visite passano da qui per ricaricare i sottoalberi sfrattati
+static inline InternalNode* childInternal(ChildNode* child) {
+    if (__builtin_expect(child->flags != 0, 0)) return nodeStoreTouch(child);
+    return child->node.internal;
+}
+
+// Digest memorizzato del figlio, senza ricaricarlo; per un nodo interno residente deve essere aggiornato
+static inline const HashValue* childHash(const ChildNode* child) {
+    if (child->isLeaf) return &child->node.leaf->leafDigest;
+    if (child->flags & JMT_CHILD_EVICTED) return &child->node.evicted->digest;
+    return &child->node.internal->digest;
+}
+
 typedef struct Sibling {
     uint8_t index;
     HashValue hash;
@@ -68,16 +116,153 @@ typedef struct {
     HashValue RootN;
 } AncestryProof;
 
+#define JMT_PROOF_CACHE_SIZE 64
+
+typedef struct {
+    uint64_t digestHits;        // digest di fratelli letti già pronti dal nodo
+    uint64_t digestRehashes;    // nodi sporchi ricalcolati prima della lettura
+    uint64_t proofCacheHits;
+    uint64_t proofCacheMisses;
+} JMTStats;
+
+typedef struct {
+    bool used;
+    uint64_t lastUse;
+    HashValue root;
+    NodeKey key;
+    Proof proof;
+} ProofCacheEntry;
+
+/*
+ * Esito di updateJMTWithProof. I fratelli lungo il percorso non dipendono dal valore della foglia:
+ * proof (con leafHash = foglia precedente) prova lo stato prima dell'aggiornamento con oldValue,
+ * e gli stessi livelli con newLeafHash portano a newRoot. Si libera con freeUpdateProof.
+ */
+typedef struct {
+    Proof proof;
+    uint8_t* oldValue;
+    size_t oldValueLength;
+    HashValue newLeafHash;
+    HashValue newRoot;
+} UpdateProof;
+
+// Albero con statistiche proprie e cache LRU delle prove, invalidata ad ogni commit
+typedef struct {
+    InternalNode* root;
+    const JMTHasher* hasher;    // scelta alla creazione, attiva durante ogni operazione sull'handle
+    uint64_t version;           // numero di commit eseguiti
+    HashValue committedRoot;
+    bool mutated;               // modifiche successive all'ultimo commit
+    JMTStats stats;
+    uint64_t tick;
+    ProofCacheEntry proofCache[JMT_PROOF_CACHE_SIZE];
+    struct NodeStore* store;    // modalità a memoria limitata (jmtEnableEviction), NULL altrimenti
+    size_t tombstones;          // cancellazioni di jmtDelete in attesa di compattazione
+} JMT;
+
+/*
+ * Livello di un ProofDelta, contato dalla root (0) come i nibble della chiave.
+ * siblings è la maschera degli slot fratelli occupati nella versione nuova, changed quella dei digest
+ * cambiati (in hashes, indicizzato per slot); i fratelli fuori da siblings sono stati rimossi.
+ */
+typedef struct {
+    uint8_t level;
+    uint16_t siblings;
+    uint16_t changed;
+    HashValue hashes[16];
+} ProofDeltaLevel;
+
+// Differenza tra la prova di una chiave alla versione fromVersion e quella alla versione toVersion
+typedef struct {
+    uint64_t fromVersion;
+    uint64_t toVersion;
+    size_t depth;               // livelli della prova nuova
+    bool isPresent;
+    HashValue leafHash;
+    size_t levelCount;
+    ProofDeltaLevel* levels;    // dalla root, solo i livelli il cui nodo è cambiato
+} ProofDelta;
+
+// Esito di una ricerca in lookupBatchJMT; value è in prestito come in lookupJMTRef
+typedef struct {
+    bool found;
+    const uint8_t* value;
+    size_t valueLength;
+} LookupResult;
+
+#define JMT_LOOKUP_GROUP 16
+
+#define JMT_KEY_NIBBLES 24              // version (8 nibble) ‖ tokenId (16 nibble)
+#define JMT_HASHED_PATH_NIBBLES 64      // keccak256(version ‖ tokenId)
+#define JMT_HASHED_KEY_NIBBLES (JMT_HASHED_PATH_NIBBLES + JMT_KEY_NIBBLES)
+
+#define JMT_INSPECT_LEVELS 65
+
+/*
+ * Forma e memoria dell'albero raccolte da jmtInspect senza ricalcolare digest.
+ * La profondità di una foglia è il numero di InternalNode sopra di essa (= livelli della prova).
+ * Una catena è una sequenza massimale di InternalNode con un solo figlio.
+ */
+typedef struct {
+    size_t leafCount;
+    size_t internalCount;
+    size_t maxDepth;
+    size_t leafDepth[JMT_INSPECT_LEVELS];           // foglie per profondità
+    size_t fanout[JMT_INSPECT_LEVELS][17];          // InternalNode per livello e numero di figli
+    size_t chainLength[JMT_INSPECT_LEVELS];         // catene per lunghezza
+    size_t longestChain;
+    struct {
+        size_t internalNodes;   // InternalNode
+        size_t childNodes;      // involucri ChildNode
+        size_t leafNodes;       // LeafNode
+        size_t keys;            // nibble delle chiavi nelle foglie
+        size_t values;          // valori nel value log, ogni copia condivisa contata una volta
+        size_t total;
+        size_t allocated;       // totale effettivo secondo malloc_usable_size
+    } heapBytes;
+} JMTInspectStats;
+
 // Funzioni principali da esportare
 NibblePath buildPathFromTokenId(uint64_t tokenId);
 InternalNode* createInternalNode();
+void freeJMT(InternalNode* node);
 LeafNode* createLeafNode(NodeKey key, uint8_t* value, size_t len);
+// Foglia con digest già noto (ricaricata dal node file), senza ricalcolare l'hash
+LeafNode* restoreLeafNode(NodeKey key, const uint8_t* value, size_t len, HashValue digest);
+void freeLeafNode(LeafNode* leaf);
+// Libera lo slot e il sottoalbero (o lo stub, se sfrattato)
+void freeChildNode(ChildNode* child);
 bool lookupJMT(InternalNode* root, NodeKey* key, uint8_t** result, size_t* resLength);
+/*
+ * Come lookupJMT senza allocare: *value punta al valore memorizzato nell'albero.
+ * Il puntatore resta valido fino alla prossima insert/delete sull'albero (o a valueLogReset).
+ */
+bool lookupJMTRef(InternalNode* root, NodeKey* key, const uint8_t** value, size_t* len);
+void lookupBatchJMT(InternalNode* root, NodeKey* keys, size_t n, LookupResult* results);
 bool insertJMT(InternalNode** root, NodeKey* key, uint8_t* value, size_t len,AncestryProof* ap) ;
 bool deleteJMT(InternalNode** root, NodeKey* key) ;
-HashValue computeLeafHash(NodeKey* key, uint8_t* value, size_t len);
+/*
+ * Cancellazione a tombstone: markDeletedJMT marca la foglia e segna il percorso, compactJMT rimuove in un
+ * solo passaggio le foglie marcate, riporta nello slot del primo antenato le foglie rimaste sole (anche in
+ * fondo a catene di più livelli), libera i nodi svuotati e ricalcola i digest dei soli percorsi segnati.
+ * Lookup, iteratore e insert ignorano le foglie marcate; digest e prove valgono dopo la compattazione.
+ * deleteJMT equivale a markDeletedJMT seguita da compactJMT. compactJMT restituisce le foglie rimosse.
+ */
+bool markDeletedJMT(InternalNode* root, NodeKey* key);
+size_t compactJMT(InternalNode* root);
+/*
+ * Cambia il valore di una foglia esistente con una sola discesa e restituisce la prova dello stato precedente,
+ * il nuovo digest della foglia e la nuova root. false, senza modifiche, se la chiave non è nell'albero o è marcata come cancellata.
+ */
+bool updateJMTWithProof(InternalNode* root, NodeKey* key, uint8_t* value, size_t len, UpdateProof* out);
+void freeUpdateProof(UpdateProof* u);
+HashValue computeLeafHash(NodeKey* key, const uint8_t* value, size_t len);
+// Primo nibble della chiave coperto dall'hash della foglia: i precedenti sono vincolati solo dal percorso nell'albero
+size_t leafHashStart(const NodeKey* key);
 HashValue computeInternalHash(InternalNode* node) ;
+HashValue computeNodeDigest(InternalNode* node);
 HashValue computeProofRoot(NodeKey* key, Proof* P, HashValue leafStart);
+HashValue computeLevelHash(LevelSibling* level, uint8_t pos, HashValue current);
 bool generateProof(InternalNode* root, NodeKey* key, Proof* P);
 size_t longestCommonPrefix(const NibblePath* p1, const NibblePath* p2);
 
@@ -92,7 +277,10 @@ Sibling* createSiblingNode(uint8_t index, HashValue hash);
 void addSibling(LevelSibling** level, uint8_t index, HashValue hash);
 LevelSibling* addLevel(Proof* P);
 bool verifyProof(NodeKey* key, Proof* P, HashValue rootDigest);
+void verifyProofBatch(NodeKey* const* keys, Proof* const* proofs, const HashValue* roots, size_t n, bool* ok);
+void freeProof(Proof* P);
 NodeKey buildKey(NibblePath tokenPath);
+NodeKey buildKeyFromParts(uint32_t versionNum, uint64_t tokenId);
 NibblePath buildPathFromTokenId(uint64_t tokenId);
 LevelSibling* truncateProofLevels(LevelSibling* head, size_t keepDepth);
 HashValue prevRootJMT(AncestryProof* ancestry, uint8_t* insertedValue, size_t insertedValueLen);
@@ -101,4 +289,50 @@ void printHash(HashValue h);
 void printJMT(InternalNode* node, int depth, char* prefix, bool isLast);
 void printProof(Proof* P);
 NodeKey buildKeyWithControl(uint64_t tokenId, bool isMint);
+// Contatore delle versioni di buildKey/buildKeyWithControl e indice tokenId -> version dei mint, per i checkpoint
+uint32_t jmtNextVersion(void);
+void jmtSetNextVersion(uint32_t next);
+// Visita le voci non nulle dell'indice (le altre valgono 0 come in un processo appena avviato)
+void jmtForEachTokenVersion(void (*fn)(uint64_t tokenId, uint32_t version, void* arg), void* arg);
+bool jmtSetTokenVersion(uint64_t tokenId, uint32_t version);
+// Version dell'ultimo mint del tokenId, 0 se mai registrato
+uint32_t jmtTokenVersion(uint64_t tokenId);
+
+/*
+ * Modalità hashed-key: il percorso è keccak256(version ‖ tokenId) sui 12 byte big-endian della chiave,
+ * seguito dalla chiave originale. Con versioni sequenziali l'albero resta profondo ~log16(N) invece di
+ * scendere lungo il prefisso comune; la foglia impegna sempre i nibble del tokenId della chiave originale.
+ */
+NodeKey hashedKey(const NodeKey* key);
+bool isHashedKey(const NodeKey* key);
+// version e tokenId della chiave originale, anche per chiavi hashed
+uint32_t keyVersion(const NodeKey* key);
+uint64_t keyTokenId(const NodeKey* key);
+
+JMT* createJMT();
+JMT* createJMTWithHasher(const JMTHasher* hasher);
+void destroyJMT(JMT* t);
+bool jmtInsert(JMT* t, NodeKey* key, uint8_t* value, size_t len, AncestryProof* ap);
+/*
+ * jmtDelete marca soltanto la foglia: la compattazione avviene una volta per lotto, in jmtCommit o con jmtCompact,
+ * e prima di ogni operazione che legge i digest (prove, insert con ancestry, jmtUpdateWithProof, sfratti).
+ */
+bool jmtDelete(JMT* t, NodeKey* key);
+size_t jmtCompact(JMT* t);
+bool jmtUpdateWithProof(JMT* t, NodeKey* key, uint8_t* value, size_t len, UpdateProof* out);
+HashValue jmtCommit(JMT* t);
+bool jmtGenerateProof(JMT* t, NodeKey* key, Proof* P);
+
+/*
+ * Aggiornamento di una prova ottenuta alla versione fromVersion: solo i fratelli cambiati lungo il percorso.
+ * Le versioni sono i commit dell'handle, marcati sugli slot da jmtInsert/jmtDelete; toVersion deve essere
+ * la versione corrente e l'albero non deve avere modifiche non committate.
+ */
+bool jmtProofDelta(JMT* t, NodeKey* key, uint64_t fromVersion, uint64_t toVersion, ProofDelta* out);
+// Applica il delta alla prova: il risultato coincide con la prova generata alla versione nuova
+bool applyProofDelta(Proof* P, const ProofDelta* delta);
+void freeProofDelta(ProofDelta* delta);
+
+void jmtInspect(InternalNode* root, JMTInspectStats* out);
+void printInspectStats(FILE* f, const JMTInspectStats* s);
 #endif // JELLYFISH_STRUCTURE_H
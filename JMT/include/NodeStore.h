@@ -0,0 +1,73 @@
+#ifndef JELLYFISH_NODESTORE_H
+#define JELLYFISH_NODESTORE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "Jellyfish.h"
+
+/*
+ * Modalità a memoria limitata: i sottoalberi che partono a profondità evictDepth (unità) vengono scritti
+ * in un node file e liberati quando i byte dei nodi in memoria superano il budget, scegliendo le vittime con CLOCK.
+ * Lo slot dell'unità diventa un EvictedNode con il solo digest, quindi la root resta calcolabile senza ricaricarla;
+ * childInternal ricarica l'unità al primo accesso (lookupJMT, generateProof, insertJMT, ...).
+ *
+ * Il node file è solo in append e viene rimosso dal file system all'apertura: vive quanto il processo.
+ * Un'unità è serializzata in visita anticipata, interi little-endian:
+ *   nodo   u16 figli interni | u16 foglie | digest[32], poi i figli per slot crescente
+ *   figlio u32 version, poi il nodo interno oppure la foglia
+ *   foglia u8 nibble | chiave | u32 len | valore | digest[32]
+ * Come l'handle JMT, un albero con NodeStore va usato da un thread alla volta: anche le letture lo modificano.
+ */
+
+#define JMT_INTERNAL_BYTES (sizeof(InternalNode) + sizeof(ChildNode))
+#define JMT_LEAF_BYTES(keyBytes) (sizeof(LeafNode) + sizeof(ChildNode) + (keyBytes))
+
+typedef struct {
+    uint64_t hits;          // accessi a unità già in memoria
+    uint64_t faults;        // unità ricaricate dal node file
+    uint64_t evictions;
+    uint64_t bytesWritten;
+    uint64_t bytesRead;
+} NodeStoreStats;
+
+typedef struct NodeStore {
+    int fd;
+    uint64_t fileEnd;
+    size_t budget;          // byte dei nodi in memoria oltre i quali si sfratta
+    size_t resident;        // byte dei nodi in memoria, stimati con JMT_INTERNAL_BYTES e JMT_LEAF_BYTES
+    unsigned evictDepth;    // profondità delle unità (la root è a profondità 0)
+    size_t hand;            // posizione della lancetta del CLOCK tra le unità, in ordine di chiave
+    NodeStoreStats stats;
+} NodeStore;
+
+/*
+ * NodeStore su cui si sta operando: createInternalNode, createLeafNode e le free dell'albero aggiornano
+ * il suo contatore resident e childInternal conta gli accessi alle unità residenti.
+ * Le operazioni dell'handle lo impostano per la loro durata; il caricamento di un'unità usa quello dell'unità.
+ */
+extern _Thread_local NodeStore* jmtActiveStore;
+
+NodeStore* jmtUseStore(NodeStore* s);
+void jmtRestoreStore(NodeStore** prev);
+
+#define JMT_WITH_STORE(s) \
+    NodeStore* jmtPrevStore_ __attribute__((cleanup(jmtRestoreStore))) = jmtUseStore(s)
+
+static inline void jmtAccountNodeBytes(size_t bytes, bool freed) {
+    NodeStore* s = jmtActiveStore;
+    if (s == NULL) return;
+    if (!freed) s->resident += bytes;
+    else s->resident -= bytes < s->resident ? bytes : s->resident;
+}
+
+/*
+ * Attiva la modalità a memoria limitata sull'handle, che diventa proprietario del NodeStore.
+ * budget è in byte; evictDepth >= 1. Restituisce false se il node file non può essere creato.
+ */
+bool jmtEnableEviction(JMT* t, const char* path, size_t budget, unsigned evictDepth);
+// Sfratta unità con CLOCK finché i byte in memoria scendono sotto i 7/8 del budget
+void nodeStoreEnforce(NodeStore* s, InternalNode* root);
+void nodeStoreClose(NodeStore* s);
+
+#endif // JELLYFISH_NODESTORE_H
@@ -0,0 +1,77 @@
+#ifndef JELLYFISH_PROOFARCHIVE_H
+#define JELLYFISH_PROOFARCHIVE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "Jellyfish.h"
+
+#define JMTARCH_MAGIC "JMTARCH1"
+#define JMTARCH_FORMAT 1
+
+/*
+ * Archivio delle prove di jmt_export: le prove consecutive condividono quasi tutti i fratelli dei livelli alti,
+ * quindi ogni digest (fratelli, leafHash, root, RootN) è scritto una sola volta in una tabella e le prove lo
+ * citano con il suo indice. Il file è:
+ *   JMTArchiveHeader | record delle prove | tabella dei digest (hashes x 32 byte) | indice (proofs x u64 offset)
+ * L'indice dà l'accesso diretto alla prova i, che si ricostruisce con i soli suoi byte e la tabella.
+ *
+ * Un record, interi little-endian e riferimenti alla tabella in varint (LEB128):
+ *   u8 flag (PROOFARCH_*) | u8 nibble della chiave | chiave | varint len | valore | rif root | prova
+ *   ancestry: u8 preForkDepth | u8 nibble della chiave | chiave | rif RootN | prova
+ * Una prova è u8 depth | rif leafHash | u8 livelli, poi i livelli nell'ordine della Proof (dalla foglia):
+ * u16 maschera dei fratelli | un riferimento per bit, per slot decrescente come li produce generateProof.
+ * L'header è scritto così com'è (come JMTSyncHeader).
+ */
+typedef struct {
+    char magic[8];
+    uint32_t format;
+    uint32_t hashKind;          // JMTHashKind con cui sono state generate le prove
+    uint64_t proofs;
+    uint64_t hashes;            // digest distinti nella tabella
+    uint64_t hashesOffset;
+    uint64_t indexOffset;
+} JMTArchiveHeader;
+
+#define PROOFARCH_PRESENT           0x01
+#define PROOFARCH_SPLITTED          0x02
+#define PROOFARCH_ANCESTRY_PRESENT  0x04
+
+typedef struct {
+    uint64_t proofs;
+    uint64_t hashes;            // digest distinti scritti
+    uint64_t references;        // digest citati dalle prove
+    uint64_t bytes;
+} ProofArchiveStats;
+
+typedef struct ProofArchiveWriter ProofArchiveWriter;
+typedef struct ProofArchive ProofArchive;
+
+// Prova estratta dall'archivio: i campi di exportProofAndAncestry, allocati dal lettore
+typedef struct {
+    NodeKey key;
+    uint8_t* value;
+    size_t valueLength;
+    HashValue root;
+    Proof proof;
+    AncestryProof ancestry;
+} ArchivedProof;
+
+ProofArchiveWriter* proofArchiveCreate(const char* path);
+// Aggiunge la prova successiva; i livelli devono avere i fratelli per slot decrescente
+bool proofArchiveAppend(ProofArchiveWriter* w, Proof* proof, AncestryProof* ancestry, NodeKey* key,
+                        const uint8_t* value, size_t valueLen, HashValue root);
+// Scrive tabella, indice e header definitivo; libera il writer anche in caso di errore
+bool proofArchiveFinish(ProofArchiveWriter* w, ProofArchiveStats* stats);
+
+// Il file è mappato in memoria: aprire costa solo la validazione dell'header
+ProofArchive* proofArchiveOpen(const char* path);
+size_t proofArchiveCount(const ProofArchive* a);
+// Funzione di hash delle prove archiviate
+const JMTHasher* proofArchiveHasher(const ProofArchive* a);
+bool proofArchiveGet(const ProofArchive* a, size_t index, ArchivedProof* out);
+void freeArchivedProof(ArchivedProof* p);
+void proofArchiveClose(ProofArchive* a);
+
+#endif // JELLYFISH_PROOFARCHIVE_H
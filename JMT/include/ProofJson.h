@@ -0,0 +1,38 @@
+#ifndef JELLYFISH_PROOFJSON_H
+#define JELLYFISH_PROOFJSON_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "Jellyfish.h"
+
+#define PROOFJSON_MAX_VALUE 256
+
+/*
+ * Prova letta da un JSON esportato (proofs/ o proofs-verify/).
+ * Dell'oggetto servono tokenId, version, value, root, hash, keyMode e proof; gli altri campi (es. ancestry) sono saltati.
+ */
+typedef struct {
+    uint64_t tokenId;
+    uint32_t version;
+    uint8_t value[PROOFJSON_MAX_VALUE];
+    size_t valueLength;
+    bool hasRoot;
+    HashValue root;
+    const JMTHasher* hasher;    // campo "hash" della prova, keccak256 se assente
+    bool hashedKey;             // campo "keyMode": "hashed"
+    NodeKey key;        // version‖tokenId (preceduta dal percorso keccak se hashed), allocata dal parser
+    Proof proof;
+} ProofRecord;
+
+/*
+ * Legge un oggetto a partire da *cursor e sposta il cursore dopo la '}' finale,
+ * così un contenitore di oggetti concatenati si legge con chiamate successive.
+ * Ritorna false su testo non valido o a fine input (*cursor == end dopo gli spazi).
+ */
+bool parseProofRecord(const char** cursor, const char* end, ProofRecord* out);
+void freeProofRecord(ProofRecord* r);
+// 64 cifre esadecimali, con o senza prefisso 0x
+bool parseHashHex(const char* s, size_t len, HashValue* h);
+
+#endif // JELLYFISH_PROOFJSON_H
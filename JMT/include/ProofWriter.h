@@ -0,0 +1,56 @@
+#ifndef JELLYFISH_PROOFWRITER_H
+#define JELLYFISH_PROOFWRITER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/*
+ * Stadio di uscita dei file di prova: il thread dell'albero serializza la prova in un buffer e lo accoda,
+ * openat/write/close avvengono fuori dal suo percorso con al più depth file in volo.
+ *   uring   io_uring con le syscall dirette (senza liburing): ogni file passa per openat -> write -> close,
+ *           la SQE successiva parte al completamento della precedente
+ *   threads pool di thread con una coda limitata a depth file, usato se io_uring non è disponibile
+ *   sync    open/write/close subito, nel thread chiamante (il comportamento di fopen/fprintf/fclose)
+ * I contenuti e i nomi dei file non dipendono dal backend.
+ */
+
+typedef enum { PROOF_IO_AUTO, PROOF_IO_URING, PROOF_IO_THREADS, PROOF_IO_SYNC } ProofIOBackend;
+
+#define PROOF_IO_DEFAULT_DEPTH 64
+#define PROOF_IO_THREADS_MAX 8
+#define PROOF_NAME_DIGITS 5
+
+typedef struct {
+    uint64_t files;
+    uint64_t bytes;
+    uint64_t errors;        // file non scritti (errore già stampato su stderr)
+    uint64_t enters;        // chiamate a io_uring_enter, oppure attese del produttore sulla coda piena
+    uint64_t depthSum;      // file in volo a ogni accodamento, per la profondità media
+    unsigned maxDepth;
+} ProofWriterStats;
+
+typedef struct ProofWriter ProofWriter;
+
+// "auto", "uring", "threads" o "sync"; false se sconosciuto
+bool proofIOBackendByName(const char* name, ProofIOBackend* out);
+
+// AUTO prova io_uring e ripiega sui thread; NULL solo se il backend richiesto esplicitamente non parte
+ProofWriter* proofWriterStart(ProofIOBackend backend, unsigned depth);
+const char* proofWriterBackendName(const ProofWriter* w);
+// Accoda il file path con i len byte di data; il writer diventa proprietario di data (malloc) e la libera
+void proofWriterSubmit(ProofWriter* w, const char* path, char* data, size_t len);
+// Attende che i file accodati finora siano scritti, ad esempio prima di un checkpoint
+void proofWriterSync(ProofWriter* w);
+// Attende i file in volo e chiude lo stadio; false se qualche file non è stato scritto
+bool proofWriterStop(ProofWriter* w, ProofWriterStats* stats);
+
+/*
+ * dir/output_<index>.json con almeno PROOF_NAME_DIGITS cifre: oltre 99999 il nome si allarga
+ * (output_100000.json), come padStart(5, '0') negli script Hardhat. Per l'ordine numerico dei file
+ * va confrontata prima la lunghezza del nome (compareProofFileNames).
+ */
+void proofFileName(char* out, size_t cap, const char* dir, uint64_t index);
+int compareProofFileNames(const char* a, const char* b);
+
+#endif // JELLYFISH_PROOFWRITER_H
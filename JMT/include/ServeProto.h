@@ -0,0 +1,114 @@
+#ifndef JELLYFISH_SERVEPROTO_H
+#define JELLYFISH_SERVEPROTO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "Jellyfish.h"
+
+/*
+ * Protocollo binario di jmt_served su socket Unix, interi little-endian.
+ * Ogni messaggio è un header da SERVE_HEADER_SIZE byte seguito da length byte di payload:
+ *   u32 length | u32 id | u8 op | u8 status | u16 count
+ * Le risposte riportano l'id della richiesta e possono arrivare in ordine diverso (pipelining).
+ *
+ * Richieste: count chiavi da SERVE_KEY_SIZE byte (u32 version | u64 tokenId);
+ * version = SERVE_ANY_VERSION indica la versione assegnata al mint del tokenId.
+ * Risposte:
+ *   ROOT       root[32] | u64 foglie | u8 JMTHashKind | u8 chiavi hashed
+ *   LOOKUP     u32 version | u64 tokenId | u32 len | valore          (status NOT_FOUND senza payload)
+ *   PROOF      root[32] | prova
+ *   MULTIPROOF root[32] | count prove
+ *   STATS      ServeStats, SERVE_STATS_FIELDS u64
+ * Una prova è u8 flag (SERVE_PROOF_*) | u32 version | u64 tokenId | u8 livelli | leafHash[32],
+ * poi i livelli dalla root verso la foglia: u16 maschera dei fratelli | un digest per bit, in ordine di slot.
+ */
+
+#define SERVE_HEADER_SIZE 12
+#define SERVE_KEY_SIZE 12
+#define SERVE_MAX_KEYS 256
+#define SERVE_MAX_PAYLOAD (1u << 20)
+#define SERVE_ANY_VERSION UINT32_MAX
+
+#define SERVE_PROOF_PRESENT 0x01
+#define SERVE_PROOF_HASHED  0x02
+
+typedef enum {
+    SERVE_OP_ROOT = 1,
+    SERVE_OP_LOOKUP,
+    SERVE_OP_PROOF,
+    SERVE_OP_MULTIPROOF,
+    SERVE_OP_STATS
+} ServeOp;
+
+typedef enum {
+    SERVE_OK = 0,
+    SERVE_NOT_FOUND,        // chiave assente (LOOKUP) o tokenId mai coniato (SERVE_ANY_VERSION)
+    SERVE_BAD_REQUEST
+} ServeStatus;
+
+typedef struct {
+    uint32_t length;
+    uint32_t id;
+    uint8_t op;
+    uint8_t status;
+    uint16_t count;
+} ServeHeader;
+
+#define SERVE_STATS_FIELDS 6
+typedef struct {
+    uint64_t requests;
+    uint64_t keys;          // chiavi richieste, comprese quelle delle multi-proof
+    uint64_t coalesced;     // richieste servite dalla risposta di un'altra identica in corso
+    uint64_t computed;      // lookup e prove calcolate dai worker
+    uint64_t connections;
+    uint64_t badRequests;
+} ServeStats;
+
+// Buffer di byte in crescita, per comporre e accumulare messaggi
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+} ServeBuf;
+
+void serveBufReserve(ServeBuf* b, size_t extra);
+void serveBufPut(ServeBuf* b, const void* src, size_t n);
+void serveBufPutU8(ServeBuf* b, uint8_t v);
+void serveBufPutU16(ServeBuf* b, uint16_t v);
+void serveBufPutU32(ServeBuf* b, uint32_t v);
+void serveBufPutU64(ServeBuf* b, uint64_t v);
+void serveBufConsume(ServeBuf* b, size_t n);
+void serveBufFree(ServeBuf* b);
+
+uint16_t serveGetU16(const uint8_t* p);
+uint32_t serveGetU32(const uint8_t* p);
+uint64_t serveGetU64(const uint8_t* p);
+
+void servePutHeader(ServeBuf* b, const ServeHeader* h);
+void serveParseHeader(const uint8_t* p, ServeHeader* h);
+
+// Prova di generateProof per la chiave version‖tokenId
+void serveEncodeProof(ServeBuf* b, const Proof* P, uint32_t version, uint64_t tokenId, bool hashed);
+
+// Prova decodificata con la chiave già costruita (hashed se SERVE_PROOF_HASHED), da liberare con serveFreeProof
+typedef struct {
+    uint32_t version;
+    uint64_t tokenId;
+    bool hashed;
+    NodeKey key;
+    Proof proof;
+} ServeProof;
+
+// Legge una prova da *p e sposta il cursore dopo di essa; false se il payload è troncato o non valido
+bool serveDecodeProof(const uint8_t** p, const uint8_t* end, ServeProof* out);
+void serveFreeProof(ServeProof* sp);
+
+/*
+ * ProofDelta (jmtProofDelta): u64 from | u64 to | u8 flag | u8 livelli | leafHash[32] | u8 livelli cambiati,
+ * poi per ognuno u8 livello | u16 fratelli | u16 cambiati | un digest per bit di cambiati, in ordine di slot.
+ */
+void serveEncodeProofDelta(ServeBuf* b, const ProofDelta* d);
+bool serveDecodeProofDelta(const uint8_t** p, const uint8_t* end, ProofDelta* out);
+
+#endif // JELLYFISH_SERVEPROTO_H
@@ -0,0 +1,56 @@
+#ifndef JELLYFISH_STATESYNC_H
+#define JELLYFISH_STATESYNC_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "Jellyfish.h"
+
+#define JMTSYNC_MAGIC "JMTSYNC1"
+#define JMTSYNC_FORMAT 1
+
+/*
+ * Segmento di sincronizzazione tra due versioni committate di un JMT:
+ *   JMTSyncHeader, poi bodyBytes byte con i nodi cambiati in visita anticipata dalla root.
+ * Ogni nodo è u16 slot occupati | u16 slot interni cambiati | u16 foglie cambiate,
+ * poi le foglie cambiate (u8 nibble della chiave | chiave | u32 len | valore) e i nodi interni cambiati,
+ * entrambi per slot crescente. Gli slot occupati e non cambiati restano quelli della replica;
+ * i sottoalberi negli slot non più occupati o rimpiazzati sono i nodi stantii, liberati dall'import.
+ * Gli interi del corpo sono little-endian, l'header è scritto così com'è (come EventLogHeader).
+ */
+typedef struct {
+    char magic[8];
+    uint32_t format;
+    uint32_t hashKind;          // JMTHashKind dell'albero
+    uint64_t fromVersion;       // 0 = albero completo
+    uint64_t toVersion;
+    uint64_t nodes;
+    uint64_t bodyBytes;
+    HashValue root;             // root committata alla versione toVersion
+} JMTSyncHeader;
+
+typedef struct {
+    uint64_t segments;
+    uint64_t nodes;             // nodi interni scritti o applicati
+    uint64_t leaves;            // foglie nuove o modificate
+    uint64_t staleSubtrees;     // sottoalberi rimossi dalla replica
+    uint64_t bytes;
+} JMTSyncStats;
+
+/*
+ * Scrive su out le differenze tra fromVersion e la versione corrente, visitando solo gli slot
+ * marcati dopo fromVersion (ChildNode.version): il costo dipende dai nodi cambiati, non dall'albero.
+ * L'albero non deve avere modifiche non committate; fromVersion = 0 esporta tutto.
+ */
+bool jmtSyncExport(JMT* t, uint64_t fromVersion, FILE* out, JMTSyncStats* stats);
+
+/*
+ * Applica un segmento letto da in alla replica, che deve essere alla versione fromVersion e usare la stessa
+ * funzione di hash. Il corpo è validato prima di toccare l'albero; dopo l'applicazione la replica è committata
+ * alla versione toVersion e la sua root deve coincidere con quella dell'header.
+ * Restituisce 1 se il segmento è stato applicato, 0 a fine input, -1 in caso di errore.
+ */
+int jmtSyncImport(JMT* t, FILE* in, JMTSyncStats* stats);
+
+#endif // JELLYFISH_STATESYNC_H
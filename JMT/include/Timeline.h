@@ -0,0 +1,77 @@
+#ifndef JELLYFISH_TIMELINE_H
+#define JELLYFISH_TIMELINE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "Jellyfish.h"
+
+#define JMTTIME_MAGIC "JMTTIME1"
+#define JMTTIME_FORMAT 1
+
+#define JMTTIME_HASHED_KEYS 0x01
+
+/*
+ * Timeline di un'esportazione: una voce per ogni blocco che ha aggiunto foglie, scritta al confine di blocco.
+ *   JMTTimelineHeader | voci JMTTimelineEntry a dimensione fissa, in ordine di blocco e di timestamp
+ * Le voci si cercano per bisezione direttamente nel file mappato; il numero di voci è dato dalla dimensione.
+ * Lo stato al blocco B è quello dell'ultima voce con blockId <= B (i blocchi senza mint non hanno voce).
+ * Le strutture sono scritte così come sono (come JMTSyncHeader).
+ */
+typedef struct {
+    char magic[8];
+    uint32_t format;
+    uint32_t hashKind;
+    uint32_t flags;             // JMTTIME_*
+    uint32_t reserved;
+} JMTTimelineHeader;
+
+typedef struct {
+    uint32_t blockId;
+    uint32_t timestamp;         // massimo timestamp visto fino al blocco
+    uint32_t keyLimit;          // jmtNextVersion a fine blocco: le foglie con version minore esistevano
+    uint32_t reserved;
+    uint64_t version;           // commit dell'handle con la root del blocco
+    HashValue root;
+} JMTTimelineEntry;
+
+typedef struct JMTTimelineWriter JMTTimelineWriter;
+typedef struct JMTTimeline JMTTimeline;
+
+JMTTimelineWriter* jmtTimelineCreate(const char* path, const JMTHasher* hasher, bool hashedKeys);
+/*
+ * Riapre la timeline per riprendere un'esportazione dal checkpoint al commit atVersion: le voci successive
+ * (scritte dopo il checkpoint da un'esecuzione interrotta) sono scartate e verranno riscritte.
+ */
+JMTTimelineWriter* jmtTimelineResume(const char* path, const JMTHasher* hasher, bool hashedKeys, uint64_t atVersion);
+// Ultima voce scritta, NULL se la timeline è vuota
+const JMTTimelineEntry* jmtTimelineLast(const JMTTimelineWriter* w);
+bool jmtTimelineAppend(JMTTimelineWriter* w, const JMTTimelineEntry* e);
+// Porta su disco le voci scritte, prima di un checkpoint che le dà per acquisite
+bool jmtTimelineSync(JMTTimelineWriter* w);
+bool jmtTimelineFinish(JMTTimelineWriter* w);
+
+JMTTimeline* jmtTimelineOpen(const char* path);
+size_t jmtTimelineCount(const JMTTimeline* tl);
+const JMTTimelineEntry* jmtTimelineEntry(const JMTTimeline* tl, size_t i);
+const JMTHasher* jmtTimelineHasher(const JMTTimeline* tl);
+bool jmtTimelineHashedKeys(const JMTTimeline* tl);
+// Ultima voce con blockId <= blockId (timestamp <= timestamp), NULL se precedente alla prima voce
+const JMTTimelineEntry* jmtTimelineAtBlock(const JMTTimeline* tl, uint32_t blockId);
+const JMTTimelineEntry* jmtTimelineAtTime(const JMTTimeline* tl, uint32_t timestamp);
+void jmtTimelineClose(JMTTimeline* tl);
+
+/*
+ * Root e prove al commit di una voce, calcolate sull'albero attuale senza riapplicare gli eventi.
+ * Valgono per alberi in sola inserzione con version crescenti, come quello di jmt_export: una foglia
+ * esisteva alla voce se la sua version è minore di keyLimit. Gli slot non marcati dopo e->version hanno
+ * ancora il digest di allora; negli altri i digest sono ricalcolati con le sole foglie esistenti, e un
+ * sottoalbero rimasto con una foglia torna a essere quella foglia. Con chiavi non hashed il percorso inizia
+ * con la version, quindi i rami con version tutte >= keyLimit sono scartati senza visitarli.
+ * L'albero deve essere committato a una versione >= e->version; false altrimenti.
+ */
+bool jmtTimelineRoot(JMT* t, const JMTTimelineEntry* e, bool hashedKeys, HashValue* root);
+bool jmtTimelineProof(JMT* t, const JMTTimelineEntry* e, NodeKey* key, Proof* P);
+
+#endif // JELLYFISH_TIMELINE_H
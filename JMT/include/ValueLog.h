@@ -0,0 +1,29 @@
+#ifndef JELLYFISH_VALUELOG_H
+#define JELLYFISH_VALUELOG_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define VALUE_LOG_SEGMENT (1 << 20)
+
+/*
+ * Log dei valori delle foglie più lunghi di JMT_INLINE_VALUE, condiviso da tutti gli alberi del processo.
+ * I valori sono appesi in segmenti di VALUE_LOG_SEGMENT byte che non vengono mai spostati né liberati,
+ * quindi i puntatori restituiti restano validi fino a valueLogReset.
+ * Ogni valore è indicizzato per contenuto: valori uguali condividono la stessa copia.
+ */
+typedef struct {
+    size_t segments;
+    size_t bytes;           // byte occupati nei segmenti
+    size_t values;          // valori distinti
+    uint64_t interned;      // richieste di valueLogIntern
+    uint64_t dedupHits;     // richieste risolte con una copia già presente
+} ValueLogStats;
+
+const uint8_t* valueLogIntern(const uint8_t* value, size_t len);
+void valueLogStats(ValueLogStats* out);
+// Libera segmenti e indice: nessun albero deve più riferirsi a valori del log
+void valueLogReset(void);
+
+#endif // JELLYFISH_VALUELOG_H
@@ -5,6 +5,22 @@
 #include <stdlib.h>
 
 int keccak_256(uint8_t* out, const uint8_t* in, size_t inlen);
+/* Four independent keccak_256 digests of equal-length inputs, computed in lockstep. */
+int keccak_256_x4(uint8_t* out[4], const uint8_t* const in[4], size_t inlen);
+
+/* Incremental keccak_256: the preimage is absorbed in pieces, without building it in a buffer. */
+typedef struct {
+  uint64_t state[25];
+  size_t offset;      /* bytes absorbed into the current block */
+  size_t length;      /* total bytes absorbed */
+} keccak_256_ctx;
+
+void keccak_256_init(keccak_256_ctx* ctx);
+void keccak_256_absorb(keccak_256_ctx* ctx, const uint8_t* in, size_t inlen);
+void keccak_256_absorb_byte(keccak_256_ctx* ctx, uint8_t b);
+/* Same as absorbing len zero bytes: only advances the position in the block. */
+void keccak_256_absorb_zeros(keccak_256_ctx* ctx, size_t len);
+void keccak_256_final(keccak_256_ctx* ctx, uint8_t* out);
 
 #define decshake(bits) \
   int shake##bits(uint8_t*, size_t, const uint8_t*, size_t);
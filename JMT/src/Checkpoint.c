@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "macros.h"
+#include "ServeProto.h"
+#include "StateSync.h"
+#include "Checkpoint.h"
+#include "NodeStore.h"
+
+static void putTokenVersion(uint64_t tokenId, uint32_t version, void* arg) {
+    ServeBuf* b = arg;
+    serveBufPutU64(b, tokenId);
+    serveBufPutU32(b, version);
+}
+
+static void putSlotVersions(InternalNode* node, ServeBuf* b) {
+    for (int i = 0; i < 16; i++) {
+        ChildNode* c = node->children[i];
+        if (c == NULL) continue;
+        serveBufPutU32(b, c->version);
+        if (!c->isLeaf) putSlotVersions(childInternal(c), b);
+    }
+}
+
+// Stessa visita di putSlotVersions: l'albero importato ha la forma di quello salvato
+static bool getSlotVersions(InternalNode* node, FILE* f, uint64_t* left) {
+    uint8_t v[4];
+    for (int i = 0; i < 16; i++) {
+        ChildNode* c = node->children[i];
+        if (c == NULL) continue;
+        if (*left == 0 || fread(v, sizeof(v), 1, f) != 1) return false;
+        (*left)--;
+        c->version = serveGetU32(v);
+        if (!c->isLeaf && !getSlotVersions(childInternal(c), f, left)) return false;
+    }
+    return true;
+}
+
+bool jmtCheckpointSave(const char* path, JMT* t, const JMTCheckpoint* cp) {
+    jmtCommit(t);
+
+    ServeBuf tokens = {0};
+    jmtForEachTokenVersion(putTokenVersion, &tokens);
+    ServeBuf stamps = {0};
+    {
+        JMT_WITH_STORE(t->store);
+        putSlotVersions(t->root, &stamps);
+    }
+    uint8_t stampCount[8];
+    for (int i = 0; i < 8; i++) stampCount[i] = (uint8_t)((stamps.len / 4) >> (8 * i));
+
+    JMTCheckpointHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, JMTCKPT_MAGIC, sizeof(h.magic));
+    h.format = JMTCKPT_FORMAT;
+    h.hashKind = (uint32_t)t->hasher->kind;
+    h.flags = (cp->hashedKeys ? JMTCKPT_HASHED_KEYS : 0) | (cp->ownerValues ? JMTCKPT_OWNER_VALUES : 0) | JMTCKPT_SLOT_VERSIONS;
+    h.fromBlock = cp->fromBlock;
+    h.inputPosition = cp->inputPosition;
+    h.outputs = cp->outputs;
+    h.nextVersion = jmtNextVersion();
+    h.tokens = tokens.len / 12;
+
+    char* tmp;
+    SYSCN(tmp, (char*)malloc(strlen(path) + 5), "Error allocating checkpoint path");
+    sprintf(tmp, "%s.tmp", path);
+    FILE* f = fopen(tmp, "wb");
+    bool ok = f != NULL &&
+              fwrite(&h, sizeof(h), 1, f) == 1 &&
+              (tokens.len == 0 || fwrite(tokens.data, tokens.len, 1, f) == 1) &&
+              jmtSyncExport(t, 0, f, NULL) &&
+              fwrite(stampCount, sizeof(stampCount), 1, f) == 1 &&
+              (stamps.len == 0 || fwrite(stamps.data, stamps.len, 1, f) == 1) &&
+              fsync(fileno(f)) == 0;
+    if (f != NULL && fclose(f) != 0) ok = false;
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok) {
+        perror("Error writing checkpoint");
+        unlink(tmp);
+    }
+    free(tmp);
+    serveBufFree(&tokens);
+    serveBufFree(&stamps);
+    return ok;
+}
+
+bool jmtCheckpointLoad(const char* path, JMT* t, JMTCheckpoint* cp) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        perror("Error opening checkpoint");
+        return false;
+    }
+
+    JMTCheckpointHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, JMTCKPT_MAGIC, sizeof(h.magic)) != 0 || h.format != JMTCKPT_FORMAT) {
+        fprintf(stderr, "Error: %s is not a checkpoint\n", path);
+        fclose(f);
+        return false;
+    }
+    if (h.hashKind != (uint32_t)t->hasher->kind) {
+        fprintf(stderr, "Error: checkpoint uses a different hash function\n");
+        fclose(f);
+        return false;
+    }
+
+    uint8_t pair[12];
+    for (uint64_t i = 0; i < h.tokens; i++) {
+        if (fread(pair, sizeof(pair), 1, f) != 1 || !jmtSetTokenVersion(serveGetU64(pair), serveGetU32(pair + 8))) {
+            fprintf(stderr, "Error: corrupted token index in checkpoint\n");
+            fclose(f);
+            return false;
+        }
+    }
+
+    // L'albero è un segmento completo: l'import controlla anche la root
+    bool ok = jmtSyncImport(t, f, NULL) == 1;
+    if (!ok) {
+        fprintf(stderr, "Error: cannot restore the tree from %s\n", path);
+        fclose(f);
+        return false;
+    }
+    if (h.flags & JMTCKPT_SLOT_VERSIONS) {
+        JMT_WITH_STORE(t->store);
+        uint8_t count[8];
+        uint64_t left = 0;
+        ok = fread(count, sizeof(count), 1, f) == 1;
+        if (ok) left = serveGetU64(count);
+        ok = ok && getSlotVersions(t->root, f, &left) && left == 0;
+    }
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "Error: corrupted slot versions in checkpoint\n");
+        return false;
+    }
+
+    jmtSetNextVersion(h.nextVersion);
+    cp->inputPosition = h.inputPosition;
+    cp->outputs = h.outputs;
+    cp->fromBlock = h.fromBlock;
+    cp->hashedKeys = (h.flags & JMTCKPT_HASHED_KEYS) != 0;
+    cp->ownerValues = (h.flags & JMTCKPT_OWNER_VALUES) != 0;
+    return true;
+}
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "macros.h"
+#include "EventLog.h"
+
+// Colonne all'interno di un gruppo
+#define COL_TOKEN(g)     ((uint64_t*)((g) + sizeof(EventLogGroupHeader)))
+#define COL_TIMESTAMP(g) ((uint32_t*)((g) + sizeof(EventLogGroupHeader) + 8 * EVENTLOG_GROUP))
+#define COL_CONTRACT(g)  (COL_TIMESTAMP(g) + EVENTLOG_GROUP)
+#define COL_FROM(g)      (COL_TIMESTAMP(g) + 2 * EVENTLOG_GROUP)
+#define COL_TO(g)        (COL_TIMESTAMP(g) + 3 * EVENTLOG_GROUP)
+#define COL_BLOCK(g)     ((uint16_t*)(COL_TIMESTAMP(g) + 4 * EVENTLOG_GROUP))
+
+static void flushGroup(EventLogWriter* w) {
+    if (w->gh->count == 0) return;
+
+    if (w->header.groupCount == w->indexCap) {
+        w->indexCap = w->indexCap ? w->indexCap * 2 : 256;
+        SYSCN(w->index, (EventLogIndexEntry*)realloc(w->index, w->indexCap * sizeof(EventLogIndexEntry)), "Error growing event log index");
+    }
+    EventLogIndexEntry* e = &w->index[w->header.groupCount];
+    e->firstRecord = w->header.recordCount - w->gh->count;
+    e->baseBlock = w->gh->baseBlock;
+    e->lastBlock = w->gh->lastBlock;
+
+    if (fwrite(w->group, EVENTLOG_GROUP_BYTES, 1, w->out) != 1) {
+        perror("Error writing event log group");
+        exit(EXIT_FAILURE);
+    }
+    w->header.groupCount++;
+    memset(w->group, 0, EVENTLOG_GROUP_BYTES);
+}
+
+EventLogWriter* eventLogCreate(const char* path) {
+    EventLogWriter* w;
+    SYSCN(w, (EventLogWriter*)calloc(1, sizeof(EventLogWriter)), "Error allocating event log writer");
+    SYSCN(w->out, fopen(path, "wb"), "Error creating event log");
+    SYSCN(w->group, (uint8_t*)calloc(1, EVENTLOG_GROUP_BYTES), "Error allocating event log group");
+    w->gh = (EventLogGroupHeader*)w->group;
+
+    memcpy(w->header.magic, EVENTLOG_MAGIC, 8);
+    w->header.format = EVENTLOG_FORMAT;
+    w->header.groupCapacity = EVENTLOG_GROUP;
+
+    // L'intestazione definitiva viene riscritta da eventLogFinish
+    if (fwrite(&w->header, sizeof(EventLogHeader), 1, w->out) != 1) {
+        perror("Error writing event log header");
+        exit(EXIT_FAILURE);
+    }
+    return w;
+}
+
+void eventLogAppend(EventLogWriter* w, const EventRecord* ev) {
+    EventLogGroupHeader* gh = w->gh;
+    if (gh->count == EVENTLOG_GROUP ||
+        (gh->count > 0 && (ev->blockId < gh->baseBlock || ev->blockId - gh->baseBlock > UINT16_MAX))) {
+        flushGroup(w);
+    }
+
+    if (gh->count == 0) {
+        gh->baseBlock = ev->blockId;
+        gh->lastBlock = ev->blockId;
+    }
+
+    uint32_t slot = gh->count++;
+    COL_TOKEN(w->group)[slot] = ev->tokenId;
+    COL_TIMESTAMP(w->group)[slot] = ev->timestamp;
+    COL_CONTRACT(w->group)[slot] = ev->contractId;
+    COL_FROM(w->group)[slot] = ev->fromId;
+    COL_TO(w->group)[slot] = ev->toId;
+    COL_BLOCK(w->group)[slot] = (uint16_t)(ev->blockId - gh->baseBlock);
+    if (ev->blockId > gh->lastBlock) gh->lastBlock = ev->blockId;
+    w->header.recordCount++;
+}
+
+void eventLogFinish(EventLogWriter* w, uint64_t sourceBytes) {
+    flushGroup(w);
+
+    w->header.indexOffset = sizeof(EventLogHeader) + w->header.groupCount * EVENTLOG_GROUP_BYTES;
+    w->header.sourceBytes = sourceBytes;
+    if (w->header.groupCount > 0 &&
+        fwrite(w->index, sizeof(EventLogIndexEntry), w->header.groupCount, w->out) != w->header.groupCount) {
+        perror("Error writing event log index");
+        exit(EXIT_FAILURE);
+    }
+
+    SYS(fseek(w->out, 0, SEEK_SET), "Error rewinding event log");
+    if (fwrite(&w->header, sizeof(EventLogHeader), 1, w->out) != 1) {
+        perror("Error writing event log header");
+        exit(EXIT_FAILURE);
+    }
+    SUCC0(fclose(w->out), "Error closing event log");
+
+    free(w->index);
+    free(w->group);
+    free(w);
+}
+
+bool isEventLog(const char* path) {
+    char magic[8];
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    bool ok = fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, EVENTLOG_MAGIC, 8) == 0;
+    fclose(f);
+    return ok;
+}
+
+EventLog* eventLogOpen(const char* path) {
+    EventLog* log;
+    SYSCN(log, (EventLog*)calloc(1, sizeof(EventLog)), "Error allocating event log");
+
+    log->fd = open(path, O_RDONLY);
+    if (log->fd == -1) {
+        free(log);
+        return NULL;
+    }
+
+    struct stat st;
+    SYS(fstat(log->fd, &st), "Error reading event log size");
+    log->size = (size_t)st.st_size;
+    if (log->size < sizeof(EventLogHeader)) {
+        fprintf(stderr, "❌ Event log troncato: %s\n", path);
+        close(log->fd);
+        free(log);
+        return NULL;
+    }
+
+    log->map = mmap(NULL, log->size, PROT_READ, MAP_SHARED, log->fd, 0);
+    if (log->map == MAP_FAILED) {
+        perror("Error mapping event log");
+        exit(errno);
+    }
+    madvise(log->map, log->size, MADV_SEQUENTIAL);
+
+    log->header = (const EventLogHeader*)log->map;
+    const EventLogHeader* h = log->header;
+    if (memcmp(h->magic, EVENTLOG_MAGIC, 8) != 0 || h->format != EVENTLOG_FORMAT || h->groupCapacity != EVENTLOG_GROUP ||
+        h->indexOffset + h->groupCount * sizeof(EventLogIndexEntry) > log->size) {
+        fprintf(stderr, "❌ Event log non valido: %s\n", path);
+        eventLogClose(log);
+        return NULL;
+    }
+    log->index = (const EventLogIndexEntry*)(log->map + h->indexOffset);
+    return log;
+}
+
+void eventLogClose(EventLog* log) {
+    if (log == NULL) return;
+    munmap(log->map, log->size);
+    close(log->fd);
+    free(log);
+}
+
+static inline const uint8_t* groupAt(EventLog* log, uint64_t g) {
+    return log->map + sizeof(EventLogHeader) + g * EVENTLOG_GROUP_BYTES;
+}
+
+static inline void decode(const uint8_t* g, uint32_t slot, EventRecord* ev) {
+    const EventLogGroupHeader* gh = (const EventLogGroupHeader*)g;
+    ev->blockId = gh->baseBlock + COL_BLOCK(g)[slot];
+    ev->timestamp = COL_TIMESTAMP(g)[slot];
+    ev->contractId = COL_CONTRACT(g)[slot];
+    ev->fromId = COL_FROM(g)[slot];
+    ev->toId = COL_TO(g)[slot];
+    ev->reserved = 0;
+    ev->tokenId = COL_TOKEN(g)[slot];
+}
+
+EventLogCursor eventLogCursorAt(EventLog* log, uint64_t record) {
+    EventLogCursor c = {log->header->groupCount, 0};
+    if (record >= log->header->recordCount) return c;
+
+    // Ultimo gruppo con firstRecord <= record
+    uint64_t lo = 0, hi = log->header->groupCount;
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (log->index[mid].firstRecord <= record) lo = mid;
+        else hi = mid;
+    }
+    c.group = lo;
+    c.slot = (uint32_t)(record - log->index[lo].firstRecord);
+    return c;
+}
+
+bool eventLogNext(EventLog* log, EventLogCursor* c, EventRecord* ev) {
+    while (c->group < log->header->groupCount) {
+        const uint8_t* g = groupAt(log, c->group);
+        if (c->slot < ((const EventLogGroupHeader*)g)->count) {
+            decode(g, c->slot++, ev);
+            return true;
+        }
+        c->group++;
+        c->slot = 0;
+    }
+    return false;
+}
+
+bool eventLogRead(EventLog* log, uint64_t record, EventRecord* ev) {
+    EventLogCursor c = eventLogCursorAt(log, record);
+    return eventLogNext(log, &c, ev);
+}
+
+uint64_t eventLogSeekBlock(EventLog* log, uint32_t blockId) {
+    const EventLogHeader* h = log->header;
+
+    // Primo gruppo il cui ultimo blocco raggiunge blockId: i gruppi sono ordinati per blocco
+    uint64_t lo = 0, hi = h->groupCount;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (log->index[mid].lastBlock < blockId) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == h->groupCount) return h->recordCount;
+
+    const uint8_t* g = groupAt(log, lo);
+    const EventLogGroupHeader* gh = (const EventLogGroupHeader*)g;
+    uint32_t target = blockId > gh->baseBlock ? blockId - gh->baseBlock : 0;
+    uint32_t slot = 0;
+    while (slot < gh->count && COL_BLOCK(g)[slot] < target) slot++;
+    return log->index[lo].firstRecord + slot;
+}
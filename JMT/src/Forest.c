@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "keccak-tiny.h"
+#include "macros.h"
+#include "Forest.h"
+
+#define FOREST_BATCH 64
+
+extern HashValue default_hash;
+
+static void applyOp(ForestShard* S, ForestOp* op) {
+    insertJMT(&S->root, &op->key, op->value, op->valueLength, NULL);
+    S->inserted++;
+    free(op->key.nibble_path.nibbles);
+    free(op->value);
+}
+
+static void* shardWorker(void* arg) {
+    ForestShard* S = (ForestShard*)arg;
+    ForestOp batch[FOREST_BATCH];
+
+    pthread_mutex_lock(&S->lock);
+    for (;;) {
+        while (S->count == 0 && !S->syncRequested && !S->stop) pthread_cond_wait(&S->notEmpty, &S->lock);
+
+        if (S->count > 0) {
+            // Preleva un blocco di operazioni per ridurre la contesa sul lock
+            size_t n = 0;
+            while (S->count > 0 && n < FOREST_BATCH) {
+                batch[n++] = S->ops[S->head];
+                S->head = (S->head + 1) % FOREST_QUEUE_SIZE;
+                S->count--;
+            }
+            pthread_cond_broadcast(&S->notFull);
+            pthread_mutex_unlock(&S->lock);
+            for (size_t i = 0; i < n; i++) applyOp(S, &batch[i]);
+            pthread_mutex_lock(&S->lock);
+            continue;
+        }
+
+        if (S->syncRequested) {
+            // Richiesta di sync: la root dello shard viene calcolata sul core del worker
+            pthread_mutex_unlock(&S->lock);
+            S->rootDigest = computeInternalHash(S->root);
+            pthread_mutex_lock(&S->lock);
+            S->syncRequested = false;
+            pthread_cond_broadcast(&S->drained);
+            continue;
+        }
+
+        if (S->stop) break;
+    }
+    pthread_mutex_unlock(&S->lock);
+    return NULL;
+}
+
+static size_t topDepthFor(size_t shardCount) {
+    size_t depth = 0;
+    size_t capacity = 1;
+    while (capacity < shardCount) {
+        capacity *= 16;
+        depth++;
+    }
+    return depth;
+}
+
+Forest* createForest(size_t shardCount, ForestPartition partition, size_t nibbleOffset, bool threaded) {
+    if (shardCount == 0 || shardCount > FOREST_MAX_SHARDS) {
+        fprintf(stderr, "Error: shard count must be in [1, %d]\n", FOREST_MAX_SHARDS);
+        return NULL;
+    }
+
+    Forest* F;
+    SYSCN(F, (Forest*)calloc(1, sizeof(Forest)), "Error allocating forest");
+    SYSCN(F->shards, (ForestShard*)calloc(shardCount, sizeof(ForestShard)), "Error allocating forest shards");
+
+    F->shardCount = shardCount;
+    F->topDepth = topDepthFor(shardCount);
+    F->partition = partition;
+    F->nibbleOffset = nibbleOffset;
+    F->threaded = threaded;
+
+    SYSCN(F->topLayers, (HashValue**)calloc(F->topDepth + 1, sizeof(HashValue*)), "Error allocating forest layers");
+    for (size_t k = 0, w = 1; k <= F->topDepth; k++, w *= 16) {
+        SYSCN(F->topLayers[F->topDepth - k], (HashValue*)calloc(w, sizeof(HashValue)), "Error allocating forest layer");
+    }
+
+    for (size_t i = 0; i < shardCount; i++) {
+        ForestShard* S = &F->shards[i];
+        S->root = createInternalNode();
+        S->rootDigest = computeInternalHash(S->root);
+        if (!threaded) continue;
+
+        SUCC0(pthread_mutex_init(&S->lock, NULL), "Error initializing shard lock");
+        SUCC0(pthread_cond_init(&S->notEmpty, NULL), "Error initializing shard condition");
+        SUCC0(pthread_cond_init(&S->notFull, NULL), "Error initializing shard condition");
+        SUCC0(pthread_cond_init(&S->drained, NULL), "Error initializing shard condition");
+        SUCC0(pthread_create(&S->worker, NULL, shardWorker, S), "Error starting shard worker");
+    }
+
+    forestSync(F);
+    return F;
+}
+
+void destroyForest(Forest* F) {
+    if (F == NULL) return;
+
+    for (size_t i = 0; i < F->shardCount; i++) {
+        ForestShard* S = &F->shards[i];
+        if (F->threaded) {
+            pthread_mutex_lock(&S->lock);
+            S->stop = true;
+            pthread_cond_signal(&S->notEmpty);
+            pthread_mutex_unlock(&S->lock);
+            pthread_join(S->worker, NULL);
+
+            pthread_mutex_destroy(&S->lock);
+            pthread_cond_destroy(&S->notEmpty);
+            pthread_cond_destroy(&S->notFull);
+            pthread_cond_destroy(&S->drained);
+        }
+        freeJMT(S->root);
+    }
+    for (size_t k = 0; k <= F->topDepth; k++) free(F->topLayers[k]);
+    free(F->topLayers);
+    free(F->shards);
+    free(F);
+}
+
+size_t forestShardOf(Forest* F, NodeKey* key, uint32_t contractId) {
+    if (F->shardCount == 1) return 0;
+
+    if (F->partition == FOREST_BY_CONTRACT) return contractId % F->shardCount;
+
+    size_t group = 0;
+    for (size_t i = 0; i < F->topDepth; i++) {
+        size_t idx = F->nibbleOffset + i;
+        uint8_t nib = idx < key->nibble_path.nibblesLength ? getNibble(key->nibble_path.nibbles, idx) : 0;
+        group = (group << 4) | nib;
+    }
+    return group % F->shardCount;
+}
+
+void forestInsert(Forest* F, size_t shard, NodeKey* key, uint8_t* value, size_t len) {
+    ForestShard* S = &F->shards[shard];
+    F->synced = false;
+
+    if (!F->threaded) {
+        insertJMT(&S->root, key, value, len, NULL);
+        S->inserted++;
+        return;
+    }
+
+    // La coda possiede una copia di chiave e valore, come insertJMT
+    ForestOp op;
+    op.key = copyNodeKey(*key);
+    SYSCN(op.value, (uint8_t*)malloc(len), "Error allocating forest value");
+    memcpy(op.value, value, len);
+    op.valueLength = len;
+
+    pthread_mutex_lock(&S->lock);
+    while (S->count == FOREST_QUEUE_SIZE) pthread_cond_wait(&S->notFull, &S->lock);
+    S->ops[(S->head + S->count) % FOREST_QUEUE_SIZE] = op;
+    S->count++;
+    pthread_cond_signal(&S->notEmpty);
+    pthread_mutex_unlock(&S->lock);
+}
+
+// Ricalcola i livelli della commitment superiore: il livello k (dal basso) ha 16^(topDepth-k) slot
+static void updateTopLayers(Forest* F) {
+    for (size_t i = 0; i < F->shardCount; i++) F->topLayers[0][i] = F->shards[i].rootDigest;
+
+    size_t w = 1;
+    for (size_t i = 0; i < F->topDepth; i++) w *= 16;
+    for (size_t k = 1; k <= F->topDepth; k++) {
+        w /= 16;
+        HashValue* prev = F->topLayers[k - 1];
+        for (size_t g = 0; g < w; g++) {
+            keccak_256(F->topLayers[k][g].hash_bytes, (uint8_t*)&prev[g * 16], 16 * sizeof(HashValue));
+        }
+    }
+}
+
+HashValue forestSync(Forest* F) {
+    if (F->threaded) {
+        // Prima si avvisano tutti gli shard, poi si attende: le root sono calcolate in parallelo
+        for (size_t i = 0; i < F->shardCount; i++) {
+            ForestShard* S = &F->shards[i];
+            pthread_mutex_lock(&S->lock);
+            S->syncRequested = true;
+            pthread_cond_signal(&S->notEmpty);
+            pthread_mutex_unlock(&S->lock);
+        }
+        for (size_t i = 0; i < F->shardCount; i++) {
+            ForestShard* S = &F->shards[i];
+            pthread_mutex_lock(&S->lock);
+            while (S->syncRequested) pthread_cond_wait(&S->drained, &S->lock);
+            pthread_mutex_unlock(&S->lock);
+        }
+    } else {
+        for (size_t i = 0; i < F->shardCount; i++) {
+            F->shards[i].rootDigest = computeInternalHash(F->shards[i].root);
+        }
+    }
+
+    updateTopLayers(F);
+    F->globalRoot = F->topLayers[F->topDepth][0];
+    F->synced = true;
+    return F->globalRoot;
+}
+
+bool forestGenerateProof(Forest* F, NodeKey* key, uint32_t contractId, ForestProof* FP) {
+    if (F == NULL || key == NULL || FP == NULL) return false;
+
+    memset(FP, 0, sizeof(ForestProof));
+    if (!F->synced) {
+        fprintf(stderr, "Error: forest proof requested before forestSync\n");
+        return false;
+    }
+
+    FP->shard = forestShardOf(F, key, contractId);
+    FP->shardRoot = F->shards[FP->shard].rootDigest;
+    FP->topDepth = F->topDepth;
+
+    if (!generateProof(F->shards[FP->shard].root, key, &FP->proof)) return false;
+
+    // Il prefisso è costruito come una Proof: si aggiungono i livelli dalla root globale verso il basso
+    Proof top = {0};
+    for (size_t k = F->topDepth; k-- > 0; ) {
+        HashValue* layer = F->topLayers[k];
+        size_t pos = FP->shard;
+        for (size_t i = 0; i < k; i++) pos >>= 4;
+        size_t base = pos & ~(size_t)0xF;
+
+        LevelSibling* level = addLevel(&top);
+        for (size_t i = 0; i < 16; i++) {
+            if (base + i == pos) continue;
+            if (memcmp(&layer[base + i], &default_hash, sizeof(HashValue)) == 0) continue;
+            addSibling(&level, i, layer[base + i]);
+        }
+    }
+    FP->topLevels = top.levels;
+    return true;
+}
+
+HashValue computeForestRoot(NodeKey* key, ForestProof* FP, HashValue leafStart) {
+    HashValue current = computeProofRoot(key, &FP->proof, leafStart);
+
+    size_t pos = FP->shard;
+    for (LevelSibling* level = FP->topLevels; level != NULL; level = level->next) {
+        current = computeLevelHash(level, pos & 0xF, current);
+        pos >>= 4;
+    }
+    return current;
+}
+
+bool verifyForestProof(NodeKey* key, ForestProof* FP, HashValue globalRoot) {
+    if (FP == NULL) return false;
+
+    if (!verifyProof(key, &FP->proof, FP->shardRoot)) return false;
+
+    size_t levels = 0;
+    for (LevelSibling* level = FP->topLevels; level != NULL; level = level->next) levels++;
+    if (levels != FP->topDepth) return false;
+
+    HashValue current = FP->shardRoot;
+    size_t pos = FP->shard;
+    for (LevelSibling* level = FP->topLevels; level != NULL; level = level->next) {
+        current = computeLevelHash(level, pos & 0xF, current);
+        pos >>= 4;
+    }
+    return memcmp(&current, &globalRoot, sizeof(HashValue)) == 0;
+}
+
+void freeForestProof(ForestProof* FP) {
+    if (FP == NULL) return;
+    freeProof(&FP->proof);
+    Proof top = {0};
+    top.levels = FP->topLevels;
+    freeProof(&top);
+    FP->topLevels = NULL;
+}
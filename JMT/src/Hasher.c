@@ -0,0 +1,94 @@
+// Le funzioni SHA256_* sono deprecate in OpenSSL 3 ma evitano l'allocazione di un EVP_MD_CTX per digest
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "Hasher.h"
+
+static const uint8_t zeros[64] = {0};
+
+static void keccakInit(JMTHashCtx* ctx) {
+    keccak_256_init(&ctx->keccak);
+}
+
+static void keccakAbsorb(JMTHashCtx* ctx, const uint8_t* in, size_t len) {
+    keccak_256_absorb(&ctx->keccak, in, len);
+}
+
+static void keccakAbsorbByte(JMTHashCtx* ctx, uint8_t b) {
+    keccak_256_absorb_byte(&ctx->keccak, b);
+}
+
+static void keccakAbsorbZeros(JMTHashCtx* ctx, size_t len) {
+    keccak_256_absorb_zeros(&ctx->keccak, len);
+}
+
+static void keccakFinal(JMTHashCtx* ctx, uint8_t* out) {
+    keccak_256_final(&ctx->keccak, out);
+}
+
+static void sha256Init(JMTHashCtx* ctx) {
+    SHA256_Init(&ctx->sha256);
+}
+
+static void sha256Absorb(JMTHashCtx* ctx, const uint8_t* in, size_t len) {
+    SHA256_Update(&ctx->sha256, in, len);
+}
+
+static void sha256AbsorbByte(JMTHashCtx* ctx, uint8_t b) {
+    SHA256_Update(&ctx->sha256, &b, 1);
+}
+
+static void sha256AbsorbZeros(JMTHashCtx* ctx, size_t len) {
+    while (len > 0) {
+        size_t n = len < sizeof(zeros) ? len : sizeof(zeros);
+        SHA256_Update(&ctx->sha256, zeros, n);
+        len -= n;
+    }
+}
+
+static void sha256Final(JMTHashCtx* ctx, uint8_t* out) {
+    SHA256_Final(out, &ctx->sha256);
+}
+
+const JMTHasher jmtKeccak256 = {
+    JMT_HASH_KECCAK256, "keccak256",
+    keccakInit, keccakAbsorb, keccakAbsorbByte, keccakAbsorbZeros, keccakFinal,
+    {0xd5, 0xc4, 0x4f, 0x65, 0x97, 0x51, 0xa8, 0x19, 0x61, 0x6c, 0x58, 0xc9, 0xef, 0xe3, 0x8e, 0x80,
+     0xf2, 0xb8, 0x4c, 0xf6, 0x21, 0x03, 0x6d, 0xa9, 0x9c, 0x01, 0x9b, 0xbe, 0x4f, 0x1f, 0xb6, 0x47}
+};
+
+const JMTHasher jmtSha256 = {
+    JMT_HASH_SHA256, "sha256",
+    sha256Init, sha256Absorb, sha256AbsorbByte, sha256AbsorbZeros, sha256Final,
+    {0x07, 0x6a, 0x27, 0xc7, 0x9e, 0x5a, 0xce, 0x2a, 0x3d, 0x47, 0xf9, 0xdd, 0x2e, 0x83, 0xe4, 0xff,
+     0x6e, 0xa8, 0x87, 0x2b, 0x3c, 0x22, 0x18, 0xf6, 0x6c, 0x92, 0xb8, 0x9b, 0x55, 0xf3, 0x65, 0x60}
+};
+
+_Thread_local const JMTHasher* jmtCurrentHasher = &jmtKeccak256;
+
+const JMTHasher* jmtUseHasher(const JMTHasher* h) {
+    const JMTHasher* prev = jmtCurrentHasher;
+    jmtCurrentHasher = h != NULL ? h : &jmtKeccak256;
+    return prev;
+}
+
+const JMTHasher* jmtHasherByName(const char* name) {
+    if (name == NULL) return NULL;
+    if (strcmp(name, jmtKeccak256.name) == 0 || strcmp(name, "keccak") == 0) return &jmtKeccak256;
+    if (strcmp(name, jmtSha256.name) == 0 || strcmp(name, "sha-256") == 0) return &jmtSha256;
+    return NULL;
+}
+
+void jmtHash(uint8_t* out, const uint8_t* in, size_t len) {
+    const JMTHasher* h = jmtCurrentHasher;
+    if (h->kind == JMT_HASH_KECCAK256) {
+        keccak_256(out, in, len);
+        return;
+    }
+    JMTHashCtx ctx;
+    h->init(&ctx);
+    h->absorb(&ctx, in, len);
+    h->final(&ctx, out);
+}
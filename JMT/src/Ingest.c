@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include "macros.h"
+#include "Ingest.h"
+#include "EventLog.h"
+
+// Legge un intero decimale; il terminatore (',' '\r' '\n') non è una cifra e ferma il ciclo
+static inline const uint8_t* scanUint(const uint8_t* p, uint64_t* out, int* digits) {
+    const uint8_t* s = p;
+    uint64_t v = 0;
+    uint8_t d;
+    while ((d = (uint8_t)(*p - '0')) < 10) {
+        v = v * 10 + d;
+        p++;
+    }
+    *digits = (int)(p - s);
+    *out = v;
+    return p;
+}
+
+// Ritorna il numero di colonne lette, oppure -1 se la riga non è valida
+static int parseLine(const uint8_t* p, const uint8_t* nl, EventRecord* ev) {
+    uint64_t cols[INGEST_COLUMNS];
+    int n = 0;
+
+    for (;;) {
+        int digits;
+        uint64_t v;
+        p = scanUint(p, &v, &digits);
+        if (digits == 0 || digits > 19) return -1;
+        if (n < INGEST_COLUMNS) cols[n] = v;
+        n++;
+
+        if (*p == ',') {
+            p++;
+            continue;
+        }
+        if (*p == '\r') p++;
+        if (p != nl) return -1;
+        break;
+    }
+
+    if (n != INGEST_COLUMNS) return n;
+    for (int i = 0; i < INGEST_COLUMNS - 1; i++) {
+        if (cols[i] > UINT32_MAX) return -1;
+    }
+
+    ev->blockId = (uint32_t)cols[0];
+    ev->timestamp = (uint32_t)cols[1];
+    ev->contractId = (uint32_t)cols[2];
+    ev->fromId = (uint32_t)cols[3];
+    ev->toId = (uint32_t)cols[4];
+    ev->reserved = 0;
+    ev->tokenId = cols[5];
+    return n;
+}
+
+// Sposta i dati non consumati in testa e legge un nuovo blocco dal file
+static size_t refill(CsvReader* r) {
+    size_t rem = r->end - r->start;
+    if (r->start > 0) {
+        memmove(r->buf, r->buf + r->start, rem);
+        r->bufOffset += r->start;
+        r->start = 0;
+        r->end = rem;
+    }
+
+    size_t got = 0;
+    while (r->end < INGEST_CHUNK_SIZE) {
+        ssize_t n = read(r->fd, r->buf + r->end, INGEST_CHUNK_SIZE - r->end);
+        if (n < 0) {
+            perror("Errore lettura CSV");
+            exit(errno);
+        }
+        if (n == 0) {
+            r->eof = true;
+            break;
+        }
+        r->end += (size_t)n;
+        got += (size_t)n;
+    }
+    return got;
+}
+
+// Consuma i byte fino al prossimo '\n' compreso, anche oltre la fine del blocco corrente
+static void skipLine(CsvReader* r) {
+    for (;;) {
+        uint8_t* nl = memchr(r->buf + r->start, '\n', r->end - r->start);
+        if (nl != NULL) {
+            r->start = (size_t)(nl - r->buf) + 1;
+            return;
+        }
+        r->start = r->end;
+        if (r->eof) return;
+        refill(r);
+    }
+}
+
+CsvReader* csvOpen(const char* path, uint64_t startOffset) {
+    CsvReader* r;
+    SYSCN(r, (CsvReader*)calloc(1, sizeof(CsvReader)), "Error allocating CSV reader");
+
+    r->fd = open(path, O_RDONLY);
+    if (r->fd == -1) {
+        free(r);
+        return NULL;
+    }
+    posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Un byte in più per il terminatore sentinella dell'ultima riga
+    SYSCN(r->buf, (uint8_t*)malloc(INGEST_CHUNK_SIZE + 1), "Error allocating CSV buffer");
+
+    if (startOffset > 0) {
+        SYS(lseek(r->fd, (off_t)startOffset, SEEK_SET), "Error seeking CSV");
+        r->bufOffset = startOffset;
+    } else {
+        // Salta l'intestazione
+        skipLine(r);
+    }
+    return r;
+}
+
+int csvNext(CsvReader* r, EventRecord* ev) {
+    for (;;) {
+        uint8_t* line = r->buf + r->start;
+        uint8_t* nl = memchr(line, '\n', r->end - r->start);
+
+        if (nl == NULL) {
+            if (!r->eof) {
+                if (r->start == 0 && r->end == INGEST_CHUNK_SIZE) {
+                    // Riga più lunga dell'intero blocco: viene scartata
+                    skipLine(r);
+                    r->lineNum++;
+                    r->malformed++;
+                    fprintf(stderr, "❌ Riga %lu troppo lunga, ignorata\n", r->lineNum);
+                } else {
+                    refill(r);
+                }
+                continue;
+            }
+            if (r->start == r->end) return 0;
+            // Ultima riga senza '\n' finale
+            nl = r->buf + r->end;
+            *nl = '\n';
+            r->end++;
+        }
+
+        r->start = (size_t)(nl - r->buf) + 1;
+        r->lineNum++;
+        if (nl == line || (nl == line + 1 && *line == '\r')) continue;
+
+        int cols = parseLine(line, nl, ev);
+        if (cols == INGEST_COLUMNS) return 1;
+
+        r->malformed++;
+        if (cols < 0) {
+            fprintf(stderr, "❌ Riga %lu malformata: %.*s\n", r->lineNum, (int)(nl - line), (char*)line);
+        } else {
+            fprintf(stderr, "❌ Riga %lu malformata (%d campi): %.*s\n", r->lineNum, cols, (int)(nl - line), (char*)line);
+        }
+    }
+}
+
+uint64_t csvOffset(CsvReader* r) {
+    return r->bufOffset + r->start;
+}
+
+void csvClose(CsvReader* r) {
+    if (r == NULL) return;
+    close(r->fd);
+    free(r->buf);
+    free(r);
+}
+
+bool ringPush(EventRing* ring, const EventRecord* ev, uint64_t end) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == INGEST_RING_SIZE) {
+        if (atomic_load_explicit(&ring->cancelled, memory_order_relaxed)) return false;
+        sched_yield();
+    }
+    ring->slots[tail % INGEST_RING_SIZE] = *ev;
+    ring->ends[tail % INGEST_RING_SIZE] = end;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool ringPop(EventRing* ring, EventRecord* ev, uint64_t* end) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    for (;;) {
+        if (head != atomic_load_explicit(&ring->tail, memory_order_acquire)) break;
+        if (atomic_load_explicit(&ring->done, memory_order_acquire)) {
+            // Ricontrolla: il produttore può aver pubblicato l'ultimo record prima di done
+            if (head == atomic_load_explicit(&ring->tail, memory_order_acquire)) return false;
+            break;
+        }
+        sched_yield();
+    }
+    *ev = ring->slots[head % INGEST_RING_SIZE];
+    *end = ring->ends[head % INGEST_RING_SIZE];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+static void* producerMain(void* arg) {
+    IngestPipeline* p = (IngestPipeline*)arg;
+    EventRecord ev;
+    while (csvNext(p->reader, &ev)) {
+        if (ev.blockId < p->fromBlock) continue;
+        if (!ringPush(&p->ring, &ev, csvOffset(p->reader))) break;
+    }
+    atomic_store_explicit(&p->ring.done, true, memory_order_release);
+    return NULL;
+}
+
+// startOffset è un offset in byte per il CSV e un indice di record per l'event log
+IngestPipeline* ingestStart(const char* path, uint64_t startOffset, uint32_t fromBlock) {
+    IngestPipeline* p;
+    SYSCN(p, (IngestPipeline*)calloc(1, sizeof(IngestPipeline)), "Error allocating ingest pipeline");
+    p->fromBlock = fromBlock;
+    p->position = startOffset;
+
+    if (isEventLog(path)) {
+        p->log = eventLogOpen(path);
+        if (p->log == NULL) {
+            free(p);
+            return NULL;
+        }
+        uint64_t first = eventLogSeekBlock(p->log, fromBlock);
+        EventLogCursor c = eventLogCursorAt(p->log, first > startOffset ? first : startOffset);
+        p->logGroup = c.group;
+        p->logSlot = c.slot;
+        return p;
+    }
+
+    p->reader = csvOpen(path, startOffset);
+    if (p->reader == NULL) {
+        free(p);
+        return NULL;
+    }
+    atomic_init(&p->ring.head, 0);
+    atomic_init(&p->ring.tail, 0);
+    atomic_init(&p->ring.done, false);
+    atomic_init(&p->ring.cancelled, false);
+
+    SUCC0(pthread_create(&p->producer, NULL, producerMain, p), "Error starting CSV parser thread");
+    return p;
+}
+
+bool ingestNext(IngestPipeline* p, EventRecord* ev) {
+    if (p->log != NULL) {
+        EventLogCursor c = {p->logGroup, p->logSlot};
+        bool ok = eventLogNext(p->log, &c, ev);
+        p->logGroup = c.group;
+        p->logSlot = c.slot;
+        if (ok) p->position = c.group < p->log->header->groupCount ? p->log->index[c.group].firstRecord + c.slot
+                                                                    : p->log->header->recordCount;
+        return ok;
+    }
+    return ringPop(&p->ring, ev, &p->position);
+}
+
+uint64_t ingestPosition(const IngestPipeline* p) {
+    return p->position;
+}
+
+void ingestStop(IngestPipeline* p) {
+    if (p == NULL) return;
+    if (p->log != NULL) {
+        eventLogClose(p->log);
+        free(p);
+        return;
+    }
+    atomic_store_explicit(&p->ring.cancelled, true, memory_order_relaxed);
+    pthread_join(p->producer, NULL);
+    if (p->reader->malformed > 0) {
+        fprintf(stderr, "⚠️ %lu righe malformate ignorate\n", p->reader->malformed);
+    }
+    csvClose(p->reader);
+    free(p);
+}
@@ -0,0 +1,217 @@
+#include "Instrument.h"
+
+#ifdef JMT_INSTRUMENT
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include "macros.h"
+
+const char* instrCounterNames[INSTR_COUNTERS] = {
+    "keccak_calls", "keccak_bytes", "node_allocs", "node_frees", "proof_levels",
+    "proof_siblings", "digest_hits", "digest_rehashes", "proof_cache_hits", "proof_cache_misses"
+};
+const char* instrOpNames[INSTR_OPS] = {
+    "insert", "lookup", "delete", "generate_proof", "verify_proof", "compute_hash", "commit", "update", "compact"
+};
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sumNs;
+    _Atomic uint64_t maxNs;
+    _Atomic uint64_t buckets[INSTR_BUCKETS];
+} AtomicHistogram;
+
+_Atomic uint64_t instrCounters[INSTR_COUNTERS];
+static AtomicHistogram histograms[INSTR_OPS];
+
+static inline size_t bucketOf(uint64_t v) {
+    if (v < INSTR_SUB_BUCKETS) return (size_t)v;
+    int msb = 63 - __builtin_clzll(v);
+    return (size_t)(msb - 3) * INSTR_SUB_BUCKETS + ((v >> (msb - 4)) & (INSTR_SUB_BUCKETS - 1));
+}
+
+static inline uint64_t bucketLow(size_t b) {
+    if (b < INSTR_SUB_BUCKETS) return b;
+    int msb = (int)(b / INSTR_SUB_BUCKETS) + 3;
+    return (uint64_t)(INSTR_SUB_BUCKETS + b % INSTR_SUB_BUCKETS) << (msb - 4);
+}
+
+void instrRecord(InstrOp op, uint64_t ns) {
+    AtomicHistogram* h = &histograms[op];
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sumNs, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->buckets[bucketOf(ns)], 1, memory_order_relaxed);
+
+    uint64_t prev = atomic_load_explicit(&h->maxNs, memory_order_relaxed);
+    while (ns > prev &&
+           !atomic_compare_exchange_weak_explicit(&h->maxNs, &prev, ns, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// I campi sono letti uno per uno: la fotografia non è atomica rispetto alle operazioni in corso
+void jmtStatsSnapshot(JMTStatsSnapshot* out) {
+    for (size_t c = 0; c < INSTR_COUNTERS; c++) {
+        out->counters[c] = atomic_load_explicit(&instrCounters[c], memory_order_relaxed);
+    }
+    for (size_t op = 0; op < INSTR_OPS; op++) {
+        AtomicHistogram* h = &histograms[op];
+        out->ops[op].count = atomic_load_explicit(&h->count, memory_order_relaxed);
+        out->ops[op].sumNs = atomic_load_explicit(&h->sumNs, memory_order_relaxed);
+        out->ops[op].maxNs = atomic_load_explicit(&h->maxNs, memory_order_relaxed);
+        for (size_t b = 0; b < INSTR_BUCKETS; b++) {
+            out->ops[op].buckets[b] = atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        }
+    }
+}
+
+void jmtStatsReset(void) {
+    for (size_t c = 0; c < INSTR_COUNTERS; c++) atomic_store(&instrCounters[c], 0);
+    for (size_t op = 0; op < INSTR_OPS; op++) {
+        AtomicHistogram* h = &histograms[op];
+        atomic_store(&h->count, 0);
+        atomic_store(&h->sumNs, 0);
+        atomic_store(&h->maxNs, 0);
+        for (size_t b = 0; b < INSTR_BUCKETS; b++) atomic_store(&h->buckets[b], 0);
+    }
+}
+
+// Limite inferiore del bucket che contiene il quantile q, limitato dal massimo osservato
+uint64_t jmtStatsPercentile(const InstrHistogram* h, double q) {
+    uint64_t total = 0;
+    for (size_t b = 0; b < INSTR_BUCKETS; b++) total += h->buckets[b];
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(q * (double)total);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < INSTR_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen > rank) {
+            uint64_t v = bucketLow(b);
+            return v < h->maxNs ? v : h->maxNs;
+        }
+    }
+    return h->maxNs;
+}
+
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+static const char* quantileNames[] = {"p50_ns", "p90_ns", "p99_ns", "p999_ns"};
+
+static void writeJson(FILE* f, const JMTStatsSnapshot* s) {
+    fprintf(f, "{\n  \"counters\": {");
+    for (size_t c = 0; c < INSTR_COUNTERS; c++) {
+        fprintf(f, "%s\n    \"%s\": %lu", c ? "," : "", instrCounterNames[c], s->counters[c]);
+    }
+    fprintf(f, "\n  },\n  \"ops\": {");
+    for (size_t op = 0; op < INSTR_OPS; op++) {
+        const InstrHistogram* h = &s->ops[op];
+        fprintf(f, "%s\n    \"%s\": {\"count\": %lu, \"sum_ns\": %lu, \"max_ns\": %lu",
+                op ? "," : "", instrOpNames[op], h->count, h->sumNs, h->maxNs);
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            fprintf(f, ", \"%s\": %lu", quantileNames[q], jmtStatsPercentile(h, quantiles[q]));
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n  }\n}\n");
+}
+
+static void writePrometheus(FILE* f, const JMTStatsSnapshot* s) {
+    for (size_t c = 0; c < INSTR_COUNTERS; c++) {
+        fprintf(f, "# TYPE jmt_%s_total counter\njmt_%s_total %lu\n",
+                instrCounterNames[c], instrCounterNames[c], s->counters[c]);
+    }
+    fprintf(f, "# TYPE jmt_op_latency_seconds summary\n");
+    for (size_t op = 0; op < INSTR_OPS; op++) {
+        const InstrHistogram* h = &s->ops[op];
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            fprintf(f, "jmt_op_latency_seconds{op=\"%s\",quantile=\"%g\"} %.9f\n",
+                    instrOpNames[op], quantiles[q], jmtStatsPercentile(h, quantiles[q]) / 1e9);
+        }
+        fprintf(f, "jmt_op_latency_seconds_sum{op=\"%s\"} %.9f\n", instrOpNames[op], h->sumNs / 1e9);
+        fprintf(f, "jmt_op_latency_seconds_count{op=\"%s\"} %lu\n", instrOpNames[op], h->count);
+    }
+}
+
+void jmtStatsWrite(FILE* f, JMTStatsFormat format) {
+    JMTStatsSnapshot* s;
+    SYSCN(s, (JMTStatsSnapshot*)malloc(sizeof(JMTStatsSnapshot)), "Error allocating stats snapshot");
+    jmtStatsSnapshot(s);
+    if (format == JMT_STATS_PROMETHEUS) writePrometheus(f, s);
+    else writeJson(f, s);
+    free(s);
+}
+
+// Dump periodico: il file viene riscritto per intero e sostituito con rename, mai letto a metà
+static struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool running;
+    bool stop;
+    char* path;
+    char* tmpPath;
+    JMTStatsFormat format;
+    unsigned intervalMs;
+} dumper = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER};
+
+static void dumpOnce(void) {
+    FILE* f = fopen(dumper.tmpPath, "w");
+    if (f == NULL) {
+        perror("Error writing stats dump");
+        return;
+    }
+    jmtStatsWrite(f, dumper.format);
+    fclose(f);
+    if (rename(dumper.tmpPath, dumper.path) != 0) perror("Error replacing stats dump");
+}
+
+static void* dumperMain(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&dumper.lock);
+    while (!dumper.stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += dumper.intervalMs / 1000;
+        deadline.tv_nsec += (long)(dumper.intervalMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        int rc = 0;
+        while (!dumper.stop && rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&dumper.wake, &dumper.lock, &deadline);
+        }
+        dumpOnce();
+    }
+    pthread_mutex_unlock(&dumper.lock);
+    return NULL;
+}
+
+bool jmtStatsStartDump(const char* path, JMTStatsFormat format, unsigned intervalMs) {
+    if (dumper.running) return false;
+    SYSCN(dumper.path, strdup(path), "Error allocating stats path");
+    SYSCN(dumper.tmpPath, (char*)malloc(strlen(path) + 5), "Error allocating stats path");
+    sprintf(dumper.tmpPath, "%s.tmp", path);
+    dumper.format = format;
+    dumper.intervalMs = intervalMs ? intervalMs : 1000;
+    dumper.stop = false;
+    SUCC0(pthread_create(&dumper.thread, NULL, dumperMain, NULL), "Error starting stats dump thread");
+    dumper.running = true;
+    return true;
+}
+
+// Ferma il thread dopo un ultimo dump con i valori finali
+void jmtStatsStopDump(void) {
+    if (!dumper.running) return;
+    pthread_mutex_lock(&dumper.lock);
+    dumper.stop = true;
+    pthread_cond_signal(&dumper.wake);
+    pthread_mutex_unlock(&dumper.lock);
+    pthread_join(dumper.thread, NULL);
+    free(dumper.path);
+    free(dumper.tmpPath);
+    dumper.running = false;
+}
+
+#endif // JMT_INSTRUMENT
@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "keccak-tiny.h"
+#include "macros.h"
+#include "Iterator.h"
+
+// Ordine lessicografico per nibble; a parità di prefisso la chiave più corta viene prima
+int compareKeys(const NodeKey* a, const NodeKey* b) {
+    size_t la = a->nibble_path.nibblesLength, lb = b->nibble_path.nibblesLength;
+    size_t n = la < lb ? la : lb;
+
+    // I nibble sono impacchettati dal più significativo: i byte interi si confrontano con memcmp
+    int c = memcmp(a->nibble_path.nibbles, b->nibble_path.nibbles, n / 2);
+    if (c != 0) return c < 0 ? -1 : 1;
+    for (size_t i = n & ~(size_t)1; i < n; i++) {
+        uint8_t na = getNibble(a->nibble_path.nibbles, i), nb = getNibble(b->nibble_path.nibbles, i);
+        if (na != nb) return na < nb ? -1 : 1;
+    }
+    return (la > lb) - (la < lb);
+}
+
+// Confronta un prefisso (un nibble per byte) con i primi len nibble di key
+static int comparePrefix(const uint8_t* path, size_t len, const NodeKey* key) {
+    size_t n = len < key->nibble_path.nibblesLength ? len : key->nibble_path.nibblesLength;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t k = getNibble(key->nibble_path.nibbles, i);
+        if (path[i] != k) return path[i] < k ? -1 : 1;
+    }
+    return 0;
+}
+
+// Il sottoalbero con questo prefisso non contiene chiavi in [lo, hi]
+static inline bool outsideRange(const uint8_t* path, size_t len, const NodeKey* lo, const NodeKey* hi) {
+    return comparePrefix(path, len, lo) < 0 || comparePrefix(path, len, hi) > 0;
+}
+
+static inline bool inRange(const NodeKey* key, const NodeKey* lo, const NodeKey* hi) {
+    return compareKeys(key, lo) >= 0 && compareKeys(key, hi) <= 0;
+}
+
+typedef enum { LEAF_OUTSIDE, LEAF_INSIDE, LEAF_UNDECIDED } LeafRange;
+
+/*
+ * Posizione rispetto a [lo, hi] di una foglia a profondità depth, secondo i soli nibble che la root vincola:
+ * il percorso fino a depth e quelli coperti dall'hash della foglia (da leafHashStart). I nibble in mezzo
+ * (la version, o il percorso delle chiavi hashed) possono essere riscritti senza cambiare la root: le chiavi
+ * possibili stanno tra quella con quei nibble a 0 e quella con quei nibble a F, e se l'intervallo le separa
+ * la foglia non si può classificare.
+ */
+static LeafRange leafRange(const NodeKey* key, size_t depth, const NodeKey* lo, const NodeKey* hi) {
+    size_t end = leafHashStart(key);
+    if (end > key->nibble_path.nibblesLength) end = key->nibble_path.nibblesLength;
+    if (depth >= end) return inRange(key, lo, hi) ? LEAF_INSIDE : LEAF_OUTSIDE;
+
+    NodeKey min = copyNodeKey(*key), max = copyNodeKey(*key);
+    for (size_t i = depth; i < end; i++) {
+        setNibble(min.nibble_path.nibbles, i, 0);
+        setNibble(max.nibble_path.nibbles, i, 0xF);
+    }
+    LeafRange r = LEAF_UNDECIDED;
+    if (compareKeys(&max, lo) < 0 || compareKeys(&min, hi) > 0) r = LEAF_OUTSIDE;
+    else if (compareKeys(&min, lo) >= 0 && compareKeys(&max, hi) <= 0) r = LEAF_INSIDE;
+    free(min.nibble_path.nibbles);
+    free(max.nibble_path.nibbles);
+    return r;
+}
+
+
+void jmtIterInit(JMTIterator* it, InternalNode* root) {
+    it->root = root;
+    it->leaf = NULL;
+    it->hi = NULL;
+    it->depth = 0;
+    if (root != NULL) {
+        it->stack[0] = (JMTIterFrame){root, 0};
+        it->depth = 1;
+    }
+}
+
+void jmtIterSeek(JMTIterator* it, NodeKey* key) {
+    it->leaf = NULL;
+    it->depth = 0;
+    if (it->root == NULL) return;
+    it->stack[0] = (JMTIterFrame){it->root, 0};
+    it->depth = 1;
+
+    // Scende lungo la chiave: ogni frame riprende dal primo slot che può contenere chiavi >= key
+    for (size_t d = 0; ; d++) {
+        JMTIterFrame* f = &it->stack[it->depth - 1];
+        if (d >= key->nibble_path.nibblesLength) return;
+
+        uint8_t nib = getNibble(key->nibble_path.nibbles, d);
+        ChildNode* child = f->node->children[nib];
+        if (child == NULL) {
+            f->next = nib + 1;
+            return;
+        }
+        if (child->isLeaf) {
+            f->next = compareKeys(&child->node.leaf->leafKey, key) >= 0 ? nib : nib + 1;
+            return;
+        }
+        f->next = nib + 1;
+        it->stack[it->depth++] = (JMTIterFrame){childInternal(child), 0};
+    }
+}
+
+void jmtIterRange(JMTIterator* it, InternalNode* root, NodeKey* lo, NodeKey* hi) {
+    jmtIterInit(it, root);
+    jmtIterSeek(it, lo);
+    it->hi = hi;
+}
+
+bool jmtIterNext(JMTIterator* it) {
+    while (it->depth > 0) {
+        JMTIterFrame* f = &it->stack[it->depth - 1];
+        InternalNode* node = f->node;
+
+        ChildNode* child = NULL;
+        while (f->next < 16 && (child = node->children[f->next++]) == NULL) {
+        }
+        if (child == NULL) {
+            it->depth--;
+            continue;
+        }
+
+        // Il prossimo fratello non vuoto è il figlio letto subito dopo questo sottoalbero
+        for (uint8_t j = f->next; j < 16; j++) {
+            if (node->children[j] != NULL) {
+                __builtin_prefetch(node->children[j]);
+                break;
+            }
+        }
+
+        if (child->isLeaf) {
+            LeafNode* leaf = child->node.leaf;
+            if (leaf->tombstone) continue;
+            if (it->hi != NULL && compareKeys(&leaf->leafKey, it->hi) > 0) break;
+            it->leaf = leaf;
+            return true;
+        }
+
+        InternalNode* inner = childInternal(child);
+        __builtin_prefetch(inner);
+        it->stack[it->depth++] = (JMTIterFrame){inner, 0};
+    }
+
+    it->depth = 0;
+    it->leaf = NULL;
+    return false;
+}
+
+
+static RangeEntry* pushEntry(RangeProof* rp, uint8_t type, uint8_t index) {
+    if (rp->count == rp->capacity) {
+        rp->capacity = rp->capacity ? rp->capacity * 2 : 64;
+        SYSCN(rp->entries, (RangeEntry*)realloc(rp->entries, rp->capacity * sizeof(RangeEntry)), "Error growing range proof");
+    }
+    RangeEntry* e = &rp->entries[rp->count++];
+    memset(e, 0, sizeof(*e));
+    e->type = type;
+    e->index = index;
+    return e;
+}
+
+bool generateRangeProof(InternalNode* root, NodeKey* lo, NodeKey* hi, RangeProof* out) {
+    memset(out, 0, sizeof(*out));
+    if (root == NULL || lo == NULL || hi == NULL || compareKeys(lo, hi) > 0) return false;
+
+    // I digest memorizzati devono essere aggiornati: i fratelli vengono letti direttamente dai nodi
+    computeInternalHash(root);
+
+    JMTIterFrame stack[JMT_INSPECT_LEVELS];
+    uint8_t path[JMT_INSPECT_LEVELS];
+    size_t depth = 0;
+
+    pushEntry(out, RANGE_OPEN, 0);
+    stack[depth++] = (JMTIterFrame){root, 0};
+
+    while (depth > 0) {
+        JMTIterFrame* f = &stack[depth - 1];
+        if (f->next == 16) {
+            pushEntry(out, RANGE_CLOSE, 0);
+            depth--;
+            continue;
+        }
+
+        uint8_t i = f->next++;
+        ChildNode* child = f->node->children[i];
+        if (child == NULL) continue;
+        path[depth - 1] = i;
+
+        if (outsideRange(path, depth, lo, hi)) {
+            RangeEntry* e = pushEntry(out, RANGE_SIBLING, i);
+            e->hash = *childHash(child);
+        } else if (child->isLeaf) {
+            LeafNode* leaf = child->node.leaf;
+            // Il verificatore rifiuterebbe la prova: la root non dice da che parte dell'intervallo sta la foglia
+            LeafRange where = leafRange(&leaf->leafKey, depth, lo, hi);
+            if (where == LEAF_UNDECIDED) {
+                fprintf(stderr, "Error: range bounds split the unhashed nibbles of a leaf at depth %zu\n", depth);
+                freeRangeProof(out);
+                return false;
+            }
+            RangeEntry* e = pushEntry(out, RANGE_LEAF, i);
+            e->key = copyNodeKey(leaf->leafKey);
+            SYSCN(e->value, (uint8_t*)malloc(leaf->valueLength ? leaf->valueLength : 1), "Error allocating range proof value");
+            memcpy(e->value, leafValue(leaf), leaf->valueLength);
+            e->valueLength = leaf->valueLength;
+            if (where == LEAF_INSIDE) out->leavesInRange++;
+        } else {
+            pushEntry(out, RANGE_OPEN, i);
+            stack[depth++] = (JMTIterFrame){childInternal(child), 0};
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    uint8_t slots[16 * sizeof(HashValue)];
+    uint8_t index;      // slot del nodo nel genitore
+    int last;           // ultimo slot riempito: gli slot devono comparire in ordine crescente
+} RangeFrame;
+
+// Registra lo slot della voce nel nodo corrente e ne aggiorna il prefisso
+static bool claimSlot(RangeFrame* f, uint8_t* path, size_t depth, uint8_t index) {
+    if (index > 15 || (int)index <= f->last) return false;
+    f->last = index;
+    path[depth - 1] = index;
+    return true;
+}
+
+bool verifyRangeProof(const RangeProof* rp, NodeKey* lo, NodeKey* hi, HashValue root, size_t* leavesInRange) {
+    if (rp == NULL || rp->count == 0 || rp->entries[0].type != RANGE_OPEN || compareKeys(lo, hi) > 0) return false;
+
+    RangeFrame* stack;
+    SYSCN(stack, (RangeFrame*)malloc(JMT_INSPECT_LEVELS * sizeof(RangeFrame)), "Error allocating range verifier");
+    uint8_t path[JMT_INSPECT_LEVELS];
+    size_t depth = 0;
+    size_t found = 0;
+    bool closed = false;
+    bool ok = true;
+    HashValue computed;
+
+    for (size_t k = 0; k < rp->count && ok; k++) {
+        const RangeEntry* e = &rp->entries[k];
+        if (closed || (depth == 0 && k > 0)) {
+            ok = false;
+            break;
+        }
+        RangeFrame* top = depth > 0 ? &stack[depth - 1] : NULL;
+
+        switch (e->type) {
+            case RANGE_OPEN:
+                if (top != NULL && !claimSlot(top, path, depth, e->index)) ok = false;
+                else if (depth == JMT_INSPECT_LEVELS) ok = false;
+                else {
+                    RangeFrame* f = &stack[depth++];
+                    memset(f->slots, 0, sizeof(f->slots));
+                    f->index = e->index;
+                    f->last = -1;
+                }
+                break;
+
+            case RANGE_SIBLING:
+                // Un digest opaco è ammesso solo se il suo sottoalbero non può contenere chiavi dell'intervallo
+                if (top == NULL || !claimSlot(top, path, depth, e->index) || !outsideRange(path, depth, lo, hi)) ok = false;
+                else memcpy(&top->slots[e->index * sizeof(HashValue)], e->hash.hash_bytes, sizeof(HashValue));
+                break;
+
+            case RANGE_LEAF: {
+                if (top == NULL || !claimSlot(top, path, depth, e->index) ||
+                    e->key.nibble_path.nibblesLength < depth || comparePrefix(path, depth, &e->key) != 0) {
+                    ok = false;
+                    break;
+                }
+                LeafRange where = leafRange(&e->key, depth, lo, hi);
+                if (where == LEAF_UNDECIDED) {
+                    ok = false;
+                    break;
+                }
+                HashValue h = computeLeafHash((NodeKey*)&e->key, e->value, e->valueLength);
+                memcpy(&top->slots[e->index * sizeof(HashValue)], h.hash_bytes, sizeof(HashValue));
+                if (where == LEAF_INSIDE) found++;
+                break;
+            }
+
+            case RANGE_CLOSE: {
+                if (top == NULL) {
+                    ok = false;
+                    break;
+                }
+                HashValue h;
+                jmtHash(h.hash_bytes, top->slots, sizeof(top->slots));
+                uint8_t index = top->index;
+                depth--;
+                if (depth == 0) {
+                    computed = h;
+                    closed = true;
+                } else {
+                    memcpy(&stack[depth - 1].slots[index * sizeof(HashValue)], h.hash_bytes, sizeof(HashValue));
+                }
+                break;
+            }
+
+            default:
+                ok = false;
+        }
+    }
+    free(stack);
+
+    ok = ok && closed && memcmp(&computed, &root, sizeof(HashValue)) == 0;
+    if (ok && leavesInRange != NULL) *leavesInRange = found;
+    return ok;
+}
+
+void freeRangeProof(RangeProof* rp) {
+    if (rp == NULL) return;
+    for (size_t k = 0; k < rp->count; k++) {
+        if (rp->entries[k].type != RANGE_LEAF) continue;
+        free(rp->entries[k].key.nibble_path.nibbles);
+        free(rp->entries[k].value);
+    }
+    free(rp->entries);
+    memset(rp, 0, sizeof(*rp));
+}
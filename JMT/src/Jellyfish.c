@@ -3,14 +3,31 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include <malloc.h>
 #include <openssl/sha.h>
 #include "keccak-tiny.h"
 #include "macros.h"
 #include "Jellyfish.h"
+#include "Instrument.h"
+#include "ValueLog.h"
+#include "NodeStore.h"
 #define maxLev 64
+
+// Versione marcata sugli slot modificati: jmtInsert/jmtDelete la impostano al prossimo commit dell'handle
+static _Thread_local uint32_t stampVersion;
+
+static void stampPath(InternalNode** stack, uint8_t* nibs, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        ChildNode* slot = stack[i]->children[nibs[i]];
+        if (slot != NULL) slot->version = stampVersion;
+    }
+}
 #define MAX_TOKEN_ID 100000000
 static uint32_t version = {0}; 
 static uint32_t versionMap[MAX_TOKEN_ID] = {0};
+// Blocchi di versionMap mai scritti restano a zero: i checkpoint visitano solo quelli marcati qui
+#define VERSION_MAP_BLOCK 65536
+static uint8_t versionMapTouched[MAX_TOKEN_ID / VERSION_MAP_BLOCK + 1] = {0};
 
 HashValue default_hash ={{0}};
 AncestryProof ancestryProof;
@@ -25,8 +42,9 @@ void printNibbles(const uint8_t* packed, size_t length) {
 
 NodeKey copyNodeKey(NodeKey original) {
     NodeKey copy = original;
-    copy.nibble_path.nibbles = malloc(original.nibble_path.nibblesLength);
-    memcpy(copy.nibble_path.nibbles, original.nibble_path.nibbles, original.nibble_path.nibblesLength);
+    size_t byteLen = (original.nibble_path.nibblesLength + 1) / 2;
+    SYSCN(copy.nibble_path.nibbles, (uint8_t*)malloc(byteLen), "Error allocating key copy");
+    memcpy(copy.nibble_path.nibbles, original.nibble_path.nibbles, byteLen);
     return copy;
 }
 
@@ -41,12 +59,14 @@ Proof deepCopyProof(Proof* src) {
 
     while (srcLvl) {
         LevelSibling* newLvl = malloc(sizeof(LevelSibling));
+        JMT_COUNT(INSTR_PROOF_LEVELS, 1);
         newLvl->siblings = NULL;
         newLvl->next = NULL;
 
         Sibling** sTail = &newLvl->siblings;
         for (Sibling* s = srcLvl->siblings; s != NULL; s = s->next) {
             Sibling* newSib = malloc(sizeof(Sibling));
+            JMT_COUNT(INSTR_PROOF_SIBLINGS, 1);
             newSib->index = s->index;
             newSib->hash = s->hash;
             newSib->next = NULL;
@@ -76,26 +96,93 @@ void setNibble(uint8_t* packedNibbles, size_t index, uint8_t val){
 }
 
 
+// Ricalcola i digest dei nodi sporchi del sottoalbero, visitando solo i rami sporchi
+static void refreshDigest(InternalNode* node, JMTStats* stats) {
+    if (!node->dirty) return;
+    for (size_t i = 0; i < 16; i++) {
+        ChildNode* child = node->children[i];
+        if (child != NULL && !child->isLeaf && !(child->flags & JMT_CHILD_EVICTED) && child->node.internal->dirty) {
+            refreshDigest(child->node.internal, stats);
+        }
+    }
+    node->digest = computeNodeDigest(node);
+    node->dirty = false;
+    JMT_COUNT(INSTR_DIGEST_REHASHES, 1);
+    if (stats) stats->digestRehashes++;
+}
+
+static const HashValue* childDigest(ChildNode* child, JMTStats* stats) {
+    // Un sottoalbero sfrattato ha il digest nello stub: non serve ricaricarlo
+    if (child->isLeaf || (child->flags & JMT_CHILD_EVICTED)) return childHash(child);
+
+    InternalNode* internal = child->node.internal;
+    if (internal->dirty) {
+        refreshDigest(internal, stats);
+    } else {
+        JMT_COUNT(INSTR_DIGEST_HITS, 1);
+        if (stats) stats->digestHits++;
+    }
+    return &internal->digest;
+}
+
 HashValue computeInternalHash(InternalNode* node) {
-    uint8_t buffer[16 * sizeof(HashValue)] = {0};
+    JMT_TIMED(INSTR_OP_COMPUTE_HASH);
+    refreshDigest(node, NULL);
+    return node->digest;
+}
+
+
+// Un solo keccak sui digest memorizzati nei figli, che devono essere aggiornati
+HashValue computeNodeDigest(InternalNode* node) {
+    const JMTHasher* H = jmtActiveHasher();
+    JMTHashCtx ctx;
     HashValue h;
 
+    // Gli slot vuoti valgono default_hash (tutti zeri): con keccak basta avanzare nel blocco
+    H->init(&ctx);
     for (size_t i = 0; i < 16; i++) {
-        HashValue childHash;
-        if (node->children[i] != NULL) {
-            if (node->children[i]->isLeaf) {
-                childHash = node->children[i]->node.leaf->leafDigest;
-            } else {
-                childHash = computeInternalHash(node->children[i]->node.internal);
-            }
-        } else {
-            childHash = default_hash;  // <-- Assicura coerenza!
+        ChildNode* child = node->children[i];
+        if (child == NULL) {
+            H->absorbZeros(&ctx, sizeof(HashValue));
+            continue;
         }
+        H->absorb(&ctx, childHash(child)->hash_bytes, sizeof(HashValue));
+    }
+
+    H->final(&ctx, h.hash_bytes);
+    return h;
+}
+
+
+// Input del keccak di un livello: 16 slot, fratelli e hash corrente nelle loro posizioni
+static inline void fillLevelBuffer(uint8_t* buffer, LevelSibling* level, uint8_t pos, const HashValue* current) {
+    memset(buffer, 0, 16 * sizeof(HashValue));
+    if (level != NULL) {
+        for (Sibling* S = level->siblings; S != NULL; S = S->next) {
+            memcpy(&buffer[S->index * sizeof(HashValue)], S->hash.hash_bytes, sizeof(HashValue));
+        }
+    }
+    memcpy(&buffer[pos * sizeof(HashValue)], current->hash_bytes, sizeof(HashValue));
+}
+
+HashValue computeLevelHash(LevelSibling* level, uint8_t pos, HashValue current) {
+    // I fratelli sono in ordine decrescente di indice: si raccolgono i puntatori per assorbirli in ordine di slot
+    const HashValue* slots[16] = {NULL};
+    if (level != NULL) {
+        for (Sibling* S = level->siblings; S != NULL; S = S->next) slots[S->index] = &S->hash;
+    }
+    slots[pos] = &current;
 
-        memcpy(&buffer[i * sizeof(HashValue)], childHash.hash_bytes, sizeof(HashValue));
+    const JMTHasher* H = jmtActiveHasher();
+    JMTHashCtx ctx;
+    H->init(&ctx);
+    for (size_t i = 0; i < 16; i++) {
+        if (slots[i] == NULL) H->absorbZeros(&ctx, sizeof(HashValue));
+        else H->absorb(&ctx, slots[i]->hash_bytes, sizeof(HashValue));
     }
 
-    keccak_256(h.hash_bytes, buffer, sizeof(buffer));
+    HashValue h;
+    H->final(&ctx, h.hash_bytes);
     return h;
 }
 
@@ -106,55 +193,21 @@ HashValue computeProofRoot(NodeKey* key, Proof* P, HashValue leafStart) {
     size_t depth = 0;
 
     if (!level) {
-        uint8_t buffer[16 * sizeof(HashValue)];
-        for (int i = 0; i < 16; i++) {
-            memcpy(&buffer[i * sizeof(HashValue)], default_hash.hash_bytes, sizeof(HashValue));
-        }
         uint8_t pos = getNibble(key->nibble_path.nibbles,P->depth-(depth+1));
-        memcpy(&buffer[pos * sizeof(HashValue)], current.hash_bytes, sizeof(HashValue));
-
-        keccak_256(current.hash_bytes, buffer, sizeof(buffer));
-        return current;
+        return computeLevelHash(NULL, pos, current);
     }
 
     while (level != NULL) {
-
-            uint8_t buffer[16 * sizeof(HashValue)];
-            for (int i = 0; i < 16; i++) {
-                memcpy(&buffer[i * sizeof(HashValue)], default_hash.hash_bytes, sizeof(HashValue));
-            }
-
-            Sibling* S = level->siblings;
-            while (S != NULL) {
-                memcpy(&buffer[S->index * sizeof(HashValue)], S->hash.hash_bytes, sizeof(HashValue));
-                S = S->next;
-            }
-
-            uint8_t pos = getNibble(key->nibble_path.nibbles, P->depth-(depth+1));
-            memcpy(&buffer[pos * sizeof(HashValue)], current.hash_bytes, sizeof(HashValue));
-
-            /*printf("  ➤ Buffer prima del keccak:\n");
-            for (int i = 0; i < 16; i++) {
-                printf("    [%02X]: ", i);
-                for (int j = 0; j < 32; j++) {
-                    printf("%02x", buffer[i * 32 + j]);
-                }
-                printf("\n");
-            }*/
-
-            keccak_256(current.hash_bytes, buffer, sizeof(buffer));
-            /*printf("  ➤ Hash calcolato dopo il livello %zu: ", depth);
-            printHash(current);
-            printf("\n");*/
-
-            level = level->next;
-            depth++;
-        }
+        uint8_t pos = getNibble(key->nibble_path.nibbles, P->depth-(depth+1));
+        current = computeLevelHash(level, pos, current);
+        level = level->next;
+        depth++;
+    }
 
     return current;
 }
 
-bool generateProof(InternalNode* root, NodeKey* key, Proof* P) {
+static bool generateProofImpl(InternalNode* root, NodeKey* key, Proof* P, JMTStats* stats) {
     if (root == NULL || key == NULL || P == NULL) return false;
 
     NibblePath* path = &key->nibble_path;
@@ -172,13 +225,7 @@ bool generateProof(InternalNode* root, NodeKey* key, Proof* P) {
 
         for (size_t i = 0; i < 16; i++) {
             if (i != nextNibble && current->children[i] != NULL) {
-                HashValue siblingHash;
-                if (current->children[i]->isLeaf) {
-                    siblingHash = current->children[i]->node.leaf->leafDigest;
-                } else {
-                    siblingHash = computeInternalHash(current->children[i]->node.internal);
-                }
-                addSibling(&level, i, siblingHash);
+                addSibling(&level, i, *childDigest(current->children[i], stats));
             }
         }
 
@@ -217,7 +264,7 @@ bool generateProof(InternalNode* root, NodeKey* key, Proof* P) {
                 return true;
             }
         } else {
-            current = child->node.internal;
+            current = childInternal(child);
             depth++;
         }
     }
@@ -225,62 +272,110 @@ bool generateProof(InternalNode* root, NodeKey* key, Proof* P) {
     return true; // path completo senza trovare nulla → esclusione
 }
 
+bool generateProof(InternalNode* root, NodeKey* key, Proof* P) {
+    JMT_TIMED(INSTR_OP_GENERATE_PROOF);
+    return generateProofImpl(root, key, P, NULL);
+}
 
 
-HashValue computeLeafHash(NodeKey* key, uint8_t* value, size_t len){
-    HashValue h;
-
-    size_t tokenNibbles = key->nibble_path.nibblesLength - 8;  // esclude i primi 8 nibble = version
-    uint8_t* expanded; 
-    SYSCN(expanded, (uint8_t*)malloc(tokenNibbles), "Error allocating for temporary nibble buffer");
-
-    for (size_t i = 0; i < tokenNibbles; i++) {
-        expanded[i] = getNibble(key->nibble_path.nibbles, i + 8);  // skip i primi 8
-    }
 
-    size_t totalLen = tokenNibbles + len;
-    uint8_t* input;
-    SYSCN(input, (uint8_t*)malloc(totalLen), "Error allocating for keccak input");
+size_t leafHashStart(const NodeKey* key) {
+    return isHashedKey(key) ? JMT_HASHED_PATH_NIBBLES + 8 : 8;
+}
 
-    memcpy(input, expanded, tokenNibbles);
-    memcpy(input + tokenNibbles, value, len);
+HashValue computeLeafHash(NodeKey* key, const uint8_t* value, size_t len){
+    const JMTHasher* H = jmtActiveHasher();
+    HashValue h;
+    JMTHashCtx ctx;
 
-    keccak_256(h.hash_bytes, input, totalLen);
+    // Nibble del tokenId uno per byte, esclusi gli 8 nibble della version (e il percorso delle chiavi hashed), seguiti dal valore
+    size_t start = leafHashStart(key);
+    H->init(&ctx);
+    for (size_t i = start; i < key->nibble_path.nibblesLength; i++) {
+        H->absorbByte(&ctx, getNibble(key->nibble_path.nibbles, i));
+    }
+    H->absorb(&ctx, value, len);
 
-    free(expanded);
-    free(input);
+    H->final(&ctx, h.hash_bytes);
     return h;
 }
 
-LeafNode* createLeafNode(NodeKey key, uint8_t* value, size_t len) {
+// I valori corti vanno nella foglia, gli altri nel value log (deduplicati, nessuna free per foglia)
+static void setLeafValue(LeafNode* leaf, const uint8_t* value, size_t len) {
+    if (len > UINT32_MAX) {
+        fprintf(stderr, "Error: leaf value too large\n");
+        exit(EXIT_FAILURE);
+    }
+    leaf->valueLength = (uint32_t)len;
+    if (len <= JMT_INLINE_VALUE) memcpy(leaf->value.inlined, value, len);
+    else leaf->value.logged = valueLogIntern(value, len);
+}
+
+LeafNode* restoreLeafNode(NodeKey key, const uint8_t* value, size_t len, HashValue digest) {
     LeafNode* leaf;
     SYSCN(leaf, (LeafNode*)malloc(sizeof(LeafNode)), "Error allocating for leaf...");
+    JMT_COUNT(INSTR_NODE_ALLOCS, 1);
 
     // Copia profonda della chiave
     leaf->leafKey.nibble_path.nibblesLength = key.nibble_path.nibblesLength;
     size_t byteLen = (key.nibble_path.nibblesLength + 1) / 2;
     SYSCN(leaf->leafKey.nibble_path.nibbles, (uint8_t*)malloc(byteLen), "Allocating leafKey.nibbles");
     memcpy(leaf->leafKey.nibble_path.nibbles, key.nibble_path.nibbles, byteLen);
+    jmtAccountNodeBytes(JMT_LEAF_BYTES(byteLen), false);
 
-    // Copia del valore
-    SYSCN(leaf->value, (uint8_t*)malloc(len), "Error allocating for leaf value");
-    memcpy(leaf->value, value, len);
-    leaf->valueLength = len;
+    setLeafValue(leaf, value, len);
+    leaf->leafDigest = digest;
+    leaf->tombstone = false;
+    return leaf;
+}
 
-    // Calcolo hash della foglia
-    leaf->leafDigest = computeLeafHash(&leaf->leafKey, leaf->value, leaf->valueLength);
+LeafNode* createLeafNode(NodeKey key, uint8_t* value, size_t len) {
+    return restoreLeafNode(key, value, len, computeLeafHash(&key, value, len));
+}
 
-    return leaf;
+void freeLeafNode(LeafNode* leaf) {
+    jmtAccountNodeBytes(JMT_LEAF_BYTES((leaf->leafKey.nibble_path.nibblesLength + 1) / 2), true);
+    free(leaf->leafKey.nibble_path.nibbles);
+    free(leaf);
+    JMT_COUNT(INSTR_NODE_FREES, 1);
 }
 
 
 InternalNode* createInternalNode(){
     InternalNode* node; 
     SYSCN(node,(InternalNode*)malloc(sizeof(InternalNode)),"Error allocating for internal node...");
+    JMT_COUNT(INSTR_NODE_ALLOCS, 1);
     memset(node->children, 0, sizeof(node->children));
+    jmtAccountNodeBytes(JMT_INTERNAL_BYTES, false);
+    // Digest di 16 default_hash con la funzione attiva
+    memcpy(node->digest.hash_bytes, jmtActiveHasher()->emptyInternal, sizeof(HashValue));
+    node->dirty = false;
+    node->tombstones = false;
     return node;
 }
 
+void freeChildNode(ChildNode* child) {
+    if (child == NULL) return;
+    if (child->isLeaf) {
+        freeLeafNode(child->node.leaf);
+    } else if (child->flags & JMT_CHILD_EVICTED) {
+        // Il contenuto resta nel node file, che non viene compattato
+        jmtAccountNodeBytes(sizeof(EvictedNode), true);
+        free(child->node.evicted);
+    } else {
+        freeJMT(child->node.internal);
+    }
+    free(child);
+}
+
+void freeJMT(InternalNode* node) {
+    if (node == NULL) return;
+    for (size_t i = 0; i < 16; i++) freeChildNode(node->children[i]);
+    jmtAccountNodeBytes(JMT_INTERNAL_BYTES, true);
+    free(node);
+    JMT_COUNT(INSTR_NODE_FREES, 1);
+}
+
 size_t longestCommonPrefix(const NibblePath* p1, const NibblePath* p2){
     size_t minLength = (p1->nibblesLength < p2->nibblesLength)? p1->nibblesLength : p2->nibblesLength;
     size_t lcp;
@@ -291,6 +386,7 @@ size_t longestCommonPrefix(const NibblePath* p1, const NibblePath* p2){
 }
 
 bool lookupJMT(InternalNode* root, NodeKey* key, uint8_t** result, size_t* resLength){
+    JMT_TIMED(INSTR_OP_LOOKUP);
     if(root==NULL || key==NULL) return false;
 
     NibblePath* path = &key->nibble_path;
@@ -305,6 +401,7 @@ bool lookupJMT(InternalNode* root, NodeKey* key, uint8_t** result, size_t* resLe
         if(child->isLeaf){
             LeafNode* leaf = child->node.leaf;
             NibblePath* leafPath = &leaf->leafKey.nibble_path;
+            if(leaf->tombstone) return false;
 
             if(leafPath->nibblesLength == path->nibblesLength){
                 bool match = true;
@@ -314,22 +411,199 @@ bool lookupJMT(InternalNode* root, NodeKey* key, uint8_t** result, size_t* resLe
                 if(match){
                     *resLength = leaf->valueLength;
                     SYSCN(*result,(uint8_t*)malloc(*resLength),"Error allocating for results");
-                    memcpy(*result,leaf->value,*resLength);
+                    memcpy(*result,leafValue(leaf),*resLength);
                     return true;
                 }
             }
             return false;
         }
         else{
-            current = child->node.internal;
+            current = childInternal(child);
             depth++;
         }
     }
     return false;
 }
 
+static inline bool sameLeafKey(const NibblePath* a, const NibblePath* b) {
+    if (a->nibblesLength != b->nibblesLength) return false;
+    size_t n = a->nibblesLength;
+    if (memcmp(a->nibbles, b->nibbles, n / 2) != 0) return false;
+    return n % 2 == 0 || getNibble(a->nibbles, n - 1) == getNibble(b->nibbles, n - 1);
+}
+
+bool lookupJMTRef(InternalNode* root, NodeKey* key, const uint8_t** value, size_t* len) {
+    JMT_TIMED(INSTR_OP_LOOKUP);
+    if (root == NULL || key == NULL) return false;
+
+    NibblePath* path = &key->nibble_path;
+    InternalNode* current = root;
+    for (size_t depth = 0; depth < path->nibblesLength; depth++) {
+        ChildNode* child = current->children[getNibble(path->nibbles, depth)];
+        if (child == NULL) return false;
+        if (!child->isLeaf) {
+            current = childInternal(child);
+            continue;
+        }
+        LeafNode* leaf = child->node.leaf;
+        if (leaf->tombstone || !sameLeafKey(&leaf->leafKey.nibble_path, path)) return false;
+        *value = leafValue(leaf);
+        *len = leaf->valueLength;
+        return true;
+    }
+    return false;
+}
+
 
-bool insertJMT(InternalNode** root, NodeKey* key, uint8_t* value, size_t len,AncestryProof* ancestryOut) {
+/*
+ * Ricerche indipendenti avanzate a gruppi di JMT_LOOKUP_GROUP: ogni passo di una ricerca
+ * legge solo memoria già richiesta con __builtin_prefetch al passo precedente, poi passa
+ * alla ricerca successiva del gruppo, così i cache miss dei diversi percorsi si sovrappongono.
+ */
+typedef enum { LOOKUP_NODE, LOOKUP_CHILD, LOOKUP_LEAF, LOOKUP_MATCH, LOOKUP_IDLE } LookupStage;
+
+typedef struct {
+    LookupStage stage;
+    size_t idx;
+    size_t depth;
+    InternalNode* node;
+    ChildNode* child;
+} LookupState;
+
+void lookupBatchJMT(InternalNode* root, NodeKey* keys, size_t n, LookupResult* results) {
+    JMT_TIMED(INSTR_OP_LOOKUP);
+    LookupState group[JMT_LOOKUP_GROUP];
+    size_t nextKey = 0;
+    size_t active = 0;
+
+    for (size_t g = 0; g < JMT_LOOKUP_GROUP; g++) group[g].stage = LOOKUP_IDLE;
+
+    do {
+        active = 0;
+        for (size_t g = 0; g < JMT_LOOKUP_GROUP; g++) {
+            LookupState* s = &group[g];
+
+            if (s->stage == LOOKUP_IDLE) {
+                if (nextKey >= n || root == NULL) {
+                    if (root == NULL) {
+                        while (nextKey < n) results[nextKey++] = (LookupResult){false, NULL, 0};
+                    }
+                    continue;
+                }
+                s->idx = nextKey++;
+                s->depth = 0;
+                s->node = root;
+                s->stage = LOOKUP_NODE;
+                results[s->idx] = (LookupResult){false, NULL, 0};
+            }
+            active++;
+
+            NibblePath* path = &keys[s->idx].nibble_path;
+            switch (s->stage) {
+                case LOOKUP_NODE: {
+                    if (s->depth >= path->nibblesLength) {
+                        s->stage = LOOKUP_IDLE;
+                        break;
+                    }
+                    ChildNode* child = s->node->children[getNibble(path->nibbles, s->depth)];
+                    if (child == NULL) {
+                        s->stage = LOOKUP_IDLE;
+                        break;
+                    }
+                    __builtin_prefetch(child);
+                    s->child = child;
+                    s->stage = LOOKUP_CHILD;
+                    break;
+                }
+                case LOOKUP_CHILD:
+                    if (s->child->isLeaf) {
+                        __builtin_prefetch(s->child->node.leaf);
+                        s->stage = LOOKUP_LEAF;
+                    } else {
+                        s->node = childInternal(s->child);
+                        s->depth++;
+                        if (s->depth < path->nibblesLength) {
+                            __builtin_prefetch(&s->node->children[getNibble(path->nibbles, s->depth)]);
+                        }
+                        s->stage = LOOKUP_NODE;
+                    }
+                    break;
+                case LOOKUP_LEAF: {
+                    LeafNode* leaf = s->child->node.leaf;
+                    __builtin_prefetch(leaf->leafKey.nibble_path.nibbles);
+                    if (leaf->valueLength > JMT_INLINE_VALUE) __builtin_prefetch(leaf->value.logged);
+                    s->stage = LOOKUP_MATCH;
+                    break;
+                }
+                case LOOKUP_MATCH: {
+                    LeafNode* leaf = s->child->node.leaf;
+                    if (!leaf->tombstone && sameLeafKey(&leaf->leafKey.nibble_path, path)) {
+                        LookupResult* r = &results[s->idx];
+                        r->found = true;
+                        r->value = leafValue(leaf);
+                        r->valueLength = leaf->valueLength;
+                    }
+                    s->stage = LOOKUP_IDLE;
+                    break;
+                }
+                case LOOKUP_IDLE:
+                    break;
+            }
+        }
+    } while (active > 0);
+}
+
+
+/*
+ * Ricalcola i digest dei nodi del percorso, dal più profondo alla root.
+ * Se P non è NULL raccoglie nello stesso passaggio i fratelli di ogni livello,
+ * nello stesso ordine di generateProof (livelli dalla foglia, fratelli per indice decrescente).
+ */
+static HashValue rehashPath(InternalNode** stack, uint8_t* nibs, size_t n, Proof* P, JMTStats* stats) {
+    stampPath(stack, nibs, n);
+    LevelSibling** tail = NULL;
+    if (P != NULL) {
+        P->levels = NULL;
+        P->depth = 0;
+        tail = &P->levels;
+    }
+
+    for (size_t i = n; i-- > 0; ) {
+        InternalNode* node = stack[i];
+
+        LevelSibling* level = NULL;
+        if (P != NULL) {
+            SYSCN(level, (LevelSibling*)malloc(sizeof(LevelSibling)), "Error allocating for level");
+            JMT_COUNT(INSTR_PROOF_LEVELS, 1);
+            level->siblings = NULL;
+            level->next = NULL;
+            *tail = level;
+            tail = &level->next;
+            P->depth++;
+        }
+
+        for (size_t j = 0; j < 16; j++) {
+            ChildNode* child = node->children[j];
+            if (j == nibs[i] || child == NULL) continue;
+            const HashValue* h = childDigest(child, stats);
+            if (level != NULL) addSibling(&level, j, *h);
+        }
+
+        node->digest = computeNodeDigest(node);
+        node->dirty = false;
+    }
+    return stack[0]->digest;
+}
+
+// Insert senza ancestry: il ricalcolo è rimandato alla prima lettura del digest
+static void markPathDirty(InternalNode** stack, uint8_t* nibs, size_t n) {
+    stampPath(stack, nibs, n);
+    for (size_t i = 0; i < n; i++) stack[i]->dirty = true;
+}
+
+// *reused conta i tombstone sostituiti dalla nuova foglia, che non restano da compattare
+static bool insertImpl(InternalNode** root, NodeKey* key, uint8_t* value, size_t len, AncestryProof* ancestryOut, JMTStats* stats,
+                       size_t* reused) {
     if (key == NULL || value == NULL || len == 0) {
         fprintf(stderr, "Error: Invalid key or value in insert\n");
         return false;
@@ -338,24 +612,48 @@ bool insertJMT(InternalNode** root, NodeKey* key, uint8_t* value, size_t len,Anc
     NibblePath* path = &key->nibble_path;
     if (*root == NULL) *root = createInternalNode();
 
+    // Nodi attraversati e nibble scelti: servono per la risalita che aggiorna i digest
+    InternalNode* stack[maxLev + 1];
+    uint8_t nibs[maxLev + 1];
+    size_t n = 0;
+
     InternalNode* current = *root;
     size_t depth = 0;
 
-    while (depth < path->nibblesLength) {
+    while (depth < path->nibblesLength && n <= maxLev) {
         uint8_t nextNibble = getNibble(path->nibbles, depth);
+        stack[n] = current;
+        nibs[n] = nextNibble;
+        n++;
+
+        // Foglia cancellata e non ancora compattata: era l'unica chiave con questo prefisso, la nuova prende lo slot
+        ChildNode* slot = current->children[nextNibble];
+        if (slot != NULL && slot->isLeaf && slot->node.leaf->tombstone) {
+            freeChildNode(slot);
+            current->children[nextNibble] = NULL;
+            if (reused != NULL) (*reused)++;
+        }
 
         if (current->children[nextNibble] == NULL) {
             
             LeafNode* newLeaf = createLeafNode(*key, value, len);
             SYSCN(current->children[nextNibble], (ChildNode*)malloc(sizeof(ChildNode)),"Error allocating for childnode");
             current->children[nextNibble]->isLeaf = true;
+            current->children[nextNibble]->flags = 0;
+            current->children[nextNibble]->version = stampVersion;
             current->children[nextNibble]->node.leaf = newLeaf;
 
+            if (ancestryOut == NULL) {
+                markPathDirty(stack, nibs, n);
+                return true;
+            }
+
             ancestryOut->splitted = false;
             ancestryOut->key = *key;
-            ancestryOut->RootN = computeInternalHash(*root);
             ancestryOut->preForkingDepth = 0;
-            generateProof(*root, key, &ancestryOut->proof);
+            ancestryOut->RootN = rehashPath(stack, nibs, n, &ancestryOut->proof, stats);
+            ancestryOut->proof.isPresent = true;
+            ancestryOut->proof.leafHash = newLeaf->leafDigest;
 
             return true;
         }
@@ -369,24 +667,36 @@ bool insertJMT(InternalNode** root, NodeKey* key, uint8_t* value, size_t len,Anc
         
             if (commonLen == path->nibblesLength && commonLen == existingPath->nibblesLength) {
                 // Update existing leaf
-                free(existingLeaf->value);
-                SYSCN(existingLeaf->value, (uint8_t*)malloc(len), "Error allocating for value");
-                memcpy(existingLeaf->value, value, len);
-                existingLeaf->valueLength = len;
+                setLeafValue(existingLeaf, value, len);
                 existingLeaf->leafDigest = computeLeafHash(key, value, len);
+                markPathDirty(stack, nibs, n);
                 return true;
             } else {
+                // Il ramo allunga lo stack fino a commonLen + 1 nodi: oltre maxLev + 1 si rifiuta prima di toccare l'albero
+                if (commonLen > maxLev) {
+                    fprintf(stderr, "Error: keys share more than %d nibbles in insert\n", maxLev);
+                    return false;
+                }
+
                 // Nuovo percorso di InternalNode da depth a commonLen - 1
                 InternalNode* newBranch = createInternalNode();
                 InternalNode* temp = newBranch;
+                stack[n] = newBranch;
+                nibs[n] = getNibble(existingPath->nibbles, depth + 1);
+                n++;
         
                 for (size_t i = depth+1; i < commonLen; i++) {
                     InternalNode* next = createInternalNode();
                     uint8_t nib = getNibble(existingPath->nibbles, i);
                     SYSCN(temp->children[nib], (ChildNode*)malloc(sizeof(ChildNode)), "Allocating mid internal child");
                     temp->children[nib]->isLeaf = false;
+                    temp->children[nib]->flags = 0;
+                    temp->children[nib]->version = stampVersion;
                     temp->children[nib]->node.internal = next;
                     temp = next;
+                    stack[n] = next;
+                    nibs[n] = getNibble(existingPath->nibbles, i + 1);
+                    n++;
                 }
         
                 // Inserisco entrambe le foglie
@@ -395,122 +705,216 @@ bool insertJMT(InternalNode** root, NodeKey* key, uint8_t* value, size_t len,Anc
         
                 SYSCN(temp->children[existingNibble], (ChildNode*)malloc(sizeof(ChildNode)), "Allocating for existing leaf");
                 temp->children[existingNibble]->isLeaf = true;
+                temp->children[existingNibble]->flags = 0;
+                temp->children[existingNibble]->version = stampVersion;
                 temp->children[existingNibble]->node.leaf = existingLeaf;
         
                 LeafNode* newLeaf = createLeafNode(*key, value, len);
                 SYSCN(temp->children[newNibble], (ChildNode*)malloc(sizeof(ChildNode)), "Allocating for new leaf");
                 temp->children[newNibble]->isLeaf = true;
+                temp->children[newNibble]->flags = 0;
+                temp->children[newNibble]->version = stampVersion;
                 temp->children[newNibble]->node.leaf = newLeaf;
         
-                // Rimpiazzo la foglia con il nuovo ramo
-                SYSCN(current->children[nextNibble], (ChildNode*)malloc(sizeof(ChildNode)), "Allocating for new branch");
-                current->children[nextNibble]->isLeaf = false;
-                current->children[nextNibble]->node.internal = newBranch;
+                // Rimpiazzo la foglia con il nuovo ramo (riuso il ChildNode che la conteneva)
+                child->isLeaf = false;
+                child->node.internal = newBranch;
 
+                if (ancestryOut == NULL) {
+                    markPathDirty(stack, nibs, n);
+                    return true;
+                }
+
+                // La prova di ancestry riguarda la foglia spostata: il percorso in stack è il suo
                 ancestryOut->splitted = true;
                 ancestryOut->key = existingLeaf->leafKey;
                 ancestryOut->preForkingDepth = depth+1;
-                ancestryOut->RootN = computeInternalHash(*root);
-                generateProof(*root, &ancestryOut->key, &ancestryOut->proof);
+                ancestryOut->RootN = rehashPath(stack, nibs, n, &ancestryOut->proof, stats);
+                ancestryOut->proof.isPresent = true;
+                ancestryOut->proof.leafHash = existingLeaf->leafDigest;
 
                 return true;
             }
         }        
         else {
-            current = child->node.internal;
+            current = childInternal(child);
             depth++;
         }
     }
     return false;
 }
 
+bool insertJMT(InternalNode** root, NodeKey* key, uint8_t* value, size_t len,AncestryProof* ancestryOut) {
+    JMT_TIMED(INSTR_OP_INSERT);
+    return insertImpl(root, key, value, len, ancestryOut, NULL, NULL);
+}
 
-bool deleteJMT(InternalNode** root, NodeKey* key) {
-    if (*root == NULL || key == NULL) return false;
+
+/*
+ * Una sola discesa fino alla foglia, poi la risalita di rehashPath raccoglie i fratelli e aggiorna i digest.
+ * I fratelli non dipendono dal valore della foglia: la stessa prova vale prima e dopo l'aggiornamento.
+ */
+static bool updateImpl(InternalNode* root, NodeKey* key, uint8_t* value, size_t len, UpdateProof* out, JMTStats* stats) {
+    if (root == NULL || key == NULL || value == NULL || len == 0 || out == NULL) {
+        fprintf(stderr, "Error: Invalid key or value in update\n");
+        return false;
+    }
 
     NibblePath* path = &key->nibble_path;
-    InternalNode* current = *root;
-    size_t depth = 0;
+    InternalNode* stack[maxLev + 1];
+    uint8_t nibs[maxLev + 1];
+    size_t n = 0;
+    InternalNode* current = root;
 
-    InternalNode* parents[maxLev];
-    uint8_t nibbles[maxLev];
+    while (n < path->nibblesLength && n <= maxLev) {
+        uint8_t nextNibble = getNibble(path->nibbles, n);
+        stack[n] = current;
+        nibs[n] = nextNibble;
+        n++;
 
-    while (depth < path->nibblesLength) {
-        uint8_t nibble = getNibble(path->nibbles, depth);
-        if (current->children[nibble] == NULL) return false;
+        ChildNode* child = current->children[nextNibble];
+        if (child == NULL) return false;
+        if (!child->isLeaf) {
+            current = childInternal(child);
+            continue;
+        }
 
-        // Salva info per la risalita
-        parents[depth] = current;
-        nibbles[depth] = nibble;
+        LeafNode* leaf = child->node.leaf;
+        if (leaf->tombstone || !sameLeafKey(&leaf->leafKey.nibble_path, path)) return false;
+
+        // Il valore corto sta nella foglia e viene sovrascritto: la copia serve a chi verifica lo stato precedente
+        HashValue oldLeafHash = leaf->leafDigest;
+        out->oldValueLength = leaf->valueLength;
+        SYSCN(out->oldValue, (uint8_t*)malloc(leaf->valueLength), "Error allocating old value");
+        memcpy(out->oldValue, leafValue(leaf), leaf->valueLength);
+        setLeafValue(leaf, value, len);
+        leaf->leafDigest = computeLeafHash(key, value, len);
+
+        out->newRoot = rehashPath(stack, nibs, n, &out->proof, stats);
+        out->proof.isPresent = true;
+        out->proof.leafHash = oldLeafHash;
+        out->newLeafHash = leaf->leafDigest;
+        return true;
+    }
+    return false;
+}
 
-        ChildNode* child = current->children[nibble];
+bool updateJMTWithProof(InternalNode* root, NodeKey* key, uint8_t* value, size_t len, UpdateProof* out) {
+    JMT_TIMED(INSTR_OP_UPDATE);
+    return updateImpl(root, key, value, len, out, NULL);
+}
 
-        if (child->isLeaf) {
-            LeafNode* leaf = child->node.leaf;
-            NibblePath* leafPath = &leaf->leafKey.nibble_path;
+void freeUpdateProof(UpdateProof* u) {
+    freeProof(&u->proof);
+    free(u->oldValue);
+    u->oldValue = NULL;
+}
 
-            // Verifica chiave
-            if (leafPath->nibblesLength != path->nibblesLength) return false;
-            for (size_t i = 0; i < path->nibblesLength; i++) {
-                if (getNibble(leafPath->nibbles, i) != getNibble(path->nibbles, i)) return false;
-            }
+bool markDeletedJMT(InternalNode* root, NodeKey* key) {
+    if (root == NULL || key == NULL) return false;
 
-            // Libera risorse della foglia
-            free(leaf->value);
-            free(leaf);
-            free(child);
-            current->children[nibble] = NULL;
-
-            // Risali lo stack per comprimere
-            while (depth > 0) {
-                depth--;
-                InternalNode* parent = parents[depth];
-                uint8_t pNibble = nibbles[depth];
-
-                size_t count = 0;
-                size_t lastIndex = 0;
-                for (size_t i = 0; i < 16; i++) {
-                    if (parent->children[i] != NULL) {
-                        count++;
-                        lastIndex = i;
-                    }
-                }
+    NibblePath* path = &key->nibble_path;
+    InternalNode* stack[maxLev + 1];
+    uint8_t nibs[maxLev + 1];
+    size_t n = 0;
+    InternalNode* current = root;
 
-                if (count == 0) {
-                    // Nodo vuoto, elimina
-                    free(parent->children[pNibble]);
-                    parent->children[pNibble] = NULL;
-                } else if (count == 1) {
-                    // Comprimibile: unico figlio → promozione se foglia
-                    ChildNode* onlyChild = parent->children[lastIndex];
-                    if (onlyChild->isLeaf) {
-                        // Sostituisci questo internal node con la foglia
-                        free(parent);
-                        if (depth == 0) {
-                            *root = NULL;
-                        } else {
-                            parents[depth - 1]->children[nibbles[depth - 1]] = onlyChild;
-                        }
-                    }
-                    break;
-                } else {
-                    break;
-                }
-            }
+    while (n < path->nibblesLength && n <= maxLev) {
+        uint8_t nibble = getNibble(path->nibbles, n);
+        stack[n] = current;
+        nibs[n] = nibble;
+        n++;
 
-            return true;
+        ChildNode* child = current->children[nibble];
+        if (child == NULL) return false;
+        if (!child->isLeaf) {
+            current = childInternal(child);
+            continue;
         }
 
-        current = child->node.internal;
-        depth++;
+        LeafNode* leaf = child->node.leaf;
+        if (leaf->tombstone || !sameLeafKey(&leaf->leafKey.nibble_path, path)) return false;
+        leaf->tombstone = true;
+        // Il percorso segnato è l'unico che la compattazione visita e ricalcola
+        markPathDirty(stack, nibs, n);
+        for (size_t i = 0; i < n; i++) stack[i]->tombstones = true;
+        return true;
     }
-
     return false;
 }
 
+/*
+ * Visita in post-ordine dei soli figli segnati. Dopo la visita un figlio interno ha 0 foglie (slot liberato),
+ * una sola foglia (che prende lo slot del figlio: le catene a figlio unico si chiudono risalendo un livello
+ * alla volta) oppure almeno due foglie, e allora resta com'è.
+ */
+static size_t compactNode(InternalNode* node) {
+    size_t removed = 0;
+    for (size_t i = 0; i < 16; i++) {
+        ChildNode* child = node->children[i];
+        if (child == NULL) continue;
+        if (child->isLeaf) {
+            if (!child->node.leaf->tombstone) continue;
+            freeChildNode(child);
+            node->children[i] = NULL;
+            removed++;
+            continue;
+        }
+        // Un sottoalbero sfrattato non ha tombstone: jmtDelete compatta prima di sfrattare
+        if (child->flags & JMT_CHILD_EVICTED) continue;
+        InternalNode* inner = child->node.internal;
+        if (!inner->tombstones) continue;
+        removed += compactNode(inner);
+
+        size_t count = 0;
+        ChildNode* only = NULL;
+        for (size_t j = 0; j < 16; j++) {
+            if (inner->children[j] == NULL) continue;
+            count++;
+            only = inner->children[j];
+        }
+        if (count == 0) {
+            freeChildNode(child);
+            node->children[i] = NULL;
+        } else if (count == 1 && only->isLeaf) {
+            // Lo slot del nodo passa alla foglia: si liberano il nodo e lo slot che conteneva la foglia
+            child->isLeaf = true;
+            child->flags = 0;
+            child->node.leaf = only->node.leaf;
+            free(only);
+            jmtAccountNodeBytes(JMT_INTERNAL_BYTES, true);
+            free(inner);
+            JMT_COUNT(INSTR_NODE_FREES, 1);
+        }
+    }
+    node->tombstones = false;
+    return removed;
+}
+
+static size_t compactImpl(InternalNode* root, JMTStats* stats) {
+    if (root == NULL || !root->tombstones) return 0;
+    size_t removed = compactNode(root);
+    refreshDigest(root, stats);
+    return removed;
+}
+
+size_t compactJMT(InternalNode* root) {
+    JMT_TIMED(INSTR_OP_COMPACT);
+    return compactImpl(root, NULL);
+}
+
+// La root resta un nodo interno anche se le rimane una sola foglia, come dopo il primo insert
+bool deleteJMT(InternalNode** root, NodeKey* key) {
+    JMT_TIMED(INSTR_OP_DELETE);
+    if (*root == NULL || !markDeletedJMT(*root, key)) return false;
+    compactImpl(*root, NULL);
+    return true;
+}
+
 Sibling* createSiblingNode(uint8_t index, HashValue hash){
     Sibling* node;
     SYSCN(node, (Sibling*)malloc(sizeof(Sibling)),"Error allocating for sibling");
+    JMT_COUNT(INSTR_PROOF_SIBLINGS, 1);
 
     node->index = index;
     node->hash = hash;
@@ -529,6 +933,7 @@ void addSibling(LevelSibling** level, uint8_t index, HashValue hash){
 LevelSibling* addLevel(Proof* P){
     LevelSibling* newLevel;
     SYSCN(newLevel,(LevelSibling*)malloc(sizeof(LevelSibling)),"Error allocating for level");
+    JMT_COUNT(INSTR_PROOF_LEVELS, 1);
 
     newLevel->siblings = NULL;
     newLevel->next = P->levels;
@@ -539,6 +944,7 @@ LevelSibling* addLevel(Proof* P){
 
 
 bool verifyProof(NodeKey* key, Proof* P, HashValue rootDigest) {
+    JMT_TIMED(INSTR_OP_VERIFY_PROOF);
     if (P == NULL) return false;
 
     HashValue currentHash = P->leafHash;
@@ -546,22 +952,10 @@ bool verifyProof(NodeKey* key, Proof* P, HashValue rootDigest) {
     LevelSibling* level = P->levels;
     size_t depth = 0;
 
+    // I livelli partono dalla foglia: il nibble del livello i è quello a profondità depth-(i+1)
     while (level != NULL) {
-        uint8_t buffer[16 * sizeof(HashValue)];
-        memset(buffer, 0, sizeof(buffer));
-
-        Sibling* sibling = level->siblings;
-        while (sibling != NULL) {
-            size_t position = sibling->index * sizeof(HashValue);
-            memcpy(&buffer[position], sibling->hash.hash_bytes, sizeof(HashValue));
-            sibling = sibling->next;
-        }
-
-        uint8_t currentNibble = getNibble(key->nibble_path.nibbles, depth);
-        size_t currentPosition = currentNibble * sizeof(HashValue);
-        memcpy(&buffer[currentPosition], currentHash.hash_bytes, sizeof(HashValue));
-
-        keccak_256(currentHash.hash_bytes, buffer, sizeof(buffer));
+        uint8_t currentNibble = getNibble(key->nibble_path.nibbles, P->depth - (depth + 1));
+        currentHash = computeLevelHash(level, currentNibble, currentHash);
 
         level = level->next;
         depth++;
@@ -570,6 +964,78 @@ bool verifyProof(NodeKey* key, Proof* P, HashValue rootDigest) {
     return memcmp(&currentHash, &rootDigest, sizeof(HashValue)) == 0;
 }
 
+/*
+ * Come verifyProof su n prove, quattro alla volta: lo stesso livello di quattro prove
+ * è calcolato con un'unica keccak_256_x4. Le prove di un gruppo possono avere profondità diverse.
+ */
+void verifyProofBatch(NodeKey* const* keys, Proof* const* proofs, const HashValue* roots, size_t n, bool* ok) {
+    size_t i = 0;
+    // Il percorso a quattro corsie esiste solo per keccak; con le altre funzioni si verifica una prova alla volta
+    size_t lanes = jmtActiveHasher()->kind == JMT_HASH_KECCAK256 ? n - n % 4 : 0;
+    for (; i < lanes; i += 4) {
+        uint8_t buffers[4][16 * sizeof(HashValue)];
+        HashValue current[4];
+        HashValue scratch[4];
+        LevelSibling* level[4];
+        size_t depth[4];
+
+        for (size_t l = 0; l < 4; l++) {
+            current[l] = proofs[i + l]->leafHash;
+            level[l] = proofs[i + l]->levels;
+            depth[l] = 0;
+        }
+
+        for (;;) {
+            bool active = false;
+            uint8_t* out[4];
+            const uint8_t* in[4];
+            for (size_t l = 0; l < 4; l++) {
+                in[l] = buffers[l];
+                out[l] = scratch[l].hash_bytes;
+                if (level[l] == NULL) continue;
+                active = true;
+                Proof* P = proofs[i + l];
+                uint8_t nibble = getNibble(keys[i + l]->nibble_path.nibbles, P->depth - (depth[l] + 1));
+                fillLevelBuffer(buffers[l], level[l], nibble, &current[l]);
+                out[l] = current[l].hash_bytes;
+            }
+            if (!active) break;
+
+            // Le corsie già concluse hashano il buffer precedente in scratch
+            keccak_256_x4(out, in, sizeof(buffers[0]));
+            for (size_t l = 0; l < 4; l++) {
+                if (level[l] == NULL) continue;
+                level[l] = level[l]->next;
+                depth[l]++;
+            }
+        }
+
+        for (size_t l = 0; l < 4; l++) {
+            ok[i + l] = memcmp(&current[l], &roots[i + l], sizeof(HashValue)) == 0;
+        }
+    }
+
+    for (; i < n; i++) ok[i] = verifyProof(keys[i], proofs[i], roots[i]);
+}
+
+void freeProof(Proof* P) {
+    if (P == NULL) return;
+    LevelSibling* level = P->levels;
+    while (level != NULL) {
+        Sibling* s = level->siblings;
+        while (s != NULL) {
+            Sibling* next = s->next;
+            free(s);
+            s = next;
+        }
+        LevelSibling* nextLevel = level->next;
+        free(level);
+        level = nextLevel;
+    }
+    P->levels = NULL;
+    P->depth = 0;
+}
+
 
 NodeKey buildKey(NibblePath tokenPath) {
     uint32_t versionNum = version++;
@@ -594,6 +1060,57 @@ NodeKey buildKey(NibblePath tokenPath) {
     return key;
 }
 
+// Chiave version‖tokenId già assegnata (es. letta da una prova esportata), senza toccare il contatore delle versioni
+NodeKey buildKeyFromParts(uint32_t versionNum, uint64_t tokenId) {
+    NodeKey key;
+    key.nibble_path.nibblesLength = 24;
+    SYSCN(key.nibble_path.nibbles, (uint8_t*)calloc(12, sizeof(uint8_t)), "Error allocating for key");
+
+    for (size_t i = 0; i < 4; i++) {
+        uint8_t byte = (versionNum >> (8 * (3 - i))) & 0xFF;
+        setNibble(key.nibble_path.nibbles, i * 2,     (byte >> 4) & 0x0F);
+        setNibble(key.nibble_path.nibbles, i * 2 + 1,  byte & 0x0F);
+    }
+    for (size_t i = 0; i < 8; i++) {
+        uint8_t byte = (tokenId >> (8 * (7 - i))) & 0xFF;
+        setNibble(key.nibble_path.nibbles, 8 + i * 2,     (byte >> 4) & 0x0F);
+        setNibble(key.nibble_path.nibbles, 8 + i * 2 + 1,  byte & 0x0F);
+    }
+    return key;
+}
+
+NodeKey hashedKey(const NodeKey* key) {
+    NodeKey out;
+    out.version = key->version;
+    out.nibble_path.nibblesLength = JMT_HASHED_KEY_NIBBLES;
+    SYSCN(out.nibble_path.nibbles, (uint8_t*)malloc(JMT_HASHED_KEY_NIBBLES / 2), "Error allocating hashed key");
+
+    // Il percorso è sempre keccak256, qualunque sia la funzione di hash dell'albero, come nel verificatore Solidity
+    keccak_256(out.nibble_path.nibbles, key->nibble_path.nibbles, JMT_KEY_NIBBLES / 2);
+    memcpy(out.nibble_path.nibbles + JMT_HASHED_PATH_NIBBLES / 2, key->nibble_path.nibbles, JMT_KEY_NIBBLES / 2);
+    return out;
+}
+
+bool isHashedKey(const NodeKey* key) {
+    return key->nibble_path.nibblesLength == JMT_HASHED_KEY_NIBBLES;
+}
+
+static inline const uint8_t* originalKeyBytes(const NodeKey* key) {
+    return key->nibble_path.nibbles + (isHashedKey(key) ? JMT_HASHED_PATH_NIBBLES / 2 : 0);
+}
+
+uint32_t keyVersion(const NodeKey* key) {
+    const uint8_t* b = originalKeyBytes(key);
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+uint64_t keyTokenId(const NodeKey* key) {
+    const uint8_t* b = originalKeyBytes(key) + 4;
+    uint64_t tokenId = 0;
+    for (int i = 0; i < 8; i++) tokenId = (tokenId << 8) | b[i];
+    return tokenId;
+}
+
 NibblePath buildPathFromTokenId(uint64_t tokenId){
     NibblePath p;
     p.nibblesLength = 16;
@@ -735,9 +1252,9 @@ void printJMT(InternalNode* node, int depth, char* prefix, bool isLast) {
             LeafNode* leaf = child->node.leaf;
             printf("Leaf → hash: ");
             printHash(leaf->leafDigest);
-            printf(" | value: %.*s\n", (int)leaf->valueLength, leaf->value);
+            printf(" | value: %.*s\n", (int)leaf->valueLength, leafValue(leaf));
         } else {
-            InternalNode* internal = child->node.internal;
+            InternalNode* internal = childInternal(child);
             printf("Internal → hash: ");
             printHash(computeInternalHash(internal));
             printf("\n");
@@ -771,14 +1288,185 @@ void printProof(Proof* P) {
     printf("🔚 Fine proof\n");
 }
 
+
+typedef struct {
+    InternalNode* node;
+    size_t depth;
+    size_t chain;   // nodi con un solo figlio immediatamente sopra questo
+} InspectFrame;
+
+// Valore del value log visto durante l'ispezione: valori uguali condividono il puntatore
+typedef struct {
+    const uint8_t* ptr;
+    size_t len;
+} LoggedValue;
+
+static int compareLogged(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t)((const LoggedValue*)a)->ptr, y = (uintptr_t)((const LoggedValue*)b)->ptr;
+    return x < y ? -1 : x > y;
+}
+
+static void recordChain(JMTInspectStats* out, size_t length) {
+    out->chainLength[length]++;
+    if (length > out->longestChain) out->longestChain = length;
+}
+
+// Visita unica con stack esplicito; legge solo la struttura, nessun digest viene ricalcolato
+void jmtInspect(InternalNode* root, JMTInspectStats* out) {
+    memset(out, 0, sizeof(*out));
+    if (root == NULL) return;
+
+    // Al più 15 fratelli in attesa per livello più il nodo corrente
+    InspectFrame stack[JMT_INSPECT_LEVELS * 16];
+    size_t top = 0;
+    stack[top++] = (InspectFrame){root, 0, 0};
+
+    LoggedValue* logged = NULL;
+    size_t loggedCount = 0, loggedCap = 0;
+
+    while (top > 0) {
+        InspectFrame f = stack[--top];
+        InternalNode* node = f.node;
+        out->internalCount++;
+        out->heapBytes.internalNodes += sizeof(InternalNode);
+        out->heapBytes.allocated += malloc_usable_size(node);
+
+        size_t children = 0;
+        ChildNode* only = NULL;
+        for (size_t i = 0; i < 16; i++) {
+            if (node->children[i] != NULL) {
+                children++;
+                only = node->children[i];
+            }
+        }
+        out->fanout[f.depth][children]++;
+
+        size_t chain = 0;
+        if (children == 1) {
+            chain = f.chain + 1;
+            if (only->isLeaf) recordChain(out, chain);
+        } else if (f.chain > 0) {
+            recordChain(out, f.chain);
+        }
+
+        // Figli in ordine inverso: la visita procede per nibble crescente
+        for (int i = 15; i >= 0; i--) {
+            ChildNode* child = node->children[i];
+            if (child == NULL) continue;
+            out->heapBytes.childNodes += sizeof(ChildNode);
+            out->heapBytes.allocated += malloc_usable_size(child);
+
+            if (child->isLeaf) {
+                LeafNode* leaf = child->node.leaf;
+                size_t depth = f.depth + 1;
+                out->leafCount++;
+                out->leafDepth[depth]++;
+                if (depth > out->maxDepth) out->maxDepth = depth;
+
+                out->heapBytes.leafNodes += sizeof(LeafNode);
+                out->heapBytes.keys += (leaf->leafKey.nibble_path.nibblesLength + 1) / 2;
+                // I valori fuori dalla foglia sono nel value log, deduplicati: si contano una volta sola alla fine
+                if (leaf->valueLength > JMT_INLINE_VALUE) {
+                    if (loggedCount == loggedCap) {
+                        loggedCap = loggedCap ? loggedCap * 2 : 1024;
+                        SYSCN(logged, (LoggedValue*)realloc(logged, loggedCap * sizeof(LoggedValue)), "Error allocating inspect values");
+                    }
+                    logged[loggedCount++] = (LoggedValue){leaf->value.logged, leaf->valueLength};
+                }
+                out->heapBytes.allocated += malloc_usable_size(leaf) +
+                                            malloc_usable_size(leaf->leafKey.nibble_path.nibbles);
+            } else if (!(child->flags & JMT_CHILD_EVICTED)) {
+                // I sottoalberi sfrattati non vengono ricaricati: l'ispezione riguarda la parte in memoria
+                stack[top++] = (InspectFrame){child->node.internal, f.depth + 1, chain};
+            }
+        }
+    }
+
+    if (loggedCount > 0) qsort(logged, loggedCount, sizeof(LoggedValue), compareLogged);
+    for (size_t i = 0; i < loggedCount; i++) {
+        if (i == 0 || logged[i].ptr != logged[i - 1].ptr) out->heapBytes.values += logged[i].len;
+    }
+    free(logged);
+
+    out->heapBytes.total = out->heapBytes.internalNodes + out->heapBytes.childNodes + out->heapBytes.leafNodes +
+                           out->heapBytes.keys + out->heapBytes.values;
+}
+
+void printInspectStats(FILE* f, const JMTInspectStats* s) {
+    fprintf(f, "{\n  \"leaves\": %zu,\n  \"internalNodes\": %zu,\n  \"maxDepth\": %zu,\n",
+            s->leafCount, s->internalCount, s->maxDepth);
+
+    fprintf(f, "  \"leafDepth\": {");
+    bool first = true;
+    for (size_t d = 0; d < JMT_INSPECT_LEVELS; d++) {
+        if (s->leafDepth[d] == 0) continue;
+        fprintf(f, "%s\"%zu\": %zu", first ? "" : ", ", d, s->leafDepth[d]);
+        first = false;
+    }
+
+    // fanout[livello][k] = InternalNode del livello con k figli
+    fprintf(f, "},\n  \"fanout\": [");
+    for (size_t d = 0; d < s->maxDepth; d++) {
+        fprintf(f, "%s\n    [", d ? "," : "");
+        for (size_t k = 0; k <= 16; k++) fprintf(f, "%s%zu", k ? ", " : "", s->fanout[d][k]);
+        fprintf(f, "]");
+    }
+
+    fprintf(f, "\n  ],\n  \"singleChildChains\": {");
+    first = true;
+    for (size_t l = 0; l < JMT_INSPECT_LEVELS; l++) {
+        if (s->chainLength[l] == 0) continue;
+        fprintf(f, "%s\"%zu\": %zu", first ? "" : ", ", l, s->chainLength[l]);
+        first = false;
+    }
+    fprintf(f, "},\n  \"longestChain\": %zu,\n", s->longestChain);
+
+    fprintf(f, "  \"heapBytes\": {\"internalNodes\": %zu, \"childNodes\": %zu, \"leafNodes\": %zu, "
+               "\"keys\": %zu, \"values\": %zu, \"total\": %zu, \"allocated\": %zu}\n}\n",
+            s->heapBytes.internalNodes, s->heapBytes.childNodes, s->heapBytes.leafNodes,
+            s->heapBytes.keys, s->heapBytes.values, s->heapBytes.total, s->heapBytes.allocated);
+}
+
+uint32_t jmtNextVersion(void) {
+    return version;
+}
+
+void jmtSetNextVersion(uint32_t next) {
+    version = next;
+}
+
+void jmtForEachTokenVersion(void (*fn)(uint64_t tokenId, uint32_t version, void* arg), void* arg) {
+    for (size_t b = 0; b < sizeof(versionMapTouched); b++) {
+        if (!versionMapTouched[b]) continue;
+        uint64_t end = (b + 1) * (uint64_t)VERSION_MAP_BLOCK;
+        if (end > MAX_TOKEN_ID) end = MAX_TOKEN_ID;
+        for (uint64_t t = b * (uint64_t)VERSION_MAP_BLOCK; t < end; t++) {
+            if (versionMap[t] != 0) fn(t, versionMap[t], arg);
+        }
+    }
+}
+
+bool jmtSetTokenVersion(uint64_t tokenId, uint32_t versionNum) {
+    if (tokenId >= MAX_TOKEN_ID) return false;
+    versionMap[tokenId] = versionNum;
+    versionMapTouched[tokenId / VERSION_MAP_BLOCK] = 1;
+    return true;
+}
+
+uint32_t jmtTokenVersion(uint64_t tokenId) {
+    return tokenId < MAX_TOKEN_ID ? versionMap[tokenId] : 0;
+}
+
 NodeKey buildKeyWithControl(uint64_t tokenId, bool isMint) {
     NibblePath tokenPath = buildPathFromTokenId(tokenId);
 
     uint32_t versionNum;
     if (isMint) {
         versionNum = version++;
-        if (tokenId < MAX_TOKEN_ID)
+        if (tokenId < MAX_TOKEN_ID) {
             versionMap[tokenId] = versionNum;
+            versionMapTouched[tokenId / VERSION_MAP_BLOCK] = 1;
+        }
     } else {
         if (tokenId >= MAX_TOKEN_ID) {
             fprintf(stderr, "❌ Token ID troppo grande per versionMap: %lu\n", tokenId);
@@ -809,3 +1497,315 @@ NodeKey buildKeyWithControl(uint64_t tokenId, bool isMint) {
 }
 
 
+// L'albero adotta la funzione di hash attiva nel thread al momento della creazione
+JMT* createJMT() {
+    return createJMTWithHasher(jmtActiveHasher());
+}
+
+JMT* createJMTWithHasher(const JMTHasher* hasher) {
+    JMT* t;
+    SYSCN(t, (JMT*)calloc(1, sizeof(JMT)), "Error allocating tree");
+    t->hasher = hasher != NULL ? hasher : &jmtKeccak256;
+    JMT_WITH_HASHER(t->hasher);
+    t->root = createInternalNode();
+    t->committedRoot = t->root->digest;
+    return t;
+}
+
+static void clearProofCache(JMT* t) {
+    for (size_t i = 0; i < JMT_PROOF_CACHE_SIZE; i++) {
+        ProofCacheEntry* e = &t->proofCache[i];
+        if (!e->used) continue;
+        free(e->key.nibble_path.nibbles);
+        freeProof(&e->proof);
+        e->used = false;
+    }
+}
+
+void destroyJMT(JMT* t) {
+    if (t == NULL) return;
+    clearProofCache(t);
+    freeJMT(t->root);
+    nodeStoreClose(t->store);
+    free(t);
+}
+
+// Alla fine di un'operazione dell'handle, quando nessun puntatore nell'albero è in uso
+static size_t compactPending(JMT* t) {
+    if (t->tombstones == 0) return 0;
+    t->tombstones = 0;
+    return compactImpl(t->root, &t->stats);
+}
+
+static void enforceBudget(JMT* t) {
+    if (t->store == NULL) return;
+    // Le unità sono scritte con il loro digest: i tombstone vanno rimossi prima di uno sfratto
+    if (t->store->resident > t->store->budget) compactPending(t);
+    nodeStoreEnforce(t->store, t->root);
+}
+
+bool jmtInsert(JMT* t, NodeKey* key, uint8_t* value, size_t len, AncestryProof* ap) {
+    JMT_TIMED(INSTR_OP_INSERT);
+    JMT_WITH_HASHER(t->hasher);
+    JMT_WITH_STORE(t->store);
+    if (ap != NULL) compactPending(t);
+    stampVersion = (uint32_t)(t->version + 1);
+    size_t reused = 0;
+    bool ok = insertImpl(&t->root, key, value, len, ap, &t->stats, &reused);
+    stampVersion = 0;
+    t->tombstones -= reused;
+    if (ok) t->mutated = true;
+    enforceBudget(t);
+    return ok;
+}
+
+bool jmtUpdateWithProof(JMT* t, NodeKey* key, uint8_t* value, size_t len, UpdateProof* out) {
+    JMT_TIMED(INSTR_OP_UPDATE);
+    JMT_WITH_HASHER(t->hasher);
+    JMT_WITH_STORE(t->store);
+    compactPending(t);
+    stampVersion = (uint32_t)(t->version + 1);
+    bool ok = updateImpl(t->root, key, value, len, out, &t->stats);
+    stampVersion = 0;
+    if (ok) t->mutated = true;
+    enforceBudget(t);
+    return ok;
+}
+
+bool jmtDelete(JMT* t, NodeKey* key) {
+    JMT_TIMED(INSTR_OP_DELETE);
+    JMT_WITH_HASHER(t->hasher);
+    JMT_WITH_STORE(t->store);
+    stampVersion = (uint32_t)(t->version + 1);
+    bool ok = markDeletedJMT(t->root, key);
+    stampVersion = 0;
+    if (ok) {
+        t->mutated = true;
+        t->tombstones++;
+    }
+    enforceBudget(t);
+    return ok;
+}
+
+size_t jmtCompact(JMT* t) {
+    JMT_TIMED(INSTR_OP_COMPACT);
+    JMT_WITH_HASHER(t->hasher);
+    JMT_WITH_STORE(t->store);
+    return compactPending(t);
+}
+
+HashValue jmtCommit(JMT* t) {
+    JMT_TIMED(INSTR_OP_COMMIT);
+    JMT_WITH_HASHER(t->hasher);
+    JMT_WITH_STORE(t->store);
+    compactPending(t);
+    refreshDigest(t->root, &t->stats);
+    clearProofCache(t);
+    t->committedRoot = t->root->digest;
+    t->mutated = false;
+    t->version++;
+    enforceBudget(t);
+    return t->committedRoot;
+}
+
+static bool sameKey(NodeKey* a, NodeKey* b) {
+    if (a->nibble_path.nibblesLength != b->nibble_path.nibblesLength) return false;
+    return memcmp(a->nibble_path.nibbles, b->nibble_path.nibbles, (a->nibble_path.nibblesLength + 1) / 2) == 0;
+}
+
+// Le prove sono messe in cache solo per la root committata: modifiche non committate la scavalcano
+bool jmtGenerateProof(JMT* t, NodeKey* key, Proof* P) {
+    JMT_TIMED(INSTR_OP_GENERATE_PROOF);
+    JMT_WITH_HASHER(t->hasher);
+    JMT_WITH_STORE(t->store);
+    if (t->mutated) {
+        compactPending(t);
+        bool ok = generateProofImpl(t->root, key, P, &t->stats);
+        enforceBudget(t);
+        return ok;
+    }
+
+    t->tick++;
+    ProofCacheEntry* victim = &t->proofCache[0];
+    for (size_t i = 0; i < JMT_PROOF_CACHE_SIZE; i++) {
+        ProofCacheEntry* e = &t->proofCache[i];
+        if (e->used && sameKey(&e->key, key) &&
+            memcmp(&e->root, &t->committedRoot, sizeof(HashValue)) == 0) {
+            e->lastUse = t->tick;
+            t->stats.proofCacheHits++;
+            JMT_COUNT(INSTR_PROOF_CACHE_HITS, 1);
+            *P = deepCopyProof(&e->proof);
+            return true;
+        }
+        if (!e->used || (victim->used && e->lastUse < victim->lastUse)) victim = e;
+    }
+
+    t->stats.proofCacheMisses++;
+    JMT_COUNT(INSTR_PROOF_CACHE_MISSES, 1);
+    if (!generateProofImpl(t->root, key, P, &t->stats)) return false;
+
+    if (victim->used) {
+        free(victim->key.nibble_path.nibbles);
+        freeProof(&victim->proof);
+    }
+    victim->used = true;
+    victim->lastUse = t->tick;
+    victim->root = t->committedRoot;
+    victim->key = copyNodeKey(*key);
+    victim->proof = deepCopyProof(P);
+    enforceBudget(t);
+    return true;
+}
+
+/*
+ * Scende dalla root lungo la chiave finché lo slot attraversato è stato modificato dopo fromVersion:
+ * sotto uno slot non modificato i fratelli della vecchia prova sono ancora validi.
+ * La root è sempre riportata, perché uno slot rimosso non lascia marcature.
+ */
+bool jmtProofDelta(JMT* t, NodeKey* key, uint64_t fromVersion, uint64_t toVersion, ProofDelta* out) {
+    if (t == NULL || key == NULL || out == NULL) return false;
+    if (t->mutated || toVersion != t->version || fromVersion > toVersion) return false;
+    JMT_WITH_HASHER(t->hasher);
+    JMT_WITH_STORE(t->store);
+
+    memset(out, 0, sizeof(*out));
+    out->fromVersion = fromVersion;
+    out->toVersion = toVersion;
+
+    NibblePath* path = &key->nibble_path;
+    InternalNode* current = t->root;
+    bool changed = true;
+    size_t depth = 0;
+
+    while (depth < path->nibblesLength) {
+        uint8_t nextNibble = getNibble(path->nibbles, depth);
+
+        if (changed) {
+            ProofDeltaLevel* level;
+            SYSCN(out->levels, (ProofDeltaLevel*)realloc(out->levels, (out->levelCount + 1) * sizeof(ProofDeltaLevel)),
+                  "Error allocating delta level");
+            level = &out->levels[out->levelCount++];
+            level->level = (uint8_t)depth;
+            level->siblings = 0;
+            level->changed = 0;
+            for (size_t i = 0; i < 16; i++) {
+                ChildNode* c = current->children[i];
+                if (i == nextNibble || c == NULL) continue;
+                level->siblings |= (uint16_t)(1u << i);
+                if (c->version > fromVersion) {
+                    level->changed |= (uint16_t)(1u << i);
+                    level->hashes[i] = *childDigest(c, &t->stats);
+                }
+            }
+        }
+
+        ChildNode* child = current->children[nextNibble];
+        out->depth = depth + 1;
+        if (child == NULL) return true;
+        if (child->isLeaf) {
+            out->leafHash = child->node.leaf->leafDigest;
+            out->isPresent = sameKey(&child->node.leaf->leafKey, key);
+            return true;
+        }
+        changed = changed && child->version > fromVersion;
+        current = childInternal(child);
+        depth++;
+    }
+    freeProofDelta(out);
+    return false;
+}
+
+// Ricostruisce un livello con i fratelli in ordine decrescente, come generateProof
+static void rebuildLevel(LevelSibling* level, Sibling* slots[16]) {
+    level->siblings = NULL;
+    for (uint8_t i = 0; i < 16; i++) {
+        if (slots[i] == NULL) continue;
+        slots[i]->next = level->siblings;
+        level->siblings = slots[i];
+    }
+}
+
+static bool patchProof(Proof* P, const ProofDelta* d) {
+    if (d->depth == 0 || d->depth > JMT_HASHED_KEY_NIBBLES) return false;
+
+    // Livelli dalla root: la lista della prova parte dalla foglia
+    size_t oldDepth = 0;
+    for (LevelSibling* l = P->levels; l != NULL; l = l->next) oldDepth++;
+    LevelSibling** byLevel;
+    SYSCN(byLevel, (LevelSibling**)calloc(oldDepth > d->depth ? oldDepth : d->depth, sizeof(LevelSibling*)),
+          "Error allocating delta levels");
+    size_t i = oldDepth;
+    for (LevelSibling* l = P->levels; l != NULL; l = l->next) byLevel[--i] = l;
+
+    // La prova nuova è più corta: i livelli in fondo spariscono
+    for (i = d->depth; i < oldDepth; i++) {
+        for (Sibling* s = byLevel[i]->siblings; s != NULL; ) {
+            Sibling* next = s->next;
+            free(s);
+            s = next;
+        }
+        free(byLevel[i]);
+    }
+    for (i = oldDepth; i < d->depth; i++) {
+        SYSCN(byLevel[i], (LevelSibling*)calloc(1, sizeof(LevelSibling)), "Error allocating for level");
+        JMT_COUNT(INSTR_PROOF_LEVELS, 1);
+    }
+
+    bool ok = true;
+    for (size_t k = 0; k < d->levelCount && ok; k++) {
+        const ProofDeltaLevel* dl = &d->levels[k];
+        if (dl->level >= d->depth || (dl->changed & ~dl->siblings) != 0) {
+            ok = false;
+            break;
+        }
+        LevelSibling* level = byLevel[dl->level];
+        Sibling* slots[16] = {NULL};
+        for (Sibling* s = level->siblings; s != NULL; ) {
+            Sibling* next = s->next;
+            if (s->index < 16 && (dl->siblings & (1u << s->index)) && slots[s->index] == NULL) slots[s->index] = s;
+            else free(s);
+            s = next;
+        }
+        for (uint8_t j = 0; j < 16; j++) {
+            if (!(dl->changed & (1u << j))) continue;
+            if (slots[j] == NULL) slots[j] = createSiblingNode(j, dl->hashes[j]);
+            else slots[j]->hash = dl->hashes[j];
+        }
+        // Un fratello ancora presente ma non cambiato deve già essere nella vecchia prova
+        for (uint8_t j = 0; j < 16; j++) {
+            if ((dl->siblings & (1u << j)) && slots[j] == NULL) ok = false;
+        }
+        rebuildLevel(level, slots);
+    }
+
+    P->levels = NULL;
+    for (i = 0; i < d->depth; i++) {
+        byLevel[i]->next = P->levels;
+        P->levels = byLevel[i];
+    }
+    P->depth = d->depth;
+    P->isPresent = d->isPresent;
+    P->leafHash = d->leafHash;
+    free(byLevel);
+    return ok;
+}
+
+// Lavora su una copia: se il delta non è coerente con la prova, P resta invariata
+bool applyProofDelta(Proof* P, const ProofDelta* delta) {
+    if (P == NULL || delta == NULL) return false;
+    Proof work = deepCopyProof(P);
+    if (!patchProof(&work, delta)) {
+        freeProof(&work);
+        return false;
+    }
+    freeProof(P);
+    *P = work;
+    return true;
+}
+
+void freeProofDelta(ProofDelta* delta) {
+    if (delta == NULL) return;
+    free(delta->levels);
+    delta->levels = NULL;
+    delta->levelCount = 0;
+}
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "macros.h"
+#include "ServeProto.h"
+#include "NodeStore.h"
+
+_Thread_local NodeStore* jmtActiveStore = NULL;
+
+NodeStore* jmtUseStore(NodeStore* s) {
+    NodeStore* prev = jmtActiveStore;
+    jmtActiveStore = s;
+    return prev;
+}
+
+void jmtRestoreStore(NodeStore** prev) {
+    jmtActiveStore = *prev;
+}
+
+static size_t subtreeBytes(InternalNode* node) {
+    size_t bytes = JMT_INTERNAL_BYTES;
+    for (int i = 0; i < 16; i++) {
+        ChildNode* c = node->children[i];
+        if (c == NULL) continue;
+        if (c->isLeaf) bytes += JMT_LEAF_BYTES((c->node.leaf->leafKey.nibble_path.nibblesLength + 1) / 2);
+        else if (c->flags & JMT_CHILD_EVICTED) bytes += sizeof(EvictedNode);
+        else bytes += subtreeBytes(c->node.internal);
+    }
+    return bytes;
+}
+
+bool jmtEnableEviction(JMT* t, const char* path, size_t budget, unsigned evictDepth) {
+    if (t->store != NULL || evictDepth == 0) return false;
+
+    // Il file serve solo a questo processo: rimosso subito, resta accessibile dal descrittore
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) {
+        perror("Error opening node file");
+        return false;
+    }
+    unlink(path);
+
+    NodeStore* s;
+    SYSCN(s, (NodeStore*)calloc(1, sizeof(NodeStore)), "Error allocating node store");
+    s->fd = fd;
+    s->budget = budget;
+    s->evictDepth = evictDepth;
+    s->resident = subtreeBytes(t->root);
+    t->store = s;
+    return true;
+}
+
+void nodeStoreClose(NodeStore* s) {
+    if (s == NULL) return;
+    close(s->fd);
+    free(s);
+}
+
+
+static void writeNode(ServeBuf* b, InternalNode* node) {
+    uint16_t internal = 0, leaves = 0;
+    for (int i = 0; i < 16; i++) {
+        ChildNode* c = node->children[i];
+        if (c == NULL) continue;
+        if (c->isLeaf) leaves |= (uint16_t)(1u << i);
+        else internal |= (uint16_t)(1u << i);
+    }
+    serveBufPutU16(b, internal);
+    serveBufPutU16(b, leaves);
+    serveBufPut(b, node->digest.hash_bytes, sizeof(HashValue));
+
+    for (int i = 0; i < 16; i++) {
+        ChildNode* c = node->children[i];
+        if (c == NULL) continue;
+        serveBufPutU32(b, c->version);
+        if (!c->isLeaf) {
+            // Le unità hanno tutte la stessa profondità: dentro un'unità non ci sono altri stub
+            writeNode(b, childInternal(c));
+            continue;
+        }
+        LeafNode* leaf = c->node.leaf;
+        const NibblePath* path = &leaf->leafKey.nibble_path;
+        serveBufPutU8(b, (uint8_t)path->nibblesLength);
+        serveBufPut(b, path->nibbles, (path->nibblesLength + 1) / 2);
+        serveBufPutU32(b, leaf->valueLength);
+        serveBufPut(b, leafValue(leaf), leaf->valueLength);
+        serveBufPut(b, leaf->leafDigest.hash_bytes, sizeof(HashValue));
+    }
+}
+
+// Il node file è scritto solo da questo processo: un record illeggibile è un errore fatale
+static void corrupted(void) {
+    fprintf(stderr, "Error: corrupted node file\n");
+    exit(EXIT_FAILURE);
+}
+
+static InternalNode* readNode(const uint8_t** p, const uint8_t* end) {
+    const uint8_t* c = *p;
+    if (end - c < 4 + (long)sizeof(HashValue)) corrupted();
+    uint16_t internal = serveGetU16(c);
+    uint16_t leaves = serveGetU16(c + 2);
+    c += 4;
+
+    InternalNode* node = createInternalNode();
+    memcpy(node->digest.hash_bytes, c, sizeof(HashValue));
+    c += sizeof(HashValue);
+
+    for (int i = 0; i < 16; i++) {
+        uint16_t bit = (uint16_t)(1u << i);
+        if (!((internal | leaves) & bit)) continue;
+        if (end - c < 4) corrupted();
+
+        ChildNode* child;
+        SYSCN(child, (ChildNode*)malloc(sizeof(ChildNode)), "Error allocating restored child");
+        child->version = serveGetU32(c);
+        child->flags = 0;
+        c += 4;
+
+        if (internal & bit) {
+            child->isLeaf = false;
+            child->node.internal = readNode(&c, end);
+        } else {
+            if (end - c < 1) corrupted();
+            NodeKey key = {0};
+            key.nibble_path.nibblesLength = c[0];
+            size_t keyBytes = (key.nibble_path.nibblesLength + 1) / 2;
+            if ((size_t)(end - c) < 1 + keyBytes + 4) corrupted();
+            key.nibble_path.nibbles = (uint8_t*)(c + 1);
+            uint32_t len = serveGetU32(c + 1 + keyBytes);
+            c += 1 + keyBytes + 4;
+            if ((size_t)(end - c) < len + sizeof(HashValue)) corrupted();
+            HashValue digest;
+            memcpy(digest.hash_bytes, c + len, sizeof(HashValue));
+            child->isLeaf = true;
+            child->node.leaf = restoreLeafNode(key, c, len, digest);
+            c += len + sizeof(HashValue);
+        }
+        node->children[i] = child;
+    }
+    *p = c;
+    return node;
+}
+
+InternalNode* nodeStoreTouch(ChildNode* child) {
+    if (!(child->flags & JMT_CHILD_EVICTED)) {
+        child->flags |= JMT_CHILD_REFERENCED;
+        if (jmtActiveStore != NULL && (child->flags & JMT_CHILD_UNIT)) jmtActiveStore->stats.hits++;
+        return child->node.internal;
+    }
+
+    EvictedNode* stub = child->node.evicted;
+    NodeStore* s = stub->store;
+    JMT_WITH_STORE(s);
+
+    uint8_t* data;
+    SYSCN(data, (uint8_t*)malloc(stub->length), "Error allocating node file record");
+    for (size_t done = 0; done < stub->length; ) {
+        ssize_t r = pread(s->fd, data + done, stub->length - done, (off_t)(stub->offset + done));
+        if (r <= 0) {
+            perror("Error reading node file");
+            exit(EXIT_FAILURE);
+        }
+        done += (size_t)r;
+    }
+
+    const uint8_t* p = data;
+    InternalNode* node = readNode(&p, data + stub->length);
+    if (p != data + stub->length) corrupted();
+    free(data);
+
+    s->stats.faults++;
+    s->stats.bytesRead += stub->length;
+    jmtAccountNodeBytes(sizeof(EvictedNode), true);
+    free(stub);
+    child->node.internal = node;
+    child->flags = JMT_CHILD_UNIT | JMT_CHILD_REFERENCED;
+    return node;
+}
+
+static void evictUnit(NodeStore* s, ChildNode* child) {
+    InternalNode* node = child->node.internal;
+    // Digest aggiornato prima di scrivere: i nodi sopra l'unità lo leggono dallo stub
+    computeInternalHash(node);
+
+    ServeBuf b = {0};
+    writeNode(&b, node);
+    for (size_t done = 0; done < b.len; ) {
+        ssize_t w = pwrite(s->fd, b.data + done, b.len - done, (off_t)(s->fileEnd + done));
+        if (w <= 0) {
+            perror("Error writing node file");
+            exit(EXIT_FAILURE);
+        }
+        done += (size_t)w;
+    }
+
+    EvictedNode* stub;
+    SYSCN(stub, (EvictedNode*)malloc(sizeof(EvictedNode)), "Error allocating evicted node");
+    stub->digest = node->digest;
+    stub->store = s;
+    stub->offset = s->fileEnd;
+    stub->length = (uint32_t)b.len;
+    s->fileEnd += b.len;
+    s->stats.evictions++;
+    s->stats.bytesWritten += b.len;
+    serveBufFree(&b);
+
+    freeJMT(node);
+    jmtAccountNodeBytes(sizeof(EvictedNode), false);
+    child->node.evicted = stub;
+    child->flags = JMT_CHILD_EVICTED | JMT_CHILD_UNIT;
+}
+
+typedef struct {
+    ChildNode** items;
+    size_t count;
+    size_t cap;
+} UnitList;
+
+// Unità in ordine di chiave: i figli interni dei nodi a profondità evictDepth - 1
+static void collectUnits(InternalNode* node, unsigned depth, unsigned evictDepth, UnitList* out) {
+    for (int i = 0; i < 16; i++) {
+        ChildNode* c = node->children[i];
+        if (c == NULL || c->isLeaf) continue;
+        if (depth + 1 < evictDepth) {
+            collectUnits(c->node.internal, depth + 1, evictDepth, out);
+            continue;
+        }
+        c->flags |= JMT_CHILD_UNIT;
+        if (out->count == out->cap) {
+            out->cap = out->cap ? out->cap * 2 : 256;
+            SYSCN(out->items, (ChildNode**)realloc(out->items, out->cap * sizeof(ChildNode*)), "Error allocating unit list");
+        }
+        out->items[out->count++] = c;
+    }
+}
+
+void nodeStoreEnforce(NodeStore* s, InternalNode* root) {
+    if (s->resident <= s->budget) return;
+    JMT_WITH_STORE(s);
+
+    UnitList units = {0};
+    collectUnits(root, 0, s->evictDepth, &units);
+    if (units.count == 0) return;
+
+    // CLOCK: un'unità referenziata perde il bit e viene risparmiata per un giro, le altre sono sfrattate
+    size_t target = s->budget / 8 * 7;
+    size_t i = s->hand % units.count;
+    for (size_t steps = 0; steps < 2 * units.count && s->resident > target; steps++) {
+        ChildNode* c = units.items[i];
+        if (!(c->flags & JMT_CHILD_EVICTED)) {
+            if (c->flags & JMT_CHILD_REFERENCED) c->flags &= (uint8_t)~JMT_CHILD_REFERENCED;
+            else evictUnit(s, c);
+        }
+        i = (i + 1) % units.count;
+    }
+    s->hand = i;
+    free(units.items);
+}
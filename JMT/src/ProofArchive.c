@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "macros.h"
+#include "ServeProto.h"
+#include "ProofArchive.h"
+
+struct ProofArchiveWriter {
+    FILE* f;
+    uint64_t offset;            // fine dei record scritti finora
+    HashValue* hashes;          // tabella in ordine di prima comparsa
+    size_t hashCount;
+    size_t hashCap;
+    uint32_t* slots;            // indirizzamento aperto: indice nella tabella + 1, 0 = vuoto
+    size_t slotCap;
+    uint64_t* index;
+    size_t proofCount;
+    size_t indexCap;
+    ServeBuf record;
+    uint64_t references;
+};
+
+struct ProofArchive {
+    const uint8_t* data;
+    size_t size;
+    JMTArchiveHeader header;
+    const uint8_t* hashes;
+    const uint8_t* index;
+};
+
+static void putVarint(ServeBuf* b, uint64_t v) {
+    while (v >= 0x80) {
+        serveBufPutU8(b, (uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    serveBufPutU8(b, (uint8_t)v);
+}
+
+// I digest sono già uniformi: i primi 8 byte bastano come hash della tabella
+static inline size_t slotOf(const HashValue* h, size_t cap) {
+    uint64_t k;
+    memcpy(&k, h->hash_bytes, sizeof(k));
+    return (size_t)(k * 0x9E3779B97F4A7C15ull) & (cap - 1);
+}
+
+static void growSlots(ProofArchiveWriter* w) {
+    size_t cap = w->slotCap ? w->slotCap * 2 : 1 << 16;
+    uint32_t* slots;
+    SYSCN(slots, (uint32_t*)calloc(cap, sizeof(uint32_t)), "Error allocating archive hash slots");
+    for (size_t i = 0; i < w->hashCount; i++) {
+        size_t s = slotOf(&w->hashes[i], cap);
+        while (slots[s] != 0) s = (s + 1) & (cap - 1);
+        slots[s] = (uint32_t)(i + 1);
+    }
+    free(w->slots);
+    w->slots = slots;
+    w->slotCap = cap;
+}
+
+static void putRef(ProofArchiveWriter* w, const HashValue* h) {
+    if (2 * (w->hashCount + 1) > w->slotCap) growSlots(w);
+    size_t s = slotOf(h, w->slotCap);
+    while (w->slots[s] != 0) {
+        uint32_t id = w->slots[s] - 1;
+        if (memcmp(&w->hashes[id], h, sizeof(HashValue)) == 0) {
+            putVarint(&w->record, id);
+            w->references++;
+            return;
+        }
+        s = (s + 1) & (w->slotCap - 1);
+    }
+    if (w->hashCount == w->hashCap) {
+        w->hashCap = w->hashCap ? w->hashCap * 2 : 1 << 15;
+        SYSCN(w->hashes, (HashValue*)realloc(w->hashes, w->hashCap * sizeof(HashValue)), "Error allocating archive hash table");
+    }
+    w->hashes[w->hashCount] = *h;
+    w->slots[s] = (uint32_t)(w->hashCount + 1);
+    putVarint(&w->record, w->hashCount++);
+    w->references++;
+}
+
+static void putKey(ServeBuf* b, const NodeKey* key) {
+    const NibblePath* path = &key->nibble_path;
+    serveBufPutU8(b, (uint8_t)path->nibblesLength);
+    serveBufPut(b, path->nibbles, (path->nibblesLength + 1) / 2);
+}
+
+static bool putProof(ProofArchiveWriter* w, const Proof* P) {
+    size_t levels = 0;
+    for (LevelSibling* l = P->levels; l != NULL; l = l->next) levels++;
+    if (P->depth > UINT8_MAX || levels > UINT8_MAX) return false;
+
+    serveBufPutU8(&w->record, (uint8_t)P->depth);
+    putRef(w, &P->leafHash);
+    serveBufPutU8(&w->record, (uint8_t)levels);
+    for (LevelSibling* l = P->levels; l != NULL; l = l->next) {
+        uint16_t mask = 0;
+        int prev = 16;
+        for (Sibling* s = l->siblings; s != NULL; s = s->next) {
+            // La maschera ricostruisce i fratelli per slot decrescente: altri ordini non si rappresentano
+            if (s->index >= prev) return false;
+            mask |= (uint16_t)(1u << s->index);
+            prev = s->index;
+        }
+        serveBufPutU16(&w->record, mask);
+        for (Sibling* s = l->siblings; s != NULL; s = s->next) putRef(w, &s->hash);
+    }
+    return true;
+}
+
+ProofArchiveWriter* proofArchiveCreate(const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        perror("Error opening proof archive");
+        return NULL;
+    }
+    ProofArchiveWriter* w;
+    SYSCN(w, (ProofArchiveWriter*)calloc(1, sizeof(ProofArchiveWriter)), "Error allocating archive writer");
+    w->f = f;
+    // Header provvisorio: quello vero si conosce solo a fine archivio
+    JMTArchiveHeader h;
+    memset(&h, 0, sizeof(h));
+    if (fwrite(&h, sizeof(h), 1, f) != 1) {
+        perror("Error writing proof archive");
+        fclose(f);
+        free(w);
+        return NULL;
+    }
+    w->offset = sizeof(h);
+    return w;
+}
+
+bool proofArchiveAppend(ProofArchiveWriter* w, Proof* proof, AncestryProof* ancestry, NodeKey* key,
+                        const uint8_t* value, size_t valueLen, HashValue root) {
+    ServeBuf* b = &w->record;
+    b->len = 0;
+
+    uint8_t flags = 0;
+    if (proof->isPresent) flags |= PROOFARCH_PRESENT;
+    if (ancestry->splitted) flags |= PROOFARCH_SPLITTED;
+    if (ancestry->proof.isPresent) flags |= PROOFARCH_ANCESTRY_PRESENT;
+    serveBufPutU8(b, flags);
+    putKey(b, key);
+    putVarint(b, valueLen);
+    serveBufPut(b, value, valueLen);
+    putRef(w, &root);
+    bool ok = putProof(w, proof);
+
+    serveBufPutU8(b, (uint8_t)ancestry->preForkingDepth);
+    putKey(b, &ancestry->key);
+    putRef(w, &ancestry->RootN);
+    ok = ok && ancestry->preForkingDepth <= UINT8_MAX && putProof(w, &ancestry->proof);
+    if (!ok) {
+        fprintf(stderr, "Error: proof %zu cannot be archived (unsorted siblings or too many levels)\n", w->proofCount);
+        return false;
+    }
+
+    if (fwrite(b->data, b->len, 1, w->f) != 1) {
+        perror("Error writing proof archive");
+        return false;
+    }
+    if (w->proofCount == w->indexCap) {
+        w->indexCap = w->indexCap ? w->indexCap * 2 : 1024;
+        SYSCN(w->index, (uint64_t*)realloc(w->index, w->indexCap * sizeof(uint64_t)), "Error allocating archive index");
+    }
+    w->index[w->proofCount++] = w->offset;
+    w->offset += b->len;
+    return true;
+}
+
+bool proofArchiveFinish(ProofArchiveWriter* w, ProofArchiveStats* stats) {
+    JMTArchiveHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, JMTARCH_MAGIC, sizeof(h.magic));
+    h.format = JMTARCH_FORMAT;
+    h.hashKind = (uint32_t)jmtActiveHasher()->kind;
+    h.proofs = w->proofCount;
+    h.hashes = w->hashCount;
+    h.hashesOffset = w->offset;
+    h.indexOffset = w->offset + w->hashCount * sizeof(HashValue);
+
+    ServeBuf index = {0};
+    for (size_t i = 0; i < w->proofCount; i++) serveBufPutU64(&index, w->index[i]);
+
+    bool ok = (w->hashCount == 0 || fwrite(w->hashes, sizeof(HashValue), w->hashCount, w->f) == w->hashCount) &&
+              (index.len == 0 || fwrite(index.data, index.len, 1, w->f) == 1) &&
+              fseek(w->f, 0, SEEK_SET) == 0 &&
+              fwrite(&h, sizeof(h), 1, w->f) == 1;
+    if (fclose(w->f) != 0) ok = false;
+    if (!ok) perror("Error writing proof archive");
+
+    if (ok && stats) {
+        stats->proofs = w->proofCount;
+        stats->hashes = w->hashCount;
+        stats->references = w->references;
+        stats->bytes = h.indexOffset + index.len;
+    }
+    serveBufFree(&index);
+    serveBufFree(&w->record);
+    free(w->hashes);
+    free(w->slots);
+    free(w->index);
+    free(w);
+    return ok;
+}
+
+
+ProofArchive* proofArchiveOpen(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror("Error opening proof archive");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(JMTArchiveHeader)) {
+        fprintf(stderr, "Error: %s is not a proof archive\n", path);
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Error mapping proof archive");
+        return NULL;
+    }
+
+    ProofArchive* a;
+    SYSCN(a, (ProofArchive*)calloc(1, sizeof(ProofArchive)), "Error allocating proof archive");
+    a->data = data;
+    a->size = (size_t)st.st_size;
+    memcpy(&a->header, data, sizeof(JMTArchiveHeader));
+    const JMTArchiveHeader* h = &a->header;
+    bool valid = memcmp(h->magic, JMTARCH_MAGIC, sizeof(h->magic)) == 0 && h->format == JMTARCH_FORMAT &&
+                 proofArchiveHasher(a) != NULL &&
+                 h->hashesOffset >= sizeof(JMTArchiveHeader) && h->hashesOffset <= a->size &&
+                 h->hashes <= (a->size - h->hashesOffset) / sizeof(HashValue) &&
+                 h->indexOffset == h->hashesOffset + h->hashes * sizeof(HashValue) &&
+                 h->proofs == (a->size - h->indexOffset) / sizeof(uint64_t) &&
+                 (a->size - h->indexOffset) % sizeof(uint64_t) == 0;
+    if (!valid) {
+        fprintf(stderr, "Error: %s is not a valid proof archive\n", path);
+        proofArchiveClose(a);
+        return NULL;
+    }
+    a->hashes = a->data + h->hashesOffset;
+    a->index = a->data + h->indexOffset;
+    return a;
+}
+
+size_t proofArchiveCount(const ProofArchive* a) {
+    return (size_t)a->header.proofs;
+}
+
+const JMTHasher* proofArchiveHasher(const ProofArchive* a) {
+    if (a->header.hashKind == JMT_HASH_KECCAK256) return &jmtKeccak256;
+    if (a->header.hashKind == JMT_HASH_SHA256) return &jmtSha256;
+    return NULL;
+}
+
+void proofArchiveClose(ProofArchive* a) {
+    if (a == NULL) return;
+    munmap((void*)a->data, a->size);
+    free(a);
+}
+
+
+typedef struct {
+    const uint8_t* p;
+    const uint8_t* end;
+    const ProofArchive* a;
+} ArchiveCursor;
+
+static bool getU8(ArchiveCursor* c, uint8_t* v) {
+    if (c->p >= c->end) return false;
+    *v = *c->p++;
+    return true;
+}
+
+static bool getVarint(ArchiveCursor* c, uint64_t* v) {
+    *v = 0;
+    for (int shift = 0; shift < 64 && c->p < c->end; shift += 7) {
+        uint8_t b = *c->p++;
+        *v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+static bool getRef(ArchiveCursor* c, HashValue* h) {
+    uint64_t id;
+    if (!getVarint(c, &id) || id >= c->a->header.hashes) return false;
+    memcpy(h->hash_bytes, c->a->hashes + id * sizeof(HashValue), sizeof(HashValue));
+    return true;
+}
+
+static bool getKey(ArchiveCursor* c, NodeKey* key) {
+    uint8_t nibbles;
+    if (!getU8(c, &nibbles)) return false;
+    size_t bytes = (nibbles + 1) / 2;
+    if ((size_t)(c->end - c->p) < bytes) return false;
+    key->nibble_path.nibblesLength = nibbles;
+    SYSCN(key->nibble_path.nibbles, (uint8_t*)malloc(bytes ? bytes : 1), "Error allocating archived key");
+    memcpy(key->nibble_path.nibbles, c->p, bytes);
+    c->p += bytes;
+    return true;
+}
+
+static bool getProof(ArchiveCursor* c, Proof* P) {
+    uint8_t depth, levels;
+    if (!getU8(c, &depth) || !getRef(c, &P->leafHash) || !getU8(c, &levels)) return false;
+    P->depth = depth;
+
+    LevelSibling** tail = &P->levels;
+    for (uint8_t l = 0; l < levels; l++) {
+        if (c->end - c->p < 2) return false;
+        uint16_t mask = serveGetU16(c->p);
+        c->p += 2;
+
+        LevelSibling* level;
+        SYSCN(level, (LevelSibling*)malloc(sizeof(LevelSibling)), "Error allocating for level");
+        level->siblings = NULL;
+        level->next = NULL;
+        *tail = level;
+        tail = &level->next;
+
+        Sibling** sTail = &level->siblings;
+        for (int i = 15; i >= 0; i--) {
+            if (!(mask & (1u << i))) continue;
+            HashValue h;
+            if (!getRef(c, &h)) return false;
+            *sTail = createSiblingNode((uint8_t)i, h);
+            sTail = &(*sTail)->next;
+        }
+    }
+    return true;
+}
+
+bool proofArchiveGet(const ProofArchive* a, size_t index, ArchivedProof* out) {
+    memset(out, 0, sizeof(*out));
+    if (index >= a->header.proofs) return false;
+    uint64_t start = serveGetU64(a->index + index * sizeof(uint64_t));
+    uint64_t end = index + 1 < a->header.proofs ? serveGetU64(a->index + (index + 1) * sizeof(uint64_t)) : a->header.hashesOffset;
+    if (start < sizeof(JMTArchiveHeader) || start > end || end > a->header.hashesOffset) return false;
+
+    ArchiveCursor c = {a->data + start, a->data + end, a};
+    uint8_t flags, preFork;
+    uint64_t valueLen;
+    bool ok = getU8(&c, &flags) && getKey(&c, &out->key) &&
+              getVarint(&c, &valueLen) && valueLen <= (uint64_t)(c.end - c.p);
+    if (ok) {
+        SYSCN(out->value, (uint8_t*)malloc(valueLen ? valueLen : 1), "Error allocating archived value");
+        memcpy(out->value, c.p, valueLen);
+        out->valueLength = valueLen;
+        c.p += valueLen;
+    }
+    ok = ok && getRef(&c, &out->root) && getProof(&c, &out->proof) &&
+         getU8(&c, &preFork) && getKey(&c, &out->ancestry.key) &&
+         getRef(&c, &out->ancestry.RootN) && getProof(&c, &out->ancestry.proof) && c.p == c.end;
+    if (!ok) {
+        fprintf(stderr, "Error: corrupted record %zu in proof archive\n", index);
+        freeArchivedProof(out);
+        return false;
+    }
+    out->proof.isPresent = (flags & PROOFARCH_PRESENT) != 0;
+    out->ancestry.splitted = (flags & PROOFARCH_SPLITTED) != 0;
+    out->ancestry.proof.isPresent = (flags & PROOFARCH_ANCESTRY_PRESENT) != 0;
+    out->ancestry.preForkingDepth = preFork;
+    return true;
+}
+
+void freeArchivedProof(ArchivedProof* p) {
+    if (p == NULL) return;
+    free(p->key.nibble_path.nibbles);
+    free(p->ancestry.key.nibble_path.nibbles);
+    free(p->value);
+    freeProof(&p->proof);
+    freeProof(&p->ancestry.proof);
+    memset(p, 0, sizeof(*p));
+}
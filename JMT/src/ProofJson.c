@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "macros.h"
+#include "ProofJson.h"
+
+// Parser minimale per il solo formato delle prove esportate: niente escape nelle stringhe, niente numeri negativi
+typedef struct {
+    const char* p;
+    const char* end;
+} Cursor;
+
+#define MAX_NESTING 64
+
+static inline void skipWs(Cursor* c) {
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\n' || *c->p == '\r' || *c->p == '\t')) c->p++;
+}
+
+static inline bool expect(Cursor* c, char ch) {
+    skipWs(c);
+    if (c->p < c->end && *c->p == ch) {
+        c->p++;
+        return true;
+    }
+    return false;
+}
+
+static bool parseString(Cursor* c, const char** s, size_t* len) {
+    if (!expect(c, '"')) return false;
+    const char* start = c->p;
+    const char* close = memchr(start, '"', (size_t)(c->end - start));
+    if (close == NULL || memchr(start, '\\', (size_t)(close - start)) != NULL) return false;
+    c->p = close;
+    *s = start;
+    *len = (size_t)(c->p - start);
+    c->p++;
+    return true;
+}
+
+static bool parseUint(Cursor* c, uint64_t* v) {
+    skipWs(c);
+    const char* start = c->p;
+    uint64_t x = 0;
+    while (c->p < c->end && *c->p >= '0' && *c->p <= '9') {
+        x = x * 10 + (uint64_t)(*c->p - '0');
+        c->p++;
+    }
+    *v = x;
+    return c->p != start && c->p - start <= 20;
+}
+
+static bool parseBool(Cursor* c, bool* v) {
+    skipWs(c);
+    if (c->end - c->p >= 4 && memcmp(c->p, "true", 4) == 0) {
+        c->p += 4;
+        *v = true;
+        return true;
+    }
+    if (c->end - c->p >= 5 && memcmp(c->p, "false", 5) == 0) {
+        c->p += 5;
+        *v = false;
+        return true;
+    }
+    return false;
+}
+
+// Valore delle cifre esadecimali, -1 per gli altri caratteri
+static const int8_t hexTable[256] = {
+    [0 ... 255] = -1,
+    ['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4, ['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+    ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+    ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15
+};
+
+static inline int hexValue(char ch) {
+    return hexTable[(uint8_t)ch];
+}
+
+bool parseHashHex(const char* s, size_t len, HashValue* h) {
+    if (len == 66 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        s += 2;
+        len -= 2;
+    }
+    if (len != 64) return false;
+    int bad = 0;
+    for (size_t i = 0; i < 32; i++) {
+        int hi = hexValue(s[2 * i]), lo = hexValue(s[2 * i + 1]);
+        bad |= hi | lo;
+        h->hash_bytes[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return bad >= 0;
+}
+
+static bool parseHash(Cursor* c, HashValue* h) {
+    const char* s;
+    size_t len;
+    return parseString(c, &s, &len) && parseHashHex(s, len, h);
+}
+
+static bool skipValue(Cursor* c, int nesting) {
+    if (nesting > MAX_NESTING) return false;
+    skipWs(c);
+    if (c->p >= c->end) return false;
+
+    char ch = *c->p;
+    if (ch == '"') {
+        const char* s;
+        size_t len;
+        return parseString(c, &s, &len);
+    }
+    if (ch == '{' || ch == '[') {
+        char close = ch == '{' ? '}' : ']';
+        c->p++;
+        if (expect(c, close)) return true;
+        for (;;) {
+            if (ch == '{') {
+                const char* s;
+                size_t len;
+                if (!parseString(c, &s, &len) || !expect(c, ':')) return false;
+            }
+            if (!skipValue(c, nesting + 1)) return false;
+            if (expect(c, close)) return true;
+            if (!expect(c, ',')) return false;
+        }
+    }
+    // Numeri e letterali
+    const char* start = c->p;
+    while (c->p < c->end && *c->p != ',' && *c->p != '}' && *c->p != ']' &&
+           *c->p != ' ' && *c->p != '\n' && *c->p != '\r' && *c->p != '\t') {
+        c->p++;
+    }
+    return c->p != start;
+}
+
+// Coppia chiave/valore successiva di un oggetto già aperto: 1 con la chiave, 0 a fine oggetto, -1 su errore
+static int nextKey(Cursor* c, bool* first, const char** key, size_t* len) {
+    if (expect(c, '}')) return 0;
+    if (!*first && !expect(c, ',')) return -1;
+    *first = false;
+    if (!parseString(c, key, len) || !expect(c, ':')) return -1;
+    return 1;
+}
+
+static inline bool keyIs(const char* key, size_t len, const char* name) {
+    return strlen(name) == len && memcmp(key, name, len) == 0;
+}
+
+// I fratelli restano nell'ordine del file, che è quello prodotto da generateProof
+static bool parseSiblings(Cursor* c, LevelSibling* level) {
+    if (!expect(c, '[')) return false;
+    if (expect(c, ']')) return true;
+
+    Sibling** tail = &level->siblings;
+    for (;;) {
+        if (!expect(c, '{')) return false;
+        uint64_t index = 16;
+        HashValue hash;
+        bool hasHash = false;
+        bool first = true;
+        const char* key;
+        size_t len;
+        int r;
+        while ((r = nextKey(c, &first, &key, &len)) > 0) {
+            if (keyIs(key, len, "index")) {
+                if (!parseUint(c, &index)) return false;
+            } else if (keyIs(key, len, "hash")) {
+                if (!parseHash(c, &hash)) return false;
+                hasHash = true;
+            } else if (!skipValue(c, 0)) {
+                return false;
+            }
+        }
+        if (r < 0 || index > 15 || !hasHash) return false;
+
+        Sibling* s = createSiblingNode((uint8_t)index, hash);
+        *tail = s;
+        tail = &s->next;
+
+        if (expect(c, ']')) return true;
+        if (!expect(c, ',')) return false;
+    }
+}
+
+static bool parseLevels(Cursor* c, Proof* P, size_t* count) {
+    if (!expect(c, '[')) return false;
+    if (expect(c, ']')) return true;
+
+    LevelSibling** tail = &P->levels;
+    for (;;) {
+        if (!expect(c, '{')) return false;
+        LevelSibling* level;
+        SYSCN(level, (LevelSibling*)calloc(1, sizeof(LevelSibling)), "Error allocating for level");
+        *tail = level;
+        tail = &level->next;
+        (*count)++;
+
+        bool first = true;
+        const char* key;
+        size_t len;
+        int r;
+        while ((r = nextKey(c, &first, &key, &len)) > 0) {
+            if (keyIs(key, len, "siblings")) {
+                if (!parseSiblings(c, level)) return false;
+            } else if (!skipValue(c, 0)) {
+                return false;
+            }
+        }
+        if (r < 0) return false;
+
+        if (expect(c, ']')) return true;
+        if (!expect(c, ',')) return false;
+    }
+}
+
+static bool parseProof(Cursor* c, Proof* P) {
+    if (!expect(c, '{')) return false;
+
+    uint64_t depth = 0;
+    bool hasDepth = false;
+    size_t levels = 0;
+    bool first = true;
+    const char* key;
+    size_t len;
+    int r;
+    while ((r = nextKey(c, &first, &key, &len)) > 0) {
+        bool ok;
+        if (keyIs(key, len, "isMembership")) ok = parseBool(c, &P->isPresent);
+        else if (keyIs(key, len, "depth")) ok = hasDepth = parseUint(c, &depth);
+        else if (keyIs(key, len, "leafHash")) ok = parseHash(c, &P->leafHash);
+        else if (keyIs(key, len, "levels")) ok = parseLevels(c, P, &levels);
+        else ok = skipValue(c, 0);
+        if (!ok) return false;
+    }
+    if (r < 0) return false;
+
+    P->depth = hasDepth ? depth : levels;
+    return levels == P->depth;
+}
+
+bool parseProofRecord(const char** cursor, const char* end, ProofRecord* out) {
+    Cursor c = {*cursor, end};
+    memset(out, 0, sizeof(*out));
+
+    skipWs(&c);
+    if (c.p >= c.end || !expect(&c, '{')) {
+        *cursor = c.p;
+        return false;
+    }
+
+    bool hasProof = false, hasToken = false, hasVersion = false;
+    bool first = true;
+    const char* key;
+    size_t len;
+    int r;
+    while ((r = nextKey(&c, &first, &key, &len)) > 0) {
+        bool ok;
+        uint64_t v;
+        if (keyIs(key, len, "tokenId")) {
+            ok = hasToken = parseUint(&c, &out->tokenId);
+        } else if (keyIs(key, len, "version")) {
+            ok = hasVersion = parseUint(&c, &v) && v <= UINT32_MAX;
+            out->version = (uint32_t)v;
+        } else if (keyIs(key, len, "value")) {
+            const char* s;
+            ok = parseString(&c, &s, &out->valueLength) && out->valueLength <= PROOFJSON_MAX_VALUE;
+            if (ok) memcpy(out->value, s, out->valueLength);
+        } else if (keyIs(key, len, "root")) {
+            ok = out->hasRoot = parseHash(&c, &out->root);
+        } else if (keyIs(key, len, "hash")) {
+            const char* name;
+            size_t nameLen;
+            char buf[16];
+            ok = parseString(&c, &name, &nameLen) && nameLen < sizeof(buf);
+            if (ok) {
+                memcpy(buf, name, nameLen);
+                buf[nameLen] = '\0';
+                ok = (out->hasher = jmtHasherByName(buf)) != NULL;
+            }
+        } else if (keyIs(key, len, "keyMode")) {
+            const char* mode;
+            size_t modeLen;
+            ok = parseString(&c, &mode, &modeLen);
+            if (ok && modeLen == 6 && memcmp(mode, "hashed", 6) == 0) out->hashedKey = true;
+            else ok = ok && modeLen == 5 && memcmp(mode, "plain", 5) == 0;
+        } else if (keyIs(key, len, "proof")) {
+            ok = hasProof = parseProof(&c, &out->proof);
+        } else {
+            ok = skipValue(&c, 0);
+        }
+        if (!ok) {
+            r = -1;
+            break;
+        }
+    }
+
+    *cursor = c.p;
+    if (r < 0 || !hasProof || !hasToken || !hasVersion) {
+        freeProof(&out->proof);
+        return false;
+    }
+    if (out->hasher == NULL) out->hasher = &jmtKeccak256;
+    out->key = buildKeyFromParts(out->version, out->tokenId);
+    if (out->hashedKey) {
+        NodeKey hashed = hashedKey(&out->key);
+        free(out->key.nibble_path.nibbles);
+        out->key = hashed;
+    }
+    return true;
+}
+
+void freeProofRecord(ProofRecord* r) {
+    if (r == NULL) return;
+    freeProof(&r->proof);
+    free(r->key.nibble_path.nibbles);
+    r->key.nibble_path.nibbles = NULL;
+}
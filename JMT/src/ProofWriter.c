@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "macros.h"
+#include "ProofWriter.h"
+
+typedef enum { STAGE_OPEN, STAGE_WRITE, STAGE_CLOSE } FileStage;
+
+typedef struct {
+    char* path;
+    char* data;
+    size_t len;
+    size_t done;
+    int fd;
+    FileStage stage;
+    bool failed;
+} PendingFile;
+
+typedef struct {
+    int fd;
+    struct io_uring_params params;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+    unsigned toSubmit;          // SQE preparate e non ancora passate al kernel
+    PendingFile* slots;         // user_data di ogni SQE è l'indice dello slot
+    unsigned* freeSlots;
+    unsigned freeCount;
+} Uring;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+    PendingFile* queue;         // coda circolare, con busy al più depth file
+    size_t head;
+    size_t count;
+    unsigned busy;              // file presi in carico dai thread
+    bool stopping;
+    pthread_t threads[PROOF_IO_THREADS_MAX];
+    unsigned threadCount;
+} ThreadPool;
+
+struct ProofWriter {
+    ProofIOBackend backend;
+    unsigned depth;
+    unsigned inFlight;
+    ProofWriterStats stats;
+    Uring ring;
+    ThreadPool pool;
+};
+
+bool proofIOBackendByName(const char* name, ProofIOBackend* out) {
+    if (strcmp(name, "auto") == 0) *out = PROOF_IO_AUTO;
+    else if (strcmp(name, "uring") == 0 || strcmp(name, "io_uring") == 0) *out = PROOF_IO_URING;
+    else if (strcmp(name, "threads") == 0) *out = PROOF_IO_THREADS;
+    else if (strcmp(name, "sync") == 0) *out = PROOF_IO_SYNC;
+    else return false;
+    return true;
+}
+
+const char* proofWriterBackendName(const ProofWriter* w) {
+    switch (w->backend) {
+        case PROOF_IO_URING: return "io_uring";
+        case PROOF_IO_THREADS: return "threads";
+        default: return "sync";
+    }
+}
+
+static void noteQueued(ProofWriter* w, unsigned inFlight) {
+    w->stats.depthSum += inFlight;
+    if (inFlight > w->stats.maxDepth) w->stats.maxDepth = inFlight;
+}
+
+static void finishFile(ProofWriterStats* stats, PendingFile* f) {
+    if (f->failed) {
+        stats->errors++;
+    } else {
+        stats->files++;
+        stats->bytes += f->len;
+    }
+    free(f->path);
+    free(f->data);
+}
+
+static void writeFileNow(PendingFile* f) {
+    int fd = open(f->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd == -1) {
+        fprintf(stderr, "Error opening %s: %s\n", f->path, strerror(errno));
+        f->failed = true;
+        return;
+    }
+    while (f->done < f->len) {
+        ssize_t n = write(fd, f->data + f->done, f->len - f->done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            fprintf(stderr, "Error writing %s: %s\n", f->path, strerror(errno));
+            f->failed = true;
+            break;
+        }
+        f->done += (size_t)n;
+    }
+    if (close(fd) != 0 && !f->failed) {
+        fprintf(stderr, "Error closing %s: %s\n", f->path, strerror(errno));
+        f->failed = true;
+    }
+}
+
+
+// --- io_uring ---
+
+static bool uringProbe(int fd) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe;
+    SYSCN(probe, (struct io_uring_probe*)calloc(1, size), "Error allocating io_uring probe");
+    bool ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    const uint8_t ops[] = {IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_CLOSE};
+    for (size_t i = 0; ok && i < sizeof(ops); i++) {
+        ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+static void uringClose(Uring* r) {
+    if (r->sqes) munmap(r->sqes, r->sqesSize);
+    if (r->cqRing && r->cqRing != r->sqRing) munmap(r->cqRing, r->cqRingSize);
+    if (r->sqRing) munmap(r->sqRing, r->sqRingSize);
+    if (r->fd >= 0) close(r->fd);
+    free(r->slots);
+    free(r->freeSlots);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+static bool uringSetup(Uring* r, unsigned depth) {
+    memset(r, 0, sizeof(*r));
+    r->fd = (int)syscall(__NR_io_uring_setup, depth, &r->params);
+    if (r->fd < 0) return false;
+    struct io_uring_params* p = &r->params;
+    if (!uringProbe(r->fd)) {
+        uringClose(r);
+        return false;
+    }
+
+    r->sqRingSize = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    r->cqRingSize = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    // Con SINGLE_MMAP i due anelli stanno nella stessa mappatura
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cqRingSize > r->sqRingSize) r->sqRingSize = r->cqRingSize;
+        r->cqRingSize = r->sqRingSize;
+    }
+    r->sqRing = mmap(NULL, r->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sqRing == MAP_FAILED) {
+        r->sqRing = NULL;
+        uringClose(r);
+        return false;
+    }
+    r->cqRing = r->sqRing;
+    if (!(p->features & IORING_FEAT_SINGLE_MMAP)) {
+        r->cqRing = mmap(NULL, r->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cqRing == MAP_FAILED) {
+            r->cqRing = NULL;
+            uringClose(r);
+            return false;
+        }
+    }
+    r->sqesSize = p->sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        uringClose(r);
+        return false;
+    }
+
+    uint8_t* sq = r->sqRing;
+    uint8_t* cq = r->cqRing;
+    r->sqTail = (unsigned*)(sq + p->sq_off.tail);
+    r->sqMask = (unsigned*)(sq + p->sq_off.ring_mask);
+    r->sqArray = (unsigned*)(sq + p->sq_off.array);
+    r->cqHead = (unsigned*)(cq + p->cq_off.head);
+    r->cqTail = (unsigned*)(cq + p->cq_off.tail);
+    r->cqMask = (unsigned*)(cq + p->cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p->cq_off.cqes);
+
+    SYSCN(r->slots, (PendingFile*)calloc(depth, sizeof(PendingFile)), "Error allocating io_uring slots");
+    SYSCN(r->freeSlots, (unsigned*)malloc(depth * sizeof(unsigned)), "Error allocating io_uring slots");
+    for (unsigned i = 0; i < depth; i++) r->freeSlots[i] = depth - 1 - i;
+    r->freeCount = depth;
+    return true;
+}
+
+// Ogni file ha al più una SQE in volo e i file sono al più depth <= sq_entries: l'anello non si riempie mai
+static struct io_uring_sqe* uringNextSqe(Uring* r, unsigned slot, uint8_t opcode) {
+    unsigned tail = *r->sqTail;
+    unsigned index = tail & *r->sqMask;
+    struct io_uring_sqe* sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = slot;
+    r->sqArray[index] = index;
+    __atomic_store_n(r->sqTail, tail + 1, __ATOMIC_RELEASE);
+    r->toSubmit++;
+    return sqe;
+}
+
+static void uringQueueStage(Uring* r, unsigned slot) {
+    PendingFile* f = &r->slots[slot];
+    struct io_uring_sqe* sqe;
+    switch (f->stage) {
+        case STAGE_OPEN:
+            sqe = uringNextSqe(r, slot, IORING_OP_OPENAT);
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)(uintptr_t)f->path;
+            sqe->len = 0666;
+            sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+            break;
+        case STAGE_WRITE:
+            sqe = uringNextSqe(r, slot, IORING_OP_WRITE);
+            sqe->fd = f->fd;
+            sqe->addr = (uint64_t)(uintptr_t)(f->data + f->done);
+            sqe->len = (uint32_t)(f->len - f->done);
+            sqe->off = f->done;
+            break;
+        case STAGE_CLOSE:
+            sqe = uringNextSqe(r, slot, IORING_OP_CLOSE);
+            sqe->fd = f->fd;
+            break;
+    }
+}
+
+// Il completamento di una fase accoda la successiva; a close completata lo slot torna libero
+static void uringComplete(ProofWriter* w, unsigned slot, int res) {
+    Uring* r = &w->ring;
+    PendingFile* f = &r->slots[slot];
+    switch (f->stage) {
+        case STAGE_OPEN:
+            if (res < 0) {
+                fprintf(stderr, "Error opening %s: %s\n", f->path, strerror(-res));
+                f->failed = true;
+                break;
+            }
+            f->fd = res;
+            f->stage = f->len > 0 ? STAGE_WRITE : STAGE_CLOSE;
+            uringQueueStage(r, slot);
+            return;
+        case STAGE_WRITE:
+            if (res == -EINTR || res == -EAGAIN) {
+                uringQueueStage(r, slot);
+                return;
+            }
+            if (res <= 0) {
+                fprintf(stderr, "Error writing %s: %s\n", f->path, strerror(res < 0 ? -res : EIO));
+                f->failed = true;
+            } else {
+                f->done += (size_t)res;
+            }
+            if (!f->failed && f->done < f->len) {
+                uringQueueStage(r, slot);
+                return;
+            }
+            f->stage = STAGE_CLOSE;
+            uringQueueStage(r, slot);
+            return;
+        case STAGE_CLOSE:
+            if (res < 0 && !f->failed) {
+                fprintf(stderr, "Error closing %s: %s\n", f->path, strerror(-res));
+                f->failed = true;
+            }
+            break;
+    }
+    finishFile(&w->stats, f);
+    r->freeSlots[r->freeCount++] = slot;
+    w->inFlight--;
+}
+
+static void uringReap(ProofWriter* w) {
+    Uring* r = &w->ring;
+    unsigned head = *r->cqHead;
+    unsigned tail = __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe* cqe = &r->cqes[head & *r->cqMask];
+        unsigned slot = (unsigned)cqe->user_data;
+        int res = cqe->res;
+        head++;
+        __atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+        uringComplete(w, slot, res);
+    }
+}
+
+// Passa al kernel le SQE preparate e, se wait, attende almeno un completamento
+static void uringEnter(ProofWriter* w, bool wait) {
+    Uring* r = &w->ring;
+    for (;;) {
+        unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+        long n = syscall(__NR_io_uring_enter, r->fd, r->toSubmit, wait ? 1 : 0, flags, NULL, 0);
+        w->stats.enters++;
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+            if (errno != EINTR) uringReap(w);
+            continue;
+        }
+        if (n < 0) {
+            perror("Error submitting to io_uring");
+            exit(EXIT_FAILURE);
+        }
+        r->toSubmit -= (unsigned)n;
+        if (r->toSubmit == 0) break;
+    }
+    uringReap(w);
+}
+
+static void uringSubmit(ProofWriter* w, PendingFile* file) {
+    Uring* r = &w->ring;
+    while (r->freeCount == 0) uringEnter(w, true);
+
+    unsigned slot = r->freeSlots[--r->freeCount];
+    r->slots[slot] = *file;
+    uringQueueStage(r, slot);
+    w->inFlight++;
+    noteQueued(w, w->inFlight);
+
+    // Le SQE partono a gruppi; i completamenti già arrivati liberano slot e accodano le fasi successive
+    if (r->toSubmit >= 8 || r->toSubmit >= w->depth / 2) uringEnter(w, false);
+    else uringReap(w);
+}
+
+static void uringDrain(ProofWriter* w) {
+    while (w->inFlight > 0) uringEnter(w, true);
+}
+
+
+// --- pool di thread ---
+
+static void* poolWorker(void* arg) {
+    ProofWriter* w = arg;
+    ThreadPool* p = &w->pool;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->count == 0 && !p->stopping) pthread_cond_wait(&p->notEmpty, &p->lock);
+        if (p->count == 0) break;
+        PendingFile f = p->queue[p->head];
+        p->head = (p->head + 1) % w->depth;
+        p->count--;
+        p->busy++;
+        pthread_mutex_unlock(&p->lock);
+
+        writeFileNow(&f);
+
+        pthread_mutex_lock(&p->lock);
+        p->busy--;
+        finishFile(&w->stats, &f);
+        pthread_cond_signal(&p->notFull);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static bool poolStart(ProofWriter* w) {
+    ThreadPool* p = &w->pool;
+    SYSCN(p->queue, (PendingFile*)calloc(w->depth, sizeof(PendingFile)), "Error allocating writer queue");
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->notEmpty, NULL);
+    pthread_cond_init(&p->notFull, NULL);
+    unsigned threads = w->depth < PROOF_IO_THREADS_MAX ? w->depth : PROOF_IO_THREADS_MAX;
+    for (unsigned i = 0; i < threads; i++) {
+        if (pthread_create(&p->threads[i], NULL, poolWorker, w) != 0) break;
+        p->threadCount++;
+    }
+    if (p->threadCount == 0) {
+        fprintf(stderr, "Error: cannot start proof writer threads\n");
+        free(p->queue);
+        return false;
+    }
+    return true;
+}
+
+static void poolSubmit(ProofWriter* w, PendingFile* file) {
+    ThreadPool* p = &w->pool;
+    pthread_mutex_lock(&p->lock);
+    // I file in volo sono quelli in coda più quelli presi dai thread
+    if (p->count + p->busy >= w->depth) w->stats.enters++;
+    while (p->count + p->busy >= w->depth) pthread_cond_wait(&p->notFull, &p->lock);
+    p->queue[(p->head + p->count) % w->depth] = *file;
+    p->count++;
+    noteQueued(w, (unsigned)p->count + p->busy);
+    pthread_cond_signal(&p->notEmpty);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void poolSync(ProofWriter* w) {
+    ThreadPool* p = &w->pool;
+    pthread_mutex_lock(&p->lock);
+    while (p->count + p->busy > 0) pthread_cond_wait(&p->notFull, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void poolStop(ProofWriter* w) {
+    ThreadPool* p = &w->pool;
+    pthread_mutex_lock(&p->lock);
+    p->stopping = true;
+    pthread_cond_broadcast(&p->notEmpty);
+    pthread_mutex_unlock(&p->lock);
+    for (unsigned i = 0; i < p->threadCount; i++) pthread_join(p->threads[i], NULL);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->notEmpty);
+    pthread_cond_destroy(&p->notFull);
+    free(p->queue);
+}
+
+
+ProofWriter* proofWriterStart(ProofIOBackend backend, unsigned depth) {
+    ProofWriter* w;
+    SYSCN(w, (ProofWriter*)calloc(1, sizeof(ProofWriter)), "Error allocating proof writer");
+    w->depth = depth > 0 ? depth : 1;
+    w->ring.fd = -1;
+
+    if (backend == PROOF_IO_AUTO || backend == PROOF_IO_URING) {
+        if (uringSetup(&w->ring, w->depth)) {
+            w->backend = PROOF_IO_URING;
+            return w;
+        }
+        if (backend == PROOF_IO_URING) {
+            fprintf(stderr, "Error: io_uring with openat/write/close is not available\n");
+            free(w);
+            return NULL;
+        }
+        backend = PROOF_IO_THREADS;
+    }
+    if (backend == PROOF_IO_THREADS && !poolStart(w)) {
+        free(w);
+        return NULL;
+    }
+    w->backend = backend;
+    return w;
+}
+
+void proofWriterSubmit(ProofWriter* w, const char* path, char* data, size_t len) {
+    PendingFile f = {0};
+    SYSCN(f.path, strdup(path), "Error allocating proof path");
+    f.data = data;
+    f.len = len;
+    f.fd = -1;
+
+    switch (w->backend) {
+        case PROOF_IO_URING:
+            uringSubmit(w, &f);
+            break;
+        case PROOF_IO_THREADS:
+            poolSubmit(w, &f);
+            break;
+        default:
+            noteQueued(w, 1);
+            writeFileNow(&f);
+            finishFile(&w->stats, &f);
+            break;
+    }
+}
+
+void proofWriterSync(ProofWriter* w) {
+    if (w->backend == PROOF_IO_URING) uringDrain(w);
+    else if (w->backend == PROOF_IO_THREADS) poolSync(w);
+}
+
+bool proofWriterStop(ProofWriter* w, ProofWriterStats* stats) {
+    if (w->backend == PROOF_IO_URING) {
+        uringDrain(w);
+        uringClose(&w->ring);
+    } else if (w->backend == PROOF_IO_THREADS) {
+        poolStop(w);
+    }
+    bool ok = w->stats.errors == 0;
+    if (stats) *stats = w->stats;
+    free(w);
+    return ok;
+}
+
+
+void proofFileName(char* out, size_t cap, const char* dir, uint64_t index) {
+    snprintf(out, cap, "%s/output_%0*lu.json", dir, PROOF_NAME_DIGITS, (unsigned long)index);
+}
+
+int compareProofFileNames(const char* a, const char* b) {
+    size_t la = strlen(a), lb = strlen(b);
+    if (la != lb) return la < lb ? -1 : 1;
+    return strcmp(a, b);
+}
@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "macros.h"
+#include "ServeProto.h"
+
+#define SERVE_MAX_LEVELS JMT_HASHED_KEY_NIBBLES
+
+void serveBufReserve(ServeBuf* b, size_t extra) {
+    if (b->len + extra <= b->cap) return;
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + extra) cap *= 2;
+    SYSCN(b->data, (uint8_t*)realloc(b->data, cap), "Error growing serve buffer");
+    b->cap = cap;
+}
+
+void serveBufPut(ServeBuf* b, const void* src, size_t n) {
+    serveBufReserve(b, n);
+    memcpy(b->data + b->len, src, n);
+    b->len += n;
+}
+
+void serveBufPutU8(ServeBuf* b, uint8_t v) {
+    serveBufReserve(b, 1);
+    b->data[b->len++] = v;
+}
+
+void serveBufPutU16(ServeBuf* b, uint16_t v) {
+    serveBufReserve(b, 2);
+    for (int i = 0; i < 2; i++) b->data[b->len++] = (uint8_t)(v >> (8 * i));
+}
+
+void serveBufPutU32(ServeBuf* b, uint32_t v) {
+    serveBufReserve(b, 4);
+    for (int i = 0; i < 4; i++) b->data[b->len++] = (uint8_t)(v >> (8 * i));
+}
+
+void serveBufPutU64(ServeBuf* b, uint64_t v) {
+    serveBufReserve(b, 8);
+    for (int i = 0; i < 8; i++) b->data[b->len++] = (uint8_t)(v >> (8 * i));
+}
+
+// Scarta i primi n byte (già inviati o già letti)
+void serveBufConsume(ServeBuf* b, size_t n) {
+    if (n >= b->len) {
+        b->len = 0;
+        return;
+    }
+    memmove(b->data, b->data + n, b->len - n);
+    b->len -= n;
+}
+
+void serveBufFree(ServeBuf* b) {
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+uint16_t serveGetU16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint32_t serveGetU32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint64_t serveGetU64(const uint8_t* p) {
+    return (uint64_t)serveGetU32(p) | ((uint64_t)serveGetU32(p + 4) << 32);
+}
+
+void servePutHeader(ServeBuf* b, const ServeHeader* h) {
+    serveBufPutU32(b, h->length);
+    serveBufPutU32(b, h->id);
+    serveBufPutU8(b, h->op);
+    serveBufPutU8(b, h->status);
+    serveBufPutU16(b, h->count);
+}
+
+void serveParseHeader(const uint8_t* p, ServeHeader* h) {
+    h->length = serveGetU32(p);
+    h->id = serveGetU32(p + 4);
+    h->op = p[8];
+    h->status = p[9];
+    h->count = serveGetU16(p + 10);
+}
+
+void serveEncodeProof(ServeBuf* b, const Proof* P, uint32_t version, uint64_t tokenId, bool hashed) {
+    // I livelli sono in lista dalla foglia: si scrivono dalla root, nell'ordine in cui generateProof li aggiunge
+    const LevelSibling* levels[SERVE_MAX_LEVELS];
+    size_t depth = 0;
+    for (const LevelSibling* l = P->levels; l != NULL && depth < SERVE_MAX_LEVELS; l = l->next) levels[depth++] = l;
+
+    serveBufPutU8(b, (P->isPresent ? SERVE_PROOF_PRESENT : 0) | (hashed ? SERVE_PROOF_HASHED : 0));
+    serveBufPutU32(b, version);
+    serveBufPutU64(b, tokenId);
+    serveBufPutU8(b, (uint8_t)depth);
+    serveBufPut(b, P->leafHash.hash_bytes, sizeof(HashValue));
+
+    while (depth > 0) {
+        const LevelSibling* l = levels[--depth];
+        const HashValue* slots[16] = {NULL};
+        uint16_t mask = 0;
+        for (const Sibling* s = l->siblings; s != NULL; s = s->next) {
+            slots[s->index] = &s->hash;
+            mask |= (uint16_t)(1u << s->index);
+        }
+        serveBufPutU16(b, mask);
+        for (int i = 0; i < 16; i++) {
+            if (slots[i] != NULL) serveBufPut(b, slots[i]->hash_bytes, sizeof(HashValue));
+        }
+    }
+}
+
+bool serveDecodeProof(const uint8_t** p, const uint8_t* end, ServeProof* out) {
+    const uint8_t* c = *p;
+    memset(out, 0, sizeof(*out));
+    if (end - c < 1 + 4 + 8 + 1 + (long)sizeof(HashValue)) return false;
+
+    uint8_t flags = c[0];
+    out->version = serveGetU32(c + 1);
+    out->tokenId = serveGetU64(c + 5);
+    uint8_t depth = c[13];
+    c += 14;
+    memcpy(out->proof.leafHash.hash_bytes, c, sizeof(HashValue));
+    c += sizeof(HashValue);
+    out->proof.isPresent = (flags & SERVE_PROOF_PRESENT) != 0;
+    out->hashed = (flags & SERVE_PROOF_HASHED) != 0;
+    if (depth > SERVE_MAX_LEVELS) return false;
+
+    for (uint8_t d = 0; d < depth; d++) {
+        if (end - c < 2) goto truncated;
+        uint16_t mask = serveGetU16(c);
+        c += 2;
+        // Stessa sequenza di addLevel/addSibling di generateProof: la lista risulta dalla foglia, fratelli decrescenti
+        LevelSibling* level = addLevel(&out->proof);
+        for (int i = 0; i < 16; i++) {
+            if (!(mask & (1u << i))) continue;
+            if (end - c < (long)sizeof(HashValue)) goto truncated;
+            HashValue h;
+            memcpy(h.hash_bytes, c, sizeof(HashValue));
+            c += sizeof(HashValue);
+            addSibling(&level, (uint8_t)i, h);
+        }
+    }
+
+    out->key = buildKeyFromParts(out->version, out->tokenId);
+    if (out->hashed) {
+        NodeKey hashed = hashedKey(&out->key);
+        free(out->key.nibble_path.nibbles);
+        out->key = hashed;
+    }
+    *p = c;
+    return true;
+
+truncated:
+    freeProof(&out->proof);
+    return false;
+}
+
+void serveFreeProof(ServeProof* sp) {
+    if (sp == NULL) return;
+    freeProof(&sp->proof);
+    free(sp->key.nibble_path.nibbles);
+    memset(sp, 0, sizeof(*sp));
+}
+
+void serveEncodeProofDelta(ServeBuf* b, const ProofDelta* d) {
+    serveBufPutU64(b, d->fromVersion);
+    serveBufPutU64(b, d->toVersion);
+    serveBufPutU8(b, d->isPresent ? SERVE_PROOF_PRESENT : 0);
+    serveBufPutU8(b, (uint8_t)d->depth);
+    serveBufPut(b, d->leafHash.hash_bytes, sizeof(HashValue));
+    serveBufPutU8(b, (uint8_t)d->levelCount);
+    for (size_t k = 0; k < d->levelCount; k++) {
+        const ProofDeltaLevel* l = &d->levels[k];
+        serveBufPutU8(b, l->level);
+        serveBufPutU16(b, l->siblings);
+        serveBufPutU16(b, l->changed);
+        for (int i = 0; i < 16; i++) {
+            if (l->changed & (1u << i)) serveBufPut(b, l->hashes[i].hash_bytes, sizeof(HashValue));
+        }
+    }
+}
+
+bool serveDecodeProofDelta(const uint8_t** p, const uint8_t* end, ProofDelta* out) {
+    const uint8_t* c = *p;
+    memset(out, 0, sizeof(*out));
+    if (end - c < 8 + 8 + 1 + 1 + (long)sizeof(HashValue) + 1) return false;
+
+    out->fromVersion = serveGetU64(c);
+    out->toVersion = serveGetU64(c + 8);
+    out->isPresent = (c[16] & SERVE_PROOF_PRESENT) != 0;
+    out->depth = c[17];
+    c += 18;
+    memcpy(out->leafHash.hash_bytes, c, sizeof(HashValue));
+    c += sizeof(HashValue);
+    size_t count = *c++;
+    if (out->depth > SERVE_MAX_LEVELS || count > out->depth) return false;
+
+    if (count > 0) SYSCN(out->levels, (ProofDeltaLevel*)calloc(count, sizeof(ProofDeltaLevel)), "Error allocating delta levels");
+    for (size_t k = 0; k < count; k++) {
+        ProofDeltaLevel* l = &out->levels[out->levelCount++];
+        if (end - c < 5) goto truncated;
+        l->level = c[0];
+        l->siblings = serveGetU16(c + 1);
+        l->changed = serveGetU16(c + 3);
+        c += 5;
+        for (int i = 0; i < 16; i++) {
+            if (!(l->changed & (1u << i))) continue;
+            if (end - c < (long)sizeof(HashValue)) goto truncated;
+            memcpy(l->hashes[i].hash_bytes, c, sizeof(HashValue));
+            c += sizeof(HashValue);
+        }
+    }
+    *p = c;
+    return true;
+
+truncated:
+    freeProofDelta(out);
+    return false;
+}
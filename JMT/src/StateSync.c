@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "macros.h"
+#include "ServeProto.h"
+#include "StateSync.h"
+#include "NodeStore.h"
+
+static bool slotChanged(const ChildNode* c, uint64_t fromVersion) {
+    return fromVersion == 0 || c->version > fromVersion;
+}
+
+static void exportNode(InternalNode* node, uint64_t fromVersion, ServeBuf* b, JMTSyncStats* stats) {
+    uint16_t occupied = 0, internal = 0, leaves = 0;
+    for (int j = 0; j < 16; j++) {
+        ChildNode* c = node->children[j];
+        if (c == NULL) continue;
+        occupied |= (uint16_t)(1u << j);
+        if (!slotChanged(c, fromVersion)) continue;
+        if (c->isLeaf) leaves |= (uint16_t)(1u << j);
+        else internal |= (uint16_t)(1u << j);
+    }
+    serveBufPutU16(b, occupied);
+    serveBufPutU16(b, internal);
+    serveBufPutU16(b, leaves);
+    stats->nodes++;
+
+    for (int j = 0; j < 16; j++) {
+        if (!(leaves & (1u << j))) continue;
+        LeafNode* leaf = node->children[j]->node.leaf;
+        const NibblePath* path = &leaf->leafKey.nibble_path;
+        serveBufPutU8(b, (uint8_t)path->nibblesLength);
+        serveBufPut(b, path->nibbles, (path->nibblesLength + 1) / 2);
+        serveBufPutU32(b, leaf->valueLength);
+        serveBufPut(b, leafValue(leaf), leaf->valueLength);
+        stats->leaves++;
+    }
+    for (int j = 0; j < 16; j++) {
+        if (internal & (1u << j)) exportNode(childInternal(node->children[j]), fromVersion, b, stats);
+    }
+}
+
+bool jmtSyncExport(JMT* t, uint64_t fromVersion, FILE* out, JMTSyncStats* stats) {
+    if (t->mutated || fromVersion > t->version) {
+        fprintf(stderr, "Error: sync export needs a committed tree and fromVersion <= %lu\n", (unsigned long)t->version);
+        return false;
+    }
+
+    JMTSyncStats local = {0};
+    ServeBuf body = {0};
+    exportNode(t->root, fromVersion, &body, &local);
+
+    JMTSyncHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, JMTSYNC_MAGIC, sizeof(h.magic));
+    h.format = JMTSYNC_FORMAT;
+    h.hashKind = (uint32_t)t->hasher->kind;
+    h.fromVersion = fromVersion;
+    h.toVersion = t->version;
+    h.nodes = local.nodes;
+    h.bodyBytes = body.len;
+    h.root = t->committedRoot;
+
+    bool ok = fwrite(&h, sizeof(h), 1, out) == 1 &&
+              (body.len == 0 || fwrite(body.data, body.len, 1, out) == 1) &&
+              fflush(out) == 0;
+    if (!ok) perror("Error writing sync segment");
+    serveBufFree(&body);
+
+    if (ok && stats) {
+        stats->segments++;
+        stats->nodes += local.nodes;
+        stats->leaves += local.leaves;
+        stats->bytes += sizeof(h) + h.bodyBytes;
+    }
+    return ok;
+}
+
+
+typedef struct {
+    const uint8_t* p;
+    const uint8_t* end;
+} SyncCursor;
+
+static ChildNode* newChild(uint32_t stamp) {
+    ChildNode* c;
+    SYSCN(c, (ChildNode*)malloc(sizeof(ChildNode)), "Error allocating sync child");
+    c->version = stamp;
+    c->flags = 0;
+    return c;
+}
+
+/*
+ * Un nodo del corpo. Con apply = false controlla solo il formato e che gli slot non cambiati esistano
+ * nella replica (node è NULL per i nodi che la replica non ha ancora); con apply = true modifica l'albero.
+ */
+static bool syncNode(SyncCursor* c, InternalNode* node, size_t depth, bool apply, uint32_t stamp, JMTSyncStats* stats) {
+    if (depth > JMT_HASHED_KEY_NIBBLES || c->end - c->p < 6) return false;
+    uint16_t occupied = serveGetU16(c->p);
+    uint16_t internal = serveGetU16(c->p + 2);
+    uint16_t leaves = serveGetU16(c->p + 4);
+    c->p += 6;
+    if ((internal & leaves) != 0 || ((internal | leaves) & ~occupied) != 0) return false;
+
+    for (int j = 0; j < 16; j++) {
+        uint16_t bit = (uint16_t)(1u << j);
+        ChildNode* existing = node != NULL ? node->children[j] : NULL;
+        if ((occupied & bit) && !((internal | leaves) & bit) && existing == NULL) return false;
+        if (apply && !(occupied & bit) && existing != NULL) {
+            freeChildNode(existing);
+            node->children[j] = NULL;
+            stats->staleSubtrees++;
+        }
+    }
+
+    for (int j = 0; j < 16; j++) {
+        if (!(leaves & (1u << j))) continue;
+        if (c->end - c->p < 1) return false;
+        size_t nibbles = c->p[0];
+        size_t keyBytes = (nibbles + 1) / 2;
+        if (nibbles == 0 || (size_t)(c->end - c->p) < 1 + keyBytes + 4) return false;
+        const uint8_t* keyData = c->p + 1;
+        uint32_t len = serveGetU32(c->p + 1 + keyBytes);
+        c->p += 1 + keyBytes + 4;
+        if (len == 0 || (size_t)(c->end - c->p) < len) return false;
+        const uint8_t* value = c->p;
+        c->p += len;
+        if (!apply) continue;
+
+        NodeKey key = {0};
+        key.nibble_path.nibblesLength = nibbles;
+        key.nibble_path.nibbles = (uint8_t*)keyData;
+        if (node->children[j] != NULL) stats->staleSubtrees++;
+        freeChildNode(node->children[j]);
+        node->children[j] = newChild(stamp);
+        node->children[j]->isLeaf = true;
+        node->children[j]->node.leaf = createLeafNode(key, (uint8_t*)value, len);
+        stats->leaves++;
+    }
+
+    for (int j = 0; j < 16; j++) {
+        if (!(internal & (1u << j))) continue;
+        ChildNode* existing = node != NULL ? node->children[j] : NULL;
+        InternalNode* next = existing != NULL && !existing->isLeaf ? childInternal(existing) : NULL;
+        if (apply) {
+            if (next == NULL) {
+                if (existing != NULL) stats->staleSubtrees++;
+                freeChildNode(existing);
+                node->children[j] = newChild(stamp);
+                node->children[j]->isLeaf = false;
+                node->children[j]->node.internal = next = createInternalNode();
+            }
+            node->children[j]->version = stamp;
+        }
+        if (!syncNode(c, next, depth + 1, apply, stamp, stats)) return false;
+    }
+
+    if (apply) {
+        node->dirty = true;
+        stats->nodes++;
+    }
+    return true;
+}
+
+int jmtSyncImport(JMT* t, FILE* in, JMTSyncStats* stats) {
+    JMTSyncHeader h;
+    size_t got = fread(&h, 1, sizeof(h), in);
+    if (got == 0 && feof(in)) return 0;
+    if (got != sizeof(h) || memcmp(h.magic, JMTSYNC_MAGIC, sizeof(h.magic)) != 0 || h.format != JMTSYNC_FORMAT) {
+        fprintf(stderr, "Error: invalid sync segment header\n");
+        return -1;
+    }
+    if (h.hashKind != (uint32_t)t->hasher->kind) {
+        fprintf(stderr, "Error: sync segment uses a different hash function\n");
+        return -1;
+    }
+    if (t->mutated || h.fromVersion != t->version || h.toVersion < h.fromVersion) {
+        fprintf(stderr, "Error: replica at version %lu, segment from %lu to %lu\n",
+                (unsigned long)t->version, (unsigned long)h.fromVersion, (unsigned long)h.toVersion);
+        return -1;
+    }
+
+    uint8_t* body = NULL;
+    if (h.bodyBytes > 0) SYSCN(body, (uint8_t*)malloc(h.bodyBytes), "Error allocating sync body");
+    if (h.bodyBytes > 0 && fread(body, h.bodyBytes, 1, in) != 1) {
+        fprintf(stderr, "Error: truncated sync segment\n");
+        free(body);
+        return -1;
+    }
+
+    JMT_WITH_HASHER(t->hasher);
+    JMT_WITH_STORE(t->store);
+    JMTSyncStats local = {0};
+    SyncCursor c = {body, body + h.bodyBytes};
+    if (!syncNode(&c, t->root, 0, false, 0, &local) || c.p != c.end) {
+        fprintf(stderr, "Error: malformed sync segment or replica out of sync\n");
+        free(body);
+        return -1;
+    }
+    c.p = body;
+    syncNode(&c, t->root, 0, true, (uint32_t)h.toVersion, &local);
+    free(body);
+
+    // Il commit ricalcola solo i nodi marcati sporchi: quelli del segmento
+    t->mutated = true;
+    jmtCommit(t);
+    t->version = h.toVersion;
+
+    if (stats) {
+        stats->segments++;
+        stats->nodes += local.nodes;
+        stats->leaves += local.leaves;
+        stats->staleSubtrees += local.staleSubtrees;
+        stats->bytes += sizeof(h) + h.bodyBytes;
+    }
+    if (memcmp(&t->committedRoot, &h.root, sizeof(HashValue)) != 0) {
+        fprintf(stderr, "Error: replica root differs from the writer at version %lu\n", (unsigned long)h.toVersion);
+        return -1;
+    }
+    return 1;
+}
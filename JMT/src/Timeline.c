@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "macros.h"
+#include "Timeline.h"
+#include "NodeStore.h"
+
+struct JMTTimelineWriter {
+    FILE* out;
+    bool hasLast;
+    JMTTimelineEntry last;
+};
+
+struct JMTTimeline {
+    uint8_t* data;
+    size_t size;
+    JMTTimelineHeader header;
+    const JMTTimelineEntry* entries;
+    size_t count;
+};
+
+static void fillHeader(JMTTimelineHeader* h, const JMTHasher* hasher, bool hashedKeys) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, JMTTIME_MAGIC, sizeof(h->magic));
+    h->format = JMTTIME_FORMAT;
+    h->hashKind = (uint32_t)hasher->kind;
+    h->flags = hashedKeys ? JMTTIME_HASHED_KEYS : 0;
+}
+
+JMTTimelineWriter* jmtTimelineCreate(const char* path, const JMTHasher* hasher, bool hashedKeys) {
+    JMTTimelineHeader h;
+    fillHeader(&h, hasher, hashedKeys);
+    FILE* out = fopen(path, "wb");
+    if (out == NULL || fwrite(&h, sizeof(h), 1, out) != 1) {
+        perror("Error creating timeline");
+        if (out != NULL) fclose(out);
+        return NULL;
+    }
+
+    JMTTimelineWriter* w;
+    SYSCN(w, (JMTTimelineWriter*)calloc(1, sizeof(JMTTimelineWriter)), "Error allocating timeline writer");
+    w->out = out;
+    return w;
+}
+
+JMTTimelineWriter* jmtTimelineResume(const char* path, const JMTHasher* hasher, bool hashedKeys, uint64_t atVersion) {
+    FILE* out = fopen(path, "r+b");
+    if (out == NULL) {
+        perror("Error opening timeline");
+        return NULL;
+    }
+
+    JMTTimelineHeader expected, h;
+    fillHeader(&expected, hasher, hashedKeys);
+    struct stat st;
+    if (fread(&h, sizeof(h), 1, out) != 1 || memcmp(&h, &expected, sizeof(h)) != 0 || fstat(fileno(out), &st) == -1) {
+        fprintf(stderr, "Error: %s is not a timeline of this export\n", path);
+        fclose(out);
+        return NULL;
+    }
+
+    JMTTimelineWriter* w;
+    SYSCN(w, (JMTTimelineWriter*)calloc(1, sizeof(JMTTimelineWriter)), "Error allocating timeline writer");
+    w->out = out;
+
+    // Le versioni crescono con le voci: si risale dalla fine fino all'ultima voce coperta dal checkpoint
+    size_t keep = ((size_t)st.st_size - sizeof(h)) / sizeof(JMTTimelineEntry);
+    while (keep > 0) {
+        if (fseek(out, (long)(sizeof(h) + (keep - 1) * sizeof(JMTTimelineEntry)), SEEK_SET) != 0 ||
+            fread(&w->last, sizeof(w->last), 1, out) != 1) {
+            perror("Error reading timeline");
+            fclose(out);
+            free(w);
+            return NULL;
+        }
+        if (w->last.version <= atVersion) break;
+        keep--;
+    }
+    w->hasLast = keep > 0;
+
+    off_t end = (off_t)(sizeof(h) + keep * sizeof(JMTTimelineEntry));
+    if (fflush(out) != 0 || ftruncate(fileno(out), end) == -1 || fseek(out, (long)end, SEEK_SET) != 0) {
+        perror("Error truncating timeline");
+        fclose(out);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+const JMTTimelineEntry* jmtTimelineLast(const JMTTimelineWriter* w) {
+    return w->hasLast ? &w->last : NULL;
+}
+
+bool jmtTimelineAppend(JMTTimelineWriter* w, const JMTTimelineEntry* e) {
+    // La ricerca per bisezione richiede blocchi e timestamp non decrescenti
+    if (w->hasLast && (e->blockId < w->last.blockId || e->timestamp < w->last.timestamp || e->version <= w->last.version)) {
+        fprintf(stderr, "Error: timeline entry for block %u out of order\n", e->blockId);
+        return false;
+    }
+    if (fwrite(e, sizeof(*e), 1, w->out) != 1) {
+        perror("Error writing timeline");
+        return false;
+    }
+    w->last = *e;
+    w->hasLast = true;
+    return true;
+}
+
+bool jmtTimelineSync(JMTTimelineWriter* w) {
+    if (fflush(w->out) != 0 || fsync(fileno(w->out)) != 0) {
+        perror("Error syncing timeline");
+        return false;
+    }
+    return true;
+}
+
+bool jmtTimelineFinish(JMTTimelineWriter* w) {
+    bool ok = fclose(w->out) == 0;
+    if (!ok) perror("Error closing timeline");
+    free(w);
+    return ok;
+}
+
+JMTTimeline* jmtTimelineOpen(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror("Error opening timeline");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(JMTTimelineHeader)) {
+        fprintf(stderr, "Error: %s is not a timeline\n", path);
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Error mapping timeline");
+        return NULL;
+    }
+
+    JMTTimeline* tl;
+    SYSCN(tl, (JMTTimeline*)calloc(1, sizeof(JMTTimeline)), "Error allocating timeline");
+    tl->data = data;
+    tl->size = (size_t)st.st_size;
+    memcpy(&tl->header, data, sizeof(JMTTimelineHeader));
+    if (memcmp(tl->header.magic, JMTTIME_MAGIC, sizeof(tl->header.magic)) != 0 || tl->header.format != JMTTIME_FORMAT ||
+        jmtTimelineHasher(tl) == NULL) {
+        fprintf(stderr, "Error: %s is not a valid timeline\n", path);
+        jmtTimelineClose(tl);
+        return NULL;
+    }
+    // Una voce troncata da un'interruzione in scrittura non viene contata
+    tl->entries = (const JMTTimelineEntry*)(tl->data + sizeof(JMTTimelineHeader));
+    tl->count = (tl->size - sizeof(JMTTimelineHeader)) / sizeof(JMTTimelineEntry);
+    return tl;
+}
+
+size_t jmtTimelineCount(const JMTTimeline* tl) {
+    return tl->count;
+}
+
+const JMTTimelineEntry* jmtTimelineEntry(const JMTTimeline* tl, size_t i) {
+    return i < tl->count ? &tl->entries[i] : NULL;
+}
+
+const JMTHasher* jmtTimelineHasher(const JMTTimeline* tl) {
+    if (tl->header.hashKind == JMT_HASH_KECCAK256) return &jmtKeccak256;
+    if (tl->header.hashKind == JMT_HASH_SHA256) return &jmtSha256;
+    return NULL;
+}
+
+bool jmtTimelineHashedKeys(const JMTTimeline* tl) {
+    return (tl->header.flags & JMTTIME_HASHED_KEYS) != 0;
+}
+
+const JMTTimelineEntry* jmtTimelineAtBlock(const JMTTimeline* tl, uint32_t blockId) {
+    // Prima voce con blockId > blockId: lo stato cercato è quello della precedente
+    size_t lo = 0, hi = tl->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (tl->entries[mid].blockId <= blockId) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo > 0 ? &tl->entries[lo - 1] : NULL;
+}
+
+const JMTTimelineEntry* jmtTimelineAtTime(const JMTTimeline* tl, uint32_t timestamp) {
+    size_t lo = 0, hi = tl->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (tl->entries[mid].timestamp <= timestamp) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo > 0 ? &tl->entries[lo - 1] : NULL;
+}
+
+void jmtTimelineClose(JMTTimeline* tl) {
+    if (tl == NULL) return;
+    munmap(tl->data, tl->size);
+    free(tl);
+}
+
+typedef struct {
+    uint64_t version;
+    uint32_t keyLimit;
+    bool sequential;        // chiavi non hashed: i primi 8 nibble del percorso sono la version
+} HistoryScope;
+
+// Contenuto di uno slot al commit della voce: vuoto, una foglia sola o un nodo interno (leaves == 2: almeno due)
+typedef struct {
+    unsigned leaves;
+    HashValue digest;
+    const LeafNode* leaf;
+} HistoricalSlot;
+
+// Con chiavi sequenziali, true se tutte le chiavi con questo prefisso hanno version >= keyLimit
+static bool prefixAfterLimit(const HistoryScope* s, const uint8_t* prefix, size_t nibbles) {
+    if (!s->sequential) return false;
+    uint32_t v = 0;
+    for (size_t i = 0; i < 8; i++) v = (v << 4) | (i < nibbles ? prefix[i] : 0);
+    return v >= s->keyLimit;
+}
+
+static void historicalNode(const HistoryScope* s, InternalNode* node, uint8_t* prefix, size_t depth, bool collapse, HistoricalSlot* out);
+
+// prefix contiene i depth nibble del percorso dello slot, compreso il suo
+static void historicalSlot(const HistoryScope* s, ChildNode* child, uint8_t* prefix, size_t depth, HistoricalSlot* out) {
+    out->leaves = 0;
+    out->leaf = NULL;
+    if (child == NULL || prefixAfterLimit(s, prefix, depth)) return;
+
+    if (child->isLeaf) {
+        const LeafNode* leaf = child->node.leaf;
+        if (child->version > s->version && keyVersion(&leaf->leafKey) >= s->keyLimit) return;
+        out->leaves = 1;
+        out->leaf = leaf;
+        out->digest = leaf->leafDigest;
+        return;
+    }
+    // Slot non toccato dopo il commit: sottoalbero e digest sono ancora quelli di allora
+    if (child->version <= s->version) {
+        out->leaves = 2;
+        out->digest = *childHash(child);
+        return;
+    }
+    historicalNode(s, childInternal(child), prefix, depth, true, out);
+}
+
+// Con collapse un nodo rimasto con meno di due foglie lascia il posto alla foglia (o allo slot vuoto)
+static void historicalNode(const HistoryScope* s, InternalNode* node, uint8_t* prefix, size_t depth, bool collapse, HistoricalSlot* out) {
+    HashValue digests[16];
+    bool present[16];
+    unsigned leaves = 0;
+    const LeafNode* only = NULL;
+
+    for (uint8_t i = 0; i < 16; i++) {
+        HistoricalSlot slot;
+        prefix[depth] = i;
+        historicalSlot(s, node->children[i], prefix, depth + 1, &slot);
+        present[i] = slot.leaves > 0;
+        if (!present[i]) continue;
+        digests[i] = slot.digest;
+        leaves += slot.leaves;
+        only = slot.leaf;
+    }
+
+    out->leaves = leaves < 2 ? leaves : 2;
+    out->leaf = leaves == 1 ? only : NULL;
+    if (collapse && leaves < 2) {
+        if (leaves == 1) out->digest = only->leafDigest;
+        return;
+    }
+
+    const JMTHasher* H = jmtActiveHasher();
+    JMTHashCtx ctx;
+    H->init(&ctx);
+    for (size_t i = 0; i < 16; i++) {
+        if (!present[i]) H->absorbZeros(&ctx, sizeof(HashValue));
+        else H->absorb(&ctx, digests[i].hash_bytes, sizeof(HashValue));
+    }
+    H->final(&ctx, out->digest.hash_bytes);
+}
+
+static bool historyScope(const JMT* t, const JMTTimelineEntry* e, bool hashedKeys, HistoryScope* s) {
+    if (t->mutated || e->version > t->version) {
+        fprintf(stderr, "Error: timeline lookups need a tree committed at version >= %lu\n", (unsigned long)e->version);
+        return false;
+    }
+    s->version = e->version;
+    s->keyLimit = e->keyLimit;
+    s->sequential = !hashedKeys;
+    return true;
+}
+
+bool jmtTimelineRoot(JMT* t, const JMTTimelineEntry* e, bool hashedKeys, HashValue* root) {
+    HistoryScope s;
+    if (!historyScope(t, e, hashedKeys, &s)) return false;
+    JMT_WITH_HASHER(t->hasher);
+    JMT_WITH_STORE(t->store);
+
+    uint8_t prefix[JMT_HASHED_KEY_NIBBLES + 1];
+    HistoricalSlot top;
+    // La root resta un nodo interno anche con meno di due foglie
+    historicalNode(&s, t->root, prefix, 0, false, &top);
+    *root = top.digest;
+    return true;
+}
+
+// Come generateProof sull'albero della voce: livelli dalla foglia, fratelli per indice decrescente
+bool jmtTimelineProof(JMT* t, const JMTTimelineEntry* e, NodeKey* key, Proof* P) {
+    HistoryScope s;
+    if (!historyScope(t, e, isHashedKey(key), &s)) return false;
+    JMT_WITH_HASHER(t->hasher);
+    JMT_WITH_STORE(t->store);
+
+    NibblePath* path = &key->nibble_path;
+    uint8_t prefix[JMT_HASHED_KEY_NIBBLES + 1];
+    InternalNode* current = t->root;
+    size_t depth = 0;
+    memset(P, 0, sizeof(*P));
+
+    while (depth < path->nibblesLength && depth < JMT_HASHED_KEY_NIBBLES) {
+        uint8_t nextNibble = getNibble(path->nibbles, depth);
+        LevelSibling* level = addLevel(P);
+        HistoricalSlot target = {0};
+
+        for (uint8_t i = 0; i < 16; i++) {
+            HistoricalSlot slot;
+            prefix[depth] = i;
+            historicalSlot(&s, current->children[i], prefix, depth + 1, &slot);
+            if (i == nextNibble) target = slot;
+            else if (slot.leaves > 0) addSibling(&level, i, slot.digest);
+        }
+        prefix[depth] = nextNibble;
+
+        if (target.leaves == 0) return true;    // ramo vuoto
+        if (target.leaves == 1) {
+            const NibblePath* leafPath = &target.leaf->leafKey.nibble_path;
+            P->leafHash = target.leaf->leafDigest;
+            P->isPresent = leafPath->nibblesLength == path->nibblesLength &&
+                           memcmp(leafPath->nibbles, path->nibbles, (path->nibblesLength + 1) / 2) == 0;
+            return true;
+        }
+        current = childInternal(current->children[nextNibble]);
+        depth++;
+    }
+    P->depth = depth;
+    return true;
+}
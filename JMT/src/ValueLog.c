@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "macros.h"
+#include "ValueLog.h"
+
+typedef struct Segment {
+    struct Segment* prev;
+    size_t used;
+    size_t capacity;
+    uint8_t data[];
+} Segment;
+
+typedef struct {
+    uint64_t hash;
+    const uint8_t* value;   // NULL = slot libero
+    size_t len;
+} IndexSlot;
+
+static struct {
+    pthread_mutex_t lock;
+    Segment* head;
+    IndexSlot* index;
+    size_t indexCapacity;   // potenza di 2
+    ValueLogStats stats;
+} vlog = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// FNV-1a a 64 bit: l'uguaglianza è poi confermata con memcmp
+static inline uint64_t contentHash(const uint8_t* value, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= value[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static IndexSlot* findSlot(IndexSlot* index, size_t capacity, uint64_t hash, const uint8_t* value, size_t len) {
+    size_t i = (size_t)hash & (capacity - 1);
+    for (;;) {
+        IndexSlot* s = &index[i];
+        if (s->value == NULL) return s;
+        if (s->hash == hash && s->len == len && memcmp(s->value, value, len) == 0) return s;
+        i = (i + 1) & (capacity - 1);
+    }
+}
+
+static void growIndex(void) {
+    size_t capacity = vlog.indexCapacity ? vlog.indexCapacity * 2 : 1024;
+    IndexSlot* index;
+    SYSCN(index, (IndexSlot*)calloc(capacity, sizeof(IndexSlot)), "Error allocating value log index");
+    for (size_t i = 0; i < vlog.indexCapacity; i++) {
+        IndexSlot* s = &vlog.index[i];
+        if (s->value != NULL) *findSlot(index, capacity, s->hash, s->value, s->len) = *s;
+    }
+    free(vlog.index);
+    vlog.index = index;
+    vlog.indexCapacity = capacity;
+}
+
+static const uint8_t* append(const uint8_t* value, size_t len) {
+    Segment* seg = vlog.head;
+    if (seg == NULL || seg->capacity - seg->used < len) {
+        size_t capacity = len > VALUE_LOG_SEGMENT ? len : VALUE_LOG_SEGMENT;
+        SYSCN(seg, (Segment*)malloc(sizeof(Segment) + capacity), "Error allocating value log segment");
+        seg->prev = vlog.head;
+        seg->used = 0;
+        seg->capacity = capacity;
+        vlog.head = seg;
+        vlog.stats.segments++;
+    }
+    uint8_t* dst = seg->data + seg->used;
+    memcpy(dst, value, len);
+    seg->used += len;
+    vlog.stats.bytes += len;
+    return dst;
+}
+
+const uint8_t* valueLogIntern(const uint8_t* value, size_t len) {
+    uint64_t hash = contentHash(value, len);
+    pthread_mutex_lock(&vlog.lock);
+    vlog.stats.interned++;
+
+    // Fattore di carico massimo 3/4
+    if ((vlog.stats.values + 1) * 4 > vlog.indexCapacity * 3) growIndex();
+
+    IndexSlot* s = findSlot(vlog.index, vlog.indexCapacity, hash, value, len);
+    if (s->value != NULL) {
+        vlog.stats.dedupHits++;
+    } else {
+        s->hash = hash;
+        s->len = len;
+        s->value = append(value, len);
+        vlog.stats.values++;
+    }
+    const uint8_t* stored = s->value;
+    pthread_mutex_unlock(&vlog.lock);
+    return stored;
+}
+
+void valueLogStats(ValueLogStats* out) {
+    pthread_mutex_lock(&vlog.lock);
+    *out = vlog.stats;
+    pthread_mutex_unlock(&vlog.lock);
+}
+
+void valueLogReset(void) {
+    pthread_mutex_lock(&vlog.lock);
+    while (vlog.head != NULL) {
+        Segment* prev = vlog.head->prev;
+        free(vlog.head);
+        vlog.head = prev;
+    }
+    free(vlog.index);
+    vlog.index = NULL;
+    vlog.indexCapacity = 0;
+    memset(&vlog.stats, 0, sizeof(vlog.stats));
+    pthread_mutex_unlock(&vlog.lock);
+}
@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <malloc.h>
+#include "keccak-tiny.h"
+#include "macros.h"
+#include "Jellyfish.h"
+#include "ServeProto.h"
+
+/*
+ * Microbenchmark delle operazioni del JMT, separato da parsing CSV e I/O JSON.
+ * Il binario è linkato con -Wl,--wrap=keccak_256 e keccak_256_final per contare le invocazioni di keccak.
+ * Output: un oggetto JSON con un risultato per (operazione, distribuzione, dimensione).
+ */
+
+static uint64_t keccakCalls = 0;
+int __real_keccak_256(uint8_t* out, const uint8_t* in, size_t inlen);
+int __wrap_keccak_256(uint8_t* out, const uint8_t* in, size_t inlen) {
+    keccakCalls++;
+    return __real_keccak_256(out, in, inlen);
+}
+void __real_keccak_256_final(keccak_256_ctx* ctx, uint8_t* out);
+void __wrap_keccak_256_final(keccak_256_ctx* ctx, uint8_t* out) {
+    keccakCalls++;
+    __real_keccak_256_final(ctx, out);
+}
+
+#define LOOKUP_BATCH 256
+#define DELETE_BATCH 256
+
+typedef enum { DIST_SEQ, DIST_RANDOM, DIST_CLUSTERED } KeyDist;
+static const char* distNames[] = {"seq", "random", "clustered"};
+
+static FILE* out;
+static bool firstResult = true;
+static bool hashedKeys = false;
+
+// Dimensione media delle prove emesse da generateProof (o dei delta di jmtProofDelta)
+typedef struct {
+    double levels;
+    double siblings;
+    double bytes;       // codifica di ServeProto, 0 se non misurata
+    double fullBytes;   // prova completa equivalente, per confronto con i delta
+} ProofShape;
+
+static inline uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t rng = 0x9E3779B97F4A7C15ull;
+static inline uint64_t nextRandom(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+// Chiave version‖tokenId come buildKey, senza toccare il contatore globale delle versioni
+static NodeKey makeKey(uint32_t version, uint64_t tokenId) {
+    NodeKey key;
+    key.nibble_path.nibblesLength = 24;
+    SYSCN(key.nibble_path.nibbles, (uint8_t*)calloc(12, 1), "Error allocating bench key");
+    for (int i = 0; i < 4; i++) key.nibble_path.nibbles[i] = (version >> (8 * (3 - i))) & 0xFF;
+    for (int i = 0; i < 8; i++) key.nibble_path.nibbles[4 + i] = (tokenId >> (8 * (7 - i))) & 0xFF;
+    if (hashedKeys) {
+        NodeKey hashed = hashedKey(&key);
+        free(key.nibble_path.nibbles);
+        key = hashed;
+    }
+    return key;
+}
+
+static NodeKey* makeKeys(KeyDist dist, size_t n) {
+    NodeKey* keys;
+    SYSCN(keys, (NodeKey*)malloc(n * sizeof(NodeKey)), "Error allocating bench keys");
+    for (size_t i = 0; i < n; i++) {
+        switch (dist) {
+            case DIST_SEQ:
+                // Versioni sequenziali come in buildKey, tokenId sequenziali
+                keys[i] = makeKey((uint32_t)i, i);
+                break;
+            case DIST_RANDOM:
+                keys[i] = makeKey(0, nextRandom());
+                break;
+            case DIST_CLUSTERED: {
+                // Stile Art Blocks: projectId * 1e6 + numero di edizione
+                uint64_t project = i % 400;
+                uint64_t edition = i / 400;
+                keys[i] = makeKey(0, project * 1000000ull + edition);
+                break;
+            }
+        }
+    }
+    return keys;
+}
+
+static int cmpU64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static size_t heapInUse(void) {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+static void report(const char* op, KeyDist dist, size_t n, uint64_t* lat, size_t ops,
+                   uint64_t totalNs, uint64_t keccak, double bytesPerKey, const ProofShape* shape) {
+    qsort(lat, ops, sizeof(uint64_t), cmpU64);
+    uint64_t p50 = ops ? lat[ops / 2] : 0;
+    uint64_t p99 = ops ? lat[(ops * 99) / 100 < ops ? (ops * 99) / 100 : ops - 1] : 0;
+
+    fprintf(out, "%s\n    {\"op\": \"%s\", \"hash\": \"%s\", \"keys\": \"%s\", \"dist\": \"%s\", \"n\": %zu, \"ops\": %zu, "
+                 "\"ops_per_sec\": %.1f, \"p50_ns\": %lu, \"p99_ns\": %lu, \"keccak_per_op\": %.3f",
+            firstResult ? "" : ",", op, jmtActiveHasher()->name, hashedKeys ? "hashed" : "plain", distNames[dist], n, ops,
+            totalNs ? ops * 1e9 / totalNs : 0.0, p50, p99, ops ? (double)keccak / ops : 0.0);
+    if (bytesPerKey >= 0) fprintf(out, ", \"bytes_per_key\": %.1f", bytesPerKey);
+    if (shape) fprintf(out, ", \"levels_per_proof\": %.2f, \"siblings_per_proof\": %.2f", shape->levels, shape->siblings);
+    if (shape && shape->bytes > 0) fprintf(out, ", \"bytes_per_proof\": %.1f", shape->bytes);
+    if (shape && shape->fullBytes > 0) fprintf(out, ", \"full_proof_bytes\": %.1f", shape->fullBytes);
+    fprintf(out, "}");
+    firstResult = false;
+    fflush(out);
+}
+
+static void benchSize(KeyDist dist, size_t n) {
+    NodeKey* keys = makeKeys(dist, n);
+    uint64_t* lat;
+    SYSCN(lat, (uint64_t*)malloc(n * sizeof(uint64_t)), "Error allocating latency samples");
+    uint8_t value[] = "1";
+
+    // insertJMT con ancestry, come nel percorso di export
+    size_t heapBefore = heapInUse();
+    InternalNode* root = createInternalNode();
+    uint64_t k0 = keccakCalls, t0 = nowNs();
+    for (size_t i = 0; i < n; i++) {
+        AncestryProof ap = {0};
+        uint64_t s = nowNs();
+        insertJMT(&root, &keys[i], value, 1, &ap);
+        lat[i] = nowNs() - s;
+        freeProof(&ap.proof);
+    }
+    uint64_t total = nowNs() - t0;
+    double bytesPerKey = (double)(heapInUse() - heapBefore) / n;
+    report("insertJMT", dist, n, lat, n, total, keccakCalls - k0, bytesPerKey, NULL);
+
+    // computeInternalHash su un albero costruito senza ancestry: ricalcolo di tutti i nodi sporchi
+    InternalNode* lazy = createInternalNode();
+    for (size_t i = 0; i < n; i++) insertJMT(&lazy, &keys[i], value, 1, NULL);
+    k0 = keccakCalls;
+    t0 = nowNs();
+    computeInternalHash(lazy);
+    lat[0] = nowNs() - t0;
+    report("computeInternalHash", dist, n, lat, 1, lat[0], keccakCalls - k0, -1, NULL);
+    freeJMT(lazy);
+
+    // lookupJMT
+    k0 = keccakCalls;
+    t0 = nowNs();
+    for (size_t i = 0; i < n; i++) {
+        uint8_t* res = NULL;
+        size_t resLen = 0;
+        uint64_t s = nowNs();
+        lookupJMT(root, &keys[i], &res, &resLen);
+        lat[i] = nowNs() - s;
+        free(res);
+    }
+    report("lookupJMT", dist, n, lat, n, nowNs() - t0, keccakCalls - k0, -1, NULL);
+
+    // lookupJMTRef: valore in prestito, nessuna allocazione
+    t0 = nowNs();
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t* res;
+        size_t resLen;
+        uint64_t s = nowNs();
+        lookupJMTRef(root, &keys[i], &res, &resLen);
+        lat[i] = nowNs() - s;
+    }
+    report("lookupJMTRef", dist, n, lat, n, nowNs() - t0, 0, -1, NULL);
+
+    // Ricerche in ordine casuale, una alla volta e a lotti con lookupBatchJMT: stesso ordine, stessi esiti
+    NodeKey* shuffled;
+    LookupResult* results;
+    SYSCN(shuffled, (NodeKey*)malloc(n * sizeof(NodeKey)), "Error allocating shuffled keys");
+    SYSCN(results, (LookupResult*)malloc(LOOKUP_BATCH * sizeof(LookupResult)), "Error allocating lookup results");
+    memcpy(shuffled, keys, n * sizeof(NodeKey));
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = nextRandom() % (i + 1);
+        NodeKey tmp = shuffled[i];
+        shuffled[i] = shuffled[j];
+        shuffled[j] = tmp;
+    }
+
+    t0 = nowNs();
+    for (size_t i = 0; i < n; i++) {
+        uint8_t* res = NULL;
+        size_t resLen = 0;
+        uint64_t s = nowNs();
+        lookupJMT(root, &shuffled[i], &res, &resLen);
+        lat[i] = nowNs() - s;
+        free(res);
+    }
+    report("lookupJMT_shuffled", dist, n, lat, n, nowNs() - t0, 0, -1, NULL);
+
+    // La latenza di ogni ricerca del lotto è il tempo del lotto diviso per la sua dimensione
+    size_t mismatches = 0;
+    t0 = nowNs();
+    for (size_t i = 0; i < n; i += LOOKUP_BATCH) {
+        size_t m = n - i < LOOKUP_BATCH ? n - i : LOOKUP_BATCH;
+        uint64_t s = nowNs();
+        lookupBatchJMT(root, &shuffled[i], m, results);
+        uint64_t per = (nowNs() - s) / m;
+        for (size_t j = 0; j < m; j++) {
+            lat[i + j] = per;
+            if (!results[j].found || results[j].valueLength != 1 || results[j].value[0] != value[0]) mismatches++;
+        }
+    }
+    report("lookupBatchJMT", dist, n, lat, n, nowNs() - t0, 0, -1, NULL);
+    if (mismatches) fprintf(stderr, "❌ lookupBatchJMT: %zu esiti diversi da lookupJMT\n", mismatches);
+    free(results);
+    free(shuffled);
+
+    // generateProof
+    k0 = keccakCalls;
+    total = 0;
+    size_t levels = 0, siblings = 0;
+    for (size_t i = 0; i < n; i++) {
+        Proof P = {0};
+        uint64_t s = nowNs();
+        generateProof(root, &keys[i], &P);
+        lat[i] = nowNs() - s;
+        total += lat[i];
+        levels += P.depth;
+        for (LevelSibling* l = P.levels; l != NULL; l = l->next) {
+            for (Sibling* sib = l->siblings; sib != NULL; sib = sib->next) siblings++;
+        }
+        freeProof(&P);
+    }
+    ProofShape shape = {(double)levels / n, (double)siblings / n, 0, 0};
+    report("generateProof", dist, n, lat, n, total, keccakCalls - k0, -1, &shape);
+
+    // verifyProof: la generazione della prova resta fuori dalla misura
+    HashValue rootDigest = computeInternalHash(root);
+    uint64_t kVerify = 0;
+    total = 0;
+    for (size_t i = 0; i < n; i++) {
+        Proof P = {0};
+        generateProof(root, &keys[i], &P);
+        k0 = keccakCalls;
+        uint64_t s = nowNs();
+        if (!verifyProof(&keys[i], &P, rootDigest)) {
+            fprintf(stderr, "❌ verifyProof fallita per la chiave %zu\n", i);
+        }
+        lat[i] = nowNs() - s;
+        kVerify += keccakCalls - k0;
+        total += lat[i];
+        freeProof(&P);
+    }
+    report("verifyProof", dist, n, lat, n, total, kVerify, -1, NULL);
+
+    // Trasferimento a mano: prova dello stato precedente, insert sulla foglia esistente e nuova root
+    uint8_t owners[2][2] = {"2", "3"};
+    k0 = keccakCalls;
+    t0 = nowNs();
+    for (size_t i = 0; i < n; i++) {
+        Proof P = {0};
+        uint64_t s = nowNs();
+        generateProof(root, &keys[i], &P);
+        insertJMT(&root, &keys[i], owners[0], 1, NULL);
+        computeInternalHash(root);
+        lat[i] = nowNs() - s;
+        freeProof(&P);
+    }
+    report("updateByHand", dist, n, lat, n, nowNs() - t0, keccakCalls - k0, -1, NULL);
+
+    // updateJMTWithProof: stessa coppia prova precedente / nuova root in una sola discesa
+    k0 = keccakCalls;
+    t0 = nowNs();
+    for (size_t i = 0; i < n; i++) {
+        UpdateProof up = {0};
+        uint64_t s = nowNs();
+        if (!updateJMTWithProof(root, &keys[i], owners[1], 1, &up)) {
+            fprintf(stderr, "❌ updateJMTWithProof fallita per la chiave %zu\n", i);
+        }
+        lat[i] = nowNs() - s;
+        freeUpdateProof(&up);
+    }
+    report("updateJMTWithProof", dist, n, lat, n, nowNs() - t0, keccakCalls - k0, -1, NULL);
+
+    // Cancellazioni a lotti: tombstone per ogni chiave e una compattazione per lotto, ripartita sulle sue chiavi
+    InternalNode* burst = createInternalNode();
+    for (size_t i = 0; i < n; i++) insertJMT(&burst, &keys[i], value, 1, NULL);
+    computeInternalHash(burst);
+    k0 = keccakCalls;
+    t0 = nowNs();
+    for (size_t start = 0; start < n; start += DELETE_BATCH) {
+        size_t end = start + DELETE_BATCH < n ? start + DELETE_BATCH : n;
+        for (size_t i = start; i < end; i++) {
+            uint64_t s = nowNs();
+            markDeletedJMT(burst, &keys[i]);
+            lat[i] = nowNs() - s;
+        }
+        uint64_t s = nowNs();
+        compactJMT(burst);
+        uint64_t share = (nowNs() - s) / (end - start);
+        for (size_t i = start; i < end; i++) lat[i] += share;
+    }
+    report("deleteBatched", dist, n, lat, n, nowNs() - t0, keccakCalls - k0, -1, NULL);
+    freeJMT(burst);
+
+    // deleteJMT
+    k0 = keccakCalls;
+    t0 = nowNs();
+    for (size_t i = 0; i < n; i++) {
+        uint64_t s = nowNs();
+        deleteJMT(&root, &keys[i]);
+        lat[i] = nowNs() - s;
+    }
+    report("deleteJMT", dist, n, lat, n, nowNs() - t0, keccakCalls - k0, -1, NULL);
+    freeJMT(root);
+
+    for (size_t i = 0; i < n; i++) free(keys[i].nibble_path.nibbles);
+    free(keys);
+    free(lat);
+}
+
+/*
+ * Aggiornamento di prove vecchie: campione di prove alla versione 1, poi DELTA_COMMITS commit
+ * con nuove chiavi (l'1% dell'albero in totale) e jmtProofDelta + applyProofDelta per ogni prova.
+ */
+#define DELTA_SAMPLES 1000
+#define DELTA_COMMITS 16
+static void benchProofDelta(KeyDist dist, size_t n) {
+    size_t extra = n / 100 > DELTA_COMMITS ? n / 100 : DELTA_COMMITS;
+    NodeKey* keys = makeKeys(dist, n + extra);
+    size_t samples = n < DELTA_SAMPLES ? n : DELTA_SAMPLES;
+    uint8_t value[] = "1";
+
+    JMT* t = createJMTWithHasher(jmtActiveHasher());
+    for (size_t i = 0; i < n; i++) jmtInsert(t, &keys[i], value, 1, NULL);
+    jmtCommit(t);
+    uint64_t fromVersion = t->version;
+
+    Proof* proofs;
+    uint64_t* lat;
+    SYSCN(proofs, (Proof*)calloc(samples, sizeof(Proof)), "Error allocating sample proofs");
+    SYSCN(lat, (uint64_t*)malloc(samples * sizeof(uint64_t)), "Error allocating latency samples");
+    for (size_t s = 0; s < samples; s++) jmtGenerateProof(t, &keys[s * n / samples], &proofs[s]);
+
+    for (size_t c = 0; c < DELTA_COMMITS; c++) {
+        for (size_t i = n + c * extra / DELTA_COMMITS; i < n + (c + 1) * extra / DELTA_COMMITS; i++) {
+            jmtInsert(t, &keys[i], value, 1, NULL);
+        }
+        jmtCommit(t);
+    }
+
+    uint64_t keccak = 0, total = 0;
+    size_t levels = 0, hashes = 0, deltaBytes = 0, fullBytes = 0, failures = 0;
+    ServeBuf buf = {0}, fresh = {0};
+    for (size_t s = 0; s < samples; s++) {
+        NodeKey* key = &keys[s * n / samples];
+        ProofDelta d;
+        uint64_t k0 = keccakCalls, start = nowNs();
+        bool ok = jmtProofDelta(t, key, fromVersion, t->version, &d) && applyProofDelta(&proofs[s], &d);
+        lat[s] = nowNs() - start;
+        keccak += keccakCalls - k0;
+        total += lat[s];
+
+        // La prova aggiornata deve coincidere con quella generata da zero alla versione corrente
+        Proof P = {0};
+        jmtGenerateProof(t, key, &P);
+        buf.len = fresh.len = 0;
+        serveEncodeProof(&buf, &proofs[s], 0, 0, false);
+        serveEncodeProof(&fresh, &P, 0, 0, false);
+        if (!ok || !verifyProof(key, &proofs[s], t->committedRoot) ||
+            buf.len != fresh.len || memcmp(buf.data, fresh.data, buf.len) != 0) failures++;
+        fullBytes += fresh.len;
+
+        buf.len = 0;
+        serveEncodeProofDelta(&buf, &d);
+        deltaBytes += buf.len;
+        levels += d.levelCount;
+        for (size_t l = 0; l < d.levelCount; l++) hashes += (size_t)__builtin_popcount(d.levels[l].changed);
+        freeProofDelta(&d);
+        freeProof(&P);
+        freeProof(&proofs[s]);
+    }
+    if (failures) fprintf(stderr, "❌ applyProofDelta: %zu prove diverse da quelle rigenerate\n", failures);
+
+    ProofShape shape = {(double)levels / samples, (double)hashes / samples,
+                        (double)deltaBytes / samples, (double)fullBytes / samples};
+    report("proofDelta", dist, n, lat, samples, total, keccak, -1, &shape);
+
+    serveBufFree(&buf);
+    serveBufFree(&fresh);
+    destroyJMT(t);
+    for (size_t i = 0; i < n + extra; i++) free(keys[i].nibble_path.nibbles);
+    free(keys);
+    free(proofs);
+    free(lat);
+}
+
+// Digest di 512 byte, l'input di un nodo interno, con la funzione attiva
+static void benchHash(size_t n) {
+    uint8_t buffer[16 * sizeof(HashValue)];
+    uint64_t* lat;
+    SYSCN(lat, (uint64_t*)malloc(n * sizeof(uint64_t)), "Error allocating latency samples");
+    for (size_t i = 0; i < sizeof(buffer); i++) buffer[i] = (uint8_t)nextRandom();
+
+    uint64_t k0 = keccakCalls, t0 = nowNs();
+    for (size_t i = 0; i < n; i++) {
+        uint64_t s = nowNs();
+        jmtHash(buffer, buffer, sizeof(buffer));
+        lat[i] = nowNs() - s;
+    }
+    report(jmtActiveHasher()->kind == JMT_HASH_KECCAK256 ? "keccak_256" : "sha256", DIST_SEQ, n, lat, n, nowNs() - t0, keccakCalls - k0, -1, NULL);
+    free(lat);
+}
+
+int main(int argc, char** argv) {
+    const char* sizes = "1000,10000,100000";
+    const char* dists = "seq,random,clustered";
+    const char* outPath = NULL;
+    const char* hashes = "keccak256";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) sizes = argv[++i];
+        else if (strcmp(argv[i], "--dists") == 0 && i + 1 < argc) dists = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outPath = argv[++i];
+        else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) hashes = argv[++i];
+        else if (strcmp(argv[i], "--hashed-keys") == 0) hashedKeys = true;
+        else {
+            fprintf(stderr, "Uso: %s [--sizes 1000,10000,...] [--dists seq,random,clustered] [--hash keccak256,sha256] [--hashed-keys] [--out file.json]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    out = stdout;
+    if (outPath) SYSCN(out, fopen(outPath, "w"), "Error opening bench output");
+
+    fprintf(out, "{\n  \"benchmark\": \"jmt\",\n  \"results\": [");
+
+    // Stesse chiavi per ogni funzione di hash: il generatore riparte dallo stesso seme
+    char* hashList = strdup(hashes);
+    char* hashSave;
+    for (char* name = strtok_r(hashList, ",", &hashSave); name; name = strtok_r(NULL, ",", &hashSave)) {
+        const JMTHasher* h = jmtHasherByName(name);
+        if (h == NULL) {
+            fprintf(stderr, "Funzione di hash sconosciuta: %s\n", name);
+            continue;
+        }
+        jmtUseHasher(h);
+        rng = 0x9E3779B97F4A7C15ull;
+
+        size_t maxN = 0;
+        char* sizeList = strdup(sizes);
+        char* sizeSave;
+        for (char* sz = strtok_r(sizeList, ",", &sizeSave); sz; sz = strtok_r(NULL, ",", &sizeSave)) {
+            size_t n = strtoull(sz, NULL, 10);
+            if (n == 0) continue;
+            if (n > maxN) maxN = n;
+            for (int d = 0; d < 3; d++) {
+                if (!strstr(dists, distNames[d])) continue;
+                benchSize((KeyDist)d, n);
+                benchProofDelta((KeyDist)d, n);
+            }
+        }
+        free(sizeList);
+
+        benchHash(maxN < 1000000 ? maxN : 1000000);
+    }
+    free(hashList);
+
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) fclose(out);
+    return EXIT_SUCCESS;
+}
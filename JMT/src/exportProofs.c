@@ -3,59 +3,78 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
 #include "Jellyfish.h"
+#include "Forest.h"
+#include "Ingest.h"
+#include "Instrument.h"
+#include "Iterator.h"
+#include "ProofArchive.h"
+#include "ProofWriter.h"
+#include "Checkpoint.h"
+#include "Timeline.h"
 #include <sys/stat.h>
 #include <sys/types.h>
 
 AncestryProof ancestryP;
+static const char* inspectPath = NULL;
+static const char* dumpPath = NULL;
+static bool hashedKeys = false;
+static const char* archivePath = NULL;
+static ProofIOBackend ioBackend = PROOF_IO_AUTO;
+static unsigned ioDepth = PROOF_IO_DEFAULT_DEPTH;
+static const char* checkpointPath = NULL;
+static uint64_t checkpointEvery = 100000;
+static bool resumeRun = false;
+static const char* timelinePath = NULL;
+// Valore della foglia = proprietario corrente (toId); i trasferimenti aggiornano la foglia con jmtUpdateWithProof
+static bool ownerValues = false;
 #define MAX_TOKEN_ID 10000000
 
+// version e tokenId della chiave originale: per le chiavi hashed seguono il percorso keccak
 uint64_t extractTokenIdFromKey(NodeKey* key) {
-    uint64_t tokenId = 0;
-    for (int i = 0; i < 8; i++) {
-        tokenId <<= 8;
-        uint8_t byte = (getNibble(key->nibble_path.nibbles, 8 + 2*i) << 4)
-                     | getNibble(key->nibble_path.nibbles, 8 + 2*i + 1);
-        tokenId |= byte;
-    }
-    return tokenId;
+    return keyTokenId(key);
 }
 
 uint32_t extractVersionFromKey(NodeKey* key) {
-    uint32_t version = 0;
-    for (int i = 0; i < 4; i++) {
-        version <<= 8;
-        uint8_t byte = (getNibble(key->nibble_path.nibbles, 2*i) << 4)
-                     | getNibble(key->nibble_path.nibbles, 2*i + 1);
-        version |= byte;
-    }
-    return version;
+    return keyVersion(key);
 }
 
-void exportProofAndAncestry(const char* filename, Proof* proof, AncestryProof* ancestry, NodeKey* key, uint8_t* value, size_t valueLen, HashValue rootHash) {
-    FILE* f = fopen(filename, "w");
-    if (!f) {
-        perror("Errore apertura file JSON");
-        return;
+// Un digest in esadecimale con una sola fwrite: fprintf byte per byte dominava il costo di serializzazione
+static void fprintHashHex(FILE* f, const HashValue* h) {
+    static const char digits[] = "0123456789abcdef";
+    char hex[2 * HASH_SIZE];
+    for (int i = 0; i < HASH_SIZE; i++) {
+        hex[2 * i] = digits[h->hash_bytes[i] >> 4];
+        hex[2 * i + 1] = digits[h->hash_bytes[i] & 0x0f];
     }
+    fwrite(hex, 1, sizeof(hex), f);
+}
 
+// Apertura dell'oggetto: chiave, valore, root e metadati di hash e chiave
+static void writeProofHead(FILE* f, NodeKey* key, uint8_t* value, size_t valueLen, HashValue rootHash) {
     fprintf(f, "{\n");
     fprintf(f, "  \"tokenId\": %lu,\n", extractTokenIdFromKey(key));
     fprintf(f, "  \"version\": %u,\n", extractVersionFromKey(key));
     fprintf(f, "  \"value\": \"%.*s\",\n", (int)valueLen, value);
 
     fprintf(f, "  \"root\": \"");
-    for (int i = 0; i < 32; i++) fprintf(f, "%02x", rootHash.hash_bytes[i]);
+    fprintHashHex(f, &rootHash);
     fprintf(f, "\",\n");
+    // La funzione di hash compare nei metadati solo se diversa da keccak256, il default del verificatore on-chain
+    if (jmtActiveHasher() != &jmtKeccak256) fprintf(f, "  \"hash\": \"%s\",\n", jmtActiveHasher()->name);
+    if (isHashedKey(key)) fprintf(f, "  \"keyMode\": \"hashed\",\n");
+}
 
-    // --- PROOF ---
+// Campo "proof", senza la virgola che lo separa dal successivo
+static void writeProofBody(FILE* f, Proof* proof, NodeKey* key) {
     fprintf(f, "  \"proof\": {\n");
     fprintf(f, "    \"isMembership\": %s,\n", proof->isPresent ? "true" : "false");
     fprintf(f, "    \"depth\": %zu,\n", proof->depth);
     fprintf(f, "    \"tokenId\": %lu,\n", extractTokenIdFromKey(key));
 
     fprintf(f, "    \"leafHash\": \"");
-    for (int i = 0; i < 32; i++) fprintf(f, "%02x", proof->leafHash.hash_bytes[i]);
+    fprintHashHex(f, &proof->leafHash);
     fprintf(f, "\",\n");
 
     fprintf(f, "    \"levels\": [\n");
@@ -68,7 +87,7 @@ void exportProofAndAncestry(const char* filename, Proof* proof, AncestryProof* a
         while (sib != NULL) {
             if (!first) fprintf(f, ", ");
             fprintf(f, "{ \"index\": %u, \"hash\": \"", sib->index);
-            for (int i = 0; i < 32; i++) fprintf(f, "%02x", sib->hash.hash_bytes[i]);
+            fprintHashHex(f, &sib->hash);
             fprintf(f, "\" }");
             first = 0;
             sib = sib->next;
@@ -78,7 +97,15 @@ void exportProofAndAncestry(const char* filename, Proof* proof, AncestryProof* a
         lvlIdx++;
         if (lvl != NULL) fprintf(f, ",\n");
     }
-    fprintf(f, "\n    ]\n  },\n");
+    fprintf(f, "\n    ]\n  }");
+}
+
+static void writeProofAndAncestry(FILE* f, Proof* proof, AncestryProof* ancestry, NodeKey* key, uint8_t* value, size_t valueLen, HashValue rootHash) {
+    writeProofHead(f, key, value, valueLen, rootHash);
+
+    // --- PROOF ---
+    writeProofBody(f, proof, key);
+    fprintf(f, ",\n");
 
     // --- ANCESTRY ---
     fprintf(f, "  \"ancestry\": {\n");
@@ -92,7 +119,7 @@ void exportProofAndAncestry(const char* filename, Proof* proof, AncestryProof* a
     fprintf(f, "    },\n");
 
     fprintf(f, "    \"RootN\": \"");
-    for (int i = 0; i < 32; i++) fprintf(f, "%02x", ancestry->RootN.hash_bytes[i]);
+    fprintHashHex(f, &ancestry->RootN);
     fprintf(f, "\",\n");
 
     Proof* ap = &ancestry->proof;
@@ -102,12 +129,11 @@ void exportProofAndAncestry(const char* filename, Proof* proof, AncestryProof* a
     fprintf(f, "      \"tokenId\": %lu,\n", extractTokenIdFromKey(&ancestry->key));
 
     fprintf(f, "      \"leafHash\": \"");
-    for (int i = 0; i < 32; i++) fprintf(f, "%02x", ap->leafHash.hash_bytes[i]);
+    fprintHashHex(f, &ap->leafHash);
     fprintf(f, "\",\n");
 
     fprintf(f, "      \"levels\": [\n");
-    lvl = ap->levels;
-    lvlIdx = 0;
+    LevelSibling* lvl = ap->levels;
     while (lvl != NULL) {
         fprintf(f, "        {\n          \"siblings\": [");
         Sibling* sib = lvl->siblings;
@@ -115,7 +141,7 @@ void exportProofAndAncestry(const char* filename, Proof* proof, AncestryProof* a
         while (sib != NULL) {
             if (!first) fprintf(f, ", ");
             fprintf(f, "{ \"index\": %u, \"hash\": \"", sib->index);
-            for (int i = 0; i < 32; i++) fprintf(f, "%02x", sib->hash.hash_bytes[i]);
+            fprintHashHex(f, &sib->hash);
             fprintf(f, "\" }");
             first = 0;
             sib = sib->next;
@@ -129,40 +155,247 @@ void exportProofAndAncestry(const char* filename, Proof* proof, AncestryProof* a
     fprintf(f, "  }\n");
 
     fprintf(f, "}\n");
+}
+
+// Trasferimento con --owner-values: prova del proprietario precedente e, in "update", foglia e root con il nuovo
+static void writeTransferProof(FILE* f, UpdateProof* up, NodeKey* key, const char* newValue, HashValue oldRoot) {
+    writeProofHead(f, key, up->oldValue, up->oldValueLength, oldRoot);
+    writeProofBody(f, &up->proof, key);
+    fprintf(f, ",\n");
+    fprintf(f, "  \"update\": {\n");
+    fprintf(f, "    \"value\": \"%s\",\n", newValue);
+    fprintf(f, "    \"leafHash\": \"");
+    fprintHashHex(f, &up->newLeafHash);
+    fprintf(f, "\",\n    \"root\": \"");
+    fprintHashHex(f, &up->newRoot);
+    fprintf(f, "\"\n  }\n}\n");
+}
+
+// Prova rispetto alla root di una voce della timeline: al posto dell'ancestry, blocco e timestamp della voce
+static void writeTimelineProof(FILE* f, const JMTTimelineEntry* e, Proof* proof, NodeKey* key, uint8_t* value, size_t valueLen) {
+    writeProofHead(f, key, value, valueLen, e->root);
+    fprintf(f, "  \"block\": %u,\n", e->blockId);
+    fprintf(f, "  \"timestamp\": %u,\n", e->timestamp);
+    writeProofBody(f, proof, key);
+    fprintf(f, "\n}\n");
+}
+
+// Il JSON è composto in memoria dal thread dell'albero; apertura, scrittura e chiusura del file sono dello stadio di uscita
+static FILE* openJsonBuffer(char** data, size_t* len) {
+    FILE* f = open_memstream(data, len);
+    if (!f) {
+        perror("Errore buffer JSON");
+        exit(EXIT_FAILURE);
+    }
+    return f;
+}
+
+void exportProofAndAncestry(ProofWriter* out, const char* filename, Proof* proof, AncestryProof* ancestry, NodeKey* key, uint8_t* value, size_t valueLen, HashValue rootHash) {
+    char* data;
+    size_t len;
+    FILE* f = openJsonBuffer(&data, &len);
+    writeProofAndAncestry(f, proof, ancestry, key, value, valueLen, rootHash);
     fclose(f);
+    proofWriterSubmit(out, filename, data, len);
 }
 
-void processCSV(const char* csvPath) {
-    FILE* file = fopen(csvPath, "r");
-    if (!file) {
-        perror("Errore apertura file CSV");
+static void exportTransfer(ProofWriter* out, const char* filename, UpdateProof* up, NodeKey* key, const char* newValue, HashValue oldRoot) {
+    char* data;
+    size_t len;
+    FILE* f = openJsonBuffer(&data, &len);
+    writeTransferProof(f, up, key, newValue, oldRoot);
+    fclose(f);
+    proofWriterSubmit(out, filename, data, len);
+}
+
+/*
+ * Trasferimento di un token coniato in questa esportazione: una sola discesa cambia il proprietario nella foglia.
+ * false se il token non è nell'albero (coniato prima di --from-block o in un'altra collezione).
+ */
+static bool applyTransfer(JMT* t, ProofWriter* out, const EventRecord* ev, uint64_t index) {
+    uint32_t version = jmtTokenVersion(ev->tokenId);
+    if (version == 0) return false;
+    NodeKey key = buildKeyFromParts(version, ev->tokenId);
+    if (hashedKeys) {
+        NodeKey hashed = hashedKey(&key);
+        free(key.nibble_path.nibbles);
+        key = hashed;
+    }
+
+    char value[16];
+    snprintf(value, sizeof(value), "%u", ev->toId);
+    UpdateProof up = {0};
+    bool ok = jmtUpdateWithProof(t, &key, (uint8_t*)value, strlen(value), &up);
+    if (ok) {
+        char filename[128];
+        proofFileName(filename, sizeof(filename), "proofs", index);
+        exportTransfer(out, filename, &up, &key, value, computeProofRoot(&key, &up.proof, up.proof.leafHash));
+        freeUpdateProof(&up);
+    }
+    free(key.nibble_path.nibbles);
+    return ok;
+}
+
+static ProofWriter* startProofWriter(void) {
+    ProofWriter* out = proofWriterStart(ioBackend, ioDepth);
+    if (!out) exit(EXIT_FAILURE);
+    return out;
+}
+
+static void stopProofWriter(ProofWriter* out) {
+    const char* backend = proofWriterBackendName(out);
+    ProofWriterStats stats;
+    bool ok = proofWriterStop(out, &stats);
+    printf("💾 %lu file di prova (%.1f MB) con %s: profondità media %.1f, massima %u, %lu attese/enter\n",
+           (unsigned long)stats.files, stats.bytes / 1e6, backend,
+           stats.files + stats.errors > 0 ? (double)stats.depthSum / (stats.files + stats.errors) : 0.0,
+           stats.maxDepth, (unsigned long)stats.enters);
+    if (!ok) {
+        fprintf(stderr, "❌ %lu file di prova non scritti\n", (unsigned long)stats.errors);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Stato di tutta la collezione in ordine di chiave (version, tokenId), in un'unica visita
+static void dumpLeaves(InternalNode* root, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror("Errore apertura file dump");
         exit(EXIT_FAILURE);
     }
+    fprintf(f, "version,tokenId,value\n");
+
+    JMTIterator it;
+    jmtIterInit(&it, root);
+    size_t count = 0;
+    while (jmtIterNext(&it)) {
+        fprintf(f, "%u,%lu,%.*s\n", keyVersion(&it.leaf->leafKey), keyTokenId(&it.leaf->leafKey),
+                (int)it.leaf->valueLength, leafValue(it.leaf));
+        count++;
+    }
+    fclose(f);
+    printf("📤 %zu foglie scritte in %s\n", count, path);
+}
 
-    char line[256];
-    int lineNum = 0;
-    InternalNode* root = createInternalNode();
+/*
+ * Blocco in corso per la timeline. Gli eventi con blockId minore del blocco corrente (CSV non ordinato)
+ * restano nel blocco corrente, così le voci restano ordinate per la ricerca.
+ */
+typedef struct {
+    bool open;
+    uint32_t blockId;
+    uint32_t timestamp;
+    uint64_t entries;
+    uint64_t unordered;
+} TimelineBlock;
+
+// A fine blocco, se sono state aggiunte foglie dall'ultima voce: commit e voce con la root del blocco
+static void closeTimelineBlock(JMT* t, JMTTimelineWriter* tl, TimelineBlock* b) {
+    const JMTTimelineEntry* last = jmtTimelineLast(tl);
+    bool open = b->open;
+    b->open = false;
+    if (!open || jmtNextVersion() == (last ? last->keyLimit : 0)) return;
+
+    JMTTimelineEntry e;
+    memset(&e, 0, sizeof(e));
+    e.blockId = last && last->blockId > b->blockId ? last->blockId : b->blockId;
+    e.timestamp = last && last->timestamp > b->timestamp ? last->timestamp : b->timestamp;
+    e.keyLimit = jmtNextVersion();
+    e.root = jmtCommit(t);
+    e.version = t->version;
+    if (!jmtTimelineAppend(tl, &e)) exit(EXIT_FAILURE);
+    b->entries++;
+}
 
-    fgets(line, sizeof(line), file);
+static void trackTimelineBlock(JMT* t, JMTTimelineWriter* tl, TimelineBlock* b, const EventRecord* ev) {
+    if (b->open && ev->blockId > b->blockId) closeTimelineBlock(t, tl, b);
+    if (!b->open) {
+        b->open = true;
+        b->blockId = ev->blockId;
+        b->timestamp = ev->timestamp;
+        return;
+    }
+    if (ev->blockId < b->blockId) b->unordered++;
+    if (ev->timestamp > b->timestamp) b->timestamp = ev->timestamp;
+}
+
+// I file delle prove precedenti (e le voci della timeline) devono essere su disco prima che il checkpoint li dia per scritti
+static void saveCheckpoint(JMT* t, IngestPipeline* in, ProofWriter* out, JMTTimelineWriter* timeline, JMTCheckpoint* cp, uint64_t outputs) {
+    proofWriterSync(out);
+    if (timeline && !jmtTimelineSync(timeline)) exit(EXIT_FAILURE);
+    cp->inputPosition = ingestPosition(in);
+    cp->outputs = outputs;
+    if (!jmtCheckpointSave(checkpointPath, t, cp)) exit(EXIT_FAILURE);
+    printf("📌 Checkpoint in %s: %lu prove, posizione %lu\n", checkpointPath, (unsigned long)outputs, (unsigned long)cp->inputPosition);
+}
+
+void processCSV(const char* csvPath, uint32_t fromBlock) {
+    JMT* t = createJMTWithHasher(jmtActiveHasher());
+    JMTCheckpoint cp = {0, 0, fromBlock, hashedKeys, ownerValues};
+    if (resumeRun) {
+        JMTCheckpoint saved;
+        if (!jmtCheckpointLoad(checkpointPath, t, &saved)) exit(EXIT_FAILURE);
+        if (saved.fromBlock != fromBlock || saved.hashedKeys != hashedKeys || saved.ownerValues != ownerValues) {
+            fprintf(stderr, "❌ Il checkpoint viene da un'esportazione con altri --from-block, --hashed-keys o --owner-values\n");
+            exit(EXIT_FAILURE);
+        }
+        cp = saved;
+        printf("⏩ Ripresa da %s: %lu prove già scritte, posizione %lu\n", checkpointPath,
+               (unsigned long)cp.outputs, (unsigned long)cp.inputPosition);
+    }
 
-    while (fgets(line, sizeof(line), file)) {
-        uint32_t blockId, timestamp, contractId, fromId, toId;
-        uint64_t tokenId;
-        char value[] = "1";
+    IngestPipeline* in = ingestStart(csvPath, cp.inputPosition, fromBlock);
+    if (!in) {
+        perror("Errore apertura file CSV");
+        exit(EXIT_FAILURE);
+    }
 
-        sscanf(line, "%u,%u,%u,%u,%u,%lu", &blockId, &timestamp, &contractId, &fromId, &toId, &tokenId);
+    // La timeline riprende dall'ultima voce coperta dal checkpoint
+    JMTTimelineWriter* timeline = NULL;
+    TimelineBlock block = {0};
+    if (timelinePath) {
+        timeline = resumeRun ? jmtTimelineResume(timelinePath, t->hasher, hashedKeys, t->version)
+                             : jmtTimelineCreate(timelinePath, t->hasher, hashedKeys);
+        if (!timeline) exit(EXIT_FAILURE);
+    }
 
-        if (fromId!=0) {
+    uint64_t lineNum = cp.outputs;
+    EventRecord ev;
+
+    // Con --archive le prove vanno nell'archivio deduplicato invece che in proofs/
+    ProofArchiveWriter* archive = NULL;
+    ProofWriter* out = NULL;
+    if (archivePath && !(archive = proofArchiveCreate(archivePath))) exit(EXIT_FAILURE);
+    if (!archive) out = startProofWriter();
+
+    while (ingestNext(in, &ev)) {
+        uint64_t tokenId = ev.tokenId;
+        char value[16] = "1";
+        if (ownerValues) snprintf(value, sizeof(value), "%u", ev.toId);
+
+        if (timeline) trackTimelineBlock(t, timeline, &block, &ev);
+        if (ev.fromId!=0) {
+            // I trasferimenti occupano un file nella stessa numerazione dei mint, nell'ordine degli eventi
+            if (!ownerValues || ev.toId == 0 || !applyTransfer(t, out, &ev, lineNum)) continue;
+            lineNum++;
+            if (checkpointPath && lineNum % checkpointEvery == 0) saveCheckpoint(t, in, out, timeline, &cp, lineNum);
             continue;
         }
 
         NibblePath path = buildPathFromTokenId(tokenId);
         NodeKey key = buildKey(path);
+        // Indice tokenId -> version salvato nei checkpoint: serve a ritrovare la chiave nelle interrogazioni storiche
+        jmtSetTokenVersion(tokenId, keyVersion(&key));
+        if (hashedKeys) {
+            NodeKey hashed = hashedKey(&key);
+            free(key.nibble_path.nibbles);
+            key = hashed;
+        }
 
-        insertJMT(&root, &key, (uint8_t*)value, strlen(value), &ancestryP);
+        jmtInsert(t, &key, (uint8_t*)value, strlen(value), &ancestryP);
 
         Proof proof = {0};
-        generateProof(root, &key, &proof);
+        generateProof(t->root, &key, &proof);
 
         AncestryProof ancestry = {0};
         ancestry.key = ancestryP.key;
@@ -171,11 +404,15 @@ void processCSV(const char* csvPath) {
         ancestry.preForkingDepth = ancestryP.preForkingDepth;
         ancestry.proof = deepCopyProof(&ancestryP.proof);
 
-        char filename[128];
-        sprintf(filename, "proofs/output_%05d.json", lineNum);
         HashValue rootHash = computeProofRoot(&key, &proof, proof.leafHash);
 
-        exportProofAndAncestry(filename, &proof, &ancestry, &key, (uint8_t*)value, strlen(value), rootHash);
+        if (archive) {
+            if (!proofArchiveAppend(archive, &proof, &ancestry, &key, (uint8_t*)value, strlen(value), rootHash)) exit(EXIT_FAILURE);
+        } else {
+            char filename[128];
+            proofFileName(filename, sizeof(filename), "proofs", lineNum);
+            exportProofAndAncestry(out, filename, &proof, &ancestry, &key, (uint8_t*)value, strlen(value), rootHash);
+        }
 
         free(path.nibbles);
         free(key.nibble_path.nibbles);
@@ -183,14 +420,404 @@ void processCSV(const char* csvPath) {
         lineNum++;
 
         if(lineNum%1000 == 0){
-            printf("Numero di linea: %u\n",lineNum);
+            printf("Numero di linea: %lu\n", (unsigned long)lineNum);
         }
+        if (checkpointPath && lineNum % checkpointEvery == 0) saveCheckpoint(t, in, out, timeline, &cp, lineNum);
     }
-    fclose(file);
+    // La fine dell'input chiude l'ultimo blocco
+    if (timeline) closeTimelineBlock(t, timeline, &block);
+    // L'ultimo checkpoint copre l'intero file: righe aggiunte in seguito si esportano con --resume
+    if (checkpointPath) saveCheckpoint(t, in, out, timeline, &cp, lineNum);
+    ingestStop(in);
+
+    if (timeline) {
+        if (!jmtTimelineFinish(timeline)) exit(EXIT_FAILURE);
+        printf("🕰️  %lu blocchi aggiunti alla timeline %s\n", (unsigned long)block.entries, timelinePath);
+        if (block.unordered > 0) {
+            fprintf(stderr, "⚠️ %lu eventi con blockId decrescente attribuiti al blocco precedente\n", (unsigned long)block.unordered);
+        }
+    }
+
+    if (out) stopProofWriter(out);
+    if (archive) {
+        ProofArchiveStats stats;
+        if (!proofArchiveFinish(archive, &stats)) exit(EXIT_FAILURE);
+        printf("🗜️  %lu prove in %s: %lu digest distinti su %lu citati, %.1f MB\n", (unsigned long)stats.proofs, archivePath,
+               (unsigned long)stats.hashes, (unsigned long)stats.references, stats.bytes / 1e6);
+    }
+
+    if (inspectPath) {
+        JMTInspectStats stats;
+        jmtInspect(t->root, &stats);
+        FILE* f = fopen(inspectPath, "w");
+        if (!f) {
+            perror("Errore apertura file inspect");
+            exit(EXIT_FAILURE);
+        }
+        printInspectStats(f, &stats);
+        fclose(f);
+        printf("🔍 Forma dell'albero scritta in %s\n", inspectPath);
+    }
+
+    if (dumpPath) dumpLeaves(t->root, dumpPath);
+}
+
+static void fprintLevels(FILE* f, LevelSibling* lvl, const char* indent) {
+    while (lvl != NULL) {
+        fprintf(f, "%s{\n%s  \"siblings\": [", indent, indent);
+        int first = 1;
+        for (Sibling* sib = lvl->siblings; sib != NULL; sib = sib->next) {
+            if (!first) fprintf(f, ", ");
+            fprintf(f, "{ \"index\": %u, \"hash\": \"", sib->index);
+            fprintHashHex(f, &sib->hash);
+            fprintf(f, "\" }");
+            first = 0;
+        }
+        fprintf(f, "]\n%s}", indent);
+        lvl = lvl->next;
+        if (lvl != NULL) fprintf(f, ",\n");
+    }
+}
+
+void exportForestProof(ProofWriter* out, const char* filename, ForestProof* fp, NodeKey* key, uint8_t* value, size_t valueLen, HashValue globalRoot) {
+    char* data;
+    size_t len;
+    FILE* f = openJsonBuffer(&data, &len);
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"tokenId\": %lu,\n", extractTokenIdFromKey(key));
+    fprintf(f, "  \"version\": %u,\n", extractVersionFromKey(key));
+    fprintf(f, "  \"value\": \"%.*s\",\n", (int)valueLen, value);
+
+    fprintf(f, "  \"root\": \"");
+    fprintHashHex(f, &globalRoot);
+    fprintf(f, "\",\n");
+    fprintf(f, "  \"shard\": %zu,\n", fp->shard);
+    fprintf(f, "  \"shardRoot\": \"");
+    fprintHashHex(f, &fp->shardRoot);
+    fprintf(f, "\",\n");
+
+    fprintf(f, "  \"proof\": {\n");
+    fprintf(f, "    \"isMembership\": %s,\n", fp->proof.isPresent ? "true" : "false");
+    fprintf(f, "    \"depth\": %zu,\n", fp->proof.depth);
+    fprintf(f, "    \"tokenId\": %lu,\n", extractTokenIdFromKey(key));
+    fprintf(f, "    \"leafHash\": \"");
+    fprintHashHex(f, &fp->proof.leafHash);
+    fprintf(f, "\",\n");
+    fprintf(f, "    \"levels\": [\n");
+    fprintLevels(f, fp->proof.levels, "      ");
+    fprintf(f, "\n    ]\n  },\n");
+
+    fprintf(f, "  \"topDepth\": %zu,\n", fp->topDepth);
+    fprintf(f, "  \"topLevels\": [\n");
+    fprintLevels(f, fp->topLevels, "    ");
+    fprintf(f, "\n  ]\n");
+    fprintf(f, "}\n");
+    fclose(f);
+    proofWriterSubmit(out, filename, data, len);
+}
+
+// Modalità foresta: ingest parallelo sugli shard, poi prove combinate verso la root globale
+void processCSV_Forest(const char* csvPath, size_t shards, ForestPartition partition, long nibbleOffset, uint32_t fromBlock) {
+    IngestPipeline* in = ingestStart(csvPath, 0, fromBlock);
+    if (!in) {
+        perror("Errore apertura file CSV");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t topDepth = 0;
+    for (size_t cap = 1; cap < shards; cap *= 16) topDepth++;
+    size_t offset = nibbleOffset >= 0 ? (size_t)nibbleOffset : 24 - topDepth;
+
+    Forest* F = createForest(shards, partition, offset, true);
+    if (!F) exit(EXIT_FAILURE);
+    mkdir("proofs-forest", 0777);
+
+    size_t cap = 1024, n = 0;
+    NodeKey* keys = malloc(cap * sizeof(NodeKey));
+    uint32_t* contracts = malloc(cap * sizeof(uint32_t));
+    char value[] = "1";
+    EventRecord ev;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    while (ingestNext(in, &ev)) {
+        if (ev.fromId != 0) continue;
+
+        NibblePath path = buildPathFromTokenId(ev.tokenId);
+        NodeKey key = buildKey(path);
+        free(path.nibbles);
+
+        forestInsert(F, forestShardOf(F, &key, ev.contractId), &key, (uint8_t*)value, strlen(value));
+
+        if (n == cap) {
+            cap *= 2;
+            keys = realloc(keys, cap * sizeof(NodeKey));
+            contracts = realloc(contracts, cap * sizeof(uint32_t));
+        }
+        keys[n] = key;
+        contracts[n] = ev.contractId;
+        n++;
+    }
+    ingestStop(in);
+
+    HashValue globalRoot = forestSync(F);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("🌲 %zu mint su %zu shard in %.3f s (%.0f insert/s)\n", n, shards, secs, secs > 0 ? n / secs : 0.0);
+    printf("Root globale: "); printHash(globalRoot); printf("\n");
+
+    ProofWriter* out = startProofWriter();
+    for (size_t i = 0; i < n; i++) {
+        ForestProof fp;
+        forestGenerateProof(F, &keys[i], contracts[i], &fp);
+
+        char filename[128];
+        proofFileName(filename, sizeof(filename), "proofs-forest", i);
+        exportForestProof(out, filename, &fp, &keys[i], (uint8_t*)value, strlen(value), globalRoot);
+
+        freeForestProof(&fp);
+        free(keys[i].nibble_path.nibbles);
+    }
+
+    stopProofWriter(out);
+
+    free(keys);
+    free(contracts);
+    destroyForest(F);
+}
+
+// Riscrive su stdout la prova index dell'archivio, identica al file proofs/output_XXXXX.json che sostituisce
+static int extractProof(const char* path, const char* index) {
+    ProofArchive* a = proofArchiveOpen(path);
+    if (!a) return EXIT_FAILURE;
+
+    char* end;
+    size_t i = strtoull(index, &end, 10);
+    if (*end != '\0' || i >= proofArchiveCount(a)) {
+        fprintf(stderr, "❌ Indice %s fuori dall'archivio (%zu prove)\n", index, proofArchiveCount(a));
+        proofArchiveClose(a);
+        return EXIT_FAILURE;
+    }
+
+    ArchivedProof p;
+    if (!proofArchiveGet(a, i, &p)) {
+        proofArchiveClose(a);
+        return EXIT_FAILURE;
+    }
+    jmtUseHasher(proofArchiveHasher(a));
+    writeProofAndAncestry(stdout, &p.proof, &p.ancestry, &p.key, p.value, p.valueLength, p.root);
+    freeArchivedProof(&p);
+    proofArchiveClose(a);
+    return EXIT_SUCCESS;
+}
+
+// Version dell'ultimo mint del token: dall'indice del checkpoint o, se assente (tokenId fuori indice o version 0), dalle foglie
+static uint32_t findTokenVersion(JMT* t, uint64_t tokenId) {
+    uint32_t v = jmtTokenVersion(tokenId);
+    if (v != 0) return v;
+    JMTIterator it;
+    jmtIterInit(&it, t->root);
+    while (jmtIterNext(&it)) {
+        NodeKey* k = &it.leaf->leafKey;
+        if (keyTokenId(k) == tokenId && keyVersion(k) > v) v = keyVersion(k);
+    }
+    return v;
+}
+
+/*
+ * Stato al blocco (o al timestamp) at dalla timeline: senza --checkpoint la voce trovata;
+ * con --checkpoint la root ricostruita dall'albero salvato e, con --token, la prova del token su stdout.
+ */
+static int queryTimeline(bool byTime, uint32_t at, bool hasToken, uint64_t tokenId) {
+    JMTTimeline* tl = jmtTimelineOpen(timelinePath);
+    if (!tl) return EXIT_FAILURE;
+    const JMTTimelineEntry* e = byTime ? jmtTimelineAtTime(tl, at) : jmtTimelineAtBlock(tl, at);
+    if (e == NULL) {
+        fprintf(stderr, "❌ Nessun blocco nella timeline fino a %s %u\n", byTime ? "timestamp" : "blocco", at);
+        jmtTimelineClose(tl);
+        return EXIT_FAILURE;
+    }
+    if (!checkpointPath) {
+        printf("🕰️  Blocco %u (timestamp %u): commit %lu, %u mint, root ", e->blockId, e->timestamp, (unsigned long)e->version, e->keyLimit);
+        fprintHashHex(stdout, &e->root);
+        printf("\n");
+        jmtTimelineClose(tl);
+        return EXIT_SUCCESS;
+    }
+
+    JMT* t = createJMTWithHasher(jmtTimelineHasher(tl));
+    JMTCheckpoint cp;
+    if (!jmtCheckpointLoad(checkpointPath, t, &cp)) exit(EXIT_FAILURE);
+    if (cp.hashedKeys != jmtTimelineHashedKeys(tl)) {
+        fprintf(stderr, "❌ Timeline e checkpoint vengono da esportazioni con --hashed-keys diversi\n");
+        exit(EXIT_FAILURE);
+    }
+    JMT_WITH_HASHER(t->hasher);
+
+    int rc = EXIT_SUCCESS;
+    if (!hasToken) {
+        HashValue root;
+        if (!jmtTimelineRoot(t, e, cp.hashedKeys, &root)) exit(EXIT_FAILURE);
+        bool same = memcmp(&root, &e->root, sizeof(HashValue)) == 0;
+        printf("%s Blocco %u (timestamp %u): root ", same ? "✅" : "❌", e->blockId, e->timestamp);
+        fprintHashHex(stdout, &root);
+        printf(same ? ", uguale alla timeline\n" : ", diversa dalla timeline\n");
+        if (!same) rc = EXIT_FAILURE;
+    } else {
+        NodeKey key = buildKeyFromParts(findTokenVersion(t, tokenId), tokenId);
+        if (cp.hashedKeys) {
+            NodeKey hashed = hashedKey(&key);
+            free(key.nibble_path.nibbles);
+            key = hashed;
+        }
+        Proof proof;
+        if (!jmtTimelineProof(t, e, &key, &proof)) exit(EXIT_FAILURE);
+        // Una foglia presente alla voce esiste ancora con lo stesso valore: l'albero è in sola inserzione
+        const uint8_t* value = (const uint8_t*)"";
+        size_t valueLen = 0;
+        if (proof.isPresent) lookupJMTRef(t->root, &key, &value, &valueLen);
+        writeTimelineProof(stdout, e, &proof, &key, (uint8_t*)value, valueLen);
+        freeProof(&proof);
+        free(key.nibble_path.nibbles);
+    }
+    destroyJMT(t);
+    jmtTimelineClose(tl);
+    return rc;
 }
 
 int main(int argc, char** argv) {
     const char* path = "art_blocks.csv";
-    processCSV(path);
+    size_t shards = 0;
+    long nibbleOffset = -1;
+    uint32_t fromBlock = 0;
+    ForestPartition partition = FOREST_BY_KEY_NIBBLES;
+    const char* statsPath = NULL;
+    unsigned statsInterval = 1000;
+    bool queryByBlock = false, queryByTime = false, hasToken = false;
+    uint32_t queryAt = 0;
+    uint64_t tokenId = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            shards = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--by-contract") == 0) {
+            partition = FOREST_BY_CONTRACT;
+        } else if (strcmp(argv[i], "--from-block") == 0 && i + 1 < argc) {
+            fromBlock = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--nibble-offset") == 0 && i + 1 < argc) {
+            nibbleOffset = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) {
+            const JMTHasher* h = jmtHasherByName(argv[++i]);
+            if (h == NULL) {
+                fprintf(stderr, "❌ Funzione di hash sconosciuta: %s (keccak256, sha256)\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            jmtUseHasher(h);
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            statsPath = argv[++i];
+        } else if (strcmp(argv[i], "--stats-interval") == 0 && i + 1 < argc) {
+            statsInterval = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--inspect") == 0 && i + 1 < argc) {
+            inspectPath = argv[++i];
+        } else if (strcmp(argv[i], "--dump-leaves") == 0 && i + 1 < argc) {
+            dumpPath = argv[++i];
+        } else if (strcmp(argv[i], "--hashed-keys") == 0) {
+            hashedKeys = true;
+        } else if (strcmp(argv[i], "--owner-values") == 0) {
+            ownerValues = true;
+        } else if (strcmp(argv[i], "--io-backend") == 0 && i + 1 < argc) {
+            if (!proofIOBackendByName(argv[++i], &ioBackend)) {
+                fprintf(stderr, "❌ Backend di scrittura sconosciuto: %s (auto, uring, threads, sync)\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--io-depth") == 0 && i + 1 < argc) {
+            ioDepth = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            checkpointEvery = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            resumeRun = true;
+        } else if (strcmp(argv[i], "--timeline") == 0 && i + 1 < argc) {
+            timelinePath = argv[++i];
+        } else if (strcmp(argv[i], "--at-block") == 0 && i + 1 < argc) {
+            queryByBlock = true;
+            queryAt = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--at-time") == 0 && i + 1 < argc) {
+            queryByTime = true;
+            queryAt = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--token") == 0 && i + 1 < argc) {
+            hasToken = true;
+            tokenId = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--archive") == 0 && i + 1 < argc) {
+            archivePath = argv[++i];
+        } else if (strcmp(argv[i], "--extract") == 0 && i + 2 < argc) {
+            return extractProof(argv[i + 1], argv[i + 2]);
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (queryByBlock || queryByTime) {
+        if (!timelinePath || (queryByBlock && queryByTime)) {
+            fprintf(stderr, "❌ --at-block o --at-time richiedono --timeline <file>\n");
+            return EXIT_FAILURE;
+        }
+        if (hasToken && !checkpointPath) {
+            fprintf(stderr, "❌ --token richiede --checkpoint <file> con l'albero\n");
+            return EXIT_FAILURE;
+        }
+        return queryTimeline(queryByTime, queryAt, hasToken, tokenId);
+    }
+
+    if (statsPath) jmtStatsStartDump(statsPath, jmtStatsFormatOf(statsPath), statsInterval);
+
+    // Gli shard e il livello superiore della foresta sono verificati on-chain: solo keccak256
+    if (shards > 0 && jmtActiveHasher() != &jmtKeccak256) {
+        fprintf(stderr, "❌ La modalità foresta supporta solo keccak256\n");
+        return EXIT_FAILURE;
+    }
+
+    if (shards > 0 && hashedKeys) {
+        fprintf(stderr, "❌ La modalità foresta non supporta --hashed-keys\n");
+        return EXIT_FAILURE;
+    }
+
+    if (checkpointEvery == 0) checkpointEvery = 1;
+    if (resumeRun && !checkpointPath) {
+        fprintf(stderr, "❌ --resume richiede --checkpoint <file>\n");
+        return EXIT_FAILURE;
+    }
+    // L'archivio tiene in memoria la tabella dei digest, che il checkpoint non contiene
+    if (checkpointPath && (shards > 0 || archivePath)) {
+        fprintf(stderr, "❌ --checkpoint non è supportato con --shards o --archive\n");
+        return EXIT_FAILURE;
+    }
+
+    if (shards > 0 && timelinePath) {
+        fprintf(stderr, "❌ La modalità foresta non supporta --timeline\n");
+        return EXIT_FAILURE;
+    }
+
+    if (shards > 0 && archivePath) {
+        fprintf(stderr, "❌ La modalità foresta non supporta --archive\n");
+        return EXIT_FAILURE;
+    }
+
+    // Le prove storiche e l'archivio assumono un albero in sola inserzione
+    if (ownerValues && (shards > 0 || timelinePath || archivePath)) {
+        fprintf(stderr, "❌ --owner-values non è supportato con --shards, --timeline o --archive\n");
+        return EXIT_FAILURE;
+    }
+
+    if (shards > 0) {
+        processCSV_Forest(path, shards, partition, nibbleOffset, fromBlock);
+    } else {
+        processCSV(path, fromBlock);
+    }
+
+    jmtStatsStopDump();
     return 0;
 }
@@ -7,6 +7,7 @@
  * but not liability.
  */
 #include "keccak-tiny.h"
+#include "Instrument.h"
 
 #include <stdint.h>
 #include <stdio.h>
@@ -163,5 +164,161 @@ defsha3(384)
 defsha3(512)
                                           \
 int keccak_256(uint8_t* out, const uint8_t* in, size_t inlen) {
+  JMT_COUNT(INSTR_KECCAK_CALLS, 1);
+  JMT_COUNT(INSTR_KECCAK_BYTES, inlen);
   return hash(out, 32, in, inlen, 136, 0x01);  // 32 bytes output, 136 byte rate, 0x01 padding (Ethereum style)
 }
+
+/******** Incremental Keccak-256. ********/
+
+#define KECCAK_256_RATE 136
+
+/* One out-of-line copy of the permutation shared by all the incremental entry points. */
+static __attribute__((noinline)) void permute(keccak_256_ctx* ctx) {
+  P(ctx->state);
+  ctx->offset = 0;
+}
+
+static inline void advance(keccak_256_ctx* ctx, size_t len) {
+  ctx->offset += len;
+  ctx->length += len;
+  if (ctx->offset == KECCAK_256_RATE) permute(ctx);
+}
+
+void keccak_256_init(keccak_256_ctx* ctx) {
+  memset(ctx->state, 0, sizeof(ctx->state));
+  ctx->offset = 0;
+  ctx->length = 0;
+}
+
+void keccak_256_absorb(keccak_256_ctx* ctx, const uint8_t* in, size_t inlen) {
+  uint8_t* a = (uint8_t*)ctx->state;
+  while (inlen > 0) {
+    size_t n = KECCAK_256_RATE - ctx->offset;
+    if (n > inlen) n = inlen;
+    xorin(a + ctx->offset, in, n);
+    in += n;
+    inlen -= n;
+    advance(ctx, n);
+  }
+}
+
+void keccak_256_absorb_byte(keccak_256_ctx* ctx, uint8_t b) {
+  ((uint8_t*)ctx->state)[ctx->offset] ^= b;
+  advance(ctx, 1);
+}
+
+void keccak_256_absorb_zeros(keccak_256_ctx* ctx, size_t len) {
+  while (len > 0) {
+    size_t n = KECCAK_256_RATE - ctx->offset;
+    if (n > len) n = len;
+    len -= n;
+    advance(ctx, n);
+  }
+}
+
+void keccak_256_final(keccak_256_ctx* ctx, uint8_t* out) {
+  JMT_COUNT(INSTR_KECCAK_CALLS, 1);
+  JMT_COUNT(INSTR_KECCAK_BYTES, ctx->length);
+  uint8_t* a = (uint8_t*)ctx->state;
+  a[ctx->offset] ^= 0x01;
+  a[KECCAK_256_RATE - 1] ^= 0x80;
+  permute(ctx);
+  memcpy(out, a, 32);
+}
+
+/******** Multi-buffer Keccak-256: four lanes in lockstep. ********/
+
+/* One 64-bit state word per lane; GCC lowers the vector ops to AVX2 or pairs of SSE2 registers. */
+typedef uint64_t v4u64 __attribute__((vector_size(32)));
+
+#define rol4(x, s) (((x) << (s)) | ((x) >> (64 - (s))))
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+__attribute__((target_clones("avx2", "default")))
+#endif
+static void keccakf_x4(v4u64* a) {
+  v4u64 b[5];
+  v4u64 t;
+
+  for (int i = 0; i < 24; i++) {
+    // Theta
+#pragma GCC unroll 5
+    for (int x = 0; x < 5; x++) b[x] = a[x] ^ a[x + 5] ^ a[x + 10] ^ a[x + 15] ^ a[x + 20];
+#pragma GCC unroll 5
+    for (int x = 0; x < 5; x++) {
+      t = b[(x + 4) % 5] ^ rol4(b[(x + 1) % 5], 1);
+#pragma GCC unroll 5
+      for (int y = 0; y < 25; y += 5) a[y + x] ^= t;
+    }
+    // Rho and pi
+    t = a[1];
+#pragma GCC unroll 24
+    for (int x = 0; x < 24; x++) {
+      b[0] = a[pi[x]];
+      a[pi[x]] = rol4(t, rho[x]);
+      t = b[0];
+    }
+    // Chi
+#pragma GCC unroll 5
+    for (int y = 0; y < 25; y += 5) {
+#pragma GCC unroll 5
+      for (int x = 0; x < 5; x++) b[x] = a[y + x];
+#pragma GCC unroll 5
+      for (int x = 0; x < 5; x++) a[y + x] = b[x] ^ ((~b[(x + 1) % 5]) & b[(x + 2) % 5]);
+    }
+    // Iota
+    a[0] ^= RC[i];
+  }
+}
+
+static inline uint64_t load64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+int keccak_256_x4(uint8_t* out[4], const uint8_t* const in[4], size_t inlen) {
+  const size_t rate = 136;
+  v4u64 a[25];
+  memset(a, 0, sizeof(a));
+
+  JMT_COUNT(INSTR_KECCAK_CALLS, 4);
+  JMT_COUNT(INSTR_KECCAK_BYTES, 4 * inlen);
+
+  // Absorb the full blocks
+  size_t off = 0;
+  for (; off + rate <= inlen; off += rate) {
+    for (size_t w = 0; w < rate / 8; w++) {
+      v4u64 v = {load64(in[0] + off + 8 * w), load64(in[1] + off + 8 * w),
+                 load64(in[2] + off + 8 * w), load64(in[3] + off + 8 * w)};
+      a[w] ^= v;
+    }
+    keccakf_x4(a);
+  }
+
+  // Last block with Ethereum-style padding (0x01 ... 0x80)
+  uint8_t last[4][136];
+  size_t rem = inlen - off;
+  for (int l = 0; l < 4; l++) {
+    memset(last[l], 0, rate);
+    memcpy(last[l], in[l] + off, rem);
+    last[l][rem] ^= 0x01;
+    last[l][rate - 1] ^= 0x80;
+  }
+  for (size_t w = 0; w < rate / 8; w++) {
+    v4u64 v = {load64(last[0] + 8 * w), load64(last[1] + 8 * w),
+               load64(last[2] + 8 * w), load64(last[3] + 8 * w)};
+    a[w] ^= v;
+  }
+  keccakf_x4(a);
+
+  // Squeeze 32 bytes per lane
+  for (int l = 0; l < 4; l++) {
+    for (int w = 0; w < 4; w++) {
+      uint64_t v = a[w][l];
+      memcpy(out[l] + 8 * w, &v, 8);
+    }
+  }
+  return 0;
+}
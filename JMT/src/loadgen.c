@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "macros.h"
+#include "Jellyfish.h"
+#include "Ingest.h"
+#include "ServeProto.h"
+
+/*
+ * jmt_loadgen: carico a ciclo chiuso su jmt_served. Ogni connessione mantiene --depth richieste in volo
+ * per --duration secondi; i tokenId sono quelli coniati nel CSV, chiesti con SERVE_ANY_VERSION.
+ * Con --hot una frazione delle richieste va su poche chiavi, per misurare l'accorpamento del server.
+ */
+
+typedef struct {
+    const char* socketPath;
+    uint8_t op;
+    uint16_t batch;
+    size_t depth;
+    double hot;
+    size_t hotKeys;
+    bool verify;
+    uint64_t deadlineNs;
+    const uint64_t* tokens;
+    size_t tokenCount;
+    const JMTHasher* hasher;
+} LoadConfig;
+
+typedef struct {
+    pthread_t thread;
+    const LoadConfig* cfg;
+    uint64_t rng;
+    uint64_t* lat;
+    size_t count;
+    size_t cap;
+    uint64_t keys;
+    uint64_t notFound;
+    uint64_t errors;
+    uint64_t invalid;
+    uint64_t bytes;
+} LoadWorker;
+
+static inline uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline uint64_t nextRandom(uint64_t* s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static int connectServer(const char* socketPath) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "❌ Percorso del socket troppo lungo: %s\n", socketPath);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, socketPath);
+    int fd;
+    SYSC(fd, socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0), "Error creating socket");
+    SYS(connect(fd, (struct sockaddr*)&addr, sizeof(addr)), "Error connecting to jmt_served");
+    return fd;
+}
+
+static void writeAll(int fd, const uint8_t* p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w == -1 && errno == EINTR) continue;
+        SYS(w, "Error writing request");
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+static bool readAll(int fd, uint8_t* p, size_t n) {
+    while (n > 0) {
+        ssize_t r = read(fd, p, n);
+        if (r == -1 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        n -= (size_t)r;
+    }
+    return true;
+}
+
+// Legge una risposta intera; payload resta valido fino alla chiamata successiva
+static bool readResponse(int fd, ServeHeader* h, ServeBuf* payload) {
+    uint8_t head[SERVE_HEADER_SIZE];
+    if (!readAll(fd, head, sizeof(head))) return false;
+    serveParseHeader(head, h);
+    payload->len = 0;
+    serveBufReserve(payload, h->length);
+    if (!readAll(fd, payload->data, h->length)) return false;
+    payload->len = h->length;
+    return true;
+}
+
+// Richiesta senza chiavi (ROOT, STATS) su una connessione dedicata
+static void simpleRequest(const char* socketPath, uint8_t op, ServeBuf* payload) {
+    int fd = connectServer(socketPath);
+    ServeBuf req = {0};
+    ServeHeader h = {0, 0, op, 0, 0};
+    servePutHeader(&req, &h);
+    writeAll(fd, req.data, req.len);
+    if (!readResponse(fd, &h, payload) || h.status != SERVE_OK) {
+        fprintf(stderr, "❌ Risposta non valida da jmt_served (op %u)\n", op);
+        exit(EXIT_FAILURE);
+    }
+    serveBufFree(&req);
+    close(fd);
+}
+
+static uint64_t pickToken(LoadWorker* w) {
+    const LoadConfig* cfg = w->cfg;
+    uint64_t r = nextRandom(&w->rng);
+    size_t hotKeys = cfg->hotKeys < cfg->tokenCount ? cfg->hotKeys : cfg->tokenCount;
+    if (cfg->hot > 0 && (double)(r >> 11) / (double)(1ull << 53) < cfg->hot) {
+        return cfg->tokens[nextRandom(&w->rng) % hotKeys];
+    }
+    return cfg->tokens[nextRandom(&w->rng) % cfg->tokenCount];
+}
+
+static void sendRequest(LoadWorker* w, int fd, uint32_t id, ServeBuf* req) {
+    const LoadConfig* cfg = w->cfg;
+    uint16_t count = cfg->op == SERVE_OP_MULTIPROOF ? cfg->batch : (cfg->op == SERVE_OP_ROOT ? 0 : 1);
+    ServeHeader h = {(uint32_t)count * SERVE_KEY_SIZE, id, cfg->op, 0, count};
+    req->len = 0;
+    servePutHeader(req, &h);
+    for (uint16_t k = 0; k < count; k++) {
+        serveBufPutU32(req, SERVE_ANY_VERSION);
+        serveBufPutU64(req, pickToken(w));
+    }
+    writeAll(fd, req->data, req->len);
+    w->keys += count;
+}
+
+// Controlla le prove ricevute contro la root che le accompagna
+static void checkProofs(LoadWorker* w, const ServeHeader* h, const ServeBuf* payload) {
+    if (payload->len < sizeof(HashValue)) {
+        w->invalid++;
+        return;
+    }
+    HashValue root;
+    memcpy(root.hash_bytes, payload->data, sizeof(HashValue));
+    const uint8_t* p = payload->data + sizeof(HashValue);
+    const uint8_t* end = payload->data + payload->len;
+    uint16_t count = h->op == SERVE_OP_MULTIPROOF ? h->count : 1;
+    for (uint16_t k = 0; k < count; k++) {
+        ServeProof sp;
+        if (!serveDecodeProof(&p, end, &sp)) {
+            w->invalid++;
+            return;
+        }
+        if (!sp.proof.isPresent || !verifyProof(&sp.key, &sp.proof, root)) w->invalid++;
+        serveFreeProof(&sp);
+    }
+}
+
+static void* loadWorkerMain(void* arg) {
+    LoadWorker* w = (LoadWorker*)arg;
+    const LoadConfig* cfg = w->cfg;
+    jmtUseHasher(cfg->hasher);
+
+    int fd = connectServer(cfg->socketPath);
+    uint64_t* sentAt;
+    SYSCN(sentAt, (uint64_t*)malloc(cfg->depth * sizeof(uint64_t)), "Error allocating request slots");
+    ServeBuf req = {0}, payload = {0};
+
+    // L'id della richiesta è il suo slot: ogni risposta libera lo slot per la richiesta successiva
+    for (size_t s = 0; s < cfg->depth; s++) {
+        sentAt[s] = nowNs();
+        sendRequest(w, fd, (uint32_t)s, &req);
+    }
+
+    size_t inFlight = cfg->depth;
+    while (inFlight > 0) {
+        ServeHeader h;
+        if (!readResponse(fd, &h, &payload) || h.id >= cfg->depth) {
+            fprintf(stderr, "❌ Connessione interrotta da jmt_served\n");
+            w->errors += inFlight;
+            break;
+        }
+        uint64_t now = nowNs();
+        if (w->count == w->cap) {
+            w->cap = w->cap ? w->cap * 2 : 65536;
+            SYSCN(w->lat, (uint64_t*)realloc(w->lat, w->cap * sizeof(uint64_t)), "Error growing latency samples");
+        }
+        w->lat[w->count++] = now - sentAt[h.id];
+        w->bytes += SERVE_HEADER_SIZE + h.length;
+
+        if (h.status == SERVE_NOT_FOUND) w->notFound++;
+        else if (h.status != SERVE_OK) w->errors++;
+        else if (cfg->verify && (h.op == SERVE_OP_PROOF || h.op == SERVE_OP_MULTIPROOF)) checkProofs(w, &h, &payload);
+
+        if (now < cfg->deadlineNs) {
+            sentAt[h.id] = now;
+            sendRequest(w, fd, h.id, &req);
+        } else {
+            inFlight--;
+        }
+    }
+
+    close(fd);
+    free(sentAt);
+    serveBufFree(&req);
+    serveBufFree(&payload);
+    return NULL;
+}
+
+static int cmpU64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t* loadTokens(const char* path, size_t* count) {
+    IngestPipeline* in = ingestStart(path, 0, 0);
+    if (!in) {
+        perror("Errore apertura file CSV");
+        exit(EXIT_FAILURE);
+    }
+    size_t cap = 1024, n = 0;
+    uint64_t* tokens;
+    SYSCN(tokens, (uint64_t*)malloc(cap * sizeof(uint64_t)), "Error allocating token list");
+    EventRecord ev;
+    while (ingestNext(in, &ev)) {
+        if (ev.fromId != 0) continue;
+        if (n == cap) {
+            cap *= 2;
+            SYSCN(tokens, (uint64_t*)realloc(tokens, cap * sizeof(uint64_t)), "Error growing token list");
+        }
+        tokens[n++] = ev.tokenId;
+    }
+    ingestStop(in);
+    *count = n;
+    return tokens;
+}
+
+static void readStats(const char* socketPath, uint64_t* fields) {
+    ServeBuf payload = {0};
+    simpleRequest(socketPath, SERVE_OP_STATS, &payload);
+    for (int i = 0; i < SERVE_STATS_FIELDS; i++) fields[i] = serveGetU64(payload.data + 8 * i);
+    serveBufFree(&payload);
+}
+
+int main(int argc, char** argv) {
+    const char* path = "art_blocks.csv";
+    const char* outPath = NULL;
+    const char* opName = "proof";
+    size_t conns = 4;
+    double duration = 5;
+    LoadConfig cfg = {.socketPath = "jmt.sock", .batch = 16, .depth = 16, .hotKeys = 16};
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) cfg.socketPath = argv[++i];
+        else if (strcmp(argv[i], "--conns") == 0 && i + 1 < argc) conns = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) cfg.depth = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) duration = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "--op") == 0 && i + 1 < argc) opName = argv[++i];
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) cfg.batch = (uint16_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--hot") == 0 && i + 1 < argc) cfg.hot = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "--hot-keys") == 0 && i + 1 < argc) cfg.hotKeys = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--verify") == 0) cfg.verify = true;
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outPath = argv[++i];
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "Uso: %s [file.csv] [--socket jmt.sock] [--conns 4] [--depth 16] [--duration 5] "
+                            "[--op proof|lookup|multiproof|root] [--batch 16] [--hot 0.5] [--hot-keys 16] [--verify] [--out file.json]\n", argv[0]);
+            return EXIT_FAILURE;
+        } else path = argv[i];
+    }
+
+    if (strcmp(opName, "proof") == 0) cfg.op = SERVE_OP_PROOF;
+    else if (strcmp(opName, "lookup") == 0) cfg.op = SERVE_OP_LOOKUP;
+    else if (strcmp(opName, "multiproof") == 0) cfg.op = SERVE_OP_MULTIPROOF;
+    else if (strcmp(opName, "root") == 0) cfg.op = SERVE_OP_ROOT;
+    else {
+        fprintf(stderr, "❌ Operazione sconosciuta: %s\n", opName);
+        return EXIT_FAILURE;
+    }
+    if (conns < 1) conns = 1;
+    if (cfg.depth < 1) cfg.depth = 1;
+    if (cfg.hotKeys < 1) cfg.hotKeys = 1;
+    if (cfg.batch < 1 || cfg.batch > SERVE_MAX_KEYS) cfg.batch = 16;
+
+    uint64_t* tokens = loadTokens(path, &cfg.tokenCount);
+    if (cfg.tokenCount == 0) {
+        fprintf(stderr, "❌ Nessun mint in %s\n", path);
+        return EXIT_FAILURE;
+    }
+    cfg.tokens = tokens;
+
+    // La root dice con quale funzione di hash verificare le prove
+    ServeBuf rootInfo = {0};
+    simpleRequest(cfg.socketPath, SERVE_OP_ROOT, &rootInfo);
+    cfg.hasher = rootInfo.data[sizeof(HashValue) + 8] == JMT_HASH_SHA256 ? &jmtSha256 : &jmtKeccak256;
+    serveBufFree(&rootInfo);
+
+    uint64_t before[SERVE_STATS_FIELDS], after[SERVE_STATS_FIELDS];
+    readStats(cfg.socketPath, before);
+
+    LoadWorker* workers;
+    SYSCN(workers, (LoadWorker*)calloc(conns, sizeof(LoadWorker)), "Error allocating load workers");
+    uint64_t t0 = nowNs();
+    cfg.deadlineNs = t0 + (uint64_t)(duration * 1e9);
+    for (size_t i = 0; i < conns; i++) {
+        workers[i].cfg = &cfg;
+        workers[i].rng = 0x9E3779B97F4A7C15ull ^ ((i + 1) * 0xD1B54A32D192ED03ull);
+        SUCC0(pthread_create(&workers[i].thread, NULL, loadWorkerMain, &workers[i]), "Error starting load worker");
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < conns; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total += workers[i].count;
+    }
+    uint64_t elapsed = nowNs() - t0;
+    readStats(cfg.socketPath, after);
+
+    uint64_t* lat;
+    SYSCN(lat, (uint64_t*)malloc((total ? total : 1) * sizeof(uint64_t)), "Error allocating latency samples");
+    uint64_t keys = 0, notFound = 0, errors = 0, invalid = 0, bytes = 0;
+    size_t pos = 0;
+    for (size_t i = 0; i < conns; i++) {
+        memcpy(lat + pos, workers[i].lat, workers[i].count * sizeof(uint64_t));
+        pos += workers[i].count;
+        keys += workers[i].keys;
+        notFound += workers[i].notFound;
+        errors += workers[i].errors;
+        invalid += workers[i].invalid;
+        bytes += workers[i].bytes;
+        free(workers[i].lat);
+    }
+    qsort(lat, total, sizeof(uint64_t), cmpU64);
+#define PCT(p) (total ? lat[(size_t)((total - 1) * (p))] : 0)
+
+    FILE* out = stdout;
+    if (outPath) SYSCN(out, fopen(outPath, "w"), "Error opening loadgen output");
+    fprintf(out, "{\"op\": \"%s\", \"conns\": %zu, \"depth\": %zu, \"batch\": %u, \"hot\": %.2f, \"requests\": %zu, "
+                 "\"qps\": %.1f, \"keys_per_sec\": %.1f, \"p50_us\": %.1f, \"p90_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, "
+                 "\"max_us\": %.1f, \"bytes_per_response\": %.1f, \"not_found\": %lu, \"errors\": %lu, \"invalid\": %lu, "
+                 "\"server_computed\": %lu, \"server_coalesced\": %lu}\n",
+            opName, conns, cfg.depth, cfg.op == SERVE_OP_MULTIPROOF ? cfg.batch : 1, cfg.hot, total,
+            total * 1e9 / elapsed, keys * 1e9 / elapsed, PCT(0.5) / 1e3, PCT(0.9) / 1e3, PCT(0.99) / 1e3, PCT(0.999) / 1e3,
+            (total ? lat[total - 1] : 0) / 1e3, total ? (double)bytes / total : 0.0,
+            (unsigned long)notFound, (unsigned long)errors, (unsigned long)invalid,
+            (unsigned long)(after[3] - before[3]), (unsigned long)(after[2] - before[2]));
+#undef PCT
+    if (out != stdout) fclose(out);
+
+    free(lat);
+    free(workers);
+    free(tokens);
+    return invalid || errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,751 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "macros.h"
+#include "Jellyfish.h"
+#include "Ingest.h"
+#include "Instrument.h"
+#include "ServeProto.h"
+
+#define SERVED_MAX_EVENTS 256
+#define SERVED_READ_CHUNK 65536
+#define SERVED_INFLIGHT_BUCKETS 4096
+
+/*
+ * jmt_served: l'albero costruito dal CSV resta in memoria e viene servito in sola lettura.
+ * Il thread principale gestisce socket e parsing con epoll; lookup e prove sono calcolati dal pool di worker.
+ * Richieste uguali (stessa operazione e chiave) arrivate mentre una è in calcolo si accodano a quella:
+ * l'albero non cambia durante il servizio, quindi la root è la stessa e la risposta viene replicata.
+ */
+
+typedef struct Conn {
+    int fd;
+    ServeBuf in;                // solo thread principale
+    ServeBuf out;               // protetto da lock, scritto anche dai worker
+    pthread_mutex_t lock;
+    bool closed;                // protetto da lock
+    _Atomic int refs;           // thread principale + richieste in corso + coda di flush
+    bool queued;                // in flushQueue, protetto da server.flushLock
+    bool wantWrite;             // EPOLLOUT registrato, solo thread principale
+    struct Conn* nextFlush;
+    struct Conn* prev;          // connessioni aperte, solo thread principale
+    struct Conn* next;
+} Conn;
+
+typedef struct {
+    Conn* conn;
+    uint32_t id;
+} Waiter;
+
+// Richiesta LOOKUP/PROOF in calcolo, con le richieste identiche che ne attendono la risposta
+typedef struct InFlight {
+    uint8_t op;
+    uint32_t version;
+    uint64_t tokenId;
+    Waiter* waiters;
+    size_t count;
+    size_t cap;
+    struct InFlight* next;
+} InFlight;
+
+typedef struct Job {
+    InFlight* single;           // LOOKUP o PROOF
+    Conn* conn;                 // MULTIPROOF: richiesta non condivisa
+    uint32_t id;
+    uint16_t count;
+    uint32_t* versions;
+    uint64_t* tokenIds;
+    struct Job* next;
+} Job;
+
+// tokenId → versione assegnata al mint, per le richieste con SERVE_ANY_VERSION
+typedef struct {
+    uint64_t* tokens;
+    uint32_t* versions;
+    uint8_t* used;
+    size_t cap;
+    size_t count;
+} TokenIndex;
+
+static struct {
+    InternalNode* root;
+    HashValue rootDigest;
+    size_t leaves;
+    const JMTHasher* hasher;
+    bool hashedKeys;
+    TokenIndex index;
+
+    int epfd;
+    int listenFd;
+    int wakeFd;
+    int sigFd;
+    Conn* conns;
+
+    pthread_mutex_t jobLock;
+    pthread_cond_t jobReady;
+    Job* jobHead;
+    Job* jobTail;
+    bool stopping;
+
+    pthread_mutex_t inflightLock;
+    InFlight* inflight[SERVED_INFLIGHT_BUCKETS];
+
+    pthread_mutex_t flushLock;
+    Conn* flushHead;
+
+    struct {
+        _Atomic uint64_t requests;
+        _Atomic uint64_t keys;
+        _Atomic uint64_t coalesced;
+        _Atomic uint64_t computed;
+        _Atomic uint64_t connections;
+        _Atomic uint64_t badRequests;
+    } stats;
+} server = {
+    .jobLock = PTHREAD_MUTEX_INITIALIZER,
+    .jobReady = PTHREAD_COND_INITIALIZER,
+    .inflightLock = PTHREAD_MUTEX_INITIALIZER,
+    .flushLock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+// Marcatori in epoll_event.data.ptr per i descrittori che non sono connessioni
+static int listenTag, wakeTag, sigTag;
+
+
+static inline size_t tokenSlot(uint64_t tokenId, size_t cap) {
+    return (size_t)((tokenId * 0x9E3779B97F4A7C15ull) >> 17) & (cap - 1);
+}
+
+static void indexPut(TokenIndex* ix, uint64_t tokenId, uint32_t version) {
+    if ((ix->count + 1) * 2 > ix->cap) {
+        TokenIndex grown = {0};
+        grown.cap = ix->cap ? ix->cap * 2 : 1024;
+        SYSCN(grown.tokens, (uint64_t*)malloc(grown.cap * sizeof(uint64_t)), "Error allocating token index");
+        SYSCN(grown.versions, (uint32_t*)malloc(grown.cap * sizeof(uint32_t)), "Error allocating token index");
+        SYSCN(grown.used, (uint8_t*)calloc(grown.cap, 1), "Error allocating token index");
+        for (size_t i = 0; i < ix->cap; i++) {
+            if (ix->used[i]) indexPut(&grown, ix->tokens[i], ix->versions[i]);
+        }
+        free(ix->tokens);
+        free(ix->versions);
+        free(ix->used);
+        *ix = grown;
+    }
+
+    size_t i = tokenSlot(tokenId, ix->cap);
+    while (ix->used[i] && ix->tokens[i] != tokenId) i = (i + 1) & (ix->cap - 1);
+    if (!ix->used[i]) ix->count++;
+    // Un tokenId coniato di nuovo riceve una nuova versione: vale l'ultima
+    ix->used[i] = 1;
+    ix->tokens[i] = tokenId;
+    ix->versions[i] = version;
+}
+
+static bool indexGet(const TokenIndex* ix, uint64_t tokenId, uint32_t* version) {
+    if (ix->cap == 0) return false;
+    for (size_t i = tokenSlot(tokenId, ix->cap); ix->used[i]; i = (i + 1) & (ix->cap - 1)) {
+        if (ix->tokens[i] == tokenId) {
+            *version = ix->versions[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Stessi eventi e stessa assegnazione delle versioni di jmt_export: la root coincide con quella finale delle prove esportate
+static void loadTree(const char* path, uint32_t fromBlock) {
+    IngestPipeline* in = ingestStart(path, 0, fromBlock);
+    if (!in) {
+        perror("Errore apertura file CSV");
+        exit(EXIT_FAILURE);
+    }
+
+    InternalNode* root = createInternalNode();
+    EventRecord ev;
+    char value[] = "1";
+    while (ingestNext(in, &ev)) {
+        if (ev.fromId != 0) continue;
+
+        NibblePath tokenPath = buildPathFromTokenId(ev.tokenId);
+        NodeKey key = buildKey(tokenPath);
+        indexPut(&server.index, ev.tokenId, keyVersion(&key));
+        if (server.hashedKeys) {
+            NodeKey hashed = hashedKey(&key);
+            free(key.nibble_path.nibbles);
+            key = hashed;
+        }
+
+        // Senza ancestry i digest vengono ricalcolati una volta sola alla fine del caricamento
+        insertJMT(&root, &key, (uint8_t*)value, strlen(value), NULL);
+        free(tokenPath.nibbles);
+        free(key.nibble_path.nibbles);
+        server.leaves++;
+    }
+    ingestStop(in);
+
+    // Dopo il ricalcolo nessun nodo è sporco: lookup e generateProof non scrivono più nell'albero
+    server.root = root;
+    server.rootDigest = computeInternalHash(root);
+}
+
+
+static void connRelease(Conn* c) {
+    if (atomic_fetch_sub(&c->refs, 1) != 1) return;
+    serveBufFree(&c->in);
+    serveBufFree(&c->out);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+static void wakeLoop(void) {
+    uint64_t one = 1;
+    if (write(server.wakeFd, &one, sizeof(one)) == -1 && errno != EAGAIN) perror("Error waking event loop");
+}
+
+// Mette la connessione in coda per l'invio da parte del thread principale
+static void scheduleFlush(Conn* c) {
+    bool wasEmpty;
+    pthread_mutex_lock(&server.flushLock);
+    wasEmpty = server.flushHead == NULL;
+    if (!c->queued) {
+        c->queued = true;
+        atomic_fetch_add(&c->refs, 1);
+        c->nextFlush = server.flushHead;
+        server.flushHead = c;
+    }
+    pthread_mutex_unlock(&server.flushLock);
+    if (wasEmpty) wakeLoop();
+}
+
+static void appendResponse(Conn* c, uint32_t id, uint8_t op, uint8_t status, uint16_t count, const ServeBuf* payload) {
+    ServeHeader h = {payload ? (uint32_t)payload->len : 0, id, op, status, count};
+    pthread_mutex_lock(&c->lock);
+    if (!c->closed) {
+        servePutHeader(&c->out, &h);
+        if (payload) serveBufPut(&c->out, payload->data, payload->len);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+// Solo thread principale: invia quanto possibile e registra EPOLLOUT per il resto
+static void flushConn(Conn* c) {
+    pthread_mutex_lock(&c->lock);
+    if (c->closed) {
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+    size_t sent = 0;
+    while (sent < c->out.len) {
+        ssize_t n = write(c->fd, c->out.data + sent, c->out.len - sent);
+        if (n > 0) {
+            sent += (size_t)n;
+            continue;
+        }
+        if (n == -1 && errno == EINTR) continue;
+        break;
+    }
+    serveBufConsume(&c->out, sent);
+    bool pending = c->out.len > 0;
+    pthread_mutex_unlock(&c->lock);
+
+    if (pending != c->wantWrite) {
+        struct epoll_event ev = {.events = EPOLLIN | (pending ? EPOLLOUT : 0), .data.ptr = c};
+        SYS(epoll_ctl(server.epfd, EPOLL_CTL_MOD, c->fd, &ev), "Error updating connection events");
+        c->wantWrite = pending;
+    }
+}
+
+static void closeConn(Conn* c) {
+    epoll_ctl(server.epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    pthread_mutex_lock(&c->lock);
+    c->closed = true;
+    close(c->fd);
+    pthread_mutex_unlock(&c->lock);
+
+    if (c->prev) c->prev->next = c->next;
+    else server.conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    connRelease(c);
+}
+
+
+static void pushJob(Job* job) {
+    pthread_mutex_lock(&server.jobLock);
+    job->next = NULL;
+    if (server.jobTail) server.jobTail->next = job;
+    else server.jobHead = job;
+    server.jobTail = job;
+    pthread_cond_signal(&server.jobReady);
+    pthread_mutex_unlock(&server.jobLock);
+}
+
+static inline size_t inflightBucket(uint8_t op, uint32_t version, uint64_t tokenId) {
+    uint64_t h = (tokenId ^ ((uint64_t)version << 32) ^ op) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> 40) & (SERVED_INFLIGHT_BUCKETS - 1);
+}
+
+static void addWaiter(InFlight* f, Conn* c, uint32_t id) {
+    if (f->count == f->cap) {
+        f->cap = f->cap ? f->cap * 2 : 4;
+        SYSCN(f->waiters, (Waiter*)realloc(f->waiters, f->cap * sizeof(Waiter)), "Error growing waiter list");
+    }
+    atomic_fetch_add(&c->refs, 1);
+    f->waiters[f->count++] = (Waiter){c, id};
+}
+
+// Accoda la richiesta a una identica già in calcolo, altrimenti crea il job
+static void submitSingle(Conn* c, uint32_t id, uint8_t op, uint32_t version, uint64_t tokenId) {
+    size_t b = inflightBucket(op, version, tokenId);
+    pthread_mutex_lock(&server.inflightLock);
+    InFlight* f = server.inflight[b];
+    while (f != NULL && !(f->op == op && f->version == version && f->tokenId == tokenId)) f = f->next;
+    if (f != NULL) {
+        addWaiter(f, c, id);
+        pthread_mutex_unlock(&server.inflightLock);
+        atomic_fetch_add(&server.stats.coalesced, 1);
+        return;
+    }
+
+    SYSCN(f, (InFlight*)calloc(1, sizeof(InFlight)), "Error allocating in-flight request");
+    f->op = op;
+    f->version = version;
+    f->tokenId = tokenId;
+    addWaiter(f, c, id);
+    f->next = server.inflight[b];
+    server.inflight[b] = f;
+    pthread_mutex_unlock(&server.inflightLock);
+
+    Job* job;
+    SYSCN(job, (Job*)calloc(1, sizeof(Job)), "Error allocating job");
+    job->single = f;
+    pushJob(job);
+}
+
+static void detachInFlight(InFlight* f) {
+    size_t b = inflightBucket(f->op, f->version, f->tokenId);
+    pthread_mutex_lock(&server.inflightLock);
+    InFlight** pp = &server.inflight[b];
+    while (*pp != f) pp = &(*pp)->next;
+    *pp = f->next;
+    pthread_mutex_unlock(&server.inflightLock);
+}
+
+
+static NodeKey serveKey(uint32_t version, uint64_t tokenId) {
+    NodeKey key = buildKeyFromParts(version, tokenId);
+    if (server.hashedKeys) {
+        NodeKey hashed = hashedKey(&key);
+        free(key.nibble_path.nibbles);
+        key = hashed;
+    }
+    return key;
+}
+
+static void appendProof(ServeBuf* payload, uint32_t version, uint64_t tokenId) {
+    NodeKey key = serveKey(version, tokenId);
+    Proof P = {0};
+    generateProof(server.root, &key, &P);
+    serveEncodeProof(payload, &P, version, tokenId, server.hashedKeys);
+    freeProof(&P);
+    free(key.nibble_path.nibbles);
+}
+
+static void runSingle(InFlight* f, ServeBuf* payload) {
+    uint8_t status = SERVE_OK;
+    payload->len = 0;
+
+    if (f->op == SERVE_OP_LOOKUP) {
+        NodeKey key = serveKey(f->version, f->tokenId);
+        const uint8_t* value;
+        size_t len;
+        if (lookupJMTRef(server.root, &key, &value, &len)) {
+            serveBufPutU32(payload, f->version);
+            serveBufPutU64(payload, f->tokenId);
+            serveBufPutU32(payload, (uint32_t)len);
+            serveBufPut(payload, value, len);
+        } else {
+            status = SERVE_NOT_FOUND;
+        }
+        free(key.nibble_path.nibbles);
+    } else {
+        serveBufPut(payload, server.rootDigest.hash_bytes, sizeof(HashValue));
+        appendProof(payload, f->version, f->tokenId);
+    }
+    atomic_fetch_add(&server.stats.computed, 1);
+
+    // Da qui nessuna nuova richiesta può accodarsi: la lista dei waiter è definitiva
+    detachInFlight(f);
+    for (size_t i = 0; i < f->count; i++) {
+        Conn* c = f->waiters[i].conn;
+        appendResponse(c, f->waiters[i].id, f->op, status, 1, payload);
+        scheduleFlush(c);
+        connRelease(c);
+    }
+    free(f->waiters);
+    free(f);
+}
+
+static void* workerMain(void* arg) {
+    (void)arg;
+    jmtUseHasher(server.hasher);
+    ServeBuf payload = {0};
+
+    for (;;) {
+        pthread_mutex_lock(&server.jobLock);
+        while (server.jobHead == NULL && !server.stopping) pthread_cond_wait(&server.jobReady, &server.jobLock);
+        Job* job = server.jobHead;
+        if (job == NULL) {
+            pthread_mutex_unlock(&server.jobLock);
+            break;
+        }
+        server.jobHead = job->next;
+        if (server.jobHead == NULL) server.jobTail = NULL;
+        pthread_mutex_unlock(&server.jobLock);
+
+        if (job->single) {
+            runSingle(job->single, &payload);
+        } else {
+            payload.len = 0;
+            serveBufPut(&payload, server.rootDigest.hash_bytes, sizeof(HashValue));
+            for (uint16_t k = 0; k < job->count; k++) appendProof(&payload, job->versions[k], job->tokenIds[k]);
+            atomic_fetch_add(&server.stats.computed, job->count);
+            appendResponse(job->conn, job->id, SERVE_OP_MULTIPROOF, SERVE_OK, job->count, &payload);
+            scheduleFlush(job->conn);
+            connRelease(job->conn);
+            free(job->versions);
+            free(job->tokenIds);
+        }
+        free(job);
+    }
+
+    serveBufFree(&payload);
+    return NULL;
+}
+
+
+// Versione effettiva della chiave: SERVE_ANY_VERSION si risolve con l'indice dei mint
+static bool resolveKey(const uint8_t* p, uint32_t* version, uint64_t* tokenId) {
+    *version = serveGetU32(p);
+    *tokenId = serveGetU64(p + 4);
+    if (*version != SERVE_ANY_VERSION) return true;
+    return indexGet(&server.index, *tokenId, version);
+}
+
+static void dispatch(Conn* c, const ServeHeader* h, const uint8_t* payload) {
+    atomic_fetch_add(&server.stats.requests, 1);
+    ServeBuf out = {0};
+
+    switch (h->op) {
+        case SERVE_OP_ROOT:
+            serveBufPut(&out, server.rootDigest.hash_bytes, sizeof(HashValue));
+            serveBufPutU64(&out, server.leaves);
+            serveBufPutU8(&out, (uint8_t)server.hasher->kind);
+            serveBufPutU8(&out, server.hashedKeys);
+            appendResponse(c, h->id, h->op, SERVE_OK, 0, &out);
+            break;
+
+        case SERVE_OP_STATS: {
+            uint64_t fields[SERVE_STATS_FIELDS] = {
+                server.stats.requests, server.stats.keys, server.stats.coalesced,
+                server.stats.computed, server.stats.connections, server.stats.badRequests
+            };
+            for (int i = 0; i < SERVE_STATS_FIELDS; i++) serveBufPutU64(&out, fields[i]);
+            appendResponse(c, h->id, h->op, SERVE_OK, 0, &out);
+            break;
+        }
+
+        case SERVE_OP_LOOKUP:
+        case SERVE_OP_PROOF: {
+            uint32_t version;
+            uint64_t tokenId;
+            if (h->count != 1 || h->length != SERVE_KEY_SIZE) goto bad;
+            atomic_fetch_add(&server.stats.keys, 1);
+            if (!resolveKey(payload, &version, &tokenId)) {
+                appendResponse(c, h->id, h->op, SERVE_NOT_FOUND, 0, NULL);
+                break;
+            }
+            submitSingle(c, h->id, h->op, version, tokenId);
+            break;
+        }
+
+        case SERVE_OP_MULTIPROOF: {
+            if (h->count == 0 || h->count > SERVE_MAX_KEYS || h->length != (uint32_t)h->count * SERVE_KEY_SIZE) goto bad;
+            atomic_fetch_add(&server.stats.keys, h->count);
+            Job* job;
+            SYSCN(job, (Job*)calloc(1, sizeof(Job)), "Error allocating job");
+            SYSCN(job->versions, (uint32_t*)malloc(h->count * sizeof(uint32_t)), "Error allocating job keys");
+            SYSCN(job->tokenIds, (uint64_t*)malloc(h->count * sizeof(uint64_t)), "Error allocating job keys");
+            for (uint16_t k = 0; k < h->count; k++) {
+                if (!resolveKey(payload + k * SERVE_KEY_SIZE, &job->versions[k], &job->tokenIds[k])) {
+                    free(job->versions);
+                    free(job->tokenIds);
+                    free(job);
+                    appendResponse(c, h->id, h->op, SERVE_NOT_FOUND, 0, NULL);
+                    goto done;
+                }
+            }
+            job->conn = c;
+            job->id = h->id;
+            job->count = h->count;
+            atomic_fetch_add(&c->refs, 1);
+            pushJob(job);
+            break;
+        }
+
+        default:
+            goto bad;
+    }
+done:
+    serveBufFree(&out);
+    return;
+
+bad:
+    atomic_fetch_add(&server.stats.badRequests, 1);
+    appendResponse(c, h->id, h->op, SERVE_BAD_REQUEST, 0, NULL);
+    serveBufFree(&out);
+}
+
+// Smista i messaggi completi nel buffer di ingresso; false su un messaggio troppo grande
+static bool dispatchInput(Conn* c) {
+    size_t pos = 0;
+    bool ok = true;
+    while (c->in.len - pos >= SERVE_HEADER_SIZE) {
+        ServeHeader h;
+        serveParseHeader(c->in.data + pos, &h);
+        if (h.length > SERVE_MAX_PAYLOAD) {
+            ok = false;
+            break;
+        }
+        if (c->in.len - pos < SERVE_HEADER_SIZE + h.length) break;
+        dispatch(c, &h, c->in.data + pos + SERVE_HEADER_SIZE);
+        pos += SERVE_HEADER_SIZE + h.length;
+    }
+    serveBufConsume(&c->in, pos);
+    return ok;
+}
+
+// Legge il disponibile a blocchi, smistando dopo ogni blocco; false se la connessione va chiusa
+static bool readConn(Conn* c) {
+    for (;;) {
+        serveBufReserve(&c->in, SERVED_READ_CHUNK);
+        ssize_t n = read(c->fd, c->in.data + c->in.len, SERVED_READ_CHUNK);
+        if (n > 0) {
+            c->in.len += (size_t)n;
+            if (!dispatchInput(c)) return false;
+            continue;
+        }
+        if (n == 0) return false;
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+static void acceptConns(void) {
+    for (;;) {
+        int fd = accept4(server.listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("Error accepting connection");
+            return;
+        }
+        Conn* c;
+        SYSCN(c, (Conn*)calloc(1, sizeof(Conn)), "Error allocating connection");
+        c->fd = fd;
+        SUCC0(pthread_mutex_init(&c->lock, NULL), "Error initializing connection lock");
+        atomic_init(&c->refs, 1);
+        c->next = server.conns;
+        if (server.conns) server.conns->prev = c;
+        server.conns = c;
+
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+        SYS(epoll_ctl(server.epfd, EPOLL_CTL_ADD, fd, &ev), "Error registering connection");
+        atomic_fetch_add(&server.stats.connections, 1);
+    }
+}
+
+static void drainFlushQueue(void) {
+    uint64_t count;
+    if (read(server.wakeFd, &count, sizeof(count)) == -1 && errno != EAGAIN) perror("Error reading wake counter");
+
+    pthread_mutex_lock(&server.flushLock);
+    Conn* list = server.flushHead;
+    server.flushHead = NULL;
+    pthread_mutex_unlock(&server.flushLock);
+
+    // Una connessione esce dalla lista solo quando la si visita: finché è queued un worker non ne tocca nextFlush
+    while (list != NULL) {
+        Conn* c = list;
+        pthread_mutex_lock(&server.flushLock);
+        list = c->nextFlush;
+        c->queued = false;
+        pthread_mutex_unlock(&server.flushLock);
+        flushConn(c);
+        connRelease(c);
+    }
+}
+
+static int openListener(const char* socketPath) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "❌ Percorso del socket troppo lungo: %s\n", socketPath);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, socketPath);
+    unlink(socketPath);
+
+    int fd;
+    SYSC(fd, socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0), "Error creating socket");
+    SYS(bind(fd, (struct sockaddr*)&addr, sizeof(addr)), "Error binding socket");
+    SYS(listen(fd, SOMAXCONN), "Error listening on socket");
+    return fd;
+}
+
+static void serve(const char* socketPath, size_t threads) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    SUCC0(pthread_sigmask(SIG_BLOCK, &mask, NULL), "Error blocking signals");
+    signal(SIGPIPE, SIG_IGN);
+
+    // I worker ereditano la maschera: i segnali arrivano solo dal signalfd
+    pthread_t* workers;
+    SYSCN(workers, (pthread_t*)malloc(threads * sizeof(pthread_t)), "Error allocating workers");
+    for (size_t i = 0; i < threads; i++) {
+        SUCC0(pthread_create(&workers[i], NULL, workerMain, NULL), "Error starting serve worker");
+    }
+
+    SYSC(server.epfd, epoll_create1(EPOLL_CLOEXEC), "Error creating epoll");
+    SYSC(server.sigFd, signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC), "Error creating signalfd");
+    SYSC(server.wakeFd, eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), "Error creating eventfd");
+    server.listenFd = openListener(socketPath);
+
+    struct epoll_event ev = {.events = EPOLLIN};
+    ev.data.ptr = &listenTag;
+    SYS(epoll_ctl(server.epfd, EPOLL_CTL_ADD, server.listenFd, &ev), "Error registering socket");
+    ev.data.ptr = &wakeTag;
+    SYS(epoll_ctl(server.epfd, EPOLL_CTL_ADD, server.wakeFd, &ev), "Error registering eventfd");
+    ev.data.ptr = &sigTag;
+    SYS(epoll_ctl(server.epfd, EPOLL_CTL_ADD, server.sigFd, &ev), "Error registering signalfd");
+
+    printf("🛰️  In ascolto su %s con %zu worker\n", socketPath, threads);
+    fflush(stdout);
+
+    struct epoll_event events[SERVED_MAX_EVENTS];
+    bool running = true;
+    while (running) {
+        int n = epoll_wait(server.epfd, events, SERVED_MAX_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("Error waiting for events");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            void* tag = events[i].data.ptr;
+            if (tag == &listenTag) {
+                acceptConns();
+            } else if (tag == &wakeTag) {
+                drainFlushQueue();
+            } else if (tag == &sigTag) {
+                running = false;
+            } else {
+                Conn* c = (Conn*)tag;
+                if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN)) {
+                    closeConn(c);
+                    continue;
+                }
+                if ((events[i].events & EPOLLIN) && !readConn(c)) {
+                    closeConn(c);
+                    continue;
+                }
+                // Risposte immediate (ROOT, STATS, errori) e resto di invii parziali
+                flushConn(c);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&server.jobLock);
+    server.stopping = true;
+    pthread_cond_broadcast(&server.jobReady);
+    pthread_mutex_unlock(&server.jobLock);
+    for (size_t i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+    free(workers);
+
+    drainFlushQueue();
+    while (server.conns != NULL) closeConn(server.conns);
+    close(server.listenFd);
+    close(server.wakeFd);
+    close(server.sigFd);
+    close(server.epfd);
+    unlink(socketPath);
+
+    printf("📊 %lu richieste, %lu chiavi, %lu calcolate, %lu accorpate, %lu connessioni, %lu non valide\n",
+           (unsigned long)server.stats.requests, (unsigned long)server.stats.keys, (unsigned long)server.stats.computed,
+           (unsigned long)server.stats.coalesced, (unsigned long)server.stats.connections, (unsigned long)server.stats.badRequests);
+}
+
+int main(int argc, char** argv) {
+    const char* path = "art_blocks.csv";
+    const char* socketPath = "jmt.sock";
+    uint32_t fromBlock = 0;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char* statsPath = NULL;
+    unsigned statsInterval = 1000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--from-block") == 0 && i + 1 < argc) {
+            fromBlock = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) {
+            const JMTHasher* h = jmtHasherByName(argv[++i]);
+            if (h == NULL) {
+                fprintf(stderr, "❌ Funzione di hash sconosciuta: %s (keccak256, sha256)\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            jmtUseHasher(h);
+        } else if (strcmp(argv[i], "--hashed-keys") == 0) {
+            server.hashedKeys = true;
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            statsPath = argv[++i];
+        } else if (strcmp(argv[i], "--stats-interval") == 0 && i + 1 < argc) {
+            statsInterval = strtoul(argv[++i], NULL, 10);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (threads < 1) threads = 1;
+    server.hasher = jmtActiveHasher();
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    printf("📂 Carico %s...\n", path);
+    loadTree(path, fromBlock);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("🌳 %zu foglie in %.2f s, root ", server.leaves, (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    printHash(server.rootDigest);
+    printf("\n");
+
+    if (statsPath) jmtStatsStartDump(statsPath, jmtStatsFormatOf(statsPath), statsInterval);
+    serve(socketPath, (size_t)threads);
+    jmtStatsStopDump();
+
+    freeJMT(server.root);
+    return 0;
+}
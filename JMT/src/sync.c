@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "macros.h"
+#include "Jellyfish.h"
+#include "Ingest.h"
+#include "StateSync.h"
+
+/*
+ * jmt_sync: replica di sola lettura aggiornata con i segmenti di StateSync.h.
+ *   writer  costruisce l'albero dal CSV come jmt_export, committa ogni --commit-every mint e scrive
+ *           il segmento tra il commit precedente e quello nuovo (il primo contiene l'albero completo)
+ *   replica applica i segmenti nell'ordine in cui arrivano e controlla la root dopo ognuno
+ * I due processi comunicano con una pipe o con un file.
+ */
+
+static double elapsed(const struct timespec* t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Uso: %s writer <file.csv> [--commit-every N] [--from-block B] [--hash h] [--hashed-keys] [--out file]\n"
+                    "     %s replica [--in file] [--hash h]\n", prog, prog);
+}
+
+static int runWriter(const char* path, const char* outPath, size_t commitEvery, uint32_t fromBlock, bool hashedKeys) {
+    FILE* out = stdout;
+    if (outPath) SYSCN(out, fopen(outPath, "wb"), "Error opening sync output");
+
+    IngestPipeline* in = ingestStart(path, 0, fromBlock);
+    if (!in) {
+        perror("Errore apertura file CSV");
+        return EXIT_FAILURE;
+    }
+
+    JMT* t = createJMTWithHasher(jmtActiveHasher());
+    JMTSyncStats stats = {0};
+    EventRecord ev;
+    char value[] = "1";
+    size_t pending = 0, leaves = 0;
+    bool ok = true;
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    while (ok && ingestNext(in, &ev)) {
+        if (ev.fromId != 0) continue;
+
+        NibblePath tokenPath = buildPathFromTokenId(ev.tokenId);
+        NodeKey key = buildKey(tokenPath);
+        if (hashedKeys) {
+            NodeKey hashed = hashedKey(&key);
+            free(key.nibble_path.nibbles);
+            key = hashed;
+        }
+        jmtInsert(t, &key, (uint8_t*)value, strlen(value), NULL);
+        free(tokenPath.nibbles);
+        free(key.nibble_path.nibbles);
+        leaves++;
+
+        if (++pending == commitEvery) {
+            uint64_t from = t->version;
+            jmtCommit(t);
+            ok = jmtSyncExport(t, from, out, &stats);
+            pending = 0;
+        }
+    }
+    ingestStop(in);
+    if (ok && pending > 0) {
+        uint64_t from = t->version;
+        jmtCommit(t);
+        ok = jmtSyncExport(t, from, out, &stats);
+    }
+
+    // Lo stream va su stdout: il riepilogo su stderr
+    fprintf(stderr, "📤 %zu foglie, %lu segmenti, %lu nodi, %.1f MB in %.2f s, root ", leaves, (unsigned long)stats.segments,
+            (unsigned long)stats.nodes, stats.bytes / 1e6, elapsed(&t0));
+    for (int i = 0; i < HASH_SIZE; i++) fprintf(stderr, "%02x", t->committedRoot.hash_bytes[i]);
+    fprintf(stderr, "\n");
+
+    destroyJMT(t);
+    if (out != stdout) fclose(out);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int runReplica(const char* inPath) {
+    FILE* in = stdin;
+    if (inPath) SYSCN(in, fopen(inPath, "rb"), "Error opening sync input");
+
+    JMT* t = createJMTWithHasher(jmtActiveHasher());
+    JMTSyncStats stats = {0};
+    double applySeconds = 0;
+    int r;
+    for (;;) {
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        r = jmtSyncImport(t, in, &stats);
+        if (r <= 0) break;
+        applySeconds += elapsed(&t0);
+    }
+
+    printf("📥 %lu segmenti, %lu nodi, %lu foglie, %lu sottoalberi rimossi, %.1f MB, %.3f s di applicazione\n",
+           (unsigned long)stats.segments, (unsigned long)stats.nodes, (unsigned long)stats.leaves,
+           (unsigned long)stats.staleSubtrees, stats.bytes / 1e6, applySeconds);
+    if (r < 0) {
+        fprintf(stderr, "❌ Segmento non applicato: la replica è ferma alla versione %lu\n", (unsigned long)t->version);
+    } else {
+        printf("✅ Versione %lu, root ", (unsigned long)t->version);
+        printHash(t->committedRoot);
+        printf("\n");
+    }
+
+    destroyJMT(t);
+    if (in != stdin) fclose(in);
+    return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    bool writer = strcmp(argv[1], "writer") == 0;
+    if (!writer && strcmp(argv[1], "replica") != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char* path = "art_blocks.csv";
+    const char* outPath = NULL;
+    const char* inPath = NULL;
+    size_t commitEvery = 10000;
+    uint32_t fromBlock = 0;
+    bool hashedKeys = false;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--commit-every") == 0 && i + 1 < argc) {
+            commitEvery = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--from-block") == 0 && i + 1 < argc) {
+            fromBlock = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (strcmp(argv[i], "--in") == 0 && i + 1 < argc) {
+            inPath = argv[++i];
+        } else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) {
+            const JMTHasher* h = jmtHasherByName(argv[++i]);
+            if (h == NULL) {
+                fprintf(stderr, "❌ Funzione di hash sconosciuta: %s (keccak256, sha256)\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            jmtUseHasher(h);
+        } else if (strcmp(argv[i], "--hashed-keys") == 0) {
+            hashedKeys = true;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (commitEvery == 0) commitEvery = 1;
+
+    return writer ? runWriter(path, outPath, commitEvery, fromBlock, hashedKeys) : runReplica(inPath);
+}
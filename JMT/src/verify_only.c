@@ -1,40 +1,58 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include "macros.h"
 #include "Jellyfish.h"
+#include "Ingest.h"
+#include "Instrument.h"
+#include "ProofJson.h"
+#include "NodeStore.h"
+#include "ProofWriter.h"
 
 #define MAX_PROOFS 100000
-#define MAX_LINE_LENGTH 256
 #define MAX_TOKEN_ID 10000000   // aggiungilo se non c'è
 
+static bool hashedKeys = false;
+// Valore della foglia = proprietario corrente (toId), aggiornato a ogni trasferimento con updateJMTWithProof
+static bool ownerValues = false;
 
+// Modalità a memoria limitata (NodeStore.h): budget in byte, 0 = tutto in memoria
+static size_t memoryBudget = 0;
+static unsigned evictDepth = 6;
+static const char* nodeFile = "jmt.nodes";
+
+
+// version e tokenId della chiave originale: per le chiavi hashed seguono il percorso keccak
 uint64_t extractTokenIdFromKey(NodeKey* key) {
-    uint64_t tokenId = 0;
-    for (int i = 0; i < 8; i++) {
-        tokenId <<= 8;
-        uint8_t byte = (getNibble(key->nibble_path.nibbles, 8 + 2*i) << 4)
-                     | getNibble(key->nibble_path.nibbles, 8 + 2*i + 1);
-        tokenId |= byte;
-    }
-    return tokenId;
+    return keyTokenId(key);
 }
 
 uint32_t extractVersionFromKey(NodeKey* key) {
-    uint32_t version = 0;
-    for (int i = 0; i < 4; i++) {
-        version <<= 8;
-        uint8_t byte = (getNibble(key->nibble_path.nibbles, 2*i) << 4)
-                     | getNibble(key->nibble_path.nibbles, 2*i + 1);
-        version |= byte;
-    }
-    return version;
+    return keyVersion(key);
+}
+
+static void writeHash(FILE* f, const HashValue* h) {
+    for (int i = 0; i < 32; i++) fprintf(f, "%02x", h->hash_bytes[i]);
 }
 
-void exportProofOnly(const char* filename, Proof* proof, NodeKey* key, uint8_t* value, size_t valueLen, HashValue rootHash) {
+/*
+ * update != NULL: la prova è quella dello stato precedente (value e root prima del trasferimento) e
+ * l'oggetto "update" riporta valore, foglia e root dopo l'aggiornamento, con gli stessi fratelli.
+ */
+void exportProofOnly(const char* filename, Proof* proof, NodeKey* key, uint8_t* value, size_t valueLen, HashValue rootHash,
+                     const UpdateProof* update, const char* newValue) {
     FILE* f = fopen(filename, "w");
     if (!f) {
         perror("Errore apertura file JSON");
@@ -49,6 +67,18 @@ void exportProofOnly(const char* filename, Proof* proof, NodeKey* key, uint8_t*
     fprintf(f, "  \"root\": \"");
     for (int i = 0; i < 32; i++) fprintf(f, "%02x", rootHash.hash_bytes[i]);
     fprintf(f, "\",\n");
+    // La funzione di hash compare nei metadati solo se diversa da keccak256, il default del verificatore on-chain
+    if (jmtActiveHasher() != &jmtKeccak256) fprintf(f, "  \"hash\": \"%s\",\n", jmtActiveHasher()->name);
+    if (isHashedKey(key)) fprintf(f, "  \"keyMode\": \"hashed\",\n");
+    if (update != NULL) {
+        fprintf(f, "  \"update\": {\n");
+        fprintf(f, "    \"value\": \"%s\",\n", newValue);
+        fprintf(f, "    \"leafHash\": \"");
+        writeHash(f, &update->newLeafHash);
+        fprintf(f, "\",\n    \"root\": \"");
+        writeHash(f, &update->newRoot);
+        fprintf(f, "\"\n  },\n");
+    }
 
     fprintf(f, "  \"proof\": {\n");
     fprintf(f, "    \"isMembership\": %s,\n", proof->isPresent ? "true" : "false");
@@ -83,56 +113,67 @@ void exportProofOnly(const char* filename, Proof* proof, NodeKey* key, uint8_t*
     fclose(f);
 }
 
-void processCSV_TransfersOnly(const char* csvPath) {
-    FILE* file = fopen(csvPath, "r");
-    if (!file) {
+void processCSV_TransfersOnly(const char* csvPath, uint32_t fromBlock) {
+    IngestPipeline* in = ingestStart(csvPath, 0, fromBlock);
+    if (!in) {
         perror("Errore apertura file CSV");
         exit(EXIT_FAILURE);
     }
 
     printf("📦 Apertura file riuscita, costruisco il root node...\n");
-    InternalNode* root = createInternalNode();
-    if (!root) {
+    JMT* tree = createJMT();
+    if (!tree) {
         fprintf(stderr, "❌ Errore: root è NULL\n");
         exit(EXIT_FAILURE);
     }
     printf("🌱 Root node creato correttamente\n");
+    if (memoryBudget > 0) {
+        if (!jmtEnableEviction(tree, nodeFile, memoryBudget, evictDepth)) exit(EXIT_FAILURE);
+        printf("💾 Budget di memoria %.1f MB, sottoalberi sfrattabili da profondità %u\n", memoryBudget / 1e6, evictDepth);
+    }
 
     mkdir("proofs-verify", 0777);
 
-    char line[MAX_LINE_LENGTH];
     int proofIndex = 0;
     int lineNum = 0;
-    AncestryProof ancestry = {0};
+    EventRecord ev;
 
-    fgets(line, sizeof(line), file); // salta header
-
-    while (fgets(line, sizeof(line), file)) {
+    while (ingestNext(in, &ev)) {
         lineNum++;
 
-        uint32_t blockId, timestamp, contractId, fromId, toId;
-        uint64_t tokenId;
-        char value[] = "1";
-
-        int parsed = sscanf(line, "%u,%u,%u,%u,%u,%lu", &blockId, &timestamp, &contractId, &fromId, &toId, &tokenId);
-        if (parsed != 6) {
-            fprintf(stderr, "❌ Riga %d malformata (%d campi): %s", lineNum, parsed, line);
-            continue;
-        }
+        uint64_t tokenId = ev.tokenId;
+        uint32_t fromId = ev.fromId;
+        char value[16] = "1";
+        if (ownerValues) snprintf(value, sizeof(value), "%u", ev.toId);
 
         NodeKey key = buildKeyWithControl(tokenId, fromId == 0);
+        if (hashedKeys) {
+            NodeKey hashed = hashedKey(&key);
+            free(key.nibble_path.nibbles);
+            key = hashed;
+        }
 
 
         if (fromId == 0) {
-            insertJMT(&root, &key, (uint8_t*)value, strlen(value), &ancestry);
+            // Nessuna ancestry: i digest vengono ricalcolati una volta sola alla prossima prova
+            jmtInsert(tree, &key, (uint8_t*)value, strlen(value), NULL);
         } else {
-            Proof proof = {0};
-            generateProof(root, &key, &proof);
-            HashValue rootHash = computeProofRoot(&key, &proof, proof.leafHash);
-
             char filename[128];
-            sprintf(filename, "proofs-verify/output_%05d.json", proofIndex);
-            exportProofOnly(filename, &proof, &key, (uint8_t*)value, strlen(value), rootHash);
+            proofFileName(filename, sizeof(filename), "proofs-verify", (uint64_t)proofIndex);
+
+            // Una sola discesa: prova dello stato precedente e nuova root per il cambio di proprietario
+            UpdateProof up = {0};
+            if (ownerValues && jmtUpdateWithProof(tree, &key, (uint8_t*)value, strlen(value), &up)) {
+                HashValue rootHash = computeProofRoot(&key, &up.proof, up.proof.leafHash);
+                exportProofOnly(filename, &up.proof, &key, up.oldValue, up.oldValueLength, rootHash, &up, value);
+                freeUpdateProof(&up);
+            } else {
+                Proof proof = {0};
+                jmtGenerateProof(tree, &key, &proof);
+                HashValue rootHash = computeProofRoot(&key, &proof, proof.leafHash);
+                exportProofOnly(filename, &proof, &key, (uint8_t*)value, strlen(value), rootHash, NULL, NULL);
+                freeProof(&proof);
+            }
 
             proofIndex++;
             if (proofIndex % 1000 == 0) {
@@ -149,13 +190,358 @@ void processCSV_TransfersOnly(const char* csvPath) {
         free(key.nibble_path.nibbles);
     }
 
-    fclose(file);
+    ingestStop(in);
+
+    printf("📊 digest riusati: %lu, nodi ricalcolati: %lu\n", tree->stats.digestHits, tree->stats.digestRehashes);
+    if (tree->store) {
+        const NodeStoreStats* st = &tree->store->stats;
+        uint64_t accesses = st->hits + st->faults;
+        printf("💾 %lu accessi alle unità, hit rate %.2f%%, %lu fault, %lu sfratti, %.1f MB scritti, %.1f MB letti, %.1f MB in memoria\n",
+               (unsigned long)accesses, accesses ? 100.0 * st->hits / accesses : 100.0, (unsigned long)st->faults,
+               (unsigned long)st->evictions, st->bytesWritten / 1e6, st->bytesRead / 1e6, tree->store->resident / 1e6);
+    }
+    destroyJMT(tree);
+}
+
+/*
+ * Verifica massiva: legge una cartella di prove esportate oppure un contenitore di oggetti JSON concatenati
+ * (es. ottenuto con cat dei file di proofs-verify) e le verifica su un pool di thread.
+ * La root attesa è quella passata con --root, altrimenti quella scritta in ogni prova.
+ */
+#define VERIFY_BATCH 64
+#define VERIFY_MAX_REPORTED 100
+
+typedef struct {
+    char* path;         // file da leggere, NULL se la porzione è già in memoria
+    const char* data;
+    size_t len;
+} VerifyUnit;
+
+typedef struct {
+    uint64_t verified;
+    uint64_t failed;
+    uint64_t malformed;
+    uint64_t* failedTokens;
+    size_t failedCap;
+} VerifyResult;
+
+typedef struct {
+    VerifyUnit* units;
+    size_t unitCount;
+    atomic_size_t next;
+    bool hasRoot;
+    HashValue root;
+} VerifyJob;
+
+typedef struct {
+    VerifyJob* job;
+    VerifyResult result;
+    pthread_t thread;
+} VerifyWorker;
+
+static void recordFailure(VerifyResult* res, uint64_t tokenId) {
+    if (res->failed == res->failedCap) {
+        res->failedCap = res->failedCap ? res->failedCap * 2 : 64;
+        SYSCN(res->failedTokens, (uint64_t*)realloc(res->failedTokens, res->failedCap * sizeof(uint64_t)), "Error growing failure list");
+    }
+    res->failedTokens[res->failed++] = tokenId;
+}
+
+static void verifyBatch(VerifyJob* job, ProofRecord* batch, size_t n, VerifyResult* res) {
+    NodeKey* keys[VERIFY_BATCH] = {0};
+    Proof* proofs[VERIFY_BATCH] = {0};
+    HashValue roots[VERIFY_BATCH] = {{{0}}};
+    bool ok[VERIFY_BATCH];
+    if (n == 0) return;
+
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = &batch[i].key;
+        proofs[i] = &batch[i].proof;
+        roots[i] = job->hasRoot ? job->root : batch[i].root;
+    }
+    // Ogni prova si verifica con la funzione di hash dichiarata: il lotto procede per tratti omogenei
+    for (size_t i = 0, j; i < n; i = j) {
+        for (j = i + 1; j < n && batch[j].hasher == batch[i].hasher; j++) {
+        }
+        JMT_WITH_HASHER(batch[i].hasher);
+        verifyProofBatch(keys + i, proofs + i, roots + i, j - i, ok + i);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        ProofRecord* r = &batch[i];
+        bool valid = ok[i] && (job->hasRoot || r->hasRoot);
+        // Per le prove di inclusione la foglia deve corrispondere a chiave e valore dichiarati
+        if (valid && r->proof.isPresent) {
+            JMT_WITH_HASHER(r->hasher);
+            HashValue leaf = computeLeafHash(&r->key, r->value, r->valueLength);
+            valid = memcmp(&leaf, &r->proof.leafHash, sizeof(HashValue)) == 0;
+        }
+        if (valid) res->verified++;
+        else recordFailure(res, r->tokenId);
+        freeProofRecord(r);
+    }
+}
+
+static char* readWholeFile(const char* path, size_t* len) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return NULL;
+    struct stat st;
+    SYS(fstat(fd, &st), "Error reading proof size");
+
+    char* buf;
+    SYSCN(buf, (char*)malloc((size_t)st.st_size + 1), "Error allocating proof buffer");
+    size_t got = 0;
+    while (got < (size_t)st.st_size) {
+        ssize_t n = read(fd, buf + got, (size_t)st.st_size - got);
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    close(fd);
+    *len = got;
+    return buf;
+}
+
+static void* verifyWorkerMain(void* arg) {
+    VerifyWorker* w = (VerifyWorker*)arg;
+    VerifyJob* job = w->job;
+    ProofRecord* batch;
+    SYSCN(batch, (ProofRecord*)malloc(VERIFY_BATCH * sizeof(ProofRecord)), "Error allocating verify batch");
+
+    size_t u;
+    while ((u = atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed)) < job->unitCount) {
+        VerifyUnit* unit = &job->units[u];
+        char* owned = NULL;
+        const char* data = unit->data;
+        size_t len = unit->len;
+        if (unit->path != NULL) {
+            owned = readWholeFile(unit->path, &len);
+            if (owned == NULL) {
+                fprintf(stderr, "❌ Impossibile leggere %s\n", unit->path);
+                w->result.malformed++;
+                continue;
+            }
+            data = owned;
+        }
+
+        const char* cur = data;
+        const char* end = data + len;
+        size_t n = 0;
+        while (parseProofRecord(&cur, end, &batch[n])) {
+            if (++n == VERIFY_BATCH) {
+                verifyBatch(job, batch, n, &w->result);
+                n = 0;
+            }
+        }
+        verifyBatch(job, batch, n, &w->result);
+
+        // Il parser si ferma a fine input oppure sul primo oggetto non valido
+        while (cur < end && (*cur == ' ' || *cur == '\n' || *cur == '\r' || *cur == '\t')) cur++;
+        if (cur < end) {
+            w->result.malformed++;
+            fprintf(stderr, "❌ Prova malformata in %s (offset %zu)\n", unit->path ? unit->path : "contenitore", (size_t)(cur - data));
+        }
+        free(owned);
+    }
+
+    free(batch);
+    return NULL;
+}
+
+/*
+ * Divide il contenitore in porzioni che iniziano su un oggetto di primo livello.
+ * Il contenitore è una concatenazione di file esportati, dove solo la '}' finale di un oggetto
+ * sta a inizio riga: basta cercare "\n}" seguito da '{' a partire da ogni punto di taglio.
+ */
+static size_t splitContainer(const char* data, size_t len, size_t parts, VerifyUnit* units) {
+    size_t count = 0;
+    size_t start = 0;
+    size_t step = len / parts + 1;
+
+    while (start < len && count + 1 < parts) {
+        size_t from = start + step;
+        const char* cut = NULL;
+        while (from < len) {
+            const char* hit = memmem(data + from, len - from, "\n}", 2);
+            if (hit == NULL) break;
+            const char* next = hit + 2;
+            while (next < data + len && (*next == ' ' || *next == '\n' || *next == '\r' || *next == '\t')) next++;
+            if (next < data + len && *next == '{') {
+                cut = next;
+                break;
+            }
+            from = (size_t)(hit - data) + 2;
+        }
+        if (cut == NULL) break;
+        units[count++] = (VerifyUnit){NULL, data + start, (size_t)(cut - data) - start};
+        start = (size_t)(cut - data);
+    }
+    if (start < len) units[count++] = (VerifyUnit){NULL, data + start, len - start};
+    return count;
+}
+
+// output_100000.json dopo output_99999.json
+static int compareStrings(const void* a, const void* b) {
+    return compareProofFileNames(((const VerifyUnit*)a)->path, ((const VerifyUnit*)b)->path);
+}
+
+int verifyProofsBulk(const char* input, const char* rootHex, size_t threads) {
+    VerifyJob job = {0};
+    atomic_init(&job.next, 0);
+    if (rootHex != NULL) {
+        if (!parseHashHex(rootHex, strlen(rootHex), &job.root)) {
+            fprintf(stderr, "❌ Root non valida: %s\n", rootHex);
+            return EXIT_FAILURE;
+        }
+        job.hasRoot = true;
+    }
+
+    struct stat st;
+    if (stat(input, &st) == -1) {
+        perror("Errore apertura prove");
+        return EXIT_FAILURE;
+    }
+
+    void* map = NULL;
+    size_t mapLen = 0;
+    size_t cap = 0;
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(input);
+        if (!dir) {
+            perror("Errore apertura cartella");
+            return EXIT_FAILURE;
+        }
+        struct dirent* de;
+        while ((de = readdir(dir)) != NULL) {
+            size_t nameLen = strlen(de->d_name);
+            if (nameLen < 5 || strcmp(de->d_name + nameLen - 5, ".json") != 0) continue;
+            if (job.unitCount == cap) {
+                cap = cap ? cap * 2 : 1024;
+                SYSCN(job.units, (VerifyUnit*)realloc(job.units, cap * sizeof(VerifyUnit)), "Error growing proof list");
+            }
+            char* path;
+            SYSCN(path, (char*)malloc(strlen(input) + nameLen + 2), "Error allocating proof path");
+            sprintf(path, "%s/%s", input, de->d_name);
+            job.units[job.unitCount++] = (VerifyUnit){path, NULL, 0};
+        }
+        closedir(dir);
+        qsort(job.units, job.unitCount, sizeof(VerifyUnit), compareStrings);
+    } else {
+        int fd = open(input, O_RDONLY);
+        if (fd == -1) {
+            perror("Errore apertura contenitore");
+            return EXIT_FAILURE;
+        }
+        mapLen = (size_t)st.st_size;
+        if (mapLen > 0) {
+            map = mmap(NULL, mapLen, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) {
+                perror("Error mapping proofs");
+                exit(errno);
+            }
+            madvise(map, mapLen, MADV_SEQUENTIAL);
+        }
+        close(fd);
+        size_t parts = threads * 8;
+        SYSCN(job.units, (VerifyUnit*)calloc(parts, sizeof(VerifyUnit)), "Error allocating proof chunks");
+        job.unitCount = mapLen ? splitContainer((const char*)map, mapLen, parts, job.units) : 0;
+    }
+
+    printf("🔎 Verifica di %s con %zu thread%s\n", input, threads, job.hasRoot ? " (root fissata)" : "");
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    VerifyWorker* workers;
+    SYSCN(workers, (VerifyWorker*)calloc(threads, sizeof(VerifyWorker)), "Error allocating verify workers");
+    for (size_t i = 0; i < threads; i++) {
+        workers[i].job = &job;
+        SUCC0(pthread_create(&workers[i].thread, NULL, verifyWorkerMain, &workers[i]), "Error starting verify worker");
+    }
+
+    VerifyResult total = {0};
+    size_t reported = 0;
+    for (size_t i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        VerifyResult* r = &workers[i].result;
+        total.verified += r->verified;
+        total.failed += r->failed;
+        total.malformed += r->malformed;
+        for (size_t k = 0; k < r->failed; k++) {
+            if (reported++ < VERIFY_MAX_REPORTED) fprintf(stderr, "❌ Prova non valida per tokenId %lu\n", r->failedTokens[k]);
+        }
+        free(r->failedTokens);
+    }
+    if (reported > VERIFY_MAX_REPORTED) fprintf(stderr, "... altre %zu prove non valide\n", reported - VERIFY_MAX_REPORTED);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    uint64_t checked = total.verified + total.failed;
+
+    printf("📊 %lu prove verificate, %lu non valide, %lu input malformati\n", total.verified, total.failed, total.malformed);
+    printf("⏱️ %.3f s, %.0f prove/s\n", secs, secs > 0 ? checked / secs : 0.0);
+
+    for (size_t i = 0; i < job.unitCount; i++) free(job.units[i].path);
+    free(job.units);
+    free(workers);
+    if (map) munmap(map, mapLen);
+    return (total.failed == 0 && total.malformed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 int main(int argc, char** argv) {
     const char* filename = "art_blocks.csv";
-    if (argc > 1) filename = argv[1];
+    uint32_t fromBlock = 0;
+    const char* statsPath = NULL;
+    unsigned statsInterval = 1000;
+    const char* verifyPath = NULL;
+    const char* rootHex = NULL;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--from-block") == 0 && i + 1 < argc) {
+            fromBlock = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) {
+            const JMTHasher* h = jmtHasherByName(argv[++i]);
+            if (h == NULL) {
+                fprintf(stderr, "❌ Funzione di hash sconosciuta: %s (keccak256, sha256)\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            jmtUseHasher(h);
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            statsPath = argv[++i];
+        } else if (strcmp(argv[i], "--stats-interval") == 0 && i + 1 < argc) {
+            statsInterval = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--verify") == 0 && i + 1 < argc) {
+            verifyPath = argv[++i];
+        } else if (strcmp(argv[i], "--root") == 0 && i + 1 < argc) {
+            rootHex = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--hashed-keys") == 0) {
+            hashedKeys = true;
+        } else if (strcmp(argv[i], "--owner-values") == 0) {
+            ownerValues = true;
+        } else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+            memoryBudget = (size_t)(strtod(argv[++i], NULL) * 1e6);
+        } else if (strcmp(argv[i], "--evict-depth") == 0 && i + 1 < argc) {
+            evictDepth = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--node-file") == 0 && i + 1 < argc) {
+            nodeFile = argv[++i];
+        } else {
+            filename = argv[i];
+        }
+    }
+    if (threads < 1) threads = 1;
+
+    if (verifyPath) {
+        if (statsPath) jmtStatsStartDump(statsPath, jmtStatsFormatOf(statsPath), statsInterval);
+        int rc = verifyProofsBulk(verifyPath, rootHex, (size_t)threads);
+        jmtStatsStopDump();
+        return rc;
+    }
+
     printf("📂 Leggo il file: %s\n", filename);
-    processCSV_TransfersOnly(filename);
+    if (statsPath) jmtStatsStartDump(statsPath, jmtStatsFormatOf(statsPath), statsInterval);
+    processCSV_TransfersOnly(filename, fromBlock);
+    jmtStatsStopDump();
     return 0;
 }